@@ -7,6 +7,28 @@
 #include <filesystem>
 #include <iostream>
 #include <fstream>
+#include "DirectoryWalker.h"
+#include "FileAttributes.h"
+#include "FileId.h"
+#include "FileTypeDetector.h"
+#include "Journal.h"
+#include "Metrics.h"
+#include "ParallelFor.h"
+#include "SearchIndex.h"
+#include "SizeCache.h"
+#include "TextScanner.h"
+#include "Trash.h"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <limits>
+#include <mutex>
+#include <random>
+#include <string_view>
+#include <type_traits>
+#include <unordered_map>
 
 using namespace std;
 namespace fs = filesystem;
@@ -20,6 +42,877 @@ BaseFileManager& BaseFileManager::getInstance() {
     return instance;
 }
 
+/**
+ * @brief Translates search options into options for the directory walker.
+ * @param options The search options.
+ * @param ordered Whether the walk must visit entries in tree order.
+ * @return The walker options, with the time limit converted into a deadline from now.
+ */
+static WalkOptions makeWalkOptions(const SearchOptions& options, bool ordered) {
+    WalkOptions walkOptions;
+    walkOptions.threads = options.threads;
+    walkOptions.ordered = ordered;
+    walkOptions.reorderWindow = options.reorderWindow;
+    walkOptions.followSymlinks = options.followSymlinks;
+    if (options.maxDuration.count() > 0) {
+        walkOptions.deadline = chrono::steady_clock::now() + options.maxDuration;
+    }
+    return walkOptions;
+}
+
+/**
+ * @brief Returns the roots whose search indexes a search may use to skip subtrees.
+ * The index is built without following symbolic links, so it cannot rule out names reached
+ * through them and is not used when a search follows links.
+ * @param roots The roots searched.
+ * @param options The search options.
+ * @return The roots, or none if the index is not used.
+ */
+static vector<fs::path> indexedRoots(const vector<fs::path>& roots, const SearchOptions& options) {
+    return options.useIndex && !options.followSymlinks ? roots : vector<fs::path>();
+}
+
+/**
+ * @brief Checks whether the filename of a path contains a pattern.
+ * Where paths are stored as narrow strings the last path element is examined in place,
+ * so no string is built for the filename.
+ * @param path The path whose filename is examined.
+ * @param pattern The substring pattern to look for.
+ * @return True if the filename contains the pattern.
+ */
+static bool filenameContains(const fs::path& path, const string& pattern) {
+    if constexpr (is_same_v<fs::path::value_type, char>) {
+        string_view name(path.native());
+        size_t separator = name.find_last_of(static_cast<char>(fs::path::preferred_separator));
+        if (separator != string_view::npos) {
+            name.remove_prefix(separator + 1);
+        }
+        return name.find(pattern) != string_view::npos;
+    }
+    else {
+        return path.filename().string().find(pattern) != string::npos;
+    }
+}
+
+/**
+ * @brief Checks whether an entry satisfies the file type filter of the search options.
+ * @param entry The entry to check.
+ * @param options The search options.
+ * @return True if no type filter is set, or the entry is a regular file of the requested type.
+ */
+static bool matchesFileType(const fs::directory_entry& entry, const SearchOptions& options) {
+    if (options.fileType.empty()) {
+        return true;
+    }
+    error_code ec;
+    if (!fs::is_regular_file(entry.symlink_status(ec))) {
+        return false;
+    }
+    const char* type = FileTypeDetector::detectFile(entry.path());
+    return type != nullptr && options.fileType == type;
+}
+
+/**
+ * @brief Per-worker counter padded to its own cache line so workers never share one.
+ */
+struct alignas(64) WorkerCounter {
+    size_t value = 0;
+};
+
+/**
+ * @brief Ordered search with a file type filter.
+ * The ordered visitor runs on a single thread, so instead of reading headers there, the
+ * walk only gathers the regular files whose names match, in tree order. Their headers are
+ * then read in parallel batches, and the files of the requested type are reported in
+ * order until the result limit is reached.
+ * @param walker The walker, configured for ordered mode.
+ * @param roots The directories to walk.
+ * @param pattern The substring pattern to match filenames against.
+ * @param options Traversal options with a non-empty fileType.
+ * @param pruner Decides which subtrees cannot contain matches.
+ * @param results A vector to append the paths of the matching files to.
+ * @param matchCount Receives the number of matches reported.
+ * @return True if the whole tree was searched, false if a limit stopped the search early.
+ */
+static bool collectTypedMatches(DirectoryWalker& walker, const vector<fs::path>& roots, const string& pattern,
+    const SearchOptions& options, const SubtreePruner& pruner, vector<string>& results, size_t& matchCount) {
+    const size_t batchSize = 4096;
+    size_t maxResults = options.maxResults != 0 ? options.maxResults : SIZE_MAX;
+    size_t maxEntries = options.maxEntries != 0 ? options.maxEntries : SIZE_MAX;
+    size_t entriesVisited = 0;
+    vector<fs::path> candidates;
+    vector<const char*> types;
+    matchCount = 0;
+
+    // Classifies the pending candidates and reports those of the requested type.
+    auto flush = [&]() {
+        FileTypeDetector::detectFiles(candidates, types, nullptr, options.threads);
+        for (size_t i = 0; i < candidates.size() && matchCount < maxResults; ++i) {
+            if (types[i] == nullptr || options.fileType != types[i]) {
+                continue;
+            }
+            ++matchCount;
+            if (options.onMatch) {
+                options.onMatch(candidates[i].string());
+            }
+            else {
+                results.push_back(candidates[i].string());
+            }
+        }
+        candidates.clear();
+        return matchCount < maxResults;
+    };
+
+    bool completed = walker.walk(roots, [&](const fs::directory_entry& entry, unsigned) {
+        if (++entriesVisited > maxEntries) {
+            return WalkAction::Stop;
+        }
+        error_code ec;
+        if (filenameContains(entry.path(), pattern) && fs::is_regular_file(entry.symlink_status(ec))) {
+            candidates.push_back(entry.path());
+            if (candidates.size() == batchSize && !flush()) {
+                return WalkAction::Stop;
+            }
+        }
+        return pruner.prunes(entry) ? WalkAction::SkipSubtree : WalkAction::Continue;
+    });
+    bool belowLimit = flush();
+    return completed && belowLimit;
+}
+
+/**
+ * @brief Moves the paths of files reached through several hard links next to each other.
+ * Every group takes the position of its first path; all other paths keep their relative order.
+ * Only paths whose files have more than one link are indexed.
+ * @param results The paths to reorder.
+ * @param first Index of the first path to consider; earlier paths are left alone.
+ * @param threads Number of threads reading the file identities; 0 selects the hardware concurrency.
+ */
+static void groupHardLinkedPaths(vector<string>& results, size_t first, unsigned threads) {
+    size_t count = results.size() - first;
+    vector<FileId> ids(count);
+    vector<uint64_t> linkCounts(count, 1);
+    parallelFor(count, threads, [&](size_t index, unsigned) {
+        if (!getFileId(results[first + index], ids[index], &linkCounts[index], false)) {
+            linkCounts[index] = 1;
+        }
+    });
+
+    unordered_map<FileId, vector<size_t>, FileIdHash> links;
+    for (size_t i = 0; i < count; ++i) {
+        if (linkCounts[i] > 1) {
+            links[ids[i]].push_back(i);
+        }
+    }
+    if (links.empty()) {
+        return;
+    }
+
+    vector<string> grouped;
+    grouped.reserve(count);
+    vector<char> placed(count, 0);
+    for (size_t i = 0; i < count; ++i) {
+        if (placed[i]) {
+            continue;
+        }
+        if (linkCounts[i] <= 1) {
+            grouped.push_back(move(results[first + i]));
+            continue;
+        }
+        for (size_t member : links[ids[i]]) {
+            grouped.push_back(move(results[first + member]));
+            placed[member] = 1;
+        }
+    }
+    move(grouped.begin(), grouped.end(), results.begin() + first);
+}
+
+/**
+ * @brief Walks directory trees in parallel and collects the entries whose filenames contain a pattern.
+ * Matches are gathered per worker and concatenated afterwards; in ordered mode every match comes
+ * from the single replaying thread, so the output is in tree order. A file type filter is
+ * checked by the workers in unordered mode and in batches by collectTypedMatches in ordered mode.
+ * With useIndex, subtrees whose index filters rule the pattern out are skipped unless symbolic
+ * links are followed, and hard-linked paths are grouped once all matches are collected.
+ * @param roots The directories to walk.
+ * @param pattern The substring pattern to match filenames against.
+ * @param options Traversal options.
+ * @param results A vector to append the paths of the matching entries to.
+ * @param matchCount Receives the number of matches reported.
+ * @return True if the whole tree was searched, false if a limit stopped the walk early.
+ * @throws fs::filesystem_error If a directory cannot be walked.
+ */
+static bool collectMatches(const vector<fs::path>& roots, const string& pattern, const SearchOptions& options,
+    vector<string>& results, size_t& matchCount) {
+    DirectoryWalker walker(makeWalkOptions(options, options.ordered));
+
+    size_t maxResults = options.maxResults != 0 ? options.maxResults : SIZE_MAX;
+    size_t maxEntries = options.maxEntries != 0 ? options.maxEntries : SIZE_MAX;
+    vector<vector<string>> matchesPerWorker(walker.threadCount());
+    atomic<size_t> matchesClaimed{ 0 };
+    atomic<size_t> entriesVisited{ 0 };
+    mutex sinkLock;
+
+    size_t first = results.size();
+    bool groupLinks = options.groupHardLinks && !options.onMatch;
+    SubtreePruner pruner(indexedRoots(roots, options), pattern, !options.trustIndex);
+    vector<fs::path> searchedRoots;
+    for (const auto& root : roots) {
+        if (!pruner.prunes(root)) {
+            searchedRoots.push_back(root);
+        }
+    }
+
+    if (options.ordered && !options.fileType.empty()) {
+        bool completed = collectTypedMatches(walker, searchedRoots, pattern, options, pruner, results, matchCount);
+        if (groupLinks) {
+            groupHardLinkedPaths(results, first, options.threads);
+        }
+        return completed;
+    }
+
+    bool completed = walker.walk(searchedRoots, [&](const fs::directory_entry& entry, unsigned worker) {
+        if (entriesVisited.fetch_add(1, memory_order_relaxed) >= maxEntries) {
+            return WalkAction::Stop;
+        }
+        WalkAction descend = pruner.prunes(entry) ? WalkAction::SkipSubtree : WalkAction::Continue;
+        if (!filenameContains(entry.path(), pattern) || !matchesFileType(entry, options)) {
+            return descend;
+        }
+        // Workers claim result slots so that concurrent matches never exceed the limit.
+        size_t slot = matchesClaimed.fetch_add(1, memory_order_relaxed);
+        if (slot >= maxResults) {
+            return WalkAction::Stop;
+        }
+        if (options.onMatch) {
+            lock_guard<mutex> guard(sinkLock);
+            options.onMatch(entry.path().string());
+        }
+        else {
+            matchesPerWorker[worker].push_back(entry.path().string());
+        }
+        return slot + 1 == maxResults ? WalkAction::Stop : descend;
+    });
+
+    for (auto& matches : matchesPerWorker) {
+        results.insert(results.end(), make_move_iterator(matches.begin()), make_move_iterator(matches.end()));
+    }
+    matchCount = min(matchesClaimed.load(), maxResults);
+    if (groupLinks) {
+        groupHardLinkedPaths(results, first, options.threads);
+    }
+    return completed;
+}
+
+/**
+ * @brief Collects a regular file, or every regular file below a directory.
+ * Symbolic links are not followed.
+ * @param path The file or directory.
+ * @param files A vector to append the file paths to, in no particular order.
+ * @throws fs::filesystem_error If a directory cannot be walked.
+ */
+static void collectRegularFiles(const fs::path& path, vector<fs::path>& files) {
+    if (fs::is_directory(path)) {
+        WalkOptions walkOptions;
+        walkOptions.ordered = false;
+        DirectoryWalker walker(walkOptions);
+        vector<vector<fs::path>> filesPerWorker(walker.threadCount());
+        walker.walk({ path }, [&](const fs::directory_entry& entry, unsigned worker) {
+            error_code ec;
+            if (fs::is_regular_file(entry.symlink_status(ec))) {
+                filesPerWorker[worker].push_back(entry.path());
+            }
+            return WalkAction::Continue;
+        });
+        for (auto& workerFiles : filesPerWorker) {
+            files.insert(files.end(), make_move_iterator(workerFiles.begin()), make_move_iterator(workerFiles.end()));
+        }
+    }
+    else if (fs::is_regular_file(path)) {
+        files.push_back(path);
+    }
+}
+
+/**
+ * @brief Checks whether a canonical path equals or lies inside another canonical path.
+ * @param path The path to test.
+ * @param ancestor The candidate ancestor directory.
+ * @return True if every element of ancestor is a leading element of path.
+ */
+static bool isWithin(const fs::path& path, const fs::path& ancestor) {
+    auto mismatch = std::mismatch(ancestor.begin(), ancestor.end(), path.begin(), path.end());
+    return mismatch.first == ancestor.end();
+}
+
+/**
+ * @brief Creates the temporary file a file is rewritten into before it replaces the original.
+ * The temporary file is created exclusively next to the original under a name with a random
+ * suffix, so no existing file and no other run rewriting the same file is ever written into.
+ * Files with more than one hard link are refused, since the replacement would separate the
+ * link being rewritten from the others.
+ * @param file The file to rewrite.
+ * @param purpose Marker inserted into the temporary name, such as "fmconv".
+ * @param temporary Receives the path of the new, empty temporary file.
+ * @return True on success; otherwise the reason has been reported.
+ */
+static bool createRewriteFile(const fs::path& file, const char* purpose, fs::path& temporary) {
+    error_code ec;
+    uintmax_t links = fs::hard_link_count(file, ec);
+    if (ec) {
+        cerr << "Error: Unable to examine " << file.string() << ": " << ec.message() << endl;
+        return false;
+    }
+    if (links > 1) {
+        cerr << "Error: " << file.string() << " has other hard links; rewriting it would separate them." << endl;
+        return false;
+    }
+
+    thread_local mt19937_64 random(random_device{}() ^ static_cast<uint64_t>(chrono::steady_clock::now().time_since_epoch().count()));
+    static const char digits[] = "0123456789abcdef";
+    for (int attempt = 0; attempt < 16; ++attempt) {
+        uint64_t value = random();
+        string suffix = string(".") + purpose + ".";
+        for (int i = 0; i < 8; ++i, value >>= 4) {
+            suffix += digits[value & 0xF];
+        }
+        suffix += ".tmp";
+        temporary = file;
+        temporary += suffix;
+        if (createNewFile(temporary)) {
+            return true;
+        }
+        if (!fs::exists(fs::symlink_status(temporary, ec))) {
+            break;
+        }
+    }
+    cerr << "Error: Unable to create a temporary file next to " << file.string() << endl;
+    return false;
+}
+
+/**
+ * @brief Replaces a file with its rewritten copy, carrying over the owner, group and permissions.
+ * The owner is set before the permissions, since changing it clears the setuid and setgid bits.
+ * @param temporary The rewritten copy made by createRewriteFile.
+ * @param file The file to replace.
+ * @return True on success; otherwise the reason has been reported and the copy removed.
+ */
+static bool replaceWithRewrite(const fs::path& temporary, const fs::path& file) {
+    error_code ec;
+    FileAttributes original;
+    FileAttributes copy;
+    if (!readAttributes(file, original) || !readAttributes(temporary, copy)) {
+        cerr << "Error: Unable to examine " << file.string() << endl;
+        fs::remove(temporary, ec);
+        return false;
+    }
+    if (ownershipSupported() && (original.owner != copy.owner || original.group != copy.group)
+        && !setOwner(temporary, original.owner, original.group)) {
+        cerr << "Error: Unable to give the rewritten " << file.string() << " its owner and group." << endl;
+        fs::remove(temporary, ec);
+        return false;
+    }
+    fs::permissions(temporary, fs::status(file).permissions(), ec);
+    if (!ec) {
+        fs::rename(temporary, file, ec);
+    }
+    if (ec) {
+        cerr << "Error: Unable to replace " << file.string() << ": " << ec.message() << endl;
+        error_code ignored;
+        fs::remove(temporary, ignored);
+        return false;
+    }
+    return true;
+}
+
+/**
+ * @brief Result of converting a single name or file.
+ */
+enum class ConversionOutcome {
+    Converted,
+    Skipped,
+    Failed
+};
+
+/**
+ * @brief Checks whether text needs transcoding in a given direction.
+ * Plain ASCII never does. Windows-1251 text needs converting unless it is already valid
+ * UTF-8; UTF-8 text needs converting only if it is valid UTF-8 in the first place.
+ * @param isValidUtf8 Whether the text is valid UTF-8.
+ * @param hasNonAscii Whether the text contains bytes outside the ASCII range.
+ * @param direction The direction of the conversion.
+ * @return True if the text should be converted.
+ */
+static bool needsConversion(bool isValidUtf8, bool hasNonAscii, EncodingDirection direction) {
+    if (!hasNonAscii) {
+        return false;
+    }
+    return direction == EncodingDirection::Cp1251ToUtf8 ? !isValidUtf8 : isValidUtf8;
+}
+
+/**
+ * @brief Transcodes the contents of a file in place.
+ * The file is first scanned to decide whether it needs converting; files containing NUL
+ * bytes are treated as binary and left alone. The converted text is streamed into a
+ * temporary file next to the original, which then replaces it with a rename, so the file
+ * is never left half-converted.
+ * @param file The file to convert.
+ * @param direction The direction of the conversion.
+ * @return Whether the file was converted, skipped or could not be converted.
+ */
+static ConversionOutcome convertFileContents(const fs::path& file, EncodingDirection direction) {
+    constexpr size_t chunkSize = 1 << 20;
+    vector<char> buffer(chunkSize + 4);
+
+    ifstream input(file, ios::binary);
+    if (!input) {
+        cerr << "Error: Unable to open " << file.string() << endl;
+        return ConversionOutcome::Failed;
+    }
+
+    Utf8Validator validator;
+    while (input.read(buffer.data(), chunkSize) || input.gcount() > 0) {
+        size_t size = static_cast<size_t>(input.gcount());
+        if (memchr(buffer.data(), 0, size) != nullptr) {
+            return ConversionOutcome::Skipped;
+        }
+        validator.feed(buffer.data(), size);
+    }
+    bool isValidUtf8 = validator.finish();
+    if (!needsConversion(isValidUtf8, validator.hasNonAscii(), direction)) {
+        return ConversionOutcome::Skipped;
+    }
+
+    fs::path temporary;
+    if (!createRewriteFile(file, "fmconv", temporary)) {
+        return ConversionOutcome::Failed;
+    }
+    input.clear();
+    input.seekg(0);
+    {
+        ofstream output(temporary, ios::binary | ios::trunc);
+        if (!output) {
+            cerr << "Error: Unable to create " << temporary.string() << endl;
+            error_code ec;
+            fs::remove(temporary, ec);
+            return ConversionOutcome::Failed;
+        }
+
+        string converted;
+        size_t carried = 0;
+        while (input.read(buffer.data() + carried, chunkSize) || input.gcount() > 0) {
+            size_t size = carried + static_cast<size_t>(input.gcount());
+            converted.clear();
+            if (direction == EncodingDirection::Cp1251ToUtf8) {
+                EncodingConverter::cp1251ToUtf8(buffer.data(), size, converted);
+            }
+            else {
+                size_t consumed = 0;
+                if (!EncodingConverter::utf8ToCp1251(buffer.data(), size, converted, consumed)) {
+                    cerr << "Error: " << file.string() << " contains characters Windows-1251 cannot represent." << endl;
+                    output.close();
+                    fs::remove(temporary);
+                    return ConversionOutcome::Failed;
+                }
+                // Keep a sequence cut off by the chunk boundary for the next round.
+                carried = size - consumed;
+                memmove(buffer.data(), buffer.data() + consumed, carried);
+            }
+            output.write(converted.data(), static_cast<streamsize>(converted.size()));
+        }
+        if (!output.flush()) {
+            cerr << "Error: Unable to write " << temporary.string() << endl;
+            output.close();
+            fs::remove(temporary);
+            return ConversionOutcome::Failed;
+        }
+    }
+    input.close();
+
+    return replaceWithRewrite(temporary, file) ? ConversionOutcome::Converted : ConversionOutcome::Failed;
+}
+
+/**
+ * @brief Transcodes the name of a file or directory and renames it.
+ * Only platforms that store paths as byte strings carry names in a legacy code page;
+ * elsewhere names are left alone.
+ * @param entry The file or directory to rename.
+ * @param direction The direction of the conversion.
+ * @return Whether the entry was renamed, skipped or could not be renamed.
+ */
+static ConversionOutcome convertFileName(const fs::path& entry, EncodingDirection direction) {
+    if constexpr (is_same_v<fs::path::value_type, char>) {
+        const string name = entry.filename().native();
+        bool hasNonAscii = EncodingConverter::asciiPrefixLength(name.data(), name.size()) != name.size();
+        if (!needsConversion(EncodingConverter::isValidUtf8(name.data(), name.size()), hasNonAscii, direction)) {
+            return ConversionOutcome::Skipped;
+        }
+
+        string converted;
+        if (direction == EncodingDirection::Cp1251ToUtf8) {
+            EncodingConverter::cp1251ToUtf8(name.data(), name.size(), converted);
+        }
+        else {
+            size_t consumed = 0;
+            if (!EncodingConverter::utf8ToCp1251(name.data(), name.size(), converted, consumed)) {
+                cerr << "Error: The name of " << entry.string() << " contains characters Windows-1251 cannot represent." << endl;
+                return ConversionOutcome::Failed;
+            }
+        }
+
+        fs::path target = entry.parent_path() / converted;
+        error_code ec;
+        if (fs::exists(fs::symlink_status(target, ec))) {
+            cerr << "Error: Cannot rename " << entry.string() << ": " << target.string() << " already exists." << endl;
+            return ConversionOutcome::Failed;
+        }
+        fs::rename(entry, target, ec);
+        if (ec) {
+            cerr << "Error renaming " << entry.string() << ": " << ec.message() << endl;
+            return ConversionOutcome::Failed;
+        }
+        return ConversionOutcome::Converted;
+    }
+    else {
+        return ConversionOutcome::Skipped;
+    }
+}
+
+/**
+ * @brief What a find-and-replace pass learned about one file.
+ */
+struct ReplaceScan {
+    size_t occurrences = 0;
+    bool binary = false;
+    size_t firstLineNumber = 0;
+    string firstLine;
+};
+
+/**
+ * @brief Streams a file through a find-and-replace pass.
+ * The file is processed in chunks; the last pattern.size() - 1 bytes of each chunk are
+ * carried over to the next one so occurrences spanning a chunk boundary are found.
+ * Occurrences are counted without overlapping, exactly as they would be replaced.
+ * @param input The file contents.
+ * @param pattern The text to find; must not be empty.
+ * @param replacement The text to substitute.
+ * @param output Stream receiving the rewritten contents, or null to only scan.
+ * @param scan Receives the occurrence count, the first matching line, and whether the file is binary.
+ */
+static void streamReplace(istream& input, const string& pattern, const string& replacement, ostream* output, ReplaceScan& scan) {
+    constexpr size_t chunkSize = 1 << 20;
+    constexpr size_t previewLength = 200;
+    const size_t overlap = pattern.size() - 1;
+    vector<char> buffer(chunkSize + overlap);
+    char* data = buffer.data();
+    size_t carried = 0;
+    size_t newlinesBefore = 0;
+
+    while (true) {
+        input.read(data + carried, chunkSize);
+        size_t received = static_cast<size_t>(input.gcount());
+        bool atEnd = !input;
+        size_t size = carried + received;
+        if (memchr(data + carried, 0, received) != nullptr) {
+            scan.binary = true;
+            return;
+        }
+
+        size_t position = 0;
+        while (const char* hit = TextScanner::find(data + position, size - position, pattern.data(), pattern.size())) {
+            size_t offset = static_cast<size_t>(hit - data);
+            if (scan.occurrences == 0) {
+                size_t lineStart = offset;
+                while (lineStart > 0 && data[lineStart - 1] != '\n') {
+                    --lineStart;
+                }
+                const char* newline = static_cast<const char*>(memchr(data + offset, '\n', size - offset));
+                size_t lineEnd = newline ? static_cast<size_t>(newline - data) : size;
+                if (lineEnd > lineStart && data[lineEnd - 1] == '\r') {
+                    --lineEnd;
+                }
+                scan.firstLine.assign(data + lineStart, min(lineEnd - lineStart, previewLength));
+                scan.firstLineNumber = newlinesBefore + TextScanner::count(data, lineStart, '\n') + 1;
+            }
+            ++scan.occurrences;
+            if (output) {
+                output->write(data + position, static_cast<streamsize>(offset - position));
+                output->write(replacement.data(), static_cast<streamsize>(replacement.size()));
+            }
+            position = offset + pattern.size();
+        }
+
+        // Bytes that could still start an occurrence completed by the next chunk are carried over.
+        size_t keepFrom = atEnd ? size : max(position, size - min(size, overlap));
+        if (output) {
+            output->write(data + position, static_cast<streamsize>(keepFrom - position));
+        }
+        if (scan.occurrences == 0) {
+            newlinesBefore += TextScanner::count(data, keepFrom, '\n');
+        }
+        if (atEnd) {
+            return;
+        }
+        carried = size - keepFrom;
+        memmove(data, data + keepFrom, carried);
+    }
+}
+
+/**
+ * @brief Replaces every occurrence of a pattern in a string.
+ * @param text The string to edit.
+ * @param pattern The text to find; must not be empty.
+ * @param replacement The text to substitute.
+ * @return The edited string.
+ */
+static string replaceAll(string text, const string& pattern, const string& replacement) {
+    for (size_t position = text.find(pattern); position != string::npos;
+        position = text.find(pattern, position + replacement.size())) {
+        text.replace(position, pattern.size(), replacement);
+    }
+    return text;
+}
+
+/**
+ * @brief Rewrites a file with every occurrence of a pattern replaced.
+ * The new contents are streamed into a temporary file in the same directory, which then
+ * atomically replaces the original with a rename, so the file is never seen half-written.
+ * @param file The file to rewrite.
+ * @param pattern The text to find; must not be empty.
+ * @param replacement The text to substitute.
+ * @return True on success.
+ */
+static bool rewriteWithReplacement(const fs::path& file, const string& pattern, const string& replacement) {
+    fs::path temporary;
+    if (!createRewriteFile(file, "fmreplace", temporary)) {
+        return false;
+    }
+    {
+        ifstream input(file, ios::binary);
+        ofstream output(temporary, ios::binary | ios::trunc);
+        if (!input || !output) {
+            cerr << "Error: Unable to rewrite " << file.string() << endl;
+            output.close();
+            error_code ec;
+            fs::remove(temporary, ec);
+            return false;
+        }
+        ReplaceScan scan;
+        streamReplace(input, pattern, replacement, &output, scan);
+        if (!output.flush() || scan.binary) {
+            cerr << "Error: Unable to write " << temporary.string() << endl;
+            output.close();
+            error_code ec;
+            fs::remove(temporary, ec);
+            return false;
+        }
+    }
+    return replaceWithRewrite(temporary, file);
+}
+
+/**
+ * @brief Size of the per-worker buffer used to read files while counting text.
+ */
+static const size_t countBufferSize = 1 << 20;
+
+/**
+ * @brief Counts the bytes, lines and words of a file with the vectorized kernel.
+ * @param file The file to read.
+ * @param buffer Scratch buffer of countBufferSize bytes.
+ * @param counts Receives the counts.
+ * @return False if the file cannot be read.
+ */
+static bool countFileText(const fs::path& file, vector<char>& buffer, TextCounts& counts) {
+    ifstream input(file, ios::binary);
+    if (!input) {
+        return false;
+    }
+    size_t lines = 0;
+    size_t words = 0;
+    bool inWord = false;
+    while (input) {
+        input.read(buffer.data(), static_cast<streamsize>(buffer.size()));
+        size_t got = static_cast<size_t>(input.gcount());
+        if (got == 0) {
+            break;
+        }
+        TextScanner::countLinesAndWords(buffer.data(), got, lines, words, inWord);
+        counts.bytes += got;
+    }
+    if (input.bad()) {
+        return false;
+    }
+    counts.lines = lines;
+    counts.words = words;
+    return true;
+}
+
+/**
+ * @brief Counts a list of files in parallel and fills a report in list order.
+ * @param files The files to count.
+ * @param report Receives the per-file counts, the totals and the failure count.
+ */
+static void countFilesText(const vector<fs::path>& files, TextCountReport& report) {
+    vector<FileTextCounts> counted(files.size());
+    vector<char> readable(files.size(), 0);
+    unsigned workers = parallelWorkerCount(0);
+    vector<vector<char>> buffers(workers);
+    parallelFor(files.size(), workers, [&](size_t index, unsigned worker) {
+        if (buffers[worker].empty()) {
+            buffers[worker].resize(countBufferSize);
+        }
+        counted[index].path = files[index].string();
+        if (countFileText(files[index], buffers[worker], counted[index].counts)) {
+            readable[index] = 1;
+        }
+        else {
+            cerr << "Error: Unable to read " << counted[index].path << endl;
+        }
+    });
+
+    for (size_t i = 0; i < counted.size(); ++i) {
+        if (!readable[i]) {
+            ++report.failures;
+            continue;
+        }
+        report.total.bytes += counted[i].counts.bytes;
+        report.total.lines += counted[i].counts.lines;
+        report.total.words += counted[i].counts.words;
+        report.files.push_back(move(counted[i]));
+    }
+}
+
+/**
+ * @brief Result of bringing one entry into a desired state.
+ */
+enum class UpdateOutcome {
+    Changed,
+    Unchanged,
+    Failed
+};
+
+/**
+ * @brief Applies permission and ownership rules to a single entry.
+ * The current state is read first, and only the calls needed to reach the desired state are made.
+ * @param path The entry to update.
+ * @param rules The changes to apply.
+ * @return Whether the entry was changed, already in the desired state, or could not be updated.
+ */
+static UpdateOutcome applyAttributeRules(const fs::path& path, const AttributeRules& rules) {
+    FileAttributes current;
+    if (!readAttributes(path, current)) {
+        cerr << "Error: Unable to examine " << path.string() << endl;
+        return UpdateOutcome::Failed;
+    }
+
+    bool changed = false;
+    if (!current.isSymlink) {
+        uint32_t mode = current.mode;
+        if (current.isDirectory && rules.directoryMode >= 0) {
+            mode = static_cast<uint32_t>(rules.directoryMode);
+        }
+        else if (!current.isDirectory && rules.fileMode >= 0) {
+            mode = static_cast<uint32_t>(rules.fileMode);
+        }
+        mode = effectiveMode((mode | rules.addBits) & ~rules.removeBits);
+        if (mode != current.mode) {
+            if (!setMode(path, mode)) {
+                cerr << "Error: Unable to change permissions of " << path.string() << endl;
+                return UpdateOutcome::Failed;
+            }
+            changed = true;
+        }
+    }
+
+    bool ownerDiffers = rules.owner >= 0 && rules.owner != current.owner;
+    bool groupDiffers = rules.group >= 0 && rules.group != current.group;
+    if (ownerDiffers || groupDiffers) {
+        if (!setOwner(path, ownerDiffers ? rules.owner : -1, groupDiffers ? rules.group : -1)) {
+            cerr << "Error: Unable to change ownership of " << path.string() << endl;
+            return UpdateOutcome::Failed;
+        }
+        changed = true;
+    }
+    return changed ? UpdateOutcome::Changed : UpdateOutcome::Unchanged;
+}
+
+/**
+ * @brief Brings the times of a single entry to the desired values.
+ * @param path The entry to update.
+ * @param desired The desired times.
+ * @param request Which of the times to change.
+ * @return Whether the entry was changed, already had the desired times, or could not be updated.
+ */
+static UpdateOutcome applyTimes(const fs::path& path, const FileTimes& desired, const TimestampRequest& request) {
+    FileTimes current;
+    if (!readTimes(path, current)) {
+        cerr << "Error: Unable to examine " << path.string() << endl;
+        return UpdateOutcome::Failed;
+    }
+    if ((!request.setAccess || current.access == desired.access)
+        && (!request.setModification || current.modification == desired.modification)) {
+        return UpdateOutcome::Unchanged;
+    }
+    if (!setTimes(path, desired, request.setAccess, request.setModification)) {
+        cerr << "Error: Unable to change times of " << path.string() << endl;
+        return UpdateOutcome::Failed;
+    }
+    return UpdateOutcome::Changed;
+}
+
+/**
+ * @brief Records a change so that the size caches covering it are updated by their next query.
+ * @param path The entry that was created, removed or modified.
+ * @param throughout Whether entries below a directory changed as well, so its whole subtree is scanned again.
+ */
+static void recordSizeChange(const fs::path& path, bool throughout) {
+    DirectorySizeCache::invalidate(path);
+    error_code ec;
+    if (throughout && fs::is_directory(fs::symlink_status(path, ec))) {
+        DirectorySizeCache::invalidate(path, true);
+    }
+}
+
+/**
+ * @brief Fills a disk usage report for a directory from the persistent size cache.
+ * The cache shares the size of a file with n hard links equally between its paths, so files
+ * whose links all lie within the directory are counted once, as in a walk, while files also
+ * linked from elsewhere contribute only their share.
+ * @param path The directory to measure.
+ * @param validate Whether every cached directory below is checked for changes first.
+ * @param report Receives the totals and the sizes of the immediate subdirectories.
+ * @return HTTP-like status code:
+ * - 200: Success.
+ * - 207: The totals are current, but the updated cache could not be stored.
+ */
+static int cachedDiskUsage(const string& path, bool validate, DiskUsageReport& report) {
+    DirectorySize total;
+    vector<ChildSize> children;
+    size_t reread = 0;
+    bool stored = DirectorySizeCache::measure(fs::canonical(path), validate, total, children, reread);
+    if (!stored) {
+        cerr << "Error: Unable to store the size cache." << endl;
+    }
+    Metrics::getInstance().recordSizeCacheQuery(reread);
+
+    vector<DirectoryUsage> subdirectories;
+    for (const auto& child : children) {
+        subdirectories.push_back({ (fs::path(path) / fs::u8path(child.name)).string(), child.size.totalBytes() });
+    }
+    sort(subdirectories.begin(), subdirectories.end(), [](const DirectoryUsage& a, const DirectoryUsage& b) {
+        return a.bytes != b.bytes ? a.bytes > b.bytes : a.path < b.path;
+    });
+    uint64_t bytes = total.totalBytes();
+    report.bytes += bytes;
+    report.files += static_cast<size_t>(total.files);
+    report.directories += static_cast<size_t>(total.directories);
+    report.hardLinks += static_cast<size_t>((total.linkedRepeats + DirectorySizeCache::shareUnit / 2)
+        / DirectorySizeCache::shareUnit);
+    report.linkedBytes += total.linkedSize - (bytes - total.bytes);
+    report.reread += reread;
+    report.subdirectories.insert(report.subdirectories.end(), subdirectories.begin(), subdirectories.end());
+    return stored ? 200 : 207;
+}
+
 /**
  * @brief Lists the contents of a directory.
  * @param path The path to the directory.
@@ -31,23 +924,25 @@ BaseFileManager& BaseFileManager::getInstance() {
  * - 500: Other errors.
  */
 int BaseFileManager::listDirectoryContents(const string& path, vector<string>& contents) {
+    MetricsScope metrics(MetricOperation::ListDirectory);
     try {
         if (!fs::exists(path)) {
             cerr << "Error: Path does not exist." << endl;
-            return 404;
+            return metrics.done(404);
         }
         if (!fs::is_directory(path)) {
             cerr << "Error: Path is not a directory." << endl;
-            return 400;
+            return metrics.done(400);
         }
         for (const auto& entry : fs::directory_iterator(path)) {
             contents.push_back(entry.path().string());
         }
-        return 200;
+        Metrics::getInstance().addEntriesVisited(contents.size());
+        return metrics.done(200);
     }
     catch (const fs::filesystem_error& e) {
         cerr << "Error accessing directory: " << e.what() << endl;
-        return 500;
+        return metrics.done(500);
     }
 }
 
@@ -59,45 +954,59 @@ int BaseFileManager::listDirectoryContents(const string& path, vector<string>& c
  * - 500: Error creating file.
  */
 int BaseFileManager::createFile(const string& path) {
+    JournalScope journal(JournalOperation::CreateFile, path);
     try {
         ofstream file(path);
         if (!file) {
             cerr << "Error: Unable to create file." << endl;
-            return 500;
+            return journal.done(500);
         }
-        return 200;
+        recordSizeChange(path, false);
+        return journal.done(200);
     }
     catch (const exception& e) {
         cerr << "Error creating file: " << e.what() << endl;
-        return 500;
+        return journal.done(500);
     }
 }
 
 /**
  * @brief Deletes a file at the specified path.
  * @param path The path to the file to be deleted.
+ * @param mode Whether the file is removed or renamed into the trash.
  * @return HTTP-like status code:
  * - 200: Success.
  * - 404: File does not exist.
  * - 400: Path is not a regular file.
  * - 500: Other errors.
  */
-int BaseFileManager::deleteFile(const string& path) {
+int BaseFileManager::deleteFile(const string& path, DeleteMode mode) {
+    JournalScope journal(mode == DeleteMode::Trash ? JournalOperation::TrashFile : JournalOperation::DeleteFile, path);
     try {
         if (!fs::exists(path)) {
             cerr << "Error: File does not exist." << endl;
-            return 404;
+            return journal.done(404);
         }
         if (!fs::is_regular_file(path)) {
             cerr << "Error: Path is not a regular file." << endl;
-            return 400;
+            return journal.done(400);
+        }
+        if (mode == DeleteMode::Trash) {
+            int statusCode = Trash::getInstance().moveToTrash(path);
+            if (statusCode == 200) {
+                recordSizeChange(path, false);
+            }
+            return journal.done(statusCode);
         }
+        uintmax_t size = fs::file_size(path);
         fs::remove(path);
-        return 200;
+        Metrics::getInstance().addBytesDeleted(size);
+        recordSizeChange(path, false);
+        return journal.done(200);
     }
     catch (const fs::filesystem_error& e) {
         cerr << "Error deleting file: " << e.what() << endl;
-        return 500;
+        return journal.done(500);
     }
 }
 
@@ -110,46 +1019,78 @@ int BaseFileManager::deleteFile(const string& path) {
  * - 500: Other errors.
  */
 int BaseFileManager::createDirectory(const string& path) {
+    JournalScope journal(JournalOperation::CreateDirectory, path);
     try {
         if (fs::exists(path)) {
             cerr << "Error: Directory already exists." << endl;
-            return 400;
+            return journal.done(400);
         }
         fs::create_directory(path);
-        return 200;
+        recordSizeChange(path, false);
+        return journal.done(200);
     }
     catch (const fs::filesystem_error& e) {
         cerr << "Error creating directory: " << e.what() << endl;
-        return 500;
+        return journal.done(500);
     }
 }
 
 /**
- * @brief Deletes a directory at the specified path.
+ * @brief Deletes a directory at the specified path. In trash mode the directory is renamed
+ * into the trash, which takes the same time however large it is.
  * @param path The path to the directory to be deleted.
+ * @param mode Whether the directory is removed or renamed into the trash.
  * @return HTTP-like status code:
  * - 200: Success.
  * - 404: Directory does not exist.
  * - 400: Path is not a directory.
  * - 500: Other errors.
  */
-int BaseFileManager::deleteDirectory(const string& path) {
+int BaseFileManager::deleteDirectory(const string& path, DeleteMode mode) {
+    JournalScope journal(mode == DeleteMode::Trash ? JournalOperation::TrashDirectory : JournalOperation::DeleteDirectory, path);
     try {
         if (!fs::exists(path)) {
             cerr << "Error: Directory does not exist." << endl;
-            return 404;
+            return journal.done(404);
         }
         if (!fs::is_directory(path)) {
             cerr << "Error: Path is not a directory." << endl;
-            return 400;
+            return journal.done(400);
+        }
+        if (mode == DeleteMode::Trash) {
+            int statusCode = Trash::getInstance().moveToTrash(path);
+            if (statusCode == 200) {
+                recordSizeChange(path, false);
+            }
+            return journal.done(statusCode);
         }
         fs::remove_all(path);
-        return 200;
+        recordSizeChange(path, false);
+        return journal.done(200);
     }
     catch (const fs::filesystem_error& e) {
         cerr << "Error deleting directory: " << e.what() << endl;
-        return 500;
+        return journal.done(500);
+    }
+}
+
+/**
+ * @brief Restores the entry most recently moved to the trash from a path.
+ * @param path The original path of the entry.
+ * @return HTTP-like status code:
+ * - 200: Success.
+ * - 404: The trash holds nothing deleted from this path.
+ * - 400: The path exists again.
+ * - 500: Other errors.
+ */
+int BaseFileManager::restoreFromTrash(const string& path) {
+    string restoredTo;
+    JournalScope journal(JournalOperation::Restore, path, restoredTo);
+    int statusCode = Trash::getInstance().restore(path, restoredTo);
+    if (statusCode == 200) {
+        recordSizeChange(path, false);
     }
+    return journal.done(statusCode);
 }
 
 /**
@@ -162,54 +1103,1216 @@ int BaseFileManager::deleteDirectory(const string& path) {
  * - 500: Other errors.
  */
 int BaseFileManager::rename(const string& oldPath, const string& newPath) {
+    JournalScope journal(JournalOperation::Rename, oldPath, newPath);
     try {
         if (!fs::exists(oldPath)) {
             cerr << "Error: Source path does not exist." << endl;
-            return 404;
+            return journal.done(404);
         }
         fs::rename(oldPath, newPath);
-        return 200;
+        recordSizeChange(oldPath, false);
+        recordSizeChange(newPath, false);
+        return journal.done(200);
     }
     catch (const fs::filesystem_error& e) {
         cerr << e.what() << endl;
-        return 500;
+        return journal.done(500);
     }
 }
 
 /**
  * @brief Searches for files matching a specific pattern within a directory and its subdirectories.
+ * The tree is walked by a pool of worker threads. In ordered mode (the default) the results are
+ * reported in lexicographic tree order, independent of thread scheduling; otherwise they are
+ * reported in discovery order.
  * @param path The path to the directory to search in.
  * @param pattern The substring pattern to match filenames against.
  * @param results A vector to store the paths of the matching files.
+ * @param options Traversal options.
  * @return HTTP-like status code:
  * - 200: Success, with results.
  * - 204: Success, but no matches found.
+ * - 206: A result, entry or time limit was reached; the results found so far are returned.
  * - 404: Directory does not exist.
  * - 400: Path is not a directory.
  * - 500: Other errors.
  */
-int BaseFileManager::searchFiles(const string& path, const string& pattern, vector<string>& results) {
+int BaseFileManager::searchFiles(const string& path, const string& pattern, vector<string>& results,
+    const SearchOptions& options) {
+    MetricsScope metrics(MetricOperation::Search);
     try {
         if (!fs::exists(path)) {
             cerr << "Error: Directory does not exist." << endl;
-            return 404;
+            return metrics.done(404);
         }
 
         if (!fs::is_directory(path)) {
             cerr << "Error: Path is not a directory." << endl;
-            return 400;
+            return metrics.done(400);
         }
 
-        for (const auto& entry : fs::recursive_directory_iterator(path, fs::directory_options::skip_permission_denied)) {
-            if (entry.path().filename().string().find(pattern) != string::npos) {
-                results.push_back(entry.path().string());
-            }
+        size_t matchCount = 0;
+        if (!collectMatches({ path }, pattern, options, results, matchCount)) {
+            return metrics.done(206);
         }
 
-        return results.empty() ? 204 : 200;
+        return metrics.done(matchCount == 0 ? 204 : 200);
     }
-    catch (const fs::filesystem_error& e) {
+    catch (const exception& e) {
         cerr << e.what() << endl;
-        return 500;
+        return metrics.done(500);
+    }
+}
+
+/**
+ * @brief Searches several directory trees concurrently for files matching a pattern.
+ * Every root is canonicalized first; duplicate roots and roots nested inside another root
+ * are dropped so that no subtree is walked twice. The remaining roots share one pool of worker
+ * threads, so the total time approaches that of the largest root. In ordered mode the results
+ * are reported in sorted root order and tree order within each root.
+ * @param paths The paths of the directories to search in.
+ * @param pattern The substring pattern to match filenames against.
+ * @param results A vector to store the paths of the matching files.
+ * @param options Traversal options.
+ * @return HTTP-like status code:
+ * - 200: Success, with results.
+ * - 204: Success, but no matches found.
+ * - 206: A result, entry or time limit was reached; the results found so far are returned.
+ * - 404: One of the directories does not exist.
+ * - 400: No paths were given, or one of them is not a directory.
+ * - 500: Other errors.
+ */
+int BaseFileManager::searchFiles(const vector<string>& paths, const string& pattern, vector<string>& results,
+    const SearchOptions& options) {
+    MetricsScope metrics(MetricOperation::Search);
+    try {
+        if (paths.empty()) {
+            cerr << "Error: No directories to search." << endl;
+            return metrics.done(400);
+        }
+
+        vector<fs::path> roots;
+        for (const auto& path : paths) {
+            if (!fs::exists(path)) {
+                cerr << "Error: Directory does not exist: " << path << endl;
+                return metrics.done(404);
+            }
+            if (!fs::is_directory(path)) {
+                cerr << "Error: Path is not a directory: " << path << endl;
+                return metrics.done(400);
+            }
+            roots.push_back(fs::canonical(path));
+        }
+
+        // Element-wise ordering places every nested root right after its ancestor.
+        sort(roots.begin(), roots.end());
+        vector<fs::path> distinctRoots;
+        for (const auto& root : roots) {
+            if (distinctRoots.empty() || !isWithin(root, distinctRoots.back())) {
+                distinctRoots.push_back(root);
+            }
+        }
+
+        size_t matchCount = 0;
+        if (!collectMatches(distinctRoots, pattern, options, results, matchCount)) {
+            return metrics.done(206);
+        }
+
+        return metrics.done(matchCount == 0 ? 204 : 200);
+    }
+    catch (const exception& e) {
+        cerr << e.what() << endl;
+        return metrics.done(500);
+    }
+}
+
+/**
+ * @brief Counts the files matching a pattern within a directory and its subdirectories.
+ * No paths are collected: each worker increments its own counter, and the counters are
+ * summed once the walk is over. Entries are visited in discovery order; the ordering
+ * options and the result limit do not apply.
+ * @param path The path to the directory to search in.
+ * @param pattern The substring pattern to match filenames against.
+ * @param count Receives the number of matching entries.
+ * @param options Traversal options.
+ * @return HTTP-like status code:
+ * - 200: Success, at least one match.
+ * - 204: Success, but no matches found.
+ * - 206: An entry or time limit was reached; count covers the part of the tree searched.
+ * - 404: Directory does not exist.
+ * - 400: Path is not a directory.
+ * - 500: Other errors.
+ */
+int BaseFileManager::countFiles(const string& path, const string& pattern, size_t& count, const SearchOptions& options) {
+    MetricsScope metrics(MetricOperation::CountFiles);
+    try {
+        if (!fs::exists(path)) {
+            cerr << "Error: Directory does not exist." << endl;
+            return metrics.done(404);
+        }
+
+        if (!fs::is_directory(path)) {
+            cerr << "Error: Path is not a directory." << endl;
+            return metrics.done(400);
+        }
+
+        DirectoryWalker walker(makeWalkOptions(options, false));
+        size_t maxEntries = options.maxEntries != 0 ? options.maxEntries : SIZE_MAX;
+        atomic<size_t> entriesVisited{ 0 };
+        vector<WorkerCounter> matchesPerWorker(walker.threadCount());
+
+        SubtreePruner pruner(indexedRoots({ path }, options), pattern, !options.trustIndex);
+        if (pruner.prunes(fs::path(path))) {
+            count = 0;
+            return metrics.done(204);
+        }
+
+        bool completed = walker.walk({ path }, [&](const fs::directory_entry& entry, unsigned worker) {
+            if (entriesVisited.fetch_add(1, memory_order_relaxed) >= maxEntries) {
+                return WalkAction::Stop;
+            }
+            if (filenameContains(entry.path(), pattern) && matchesFileType(entry, options)) {
+                ++matchesPerWorker[worker].value;
+            }
+            return pruner.prunes(entry) ? WalkAction::SkipSubtree : WalkAction::Continue;
+        });
+
+        count = 0;
+        for (const auto& matches : matchesPerWorker) {
+            count += matches.value;
+        }
+
+        if (!completed) {
+            return metrics.done(206);
+        }
+        return metrics.done(count == 0 ? 204 : 200);
+    }
+    catch (const exception& e) {
+        cerr << e.what() << endl;
+        return metrics.done(500);
+    }
+}
+
+/**
+ * @brief Checks whether any file within a directory and its subdirectories matches a pattern.
+ * The parallel walk is abandoned by all workers as soon as one of them finds a match.
+ * @param path The path to the directory to search in.
+ * @param pattern The substring pattern to match filenames against.
+ * @param found Receives whether a matching entry exists.
+ * @param options Traversal options.
+ * @return HTTP-like status code:
+ * - 200: A match exists.
+ * - 204: No match exists.
+ * - 206: An entry or time limit was reached before a match was found.
+ * - 404: Directory does not exist.
+ * - 400: Path is not a directory.
+ * - 500: Other errors.
+ */
+int BaseFileManager::fileExists(const string& path, const string& pattern, bool& found, const SearchOptions& options) {
+    MetricsScope metrics(MetricOperation::FileExists);
+    try {
+        if (!fs::exists(path)) {
+            cerr << "Error: Directory does not exist." << endl;
+            return metrics.done(404);
+        }
+
+        if (!fs::is_directory(path)) {
+            cerr << "Error: Path is not a directory." << endl;
+            return metrics.done(400);
+        }
+
+        DirectoryWalker walker(makeWalkOptions(options, false));
+        size_t maxEntries = options.maxEntries != 0 ? options.maxEntries : SIZE_MAX;
+        atomic<size_t> entriesVisited{ 0 };
+        atomic<bool> matched{ false };
+
+        SubtreePruner pruner(indexedRoots({ path }, options), pattern, !options.trustIndex);
+        if (pruner.prunes(fs::path(path))) {
+            found = false;
+            return metrics.done(204);
+        }
+
+        bool completed = walker.walk({ path }, [&](const fs::directory_entry& entry, unsigned) {
+            if (entriesVisited.fetch_add(1, memory_order_relaxed) >= maxEntries) {
+                return WalkAction::Stop;
+            }
+            if (filenameContains(entry.path(), pattern) && matchesFileType(entry, options)) {
+                matched = true;
+                return WalkAction::Stop;
+            }
+            return pruner.prunes(entry) ? WalkAction::SkipSubtree : WalkAction::Continue;
+        });
+
+        found = matched;
+        if (found) {
+            return metrics.done(200);
+        }
+        return metrics.done(completed ? 204 : 206);
+    }
+    catch (const exception& e) {
+        cerr << e.what() << endl;
+        return metrics.done(500);
+    }
+}
+
+/**
+ * @brief Builds the persistent search index of a directory tree.
+ * Every directory gets a Bloom filter over the trigrams of all names below it, stored with its
+ * modification time in the user's cache directory. Searches with useIndex of this directory or
+ * any directory below it then skip the subtrees whose filters rule their pattern out.
+ * @param path The directory to index.
+ * @param report Receives the index statistics.
+ * @return HTTP-like status code:
+ * - 200: Success.
+ * - 400: Path is not a directory.
+ * - 404: Directory does not exist.
+ * - 500: The index could not be stored, or other errors.
+ */
+int BaseFileManager::buildSearchIndex(const string& path, SearchIndexReport& report) {
+    MetricsScope metrics(MetricOperation::BuildSearchIndex);
+    try {
+        if (!fs::exists(path)) {
+            cerr << "Error: Directory does not exist." << endl;
+            return metrics.done(404);
+        }
+
+        if (!fs::is_directory(path)) {
+            cerr << "Error: Path is not a directory." << endl;
+            return metrics.done(400);
+        }
+
+        if (!SearchIndex::build(fs::canonical(path), report.directories, report.filters, report.bytes)) {
+            cerr << "Error: Unable to store the search index." << endl;
+            return metrics.done(500);
+        }
+        return metrics.done(200);
+    }
+    catch (const exception& e) {
+        cerr << "Error building search index: " << e.what() << endl;
+        return metrics.done(500);
+    }
+}
+
+/**
+ * @brief Converts file names, and optionally file contents, between Windows-1251 and UTF-8.
+ * Directories are walked in parallel to collect their entries. File contents are then
+ * converted in parallel, one file per task. Names are converted last, deepest entries
+ * first, so renaming a directory never invalidates a path that is still to be processed.
+ * Names and files that are plain ASCII or already in the target encoding are skipped.
+ * The name of the given path itself is left unchanged.
+ * @param path The file or directory to convert.
+ * @param direction The direction of the conversion.
+ * @param convertContents Whether the contents of text files are converted too.
+ * @param report Receives the conversion counts.
+ * @return HTTP-like status code:
+ * - 200: Success.
+ * - 204: Nothing needed converting.
+ * - 207: Some names or files could not be converted.
+ * - 404: Path does not exist.
+ * - 500: Other errors.
+ */
+int BaseFileManager::convertEncoding(const string& path, EncodingDirection direction, bool convertContents, EncodingReport& report) {
+    MetricsScope metrics(MetricOperation::ConvertEncoding);
+    try {
+        if (!fs::exists(path)) {
+            cerr << "Error: Path does not exist." << endl;
+            return metrics.done(404);
+        }
+
+        vector<fs::path> entries;
+        vector<fs::path> files;
+        if (fs::is_directory(path)) {
+            WalkOptions walkOptions;
+            walkOptions.ordered = false;
+            DirectoryWalker walker(walkOptions);
+            vector<vector<fs::path>> entriesPerWorker(walker.threadCount());
+            vector<vector<fs::path>> filesPerWorker(walker.threadCount());
+            walker.walk({ path }, [&](const fs::directory_entry& entry, unsigned worker) {
+                entriesPerWorker[worker].push_back(entry.path());
+                error_code ec;
+                if (fs::is_regular_file(entry.symlink_status(ec))) {
+                    filesPerWorker[worker].push_back(entry.path());
+                }
+                return WalkAction::Continue;
+            });
+            for (size_t i = 0; i < entriesPerWorker.size(); ++i) {
+                entries.insert(entries.end(), entriesPerWorker[i].begin(), entriesPerWorker[i].end());
+                files.insert(files.end(), filesPerWorker[i].begin(), filesPerWorker[i].end());
+            }
+        }
+        else if (fs::is_regular_file(path)) {
+            files.push_back(path);
+        }
+
+        atomic<size_t> contentsConverted{ 0 };
+        atomic<size_t> contentsSkipped{ 0 };
+        atomic<size_t> failures{ 0 };
+        if (convertContents) {
+            parallelFor(files.size(), 0, [&](size_t index, unsigned) {
+                ConversionOutcome outcome;
+                try {
+                    outcome = convertFileContents(files[index], direction);
+                }
+                catch (const fs::filesystem_error& e) {
+                    cerr << "Error converting " << files[index].string() << ": " << e.what() << endl;
+                    outcome = ConversionOutcome::Failed;
+                }
+                if (outcome == ConversionOutcome::Converted) {
+                    ++contentsConverted;
+                }
+                else if (outcome == ConversionOutcome::Skipped) {
+                    ++contentsSkipped;
+                }
+                else {
+                    ++failures;
+                }
+            });
+        }
+
+        sort(entries.begin(), entries.end(), [](const fs::path& a, const fs::path& b) {
+            return distance(a.begin(), a.end()) > distance(b.begin(), b.end());
+        });
+        for (const auto& entry : entries) {
+            switch (convertFileName(entry, direction)) {
+            case ConversionOutcome::Converted:
+                ++report.namesConverted;
+                break;
+            case ConversionOutcome::Skipped:
+                ++report.namesSkipped;
+                break;
+            case ConversionOutcome::Failed:
+                ++failures;
+                break;
+            }
+        }
+
+        report.contentsConverted += contentsConverted;
+        report.contentsSkipped += contentsSkipped;
+        report.failures += failures;
+        recordSizeChange(path, true);
+
+        if (failures > 0) {
+            return metrics.done(207);
+        }
+        return metrics.done(report.namesConverted + report.contentsConverted == 0 ? 204 : 200);
+    }
+    catch (const exception& e) {
+        cerr << "Error converting encoding: " << e.what() << endl;
+        return metrics.done(500);
+    }
+}
+
+/**
+ * @brief Replaces a string in every text file under a directory.
+ * Files are collected with a parallel walk and processed in parallel, one file per task.
+ * Each file is first scanned with a vectorized substring search; files without the pattern,
+ * and binary files containing NUL bytes, are left untouched. Matching files are rewritten
+ * through a temporary file and a rename, so none is ever left half-written.
+ * @param path The file or directory to process.
+ * @param pattern The text to find.
+ * @param replacement The text to substitute.
+ * @param dryRun If true, only report what would change.
+ * @param report Receives the counts and a per-file summary with the first changed line.
+ * @return HTTP-like status code:
+ * - 200: Success, files were changed (or would be in a dry run).
+ * - 204: No file contains the pattern.
+ * - 207: Some files could not be processed.
+ * - 400: The pattern is empty.
+ * - 404: Path does not exist.
+ * - 500: Other errors.
+ */
+int BaseFileManager::replaceInFiles(const string& path, const string& pattern, const string& replacement, bool dryRun,
+    ReplaceReport& report) {
+    MetricsScope metrics(MetricOperation::ReplaceInFiles);
+    try {
+        if (pattern.empty()) {
+            cerr << "Error: Pattern is empty." << endl;
+            return metrics.done(400);
+        }
+        if (!fs::exists(path)) {
+            cerr << "Error: Path does not exist." << endl;
+            return metrics.done(404);
+        }
+
+        vector<fs::path> files;
+        collectRegularFiles(path, files);
+
+        mutex reportLock;
+        atomic<size_t> failures{ 0 };
+        atomic<size_t> scanned{ 0 };
+        parallelFor(files.size(), 0, [&](size_t index, unsigned) {
+            const fs::path& file = files[index];
+            ReplaceScan scan;
+            {
+                ifstream input(file, ios::binary);
+                if (!input) {
+                    cerr << "Error: Unable to open " << file.string() << endl;
+                    ++failures;
+                    return;
+                }
+                streamReplace(input, pattern, replacement, nullptr, scan);
+            }
+            if (scan.binary) {
+                return;
+            }
+            ++scanned;
+            if (scan.occurrences == 0) {
+                return;
+            }
+
+            if (!dryRun) {
+                bool rewritten;
+                try {
+                    rewritten = rewriteWithReplacement(file, pattern, replacement);
+                }
+                catch (const fs::filesystem_error& e) {
+                    cerr << "Error rewriting " << file.string() << ": " << e.what() << endl;
+                    rewritten = false;
+                }
+                if (!rewritten) {
+                    ++failures;
+                    return;
+                }
+            }
+
+            ReplaceFileSummary summary;
+            summary.path = file.string();
+            summary.replacements = scan.occurrences;
+            summary.lineNumber = scan.firstLineNumber;
+            summary.lineBefore = scan.firstLine;
+            summary.lineAfter = replaceAll(scan.firstLine, pattern, replacement);
+            lock_guard<mutex> guard(reportLock);
+            report.files.push_back(move(summary));
+        });
+
+        sort(report.files.begin(), report.files.end(), [](const ReplaceFileSummary& a, const ReplaceFileSummary& b) {
+            return a.path < b.path;
+        });
+        report.filesScanned += scanned;
+        report.failures += failures;
+        if (!dryRun && !report.files.empty()) {
+            recordSizeChange(path, true);
+        }
+        for (const auto& summary : report.files) {
+            ++report.filesChanged;
+            report.replacements += summary.replacements;
+        }
+
+        if (failures > 0) {
+            return metrics.done(207);
+        }
+        return metrics.done(report.files.empty() ? 204 : 200);
+    }
+    catch (const exception& e) {
+        cerr << "Error replacing in files: " << e.what() << endl;
+        return metrics.done(500);
+    }
+}
+
+/**
+ * @brief Counts the bytes, lines and words of a file or of every file under a directory.
+ * Files are read in parallel in large blocks and scanned with the vectorized kernel.
+ * @param path File or directory to count.
+ * @param report Receives per-file counts, sorted by path, and the totals.
+ * @return HTTP-like status code:
+ * - 200: Success.
+ * - 204: No files found.
+ * - 207: Some files could not be read.
+ * - 404: Path does not exist.
+ * - 500: Other errors.
+ */
+int BaseFileManager::countText(const string& path, TextCountReport& report) {
+    MetricsScope metrics(MetricOperation::CountText);
+    try {
+        if (!fs::exists(path)) {
+            cerr << "Error: Path does not exist." << endl;
+            return metrics.done(404);
+        }
+
+        vector<fs::path> files;
+        collectRegularFiles(path, files);
+        sort(files.begin(), files.end());
+        countFilesText(files, report);
+
+        if (report.failures > 0) {
+            return metrics.done(207);
+        }
+        return metrics.done(report.files.empty() ? 204 : 200);
+    }
+    catch (const exception& e) {
+        cerr << "Error counting text: " << e.what() << endl;
+        return metrics.done(500);
+    }
+}
+
+/**
+ * @brief Counts the bytes, lines and words of a list of files, such as search results.
+ * @param files Files to count; entries that are not regular files are ignored.
+ * @param report Receives per-file counts, in the order given, and the totals.
+ * @return HTTP-like status code:
+ * - 200: Success.
+ * - 204: No regular files in the list.
+ * - 207: Some files could not be read.
+ * - 500: Other errors.
+ */
+int BaseFileManager::countText(const vector<string>& files, TextCountReport& report) {
+    MetricsScope metrics(MetricOperation::CountText);
+    try {
+        vector<fs::path> regularFiles;
+        for (const auto& file : files) {
+            error_code ec;
+            if (fs::is_regular_file(file, ec)) {
+                regularFiles.push_back(file);
+            }
+        }
+        countFilesText(regularFiles, report);
+
+        if (report.failures > 0) {
+            return metrics.done(207);
+        }
+        return metrics.done(report.files.empty() ? 204 : 200);
+    }
+    catch (const exception& e) {
+        cerr << "Error counting text: " << e.what() << endl;
+        return metrics.done(500);
+    }
+}
+
+/**
+ * @brief Classifies every file under a directory by magic bytes and counts the files of each type.
+ * Files are collected with a parallel walk, and their headers are read in parallel.
+ * @param path The file or directory to classify.
+ * @param report Receives the per-type counts, most frequent type first.
+ * @return HTTP-like status code:
+ * - 200: Success.
+ * - 204: No files found.
+ * - 207: Some files could not be read.
+ * - 404: Path does not exist.
+ * - 500: Other errors.
+ */
+int BaseFileManager::fileTypeReport(const string& path, FileTypeReport& report) {
+    MetricsScope metrics(MetricOperation::FileTypeReport);
+    try {
+        if (!fs::exists(path)) {
+            cerr << "Error: Path does not exist." << endl;
+            return metrics.done(404);
+        }
+
+        vector<fs::path> files;
+        collectRegularFiles(path, files);
+        vector<const char*> types;
+        vector<uint64_t> sizes;
+        FileTypeDetector::detectFiles(files, types, &sizes);
+
+        for (size_t i = 0; i < files.size(); ++i) {
+            if (types[i] == nullptr) {
+                cerr << "Error: Unable to read " << files[i].string() << endl;
+                ++report.failures;
+                continue;
+            }
+            auto found = find_if(report.types.begin(), report.types.end(), [&](const FileTypeCount& count) {
+                return count.type == types[i];
+            });
+            if (found == report.types.end()) {
+                report.types.push_back({ types[i], 0, 0 });
+                found = report.types.end() - 1;
+            }
+            ++found->files;
+            found->bytes += sizes[i];
+        }
+        sort(report.types.begin(), report.types.end(), [](const FileTypeCount& a, const FileTypeCount& b) {
+            return a.files != b.files ? a.files > b.files : a.type < b.type;
+        });
+
+        if (report.failures > 0) {
+            return metrics.done(207);
+        }
+        return metrics.done(report.types.empty() ? 204 : 200);
+    }
+    catch (const exception& e) {
+        cerr << "Error classifying files: " << e.what() << endl;
+        return metrics.done(500);
+    }
+}
+
+/**
+ * @brief Finds empty files and directories, including directories that only contain empty directories.
+ * Emptiness is decided bottom-up in a single parallel post-order walk: every entry that is not
+ * a directory makes its directory non-empty, and a directory is empty when it was listed
+ * completely and all its subdirectories turned out empty. In prune mode each empty directory is
+ * removed as soon as it is finished, so its parent can be judged empty and removed in turn.
+ * Directories that cannot be listed completely are treated as non-empty.
+ * @param path The directory to examine; it is never removed itself.
+ * @param prune Whether the empty directories are removed.
+ * @param report Receives the empty files and directories, sorted.
+ * @return HTTP-like status code:
+ * - 200: Success, empty files or directories were found.
+ * - 204: Nothing empty was found.
+ * - 207: Some empty directories could not be removed.
+ * - 400: Path is not a directory.
+ * - 404: Path does not exist.
+ * - 500: Other errors.
+ */
+int BaseFileManager::findEmpty(const string& path, bool prune, EmptyReport& report) {
+    MetricsScope metrics(MetricOperation::FindEmpty);
+    try {
+        if (!fs::exists(path)) {
+            cerr << "Error: Directory does not exist." << endl;
+            return metrics.done(404);
+        }
+        if (!fs::is_directory(path)) {
+            cerr << "Error: Path is not a directory." << endl;
+            return metrics.done(400);
+        }
+
+        DirectoryWalker walker;
+        vector<vector<string>> filesPerWorker(walker.threadCount());
+        vector<vector<string>> directoriesPerWorker(walker.threadCount());
+        atomic<size_t> failures{ 0 };
+        uint64_t total = 0;
+
+        walker.reduce(path,
+            [&](const fs::directory_entry& entry, unsigned worker) -> uint64_t {
+                error_code ec;
+                if (fs::is_regular_file(entry.symlink_status(ec)) && entry.file_size(ec) == 0 && !ec) {
+                    filesPerWorker[worker].push_back(entry.path().string());
+                }
+                return 1;
+            },
+            [&](const fs::path& directory, uint64_t entries, bool complete, unsigned worker) -> uint64_t {
+                if (entries != 0 || !complete) {
+                    return 1;
+                }
+                if (prune) {
+                    string removed = directory.string();
+                    JournalScope journal(JournalOperation::PruneDirectory, removed);
+                    error_code ec;
+                    if (!fs::remove(directory, ec)) {
+                        cerr << "Error: Unable to remove " << removed << ": " << ec.message() << endl;
+                        ++failures;
+                        journal.done(500);
+                        return 1;
+                    }
+                    journal.done(200);
+                }
+                directoriesPerWorker[worker].push_back(directory.string());
+                return 0;
+            },
+            total);
+
+        for (size_t i = 0; i < filesPerWorker.size(); ++i) {
+            report.emptyFiles.insert(report.emptyFiles.end(), filesPerWorker[i].begin(), filesPerWorker[i].end());
+            report.emptyDirectories.insert(report.emptyDirectories.end(), directoriesPerWorker[i].begin(),
+                directoriesPerWorker[i].end());
+        }
+        sort(report.emptyFiles.begin(), report.emptyFiles.end());
+        sort(report.emptyDirectories.begin(), report.emptyDirectories.end());
+        report.failures += failures;
+        if (prune && !report.emptyDirectories.empty()) {
+            recordSizeChange(path, true);
+        }
+
+        if (failures > 0) {
+            return metrics.done(207);
+        }
+        return metrics.done(report.emptyFiles.empty() && report.emptyDirectories.empty() ? 204 : 200);
+    }
+    catch (const exception& e) {
+        cerr << "Error finding empty entries: " << e.what() << endl;
+        return metrics.done(500);
+    }
+}
+
+/**
+ * @brief Changes the permissions and ownership of an entry and everything below it.
+ * The tree is walked in parallel post-order, so each directory is updated after its contents
+ * have been listed and a mode without owner read or execute does not hide them. Directories
+ * that cannot be listed are counted as failures. Each entry is examined first and left alone
+ * if it is already in the desired state, so re-running the same change costs one stat per
+ * entry and no modifying calls.
+ * @param path The file or directory to change.
+ * @param rules The changes to apply.
+ * @param report Receives the counts of changed and unchanged entries.
+ * @return HTTP-like status code:
+ * - 200: Success, entries were changed.
+ * - 204: Every entry was already in the desired state.
+ * - 207: Some entries could not be examined or changed.
+ * - 400: The rules do not change anything.
+ * - 404: Path does not exist.
+ * - 501: Ownership changes are not supported on this platform.
+ * - 500: Other errors.
+ */
+int BaseFileManager::setAttributes(const string& path, const AttributeRules& rules, AttributeReport& report) {
+    MetricsScope metrics(MetricOperation::SetAttributes);
+    try {
+        if (rules.fileMode < 0 && rules.directoryMode < 0 && rules.addBits == 0 && rules.removeBits == 0
+            && rules.owner < 0 && rules.group < 0) {
+            cerr << "Error: No attribute changes requested." << endl;
+            return metrics.done(400);
+        }
+        if ((rules.owner >= 0 || rules.group >= 0) && !ownershipSupported()) {
+            cerr << "Error: Changing ownership is not supported on this platform." << endl;
+            return metrics.done(501);
+        }
+        error_code ec;
+        fs::file_status status = fs::symlink_status(path, ec);
+        if (!fs::exists(status)) {
+            cerr << "Error: Path does not exist." << endl;
+            return metrics.done(404);
+        }
+
+        atomic<size_t> changed{ 0 };
+        atomic<size_t> unchanged{ 0 };
+        atomic<size_t> failures{ 0 };
+        auto tally = [&](UpdateOutcome outcome) {
+            switch (outcome) {
+            case UpdateOutcome::Changed:
+                ++changed;
+                break;
+            case UpdateOutcome::Unchanged:
+                ++unchanged;
+                break;
+            case UpdateOutcome::Failed:
+                ++failures;
+                break;
+            }
+        };
+
+        if (fs::is_directory(status)) {
+            fs::directory_iterator listing(path, ec);
+            if (ec) {
+                cerr << "Error: Unable to read " << path << endl;
+                ++failures;
+            }
+            DirectoryWalker walker;
+            uint64_t total = 0;
+            walker.reduce(path,
+                [&](const fs::directory_entry& entry, unsigned) -> uint64_t {
+                    tally(applyAttributeRules(entry.path(), rules));
+                    return 0;
+                },
+                [&](const fs::path& directory, uint64_t, bool complete, unsigned) -> uint64_t {
+                    if (!complete) {
+                        cerr << "Error: Unable to read " << directory.string() << endl;
+                        ++failures;
+                    }
+                    tally(applyAttributeRules(directory, rules));
+                    return 0;
+                },
+                total);
+        }
+        tally(applyAttributeRules(path, rules));
+
+        report.changed += changed;
+        report.unchanged += unchanged;
+        report.failures += failures;
+
+        if (failures > 0) {
+            return metrics.done(207);
+        }
+        return metrics.done(changed == 0 ? 204 : 200);
+    }
+    catch (const exception& e) {
+        cerr << "Error changing attributes: " << e.what() << endl;
+        return metrics.done(500);
+    }
+}
+
+/**
+ * @brief Sets or copies the access and modification times of an entry and everything below it.
+ * The tree is walked in parallel post-order, so each directory is updated after its contents
+ * and no later listing touches its access time again. Each entry's times are read first, and
+ * entries that already have the desired times are left alone. When copying, entries without a
+ * counterpart in the reference tree are counted as unchanged.
+ * @param path The file or directory to change.
+ * @param request The change to make.
+ * @param report Receives the counts of changed and unchanged entries.
+ * @return HTTP-like status code:
+ * - 200: Success, entries were changed.
+ * - 204: Every entry already had the desired times.
+ * - 207: Some entries could not be examined or changed.
+ * - 400: The request does not change anything, the time is out of range, or the reference tree is missing.
+ * - 404: Path does not exist.
+ * - 500: Other errors.
+ */
+int BaseFileManager::setTimestamps(const string& path, const TimestampRequest& request, AttributeReport& report) {
+    MetricsScope metrics(MetricOperation::SetTimestamps);
+    try {
+        if (!request.setAccess && !request.setModification) {
+            cerr << "Error: No timestamp changes requested." << endl;
+            return metrics.done(400);
+        }
+        // Times are handled in nanoseconds, which an int64_t holds for about 292 years either side of 1970.
+        constexpr int64_t maxTime = numeric_limits<int64_t>::max() / 1000000000;
+        if (request.operation == TimestampOperation::Normalize && (request.time > maxTime || request.time < -maxTime)) {
+            cerr << "Error: Time is out of range." << endl;
+            return metrics.done(400);
+        }
+        error_code ec;
+        fs::file_status status = fs::symlink_status(path, ec);
+        if (!fs::exists(status)) {
+            cerr << "Error: Path does not exist." << endl;
+            return metrics.done(404);
+        }
+        fs::path root(path);
+        fs::path reference(request.reference);
+        if (request.operation == TimestampOperation::CopyFrom && !fs::exists(fs::symlink_status(reference, ec))) {
+            cerr << "Error: Reference path does not exist." << endl;
+            return metrics.done(400);
+        }
+
+        FileTimes fixed;
+        if (request.operation == TimestampOperation::Touch) {
+            auto now = chrono::duration_cast<chrono::nanoseconds>(chrono::system_clock::now().time_since_epoch()).count();
+            fixed.access = fixed.modification = static_cast<int64_t>(now);
+        }
+        else if (request.operation == TimestampOperation::Normalize) {
+            fixed.access = fixed.modification = request.time * 1000000000;
+        }
+
+        atomic<size_t> changed{ 0 };
+        atomic<size_t> unchanged{ 0 };
+        atomic<size_t> failures{ 0 };
+        auto update = [&](const fs::path& entry) {
+            FileTimes desired = fixed;
+            if (request.operation == TimestampOperation::CopyFrom) {
+                fs::path counterpart = entry == root ? reference : reference / entry.lexically_relative(root);
+                if (!readTimes(counterpart, desired)) {
+                    ++unchanged;
+                    return;
+                }
+            }
+            switch (applyTimes(entry, desired, request)) {
+            case UpdateOutcome::Changed:
+                ++changed;
+                break;
+            case UpdateOutcome::Unchanged:
+                ++unchanged;
+                break;
+            case UpdateOutcome::Failed:
+                ++failures;
+                break;
+            }
+        };
+
+        if (fs::is_directory(status)) {
+            // Listing a directory can update its access time, so directories are only
+            // updated once everything below them has been listed.
+            DirectoryWalker walker;
+            uint64_t total = 0;
+            walker.reduce(root,
+                [&](const fs::directory_entry& entry, unsigned) -> uint64_t {
+                    update(entry.path());
+                    return 0;
+                },
+                [&](const fs::path& directory, uint64_t, bool, unsigned) -> uint64_t {
+                    update(directory);
+                    return 0;
+                },
+                total);
+        }
+        update(root);
+
+        report.changed += changed;
+        report.unchanged += unchanged;
+        report.failures += failures;
+
+        if (failures > 0) {
+            return metrics.done(207);
+        }
+        return metrics.done(changed == 0 ? 204 : 200);
+    }
+    catch (const exception& e) {
+        cerr << "Error changing timestamps: " << e.what() << endl;
+        return metrics.done(500);
+    }
+}
+
+/**
+ * @brief Totals the size of the files under a directory, like du, counting hard-linked files once.
+ * The tree is reduced bottom-up in parallel. Only files with more than one link are entered into
+ * a set of file identities, so the memory used grows with the number of hard-linked files; any
+ * further path to a file already in the set is reported separately instead of being added again.
+ * Symbolic links are not followed and contribute nothing. With the size cache, the totals of a
+ * directory come from cachedDiskUsage instead, and only changed directories are listed again.
+ * @param path The file or directory to measure.
+ * @param report Receives the totals and the sizes of the immediate subdirectories.
+ * @param mode Whether the totals come from a fresh walk or from the size cache.
+ * @return HTTP-like status code:
+ * - 200: Success.
+ * - 207: Some files or directories could not be read; the totals cover the rest. With the
+ *   size cache, the updated cache could not be stored.
+ * - 404: Path does not exist.
+ * - 500: Other errors.
+ */
+int BaseFileManager::diskUsage(const string& path, DiskUsageReport& report, SizeCacheMode mode) {
+    MetricsScope metrics(MetricOperation::DiskUsage);
+    try {
+        error_code ec;
+        fs::file_status status = fs::symlink_status(path, ec);
+        if (!fs::exists(status)) {
+            cerr << "Error: Path does not exist." << endl;
+            return metrics.done(404);
+        }
+        if (!fs::is_directory(status)) {
+            if (fs::is_regular_file(status)) {
+                report.bytes += fs::file_size(path);
+                ++report.files;
+            }
+            return metrics.done(200);
+        }
+        if (mode != SizeCacheMode::Bypass) {
+            return metrics.done(cachedDiskUsage(path, mode == SizeCacheMode::Validate, report));
+        }
+
+        // The walker derives the paths below the root from it, so a normalized root lets the
+        // immediate subdirectories be recognized by their parent path.
+        fs::path root = fs::path(path).lexically_normal();
+        if (root.filename().empty() && root.has_relative_path()) {
+            root = root.parent_path();
+        }
+        FileIdSet linked;
+        atomic<size_t> files{ 0 };
+        atomic<size_t> directories{ 0 };
+        atomic<size_t> hardLinks{ 0 };
+        atomic<uint64_t> linkedBytes{ 0 };
+        atomic<size_t> failures{ 0 };
+        mutex subdirectoryLock;
+        vector<DirectoryUsage> subdirectories;
+
+        DirectoryWalker walker;
+        uint64_t total = 0;
+        walker.reduce(root,
+            [&](const fs::directory_entry& entry, unsigned) -> uint64_t {
+                error_code statusError;
+                if (!fs::is_regular_file(entry.symlink_status(statusError))) {
+                    return 0;
+                }
+                FileId id;
+                uint64_t linkCount = 0;
+                uint64_t size = 0;
+                if (!getFileId(entry.path(), id, &linkCount, false, &size)) {
+                    ++failures;
+                    return 0;
+                }
+                ++files;
+                if (linkCount > 1 && !linked.insert(id)) {
+                    ++hardLinks;
+                    linkedBytes += size;
+                    return 0;
+                }
+                return size;
+            },
+            [&](const fs::path& directory, uint64_t bytes, bool complete, unsigned) -> uint64_t {
+                ++directories;
+                if (!complete) {
+                    cerr << "Error: Unable to read " << directory.string() << endl;
+                    ++failures;
+                }
+                if (directory.parent_path() == root) {
+                    lock_guard<mutex> guard(subdirectoryLock);
+                    subdirectories.push_back({ directory.string(), bytes });
+                }
+                return bytes;
+            },
+            total);
+
+        sort(subdirectories.begin(), subdirectories.end(), [](const DirectoryUsage& a, const DirectoryUsage& b) {
+            return a.bytes != b.bytes ? a.bytes > b.bytes : a.path < b.path;
+        });
+        report.bytes += total;
+        report.files += files;
+        report.directories += directories;
+        report.hardLinks += hardLinks;
+        report.linkedBytes += linkedBytes;
+        report.failures += failures;
+        report.subdirectories.insert(report.subdirectories.end(), subdirectories.begin(), subdirectories.end());
+
+        return metrics.done(failures > 0 ? 207 : 200);
+    }
+    catch (const exception& e) {
+        cerr << "Error measuring disk usage: " << e.what() << endl;
+        return metrics.done(500);
+    }
+}
+
+/**
+ * @brief Copies a file or a directory tree, optionally recreating hard links.
+ * The source tree is walked in parallel first. With hard links preserved, the walk records every
+ * file with more than one link; of each group of paths sharing a file, only the first in sorted
+ * order is copied and the others are created as hard links to the copy, falling back to a separate
+ * copy where linking fails. Directories are created in sorted order before any file is copied,
+ * and the files are then copied in parallel. Symbolic links are recreated, not followed, and
+ * directory permissions are copied once the directories are filled.
+ * @param source The file or directory to copy.
+ * @param destination The path of the copy; it must not exist yet.
+ * @param preserveHardLinks Whether paths sharing one file in the source share one file in the copy.
+ * @param report Receives the counts of copied entries.
+ * @return HTTP-like status code:
+ * - 200: Success.
+ * - 207: Some entries could not be copied.
+ * - 400: The destination exists, lies inside the source, or the source is not a file, link or directory.
+ * - 404: Source does not exist.
+ * - 500: Other errors.
+ */
+int BaseFileManager::copy(const string& source, const string& destination, bool preserveHardLinks, CopyReport& report) {
+    MetricsScope metrics(MetricOperation::Copy);
+    try {
+        error_code ec;
+        fs::file_status status = fs::symlink_status(source, ec);
+        if (!fs::exists(status)) {
+            cerr << "Error: Source does not exist." << endl;
+            return metrics.done(404);
+        }
+        if (fs::exists(fs::symlink_status(destination, ec))) {
+            cerr << "Error: Destination already exists." << endl;
+            return metrics.done(400);
+        }
+
+        if (fs::is_symlink(status)) {
+            fs::copy_symlink(source, destination);
+            ++report.symlinks;
+            recordSizeChange(destination, false);
+            return metrics.done(200);
+        }
+        if (fs::is_regular_file(status)) {
+            fs::copy_file(source, destination);
+            Metrics::getInstance().addBytesCopied(fs::file_size(source));
+            ++report.files;
+            recordSizeChange(destination, false);
+            return metrics.done(200);
+        }
+        if (!fs::is_directory(status)) {
+            cerr << "Error: Source is not a file, link or directory." << endl;
+            return metrics.done(400);
+        }
+        fs::path root = fs::canonical(source);
+        if (isWithin(fs::weakly_canonical(destination), root)) {
+            cerr << "Error: Cannot copy a directory into itself." << endl;
+            return metrics.done(400);
+        }
+
+        HardLinkIndex index;
+        WalkOptions walkOptions;
+        walkOptions.ordered = false;
+        walkOptions.hardLinks = preserveHardLinks ? &index : nullptr;
+        DirectoryWalker walker(walkOptions);
+        vector<vector<fs::path>> directoriesPerWorker(walker.threadCount());
+        vector<vector<fs::path>> filesPerWorker(walker.threadCount());
+        vector<vector<fs::path>> symlinksPerWorker(walker.threadCount());
+        atomic<size_t> failures{ 0 };
+        walker.walk({ root }, [&](const fs::directory_entry& entry, unsigned worker) {
+            error_code statusError;
+            fs::file_status entryStatus = entry.symlink_status(statusError);
+            if (fs::is_directory(entryStatus)) {
+                directoriesPerWorker[worker].push_back(entry.path());
+            }
+            else if (fs::is_regular_file(entryStatus)) {
+                filesPerWorker[worker].push_back(entry.path());
+            }
+            else if (fs::is_symlink(entryStatus)) {
+                symlinksPerWorker[worker].push_back(entry.path());
+            }
+            else {
+                cerr << "Error: Cannot copy special file " << entry.path().string() << endl;
+                ++failures;
+            }
+            return WalkAction::Continue;
+        });
+
+        auto merge = [](vector<vector<fs::path>>& perWorker) {
+            vector<fs::path> merged;
+            for (auto& paths : perWorker) {
+                merged.insert(merged.end(), make_move_iterator(paths.begin()), make_move_iterator(paths.end()));
+            }
+            sort(merged.begin(), merged.end());
+            return merged;
+        };
+        vector<fs::path> directories = merge(directoriesPerWorker);
+        vector<fs::path> files = merge(filesPerWorker);
+        vector<fs::path> symlinks = merge(symlinksPerWorker);
+        fs::path target(destination);
+        auto targetOf = [&](const fs::path& entry) { return target / entry.lexically_relative(root); };
+
+        // Every path but the first of a group becomes a link instead of a copy.
+        vector<vector<fs::path>> groups = index.groups();
+        vector<fs::path> linkedPaths;
+        for (const auto& group : groups) {
+            linkedPaths.insert(linkedPaths.end(), group.begin() + 1, group.end());
+        }
+        sort(linkedPaths.begin(), linkedPaths.end());
+        files.erase(remove_if(files.begin(), files.end(), [&](const fs::path& file) {
+            return binary_search(linkedPaths.begin(), linkedPaths.end(), file);
+        }), files.end());
+
+        fs::create_directory(target);
+        ++report.directories;
+        for (const auto& directory : directories) {
+            if (fs::create_directory(targetOf(directory), ec)) {
+                ++report.directories;
+            }
+            else {
+                cerr << "Error: Unable to create " << targetOf(directory).string() << ": " << ec.message() << endl;
+                ++failures;
+            }
+        }
+
+        atomic<size_t> copied{ 0 };
+        atomic<size_t> linked{ 0 };
+        auto copyFile = [&](const fs::path& file) {
+            error_code copyError;
+            if (fs::copy_file(file, targetOf(file), copyError)) {
+                uintmax_t size = fs::file_size(file, copyError);
+                Metrics::getInstance().addBytesCopied(copyError ? 0 : size);
+                ++copied;
+            }
+            else {
+                cerr << "Error: Unable to copy " << file.string() << ": " << copyError.message() << endl;
+                ++failures;
+            }
+        };
+        parallelFor(files.size(), 0, [&](size_t i, unsigned) {
+            copyFile(files[i]);
+        });
+        parallelFor(groups.size(), 0, [&](size_t i, unsigned) {
+            fs::path original = targetOf(groups[i].front());
+            for (size_t j = 1; j < groups[i].size(); ++j) {
+                error_code linkError;
+                fs::create_hard_link(original, targetOf(groups[i][j]), linkError);
+                if (linkError) {
+                    copyFile(groups[i][j]);
+                }
+                else {
+                    ++linked;
+                }
+            }
+        });
+
+        for (const auto& symlink : symlinks) {
+            fs::copy_symlink(symlink, targetOf(symlink), ec);
+            if (ec) {
+                cerr << "Error: Unable to copy link " << symlink.string() << ": " << ec.message() << endl;
+                ++failures;
+            }
+            else {
+                ++report.symlinks;
+            }
+        }
+
+        // Permissions are copied last, so read-only directories can still be filled.
+        directories.insert(directories.begin(), root);
+        for (auto it = directories.rbegin(); it != directories.rend(); ++it) {
+            fs::permissions(targetOf(*it), fs::status(*it, ec).permissions(), ec);
+        }
+
+        report.files += copied;
+        report.hardLinks += linked;
+        report.failures += failures;
+        recordSizeChange(destination, false);
+        return metrics.done(failures > 0 ? 207 : 200);
+    }
+    catch (const exception& e) {
+        cerr << "Error copying: " << e.what() << endl;
+        return metrics.done(500);
     }
 }
@@ -6,9 +6,448 @@
 #ifndef BASE_FILE_MANAGER_H
 #define BASE_FILE_MANAGER_H
 
+#include <chrono>
+#include "EncodingConverter.h"
+#include <cstddef>
+#include <cstdint>
+#include <functional>
 #include <string>
 #include <vector>
 
+/**
+ * @struct SearchOptions
+ * @brief Tunes how searchFiles traverses the directory tree.
+ */
+struct SearchOptions {
+    /**
+     * @brief Report results in lexicographic tree order instead of discovery order.
+     */
+    bool ordered = true;
+
+    /**
+     * @brief In ordered mode, the maximum number of directories listed ahead of the output.
+     */
+    std::size_t reorderWindow = 1024;
+
+    /**
+     * @brief Number of worker threads; 0 selects the hardware concurrency.
+     */
+    unsigned threads = 0;
+
+    /**
+     * @brief Descend into symbolic links to directories, skipping directories already visited.
+     */
+    bool followSymlinks = false;
+
+    /**
+     * @brief Maximum number of matches to report; 0 means unlimited.
+     */
+    std::size_t maxResults = 0;
+
+    /**
+     * @brief Maximum number of directory entries to examine; 0 means unlimited.
+     */
+    std::size_t maxEntries = 0;
+
+    /**
+     * @brief Maximum wall time of the search; zero means unlimited.
+     */
+    std::chrono::milliseconds maxDuration{ 0 };
+
+    /**
+     * @brief Only match regular files whose contents are of this type, as named by
+     * FileTypeDetector (for example "pdf" or "zip"); empty matches entries of any type.
+     */
+    std::string fileType;
+
+    /**
+     * @brief List the paths of a file reached through several hard links next to each other,
+     * at the position of the first of them. Does not apply to matches streamed to onMatch.
+     */
+    bool groupHardLinks = false;
+
+    /**
+     * @brief Skip subtrees whose filters in a search index built with buildSearchIndex rule the
+     * pattern out. A subtree is only skipped if every indexed directory in it is unchanged since
+     * the index was built, so the results are the same as without the index. Ignored with
+     * followSymlinks, since the index does not cover names reached through symbolic links.
+     */
+    bool useIndex = false;
+
+    /**
+     * @brief With useIndex, only check the skipped directory itself for changes, not every
+     * directory below it. Faster, but entries added deeper in the subtree since the index was
+     * built may be missed until it is rebuilt.
+     */
+    bool trustIndex = false;
+
+    /**
+     * @brief Optional sink receiving matches as they stream out; when set, results stays empty.
+     */
+    std::function<void(const std::string&)> onMatch;
+};
+
+/**
+ * @struct EncodingReport
+ * @brief Outcome of a bulk encoding conversion.
+ */
+struct EncodingReport {
+    /**
+     * @brief File and directory names that were transcoded and renamed.
+     */
+    std::size_t namesConverted = 0;
+
+    /**
+     * @brief Names that were plain ASCII or already in the target encoding.
+     */
+    std::size_t namesSkipped = 0;
+
+    /**
+     * @brief Files whose contents were transcoded.
+     */
+    std::size_t contentsConverted = 0;
+
+    /**
+     * @brief Files that were binary, plain ASCII or already in the target encoding.
+     */
+    std::size_t contentsSkipped = 0;
+
+    /**
+     * @brief Names or files that could not be converted.
+     */
+    std::size_t failures = 0;
+};
+
+/**
+ * @struct SearchIndexReport
+ * @brief Outcome of building a search index.
+ */
+struct SearchIndexReport {
+    std::size_t directories = 0; ///< Directories indexed, including the root.
+    std::size_t filters = 0;     ///< Directories whose subtrees are selective enough to be skipped.
+    std::uint64_t bytes = 0;     ///< Size of the stored index.
+};
+
+/**
+ * @struct ReplaceFileSummary
+ * @brief Changes find-and-replace makes, or would make, to one file.
+ */
+struct ReplaceFileSummary {
+    /**
+     * @brief Path of the file.
+     */
+    std::string path;
+
+    /**
+     * @brief Number of occurrences replaced.
+     */
+    std::size_t replacements = 0;
+
+    /**
+     * @brief One-based number of the first line containing the pattern.
+     */
+    std::size_t lineNumber = 0;
+
+    /**
+     * @brief That line before the replacement, truncated to a preview length.
+     */
+    std::string lineBefore;
+
+    /**
+     * @brief That line after the replacement.
+     */
+    std::string lineAfter;
+};
+
+/**
+ * @struct ReplaceReport
+ * @brief Outcome of a find-and-replace across files.
+ */
+struct ReplaceReport {
+    /**
+     * @brief Text files examined.
+     */
+    std::size_t filesScanned = 0;
+
+    /**
+     * @brief Files rewritten, or that would be rewritten in a dry run.
+     */
+    std::size_t filesChanged = 0;
+
+    /**
+     * @brief Occurrences replaced in all files.
+     */
+    std::size_t replacements = 0;
+
+    /**
+     * @brief Files that could not be read or rewritten.
+     */
+    std::size_t failures = 0;
+
+    /**
+     * @brief Per-file summary of the changes, sorted by path.
+     */
+    std::vector<ReplaceFileSummary> files;
+};
+
+/**
+ * @struct TextCounts
+ * @brief Byte, line and word counts of some text, as reported by wc.
+ */
+struct TextCounts {
+    std::uint64_t bytes = 0;
+    std::uint64_t lines = 0;
+    std::uint64_t words = 0;
+};
+
+/**
+ * @struct FileTextCounts
+ * @brief Text counts of one file.
+ */
+struct FileTextCounts {
+    std::string path;
+    TextCounts counts;
+};
+
+/**
+ * @struct TextCountReport
+ * @brief Outcome of counting the text of several files.
+ */
+struct TextCountReport {
+    /**
+     * @brief Counts of every file that was read.
+     */
+    std::vector<FileTextCounts> files;
+
+    /**
+     * @brief Sum over all files that were read.
+     */
+    TextCounts total;
+
+    /**
+     * @brief Files that could not be read.
+     */
+    std::size_t failures = 0;
+};
+
+/**
+ * @struct FileTypeCount
+ * @brief Number and total size of the files of one detected type.
+ */
+struct FileTypeCount {
+    std::string type;
+    std::size_t files = 0;
+    std::uint64_t bytes = 0;
+};
+
+/**
+ * @struct FileTypeReport
+ * @brief Breakdown of the files under a directory by detected type.
+ */
+struct FileTypeReport {
+    /**
+     * @brief One entry per type found, most frequent first.
+     */
+    std::vector<FileTypeCount> types;
+
+    /**
+     * @brief Files that could not be read.
+     */
+    std::size_t failures = 0;
+};
+
+/**
+ * @struct EmptyReport
+ * @brief Empty files and directories found below a directory.
+ */
+struct EmptyReport {
+    /**
+     * @brief Regular files of size zero, sorted.
+     */
+    std::vector<std::string> emptyFiles;
+
+    /**
+     * @brief Directories that contain nothing but empty directories, sorted; in prune mode,
+     * the directories that were removed.
+     */
+    std::vector<std::string> emptyDirectories;
+
+    /**
+     * @brief Empty directories that could not be removed in prune mode.
+     */
+    std::size_t failures = 0;
+};
+
+/**
+ * @struct AttributeRules
+ * @brief Permission and ownership changes applied by setAttributes.
+ * Absolute modes are applied first, then addBits and removeBits; symbolic links only
+ * have their ownership changed.
+ */
+struct AttributeRules {
+    /**
+     * @brief Permission bits for files, or -1 to keep them.
+     */
+    int fileMode = -1;
+
+    /**
+     * @brief Permission bits for directories, or -1 to keep them.
+     */
+    int directoryMode = -1;
+
+    /**
+     * @brief Permission bits to set on every file and directory.
+     */
+    unsigned addBits = 0;
+
+    /**
+     * @brief Permission bits to clear on every file and directory.
+     */
+    unsigned removeBits = 0;
+
+    /**
+     * @brief New owner user ID, or -1 to keep it.
+     */
+    std::int64_t owner = -1;
+
+    /**
+     * @brief New owner group ID, or -1 to keep it.
+     */
+    std::int64_t group = -1;
+};
+
+/**
+ * @struct AttributeReport
+ * @brief Outcome of a bulk permission and ownership change.
+ */
+struct AttributeReport {
+    std::size_t changed = 0;   ///< Entries whose attributes were modified.
+    std::size_t unchanged = 0; ///< Entries already in the desired state.
+    std::size_t failures = 0;  ///< Entries that could not be examined or modified.
+};
+
+/**
+ * @struct DirectoryUsage
+ * @brief Total size of the files below one directory.
+ */
+struct DirectoryUsage {
+    std::string path;
+    std::uint64_t bytes = 0;
+};
+
+/**
+ * @brief How diskUsage uses the persistent directory size cache.
+ */
+enum class SizeCacheMode {
+    Bypass,   ///< Walk the tree; the cache is neither read nor written.
+    Validate, ///< Answer from the cache after checking every cached directory for changes.
+    Trust     ///< Answer from the cache, updating only the directories this program changed.
+};
+
+/**
+ * @brief How deleteFile and deleteDirectory dispose of an entry.
+ */
+enum class DeleteMode {
+    Permanent, ///< Remove the entry for good.
+    Trash      ///< Move the entry to the trash, from which it can be restored.
+};
+
+/**
+ * @struct DiskUsageReport
+ * @brief Space taken by a directory tree, counting every hard-linked file once.
+ */
+struct DiskUsageReport {
+    /**
+     * @brief Total size of the regular files, each file counted once however many links lead to it.
+     */
+    std::uint64_t bytes = 0;
+
+    /**
+     * @brief Regular file paths found, including repeated links.
+     */
+    std::size_t files = 0;
+
+    /**
+     * @brief Directories found below the root.
+     */
+    std::size_t directories = 0;
+
+    /**
+     * @brief Paths leading to a file that was already counted through another link.
+     */
+    std::size_t hardLinks = 0;
+
+    /**
+     * @brief Size those paths would have added if every link were counted separately.
+     */
+    std::uint64_t linkedBytes = 0;
+
+    /**
+     * @brief Totals of the immediate subdirectories, largest first. A file linked from several
+     * subdirectories counts towards whichever of them was reached first.
+     */
+    std::vector<DirectoryUsage> subdirectories;
+
+    /**
+     * @brief Files and directories that could not be read.
+     */
+    std::size_t failures = 0;
+
+    /**
+     * @brief Directories listed to bring the size cache up to date; 0 when the cache was current.
+     */
+    std::size_t reread = 0;
+};
+
+/**
+ * @struct CopyReport
+ * @brief Outcome of a recursive copy.
+ */
+struct CopyReport {
+    std::size_t files = 0;       ///< Regular files whose contents were copied.
+    std::size_t hardLinks = 0;   ///< Paths recreated as hard links to an already copied file.
+    std::size_t directories = 0; ///< Directories created.
+    std::size_t symlinks = 0;    ///< Symbolic links recreated.
+    std::size_t failures = 0;    ///< Entries that could not be copied.
+};
+
+/**
+ * @brief Kind of bulk timestamp change.
+ */
+enum class TimestampOperation {
+    Touch,     ///< Set the times to the current time.
+    Normalize, ///< Set the times to a fixed point in time.
+    CopyFrom   ///< Copy the times of the entries at the same relative paths in a reference tree.
+};
+
+/**
+ * @struct TimestampRequest
+ * @brief Describes a bulk timestamp change for setTimestamps.
+ */
+struct TimestampRequest {
+    TimestampOperation operation = TimestampOperation::Touch;
+
+    /**
+     * @brief For Normalize, the time to set in seconds since the Unix epoch; negative before 1970.
+     */
+    std::int64_t time = 0;
+
+    /**
+     * @brief For CopyFrom, the root of the reference tree.
+     */
+    std::string reference;
+
+    /**
+     * @brief Whether access times are changed.
+     */
+    bool setAccess = true;
+
+    /**
+     * @brief Whether modification times are changed.
+     */
+    bool setModification = true;
+};
+
  /**
   * @class BaseFileManager
   * @brief Singleton class for managing file and directory operations.
@@ -39,9 +478,10 @@ public:
     /**
      * @brief Deletes a file at the specified path.
      * @param path Path to the file.
+     * @param mode Whether the file is removed or moved to the trash.
      * @return Status code.
      */
-    int deleteFile(const std::string& path);
+    int deleteFile(const std::string& path, DeleteMode mode = DeleteMode::Permanent);
 
     /**
      * @brief Creates a directory at the specified path.
@@ -53,9 +493,17 @@ public:
     /**
      * @brief Deletes a directory at the specified path.
      * @param path Path to the directory.
+     * @param mode Whether the directory is removed or moved to the trash.
      * @return Status code.
      */
-    int deleteDirectory(const std::string& path);
+    int deleteDirectory(const std::string& path, DeleteMode mode = DeleteMode::Permanent);
+
+    /**
+     * @brief Restores the entry most recently moved to the trash from a path.
+     * @param path Original path of the entry.
+     * @return Status code.
+     */
+    int restoreFromTrash(const std::string& path);
 
     /**
      * @brief Renames a file or directory.
@@ -70,9 +518,148 @@ public:
      * @param path Directory path to search in.
      * @param pattern Filename pattern to search for.
      * @param results Vector to store matching files.
+     * @param options Traversal options.
+     * @return Status code.
+     */
+    int searchFiles(const std::string& path, const std::string& pattern, std::vector<std::string>& results,
+        const SearchOptions& options = SearchOptions());
+
+    /**
+     * @brief Searches several root directories concurrently for files matching a pattern.
+     * Roots are canonicalized, duplicates and roots nested inside other roots are dropped,
+     * and the results are merged in sorted root order.
+     * @param paths Directory paths to search in.
+     * @param pattern Filename pattern to search for.
+     * @param results Vector to store matching files.
+     * @param options Traversal options.
+     * @return Status code.
+     */
+    int searchFiles(const std::vector<std::string>& paths, const std::string& pattern, std::vector<std::string>& results,
+        const SearchOptions& options = SearchOptions());
+
+    /**
+     * @brief Counts the files matching a pattern in a directory without collecting their paths.
+     * @param path Directory path to search in.
+     * @param pattern Filename pattern to search for.
+     * @param count Receives the number of matching files.
+     * @param options Traversal options.
+     * @return Status code.
+     */
+    int countFiles(const std::string& path, const std::string& pattern, std::size_t& count,
+        const SearchOptions& options = SearchOptions());
+
+    /**
+     * @brief Checks whether any file in a directory matches a pattern, stopping at the first match.
+     * @param path Directory path to search in.
+     * @param pattern Filename pattern to search for.
+     * @param found Receives whether a matching file exists.
+     * @param options Traversal options.
+     * @return Status code.
+     */
+    int fileExists(const std::string& path, const std::string& pattern, bool& found,
+        const SearchOptions& options = SearchOptions());
+
+    /**
+     * @brief Builds a persistent index of filename trigrams per subtree, used by searches with useIndex.
+     * @param path Directory to index; searches of it and of any directory below it use the index.
+     * @param report Receives the index statistics.
+     * @return Status code.
+     */
+    int buildSearchIndex(const std::string& path, SearchIndexReport& report);
+
+    /**
+     * @brief Converts file names, and optionally file contents, between Windows-1251 and UTF-8.
+     * @param path File or directory to convert; directories are converted recursively.
+     * @param direction Source and target encodings.
+     * @param convertContents Whether the contents of text files are converted too; files with more
+     * than one hard link are not rewritten and count as failures.
+     * @param report Receives the conversion counts.
+     * @return Status code.
+     */
+    int convertEncoding(const std::string& path, EncodingDirection direction, bool convertContents, EncodingReport& report);
+
+    /**
+     * @brief Replaces a string in every text file under a directory.
+     * Files with more than one hard link are not rewritten and count as failures.
+     * @param path File or directory to process.
+     * @param pattern Text to find.
+     * @param replacement Text to substitute.
+     * @param dryRun If true, only report what would change.
+     * @param report Receives the counts and a per-file summary of the changes.
+     * @return Status code.
+     */
+    int replaceInFiles(const std::string& path, const std::string& pattern, const std::string& replacement, bool dryRun,
+        ReplaceReport& report);
+
+    /**
+     * @brief Counts the bytes, lines and words of a file or of every file under a directory.
+     * @param path File or directory to count.
+     * @param report Receives per-file counts, sorted by path, and the totals.
+     * @return Status code.
+     */
+    int countText(const std::string& path, TextCountReport& report);
+
+    /**
+     * @brief Counts the bytes, lines and words of a list of files, such as search results.
+     * @param files Files to count; entries that are not regular files are ignored.
+     * @param report Receives per-file counts, in the order given, and the totals.
+     * @return Status code.
+     */
+    int countText(const std::vector<std::string>& files, TextCountReport& report);
+
+    /**
+     * @brief Classifies every file under a directory by magic bytes and counts the files of each type.
+     * @param path File or directory to classify.
+     * @param report Receives the per-type counts.
+     * @return Status code.
+     */
+    int fileTypeReport(const std::string& path, FileTypeReport& report);
+
+    /**
+     * @brief Finds empty files and directories, including directories that only contain empty directories.
+     * @param path Directory to examine; it is never removed itself.
+     * @param prune Whether the empty directories are removed.
+     * @param report Receives the empty files and directories.
+     * @return Status code.
+     */
+    int findEmpty(const std::string& path, bool prune, EmptyReport& report);
+
+    /**
+     * @brief Changes the permissions and ownership of an entry and everything below it.
+     * @param path File or directory to change; directories are processed recursively.
+     * @param rules Changes to apply.
+     * @param report Receives the counts of changed and unchanged entries.
+     * @return Status code.
+     */
+    int setAttributes(const std::string& path, const AttributeRules& rules, AttributeReport& report);
+
+    /**
+     * @brief Sets or copies the access and modification times of an entry and everything below it.
+     * @param path File or directory to change; directories are processed recursively.
+     * @param request The change to make.
+     * @param report Receives the counts of changed and unchanged entries.
+     * @return Status code.
+     */
+    int setTimestamps(const std::string& path, const TimestampRequest& request, AttributeReport& report);
+
+    /**
+     * @brief Totals the size of the files under a directory, counting hard-linked files once.
+     * @param path File or directory to measure.
+     * @param report Receives the totals and the sizes of the immediate subdirectories.
+     * @param mode Whether the totals come from a fresh walk or from the size cache.
+     * @return Status code.
+     */
+    int diskUsage(const std::string& path, DiskUsageReport& report, SizeCacheMode mode);
+
+    /**
+     * @brief Copies a file or a directory tree.
+     * @param source File or directory to copy.
+     * @param destination Path of the copy; it must not exist yet.
+     * @param preserveHardLinks Whether paths sharing one file in the source share one file in the copy.
+     * @param report Receives the counts of copied entries.
      * @return Status code.
      */
-    int searchFiles(const std::string& path, const std::string& pattern, std::vector<std::string>& results);
+    int copy(const std::string& source, const std::string& destination, bool preserveHardLinks, CopyReport& report);
 
 private:
     /**
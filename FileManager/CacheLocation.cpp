@@ -0,0 +1,79 @@
+/**
+ * @file CacheLocation.cpp
+ * @brief Implementation of the cache file locations.
+ */
+
+#include "CacheLocation.h"
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <system_error>
+
+using namespace std;
+namespace fs = filesystem;
+
+/**
+ * @brief Returns the directory holding the cache files of this program.
+ * @return The cache directory, or a directory below the temporary directory if no home is known.
+ */
+fs::path cacheDirectory() {
+#ifdef _WIN32
+    if (const char* localAppData = getenv("LOCALAPPDATA")) {
+        return fs::path(localAppData) / "FileManager";
+    }
+#else
+    if (const char* cacheHome = getenv("XDG_CACHE_HOME")) {
+        if (*cacheHome != '\0') {
+            return fs::path(cacheHome) / "filemanager";
+        }
+    }
+    if (const char* home = getenv("HOME")) {
+        return fs::path(home) / ".cache" / "filemanager";
+    }
+#endif
+    error_code ec;
+    return fs::temp_directory_path(ec) / "filemanager";
+}
+
+/**
+ * @brief Returns the path of a cache file belonging to a directory tree.
+ * @param root Canonical path of the tree.
+ * @param extension Extension identifying the kind of cache, including the dot.
+ * @return Path of the cache file, named after the FNV-1a hash of the root path.
+ */
+fs::path cacheFilePath(const fs::path& root, const string& extension) {
+    uint64_t hash = 0xCBF29CE484222325ULL;
+    for (unsigned char c : root.generic_u8string()) {
+        hash = (hash ^ c) * 0x100000001B3ULL;
+    }
+    char name[17];
+    snprintf(name, sizeof(name), "%016llx", static_cast<unsigned long long>(hash));
+    return cacheDirectory() / (name + extension);
+}
+
+/**
+ * @brief Replaces a cache file with new contents so that readers never see a partial file.
+ * @param path Path of the cache file; missing parent directories are created.
+ * @param contents Bytes to store.
+ * @return True on success.
+ */
+bool writeCacheFile(const fs::path& path, const string& contents) {
+    error_code ec;
+    fs::create_directories(path.parent_path(), ec);
+    fs::path temporary = path;
+    temporary += ".tmp";
+    ofstream output(temporary, ios::binary | ios::trunc);
+    output.write(contents.data(), static_cast<streamsize>(contents.size()));
+    output.close();
+    if (!output) {
+        fs::remove(temporary, ec);
+        return false;
+    }
+    fs::rename(temporary, path, ec);
+    if (ec) {
+        fs::remove(temporary, ec);
+        return false;
+    }
+    return true;
+}
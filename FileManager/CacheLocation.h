@@ -0,0 +1,39 @@
+/**
+ * @file CacheLocation.h
+ * @brief Declares cacheDirectory and cacheFilePath, which place persistent per-tree caches in the user's cache directory.
+ */
+
+#ifndef CACHE_LOCATION_H
+#define CACHE_LOCATION_H
+
+#include <filesystem>
+#include <string>
+
+/**
+ * @brief Returns the directory holding the cache files and other per-user state of this program.
+ * This is %LOCALAPPDATA%\FileManager on Windows and $XDG_CACHE_HOME/filemanager, or ~/.cache/filemanager,
+ * elsewhere; a directory below the temporary directory is used if no home is known. It is not created.
+ * @return The cache directory.
+ */
+std::filesystem::path cacheDirectory();
+
+/**
+ * @brief Returns the path of a cache file belonging to a directory tree.
+ * Cache files live in the cacheDirectory and are named after a hash of the root path, so caches
+ * never have to be written into the trees they describe. The directory is not created.
+ * @param root Canonical path of the tree.
+ * @param extension Extension identifying the kind of cache, including the dot.
+ * @return Path of the cache file.
+ */
+std::filesystem::path cacheFilePath(const std::filesystem::path& root, const std::string& extension);
+
+/**
+ * @brief Replaces a cache file with new contents so that readers never see a partial file.
+ * The contents are written to a temporary file next to the target, which is then renamed over it.
+ * @param path Path of the cache file; missing parent directories are created.
+ * @param contents Bytes to store.
+ * @return True on success.
+ */
+bool writeCacheFile(const std::filesystem::path& path, const std::string& contents);
+
+#endif // CACHE_LOCATION_H
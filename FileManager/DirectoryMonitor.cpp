@@ -0,0 +1,362 @@
+/**
+ * @file DirectoryMonitor.cpp
+ * @brief Implementation of directory change monitoring with inotify, ReadDirectoryChangesW or sleeping.
+ */
+
+#include "DirectoryMonitor.h"
+#include <cstdint>
+#include <system_error>
+#include <thread>
+
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <Windows.h>
+#elif defined(__linux__)
+#include <poll.h>
+#include <sys/inotify.h>
+#include <unistd.h>
+#endif
+
+using namespace std;
+namespace fs = filesystem;
+
+#ifdef _WIN32
+
+/**
+ * @brief Opens the directory for asynchronous change notification.
+ * @param directory Directory whose entries are monitored.
+ * @param subtree Whether the entries of all subdirectories are monitored as well.
+ */
+DirectoryMonitor::DirectoryMonitor(const fs::path& directory, bool subtree) : buffer(16384), subtree(subtree) {
+    HANDLE handle = CreateFileW(directory.c_str(), FILE_LIST_DIRECTORY,
+        FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE, nullptr, OPEN_EXISTING,
+        FILE_FLAG_BACKUP_SEMANTICS | FILE_FLAG_OVERLAPPED, nullptr);
+    if (handle == INVALID_HANDLE_VALUE) {
+        return;
+    }
+    directoryHandle = handle;
+    eventHandle = CreateEventW(nullptr, TRUE, FALSE, nullptr);
+    auto* request = new OVERLAPPED();
+    request->hEvent = eventHandle;
+    overlapped = request;
+    if (eventHandle == nullptr || !this->request()) {
+        CloseHandle(directoryHandle);
+        directoryHandle = nullptr;
+    }
+}
+
+/**
+ * @brief Cancels the outstanding request and closes the directory.
+ */
+DirectoryMonitor::~DirectoryMonitor() {
+    auto* request = static_cast<OVERLAPPED*>(overlapped);
+    if (directoryHandle != nullptr) {
+        if (pending) {
+            DWORD transferred;
+            CancelIoEx(directoryHandle, request);
+            GetOverlappedResult(directoryHandle, request, &transferred, TRUE);
+        }
+        CloseHandle(directoryHandle);
+    }
+    if (eventHandle != nullptr) {
+        CloseHandle(eventHandle);
+    }
+    delete request;
+}
+
+/**
+ * @brief Reports whether changes are delivered by the operating system.
+ * @return False if the monitor only sleeps.
+ */
+bool DirectoryMonitor::isNative() const {
+    return directoryHandle != nullptr;
+}
+
+/**
+ * @brief Queues the next asynchronous change request.
+ * @return True if the request was queued.
+ */
+bool DirectoryMonitor::request() {
+    ResetEvent(eventHandle);
+    pending = ReadDirectoryChangesW(directoryHandle, buffer.data(), static_cast<DWORD>(buffer.size() * sizeof(unsigned long)),
+        subtree ? TRUE : FALSE, FILE_NOTIFY_CHANGE_FILE_NAME | FILE_NOTIFY_CHANGE_DIR_NAME | FILE_NOTIFY_CHANGE_SIZE |
+        FILE_NOTIFY_CHANGE_LAST_WRITE | FILE_NOTIFY_CHANGE_ATTRIBUTES,
+        nullptr, static_cast<OVERLAPPED*>(overlapped), nullptr) != FALSE;
+    return pending;
+}
+
+/**
+ * @brief Waits for the outstanding request to complete and decodes its notifications.
+ * @param timeout Longest time to wait.
+ * @param events Receives the events; cleared first.
+ * @return True if any event arrived before the timeout.
+ */
+bool DirectoryMonitor::wait(chrono::milliseconds timeout, vector<ChangeEvent>& events) {
+    events.clear();
+    if (directoryHandle == nullptr || !pending) {
+        this_thread::sleep_for(timeout);
+        return false;
+    }
+    if (WaitForSingleObject(eventHandle, static_cast<DWORD>(timeout.count())) != WAIT_OBJECT_0) {
+        return false;
+    }
+
+    DWORD transferred = 0;
+    pending = false;
+    if (!GetOverlappedResult(directoryHandle, static_cast<OVERLAPPED*>(overlapped), &transferred, FALSE)
+        || transferred == 0) {
+        // The buffer overflowed and the notifications were discarded.
+        events.push_back({ ChangeKind::Overflow, string(), string() });
+    }
+    else {
+        // A rename reports the old name immediately before the new one; the pair becomes one MovedIn event.
+        const auto* bytes = reinterpret_cast<const char*>(buffer.data());
+        size_t renamedFrom = SIZE_MAX;
+        for (DWORD offset = 0;;) {
+            const auto* info = reinterpret_cast<const FILE_NOTIFY_INFORMATION*>(bytes + offset);
+            ChangeKind kind = ChangeKind::Modified;
+            switch (info->Action) {
+            case FILE_ACTION_ADDED:
+                kind = ChangeKind::Created;
+                break;
+            case FILE_ACTION_RENAMED_NEW_NAME:
+                kind = ChangeKind::MovedIn;
+                break;
+            case FILE_ACTION_REMOVED:
+            case FILE_ACTION_RENAMED_OLD_NAME:
+                kind = ChangeKind::Removed;
+                break;
+            }
+            wstring name(info->FileName, info->FileNameLength / sizeof(WCHAR));
+            string path = fs::path(name).generic_string();
+            if (kind == ChangeKind::MovedIn && renamedFrom < events.size()) {
+                events[renamedFrom] = { kind, path, events[renamedFrom].name };
+            }
+            else {
+                events.push_back({ kind, path, string() });
+            }
+            renamedFrom = info->Action == FILE_ACTION_RENAMED_OLD_NAME ? events.size() - 1 : SIZE_MAX;
+            if (info->NextEntryOffset == 0) {
+                break;
+            }
+            offset += info->NextEntryOffset;
+        }
+    }
+    request();
+    return true;
+}
+
+#elif defined(__linux__)
+
+namespace {
+
+/**
+ * @brief Events requested for every watched directory.
+ */
+const uint32_t watchMask = IN_CREATE | IN_DELETE | IN_MOVED_FROM | IN_MOVED_TO | IN_MODIFY | IN_CLOSE_WRITE | IN_ATTRIB;
+
+} // namespace
+
+/**
+ * @brief Creates an inotify instance watching the directory, and in subtree mode every directory below it.
+ * @param directory Directory whose entries are monitored.
+ * @param subtree Whether the entries of all subdirectories are monitored as well.
+ */
+DirectoryMonitor::DirectoryMonitor(const fs::path& directory, bool subtree) : root(directory), subtree(subtree) {
+    descriptor = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if (descriptor < 0) {
+        return;
+    }
+    int watch = inotify_add_watch(descriptor, directory.c_str(), watchMask);
+    if (watch < 0) {
+        close(descriptor);
+        descriptor = -1;
+        return;
+    }
+    watches[watch] = string();
+    if (subtree) {
+        addWatches(string());
+    }
+}
+
+/**
+ * @brief Adds watches for the directories below a directory. Adding a watch for a directory
+ * that already has one returns the existing descriptor, whose path is then updated, so this
+ * also repairs the paths of a subtree moved within the monitored tree.
+ * @param directory Relative path of the directory; empty for the root.
+ */
+void DirectoryMonitor::addWatches(const string& directory) {
+    fs::path start = directory.empty() ? root : root / directory;
+    if (!directory.empty()) {
+        int watch = inotify_add_watch(descriptor, start.c_str(), watchMask | IN_ONLYDIR);
+        if (watch < 0) {
+            return;
+        }
+        watches[watch] = directory;
+    }
+    error_code ec;
+    for (fs::recursive_directory_iterator it(start, fs::directory_options::skip_permission_denied, ec), end;
+        !ec && it != end; it.increment(ec)) {
+        if (!it->is_directory(ec) || it->is_symlink(ec)) {
+            continue;
+        }
+        int watch = inotify_add_watch(descriptor, it->path().c_str(), watchMask | IN_ONLYDIR);
+        if (watch >= 0) {
+            watches[watch] = it->path().lexically_relative(root).generic_string();
+        }
+    }
+}
+
+/**
+ * @brief Removes the watches for a directory and every directory below it, after it was moved out of the tree.
+ * @param directory Relative path of the directory.
+ */
+void DirectoryMonitor::removeWatches(const string& directory) {
+    for (auto it = watches.begin(); it != watches.end();) {
+        const string& path = it->second;
+        if (path == directory || (path.size() > directory.size() && path.compare(0, directory.size(), directory) == 0
+            && path[directory.size()] == '/')) {
+            inotify_rm_watch(descriptor, it->first);
+            it = watches.erase(it);
+        }
+        else {
+            ++it;
+        }
+    }
+}
+
+/**
+ * @brief Closes the inotify instance.
+ */
+DirectoryMonitor::~DirectoryMonitor() {
+    if (descriptor >= 0) {
+        close(descriptor);
+    }
+}
+
+/**
+ * @brief Reports whether changes are delivered by the operating system.
+ * @return False if the monitor only sleeps.
+ */
+bool DirectoryMonitor::isNative() const {
+    return descriptor >= 0;
+}
+
+/**
+ * @brief Waits for the inotify descriptor to become readable and drains all queued events.
+ * In subtree mode, watches follow directories created, moved in, moved out and removed, and
+ * the two halves of a rename within the tree, which share a cookie, become one MovedIn event.
+ * @param timeout Longest time to wait.
+ * @param events Receives the events; cleared first.
+ * @return True if any event arrived before the timeout.
+ */
+bool DirectoryMonitor::wait(chrono::milliseconds timeout, vector<ChangeEvent>& events) {
+    events.clear();
+    if (descriptor < 0) {
+        this_thread::sleep_for(timeout);
+        return false;
+    }
+    pollfd request = { descriptor, POLLIN, 0 };
+    if (poll(&request, 1, static_cast<int>(timeout.count())) <= 0) {
+        return false;
+    }
+
+    alignas(inotify_event) char buffer[65536];
+    unordered_map<uint32_t, size_t> movedFrom;
+    ssize_t length;
+    while ((length = read(descriptor, buffer, sizeof(buffer))) > 0) {
+        for (ssize_t offset = 0; offset < length;) {
+            const auto* event = reinterpret_cast<const inotify_event*>(buffer + offset);
+            offset += static_cast<ssize_t>(sizeof(inotify_event) + event->len);
+
+            if (event->mask & IN_IGNORED) {
+                watches.erase(event->wd);
+                continue;
+            }
+            string name = event->len > 0 ? string(event->name) : string();
+            auto watch = watches.find(event->wd);
+            if (watch != watches.end() && !watch->second.empty() && !name.empty()) {
+                name = watch->second + "/" + name;
+            }
+            if (subtree && (event->mask & IN_ISDIR)) {
+                if (event->mask & IN_MOVED_FROM) {
+                    removeWatches(name);
+                }
+                else if (event->mask & (IN_CREATE | IN_MOVED_TO)) {
+                    addWatches(name);
+                }
+            }
+
+            ChangeKind kind;
+            if (event->mask & IN_Q_OVERFLOW) {
+                kind = ChangeKind::Overflow;
+            }
+            else if (event->mask & IN_CREATE) {
+                kind = ChangeKind::Created;
+            }
+            else if (event->mask & IN_MOVED_TO) {
+                kind = ChangeKind::MovedIn;
+            }
+            else if (event->mask & (IN_DELETE | IN_MOVED_FROM)) {
+                kind = ChangeKind::Removed;
+            }
+            else if (event->mask & IN_CLOSE_WRITE) {
+                kind = ChangeKind::Closed;
+            }
+            else if (event->mask & IN_MODIFY) {
+                kind = ChangeKind::Modified;
+            }
+            else if (event->mask & IN_ATTRIB) {
+                kind = ChangeKind::Attributes;
+            }
+            else {
+                continue;
+            }
+
+            auto source = movedFrom.end();
+            if (event->mask & IN_MOVED_FROM) {
+                movedFrom[event->cookie] = events.size();
+            }
+            else if ((event->mask & IN_MOVED_TO) && (source = movedFrom.find(event->cookie)) != movedFrom.end()) {
+                events[source->second] = { kind, name, events[source->second].name };
+                movedFrom.erase(source);
+                continue;
+            }
+            events.push_back({ kind, name, string() });
+        }
+    }
+    return !events.empty();
+}
+
+#else
+
+/**
+ * @brief Constructs a monitor that only sleeps; no native facility is available.
+ */
+DirectoryMonitor::DirectoryMonitor(const fs::path&, bool) {}
+
+DirectoryMonitor::~DirectoryMonitor() {}
+
+/**
+ * @brief Reports whether changes are delivered by the operating system.
+ * @return Always false.
+ */
+bool DirectoryMonitor::isNative() const {
+    return false;
+}
+
+/**
+ * @brief Sleeps for the timeout.
+ * @param timeout Time to sleep.
+ * @param events Cleared.
+ * @return Always false.
+ */
+bool DirectoryMonitor::wait(chrono::milliseconds timeout, vector<ChangeEvent>& events) {
+    events.clear();
+    this_thread::sleep_for(timeout);
+    return false;
+}
+
+#endif
@@ -0,0 +1,111 @@
+/**
+ * @file DirectoryMonitor.h
+ * @brief Declares the DirectoryMonitor class, which reports changes to the entries of a directory or a tree.
+ */
+
+#ifndef DIRECTORY_MONITOR_H
+#define DIRECTORY_MONITOR_H
+
+#include <chrono>
+#include <filesystem>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+/**
+ * @brief Kind of change reported for a directory entry.
+ */
+enum class ChangeKind {
+    Created,    ///< The entry was created, or moved in where moves are not reported separately.
+    MovedIn,    ///< The entry was moved or renamed into the directory with its contents complete.
+    Removed,    ///< The entry was deleted or moved out of the directory.
+    Modified,   ///< The entry's contents were written.
+    Closed,     ///< A file opened for writing was closed. Only reported by inotify.
+    Attributes, ///< The entry's metadata changed.
+    Overflow    ///< Events were lost; the directory must be rescanned.
+};
+
+/**
+ * @struct ChangeEvent
+ * @brief One change to a directory entry.
+ */
+struct ChangeEvent {
+    ChangeKind kind;
+    std::string name; ///< Entry path relative to the monitored directory; empty for Overflow.
+    std::string from; ///< For MovedIn, the previous relative path if it was inside the monitored tree too.
+};
+
+/**
+ * @class DirectoryMonitor
+ * @brief Waits for changes to the entries of one directory.
+ *
+ * Linux uses inotify and Windows uses ReadDirectoryChangesW. Where neither is available,
+ * or the native facility cannot be set up, the monitor falls back to sleeping for the
+ * timeout, and callers must detect changes by checking the files themselves.
+ *
+ * A monitor can cover a whole subtree. Windows watches it natively; on Linux every
+ * directory gets its own inotify watch, added as directories are created or moved in and
+ * dropped as they are removed or moved out. A directory created and filled faster than its
+ * watch is added reports only its own creation, so callers should examine new directories
+ * themselves. A rename within the monitored tree is reported as one MovedIn event naming
+ * both paths.
+ */
+class DirectoryMonitor {
+public:
+    /**
+     * @brief Starts monitoring a directory.
+     * @param directory Directory whose entries are monitored.
+     * @param subtree Whether the entries of all subdirectories are monitored as well.
+     */
+    explicit DirectoryMonitor(const std::filesystem::path& directory, bool subtree = false);
+    ~DirectoryMonitor();
+
+    DirectoryMonitor(const DirectoryMonitor&) = delete;
+    DirectoryMonitor& operator=(const DirectoryMonitor&) = delete;
+
+    /**
+     * @brief Reports whether changes are delivered by the operating system.
+     * @return False if the monitor only sleeps.
+     */
+    bool isNative() const;
+
+    /**
+     * @brief Waits for changes and collects the events that have arrived.
+     * @param timeout Longest time to wait.
+     * @param events Receives the events; cleared first.
+     * @return True if any event arrived before the timeout.
+     */
+    bool wait(std::chrono::milliseconds timeout, std::vector<ChangeEvent>& events);
+
+private:
+#ifdef _WIN32
+    void* directoryHandle = nullptr;
+    void* eventHandle = nullptr;
+    void* overlapped = nullptr;
+    std::vector<unsigned long> buffer;
+    bool pending = false;
+    bool subtree = false;
+
+    /**
+     * @brief Queues the next asynchronous change request.
+     */
+    bool request();
+#else
+    int descriptor = -1;
+    std::filesystem::path root;
+    bool subtree = false;
+    std::unordered_map<int, std::string> watches; ///< Relative directory path of every watch descriptor.
+
+    /**
+     * @brief Adds watches for a directory and, in subtree mode, for every directory below it.
+     */
+    void addWatches(const std::string& directory);
+
+    /**
+     * @brief Removes the watches for a directory and every directory below it.
+     */
+    void removeWatches(const std::string& directory);
+#endif
+};
+
+#endif // DIRECTORY_MONITOR_H
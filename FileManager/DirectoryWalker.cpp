@@ -0,0 +1,660 @@
+/**
+ * @file DirectoryWalker.cpp
+ * @brief Implementation of the DirectoryWalker class for parallel directory traversal.
+ */
+
+#include "DirectoryWalker.h"
+#include "FileId.h"
+#include "Metrics.h"
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <exception>
+#include <memory>
+#include <mutex>
+#include <queue>
+#include <system_error>
+#include <thread>
+#include <utility>
+
+using namespace std;
+namespace fs = filesystem;
+
+namespace {
+
+/**
+ * @brief Checks whether the walker should descend into an entry.
+ * Without a visited set only real directories qualify. With one, symbolic links to
+ * directories qualify as well, provided the directory they lead to has not been
+ * visited yet; the directory is marked as visited.
+ * @param entry The entry to check.
+ * @param visited Identities of the directories visited so far, or null to ignore symbolic links.
+ * @return True if the walker should list the entry.
+ */
+bool isDescendable(const fs::directory_entry& entry, FileIdSet* visited) {
+    error_code ec;
+    if (!visited) {
+        return fs::is_directory(entry.symlink_status(ec));
+    }
+    if (!entry.is_directory(ec)) {
+        return false;
+    }
+    FileId id;
+    return getFileId(entry.path(), id) && visited->insert(id);
+}
+
+/**
+ * @brief Records an entry in a hard link index if it is a regular file with several links.
+ * @param entry The entry to record.
+ * @param hardLinks The index, or null if hard links are not tracked.
+ */
+void recordHardLink(const fs::directory_entry& entry, HardLinkIndex* hardLinks) {
+    error_code ec;
+    if (!hardLinks || !fs::is_regular_file(entry.symlink_status(ec))) {
+        return;
+    }
+    FileId id;
+    uint64_t linkCount = 0;
+    if (getFileId(entry.path(), id, &linkCount, false)) {
+        hardLinks->add(entry.path(), id, linkCount);
+    }
+}
+
+/**
+ * @brief Opens a directory for iteration.
+ * @param dir The directory to open.
+ * @param it Receives the iterator positioned at the first entry.
+ * @return False if the directory vanished and should be skipped.
+ * @throws fs::filesystem_error On errors other than a missing directory.
+ */
+bool openDirectory(const fs::path& dir, fs::directory_iterator& it) {
+    error_code ec;
+    it = fs::directory_iterator(dir, fs::directory_options::skip_permission_denied, ec);
+    if (!ec) {
+        return true;
+    }
+    if (ec == errc::no_such_file_or_directory || ec == errc::not_a_directory) {
+        return false;
+    }
+    throw fs::filesystem_error("Cannot open directory", dir, ec);
+}
+
+/**
+ * @brief Advances a directory iterator, throwing on failure.
+ * @param dir The directory being iterated, for error reporting.
+ * @param it The iterator to advance.
+ */
+void advanceIterator(const fs::path& dir, fs::directory_iterator& it) {
+    error_code ec;
+    it.increment(ec);
+    if (ec) {
+        throw fs::filesystem_error("Cannot read directory", dir, ec);
+    }
+}
+
+/**
+ * @brief A directory scheduled or listed during an ordered walk.
+ * All fields except path and key are guarded by the walk's mutex.
+ */
+struct OrderedNode {
+    fs::path path;
+    vector<uint32_t> key;                      ///< Position in tree order: sibling indices from the root.
+    bool listed = false;                       ///< Entries and children are ready.
+    bool cancelled = false;                    ///< The visitor skipped this subtree.
+    bool counted = false;                      ///< The node occupies a slot of the reorder window.
+    vector<fs::directory_entry> entries;       ///< Listing sorted by filename.
+    vector<shared_ptr<OrderedNode>> children;  ///< Child node per entry, null for non-directories.
+};
+
+/**
+ * @brief A directory in a bottom-up reduction. It is finished once its own listing and all
+ * its child directories are done; children keep their parent alive until then.
+ */
+struct ReduceNode {
+    fs::path path;
+    shared_ptr<ReduceNode> parent;
+    atomic<uint64_t> total{ 0 };
+    atomic<size_t> pending{ 1 };     ///< Own listing plus unfinished child directories.
+    atomic<bool> complete{ true };   ///< Whether the listing covered every entry.
+};
+
+/**
+ * @brief Orders the pending queue so the node earliest in tree order is on top.
+ */
+struct LaterInTreeOrder {
+    bool operator()(const shared_ptr<OrderedNode>& a, const shared_ptr<OrderedNode>& b) const {
+        return a->key > b->key;
+    }
+};
+
+} // namespace
+
+/**
+ * @brief Constructs a walker with the given options.
+ * @param options Traversal options.
+ */
+DirectoryWalker::DirectoryWalker(const WalkOptions& options) : options(options) {}
+
+/**
+ * @brief Returns the number of worker threads a walk uses.
+ * @return The configured thread count, or the hardware concurrency if none was configured.
+ */
+unsigned DirectoryWalker::threadCount() const {
+    if (options.threads != 0) {
+        return options.threads;
+    }
+    return max(1u, thread::hardware_concurrency());
+}
+
+/**
+ * @brief Checks whether the configured deadline has passed.
+ * @return True if a deadline is set and the current time is at or past it.
+ */
+bool DirectoryWalker::expired() const {
+    return options.deadline != chrono::steady_clock::time_point::max() && chrono::steady_clock::now() >= options.deadline;
+}
+
+/**
+ * @brief Walks the trees below the given roots.
+ * @param roots Directories to walk.
+ * @param visitor Callback invoked for every entry.
+ * @return True if the walk completed, false if the visitor stopped it or the deadline passed.
+ */
+bool DirectoryWalker::walk(const vector<fs::path>& roots, const Visitor& visitor) {
+    if (roots.empty()) {
+        return true;
+    }
+
+    unique_ptr<FileIdSet> visited;
+    if (options.followSymlinks) {
+        visited = make_unique<FileIdSet>();
+        for (const auto& root : roots) {
+            FileId id;
+            if (getFileId(root, id)) {
+                visited->insert(id);
+            }
+        }
+    }
+    return options.ordered ? walkOrdered(roots, visitor, visited.get()) : walkUnordered(roots, visitor, visited.get());
+}
+
+/**
+ * @brief Unordered walk: workers share a stack of pending directories and visit entries as they list them.
+ * @param roots Directories to walk.
+ * @param visitor Callback invoked concurrently for every entry.
+ * @param visited Identities of the directories visited so far when following symbolic links, or null.
+ * @return True if the walk completed, false if the visitor stopped it or the deadline passed.
+ */
+bool DirectoryWalker::walkUnordered(const vector<fs::path>& roots, const Visitor& visitor, FileIdSet* visited) {
+    mutex lock;
+    condition_variable ready;
+    vector<fs::path> pending(roots.rbegin(), roots.rend());
+    size_t active = 0;
+    atomic<bool> stopped{ false };
+    bool interrupted = false;
+    exception_ptr failure;
+
+    auto work = [&](unsigned worker) {
+        while (true) {
+            fs::path dir;
+            {
+                unique_lock<mutex> guard(lock);
+                ready.wait(guard, [&]() { return stopped || !pending.empty() || active == 0; });
+                if (stopped || pending.empty()) {
+                    return;
+                }
+                dir = move(pending.back());
+                pending.pop_back();
+                ++active;
+            }
+
+            vector<fs::path> subdirs;
+            bool stop = false;
+            uint64_t listed = 0;
+            exception_ptr error;
+            try {
+                fs::directory_iterator it;
+                if (openDirectory(dir, it)) {
+                    for (fs::directory_iterator end; it != end && !stopped; advanceIterator(dir, it)) {
+                        if (expired()) {
+                            stop = true;
+                            break;
+                        }
+                        ++listed;
+                        recordHardLink(*it, options.hardLinks);
+                        WalkAction action = visitor(*it, worker);
+                        if (action == WalkAction::Stop) {
+                            stop = true;
+                            break;
+                        }
+                        if (action == WalkAction::Continue && isDescendable(*it, visited)) {
+                            subdirs.push_back(it->path());
+                        }
+                    }
+                }
+            }
+            catch (...) {
+                error = current_exception();
+            }
+            Metrics::getInstance().addEntriesVisited(listed);
+
+            bool wakeAll;
+            {
+                lock_guard<mutex> guard(lock);
+                --active;
+                if (error && !failure) {
+                    failure = error;
+                }
+                if (stop) {
+                    interrupted = true;
+                }
+                if (stop || error) {
+                    stopped = true;
+                }
+                else {
+                    // Reverse so siblings are popped in listing order.
+                    pending.insert(pending.end(), make_move_iterator(subdirs.rbegin()), make_move_iterator(subdirs.rend()));
+                }
+                wakeAll = stopped || (pending.empty() && active == 0);
+            }
+            if (wakeAll || subdirs.size() > 1) {
+                ready.notify_all();
+            }
+            else if (!subdirs.empty()) {
+                ready.notify_one();
+            }
+        }
+    };
+
+    vector<thread> workers;
+    for (unsigned i = 1; i < threadCount(); ++i) {
+        workers.emplace_back(work, i);
+    }
+    work(0);
+    for (auto& worker : workers) {
+        worker.join();
+    }
+
+    if (failure) {
+        rethrow_exception(failure);
+    }
+    return !interrupted;
+}
+
+/**
+ * @brief Ordered walk: workers list and sort directories ahead of time, preferring the directory
+ * earliest in tree order, while the calling thread replays the sorted listings depth-first.
+ *
+ * At most reorderWindow directories are listed but not yet replayed. When the window is full,
+ * workers only take the directory the replay is waiting for, which is always the earliest
+ * pending node, so the replay never stalls on a full window.
+ *
+ * @param roots Directories to walk.
+ * @param visitor Callback invoked on the calling thread for every entry, in tree order.
+ * @param visited Identities of the directories visited so far when following symbolic links, or null.
+ * @return True if the walk completed, false if the visitor stopped it or the deadline passed.
+ */
+bool DirectoryWalker::walkOrdered(const vector<fs::path>& roots, const Visitor& visitor, FileIdSet* visited) {
+    using Node = shared_ptr<OrderedNode>;
+
+    mutex lock;
+    condition_variable workReady;
+    condition_variable nodeListed;
+    priority_queue<Node, vector<Node>, LaterInTreeOrder> pending;
+    size_t window = max<size_t>(1, options.reorderWindow);
+    size_t buffered = 0;
+    Node awaited;
+    atomic<bool> finished{ false };
+    bool interrupted = false;
+    exception_ptr failure;
+
+    vector<Node> rootNodes;
+    for (size_t i = 0; i < roots.size(); ++i) {
+        auto node = make_shared<OrderedNode>();
+        node->path = roots[i];
+        node->key.push_back(static_cast<uint32_t>(i));
+        rootNodes.push_back(node);
+        pending.push(node);
+    }
+
+    // Releases a node's window slot; the caller holds the lock.
+    auto release = [&](OrderedNode& node) {
+        if (node.counted) {
+            node.counted = false;
+            --buffered;
+        }
+        node.entries.clear();
+        node.entries.shrink_to_fit();
+    };
+
+    // Cancels a skipped subtree, including any descendants already listed; the caller holds the lock.
+    function<void(OrderedNode&)> cancel = [&](OrderedNode& node) {
+        node.cancelled = true;
+        for (auto& child : node.children) {
+            if (child) {
+                cancel(*child);
+            }
+        }
+        node.children.clear();
+        release(node);
+    };
+
+    auto work = [&]() {
+        while (true) {
+            Node node;
+            {
+                unique_lock<mutex> guard(lock);
+                while (true) {
+                    if (finished || interrupted || failure) {
+                        return;
+                    }
+                    while (!pending.empty() && pending.top()->cancelled) {
+                        pending.pop();
+                    }
+                    if (!pending.empty() && (buffered < window || pending.top() == awaited)) {
+                        break;
+                    }
+                    workReady.wait(guard);
+                }
+                node = pending.top();
+                pending.pop();
+                node->counted = true;
+                ++buffered;
+            }
+
+            vector<pair<fs::path::string_type, fs::directory_entry>> listing;
+            vector<bool> descend;
+            bool expiredWhileListing = false;
+            exception_ptr error;
+            try {
+                fs::directory_iterator it;
+                if (openDirectory(node->path, it)) {
+                    for (fs::directory_iterator end; it != end && !finished; advanceIterator(node->path, it)) {
+                        if (expired()) {
+                            expiredWhileListing = true;
+                            break;
+                        }
+                        listing.emplace_back(it->path().filename().native(), *it);
+                    }
+                }
+                Metrics::getInstance().addEntriesVisited(listing.size());
+                sort(listing.begin(), listing.end(), [](const auto& a, const auto& b) { return a.first < b.first; });
+                for (const auto& item : listing) {
+                    recordHardLink(item.second, options.hardLinks);
+                    descend.push_back(isDescendable(item.second, visited));
+                }
+            }
+            catch (...) {
+                error = current_exception();
+            }
+
+            {
+                lock_guard<mutex> guard(lock);
+                if (error) {
+                    if (!failure) {
+                        failure = error;
+                    }
+                }
+                else if (expiredWhileListing) {
+                    interrupted = true;
+                }
+                else if (node->cancelled) {
+                    release(*node);
+                }
+                else {
+                    node->entries.reserve(listing.size());
+                    node->children.resize(listing.size());
+                    for (size_t i = 0; i < listing.size(); ++i) {
+                        node->entries.push_back(move(listing[i].second));
+                        if (descend[i]) {
+                            auto child = make_shared<OrderedNode>();
+                            child->path = node->entries.back().path();
+                            child->key = node->key;
+                            child->key.push_back(static_cast<uint32_t>(i));
+                            node->children[i] = child;
+                            pending.push(child);
+                        }
+                    }
+                    node->listed = true;
+                }
+            }
+            nodeListed.notify_one();
+            workReady.notify_all();
+        }
+    };
+
+    vector<thread> workers;
+    for (unsigned i = 0; i < threadCount(); ++i) {
+        workers.emplace_back(work);
+    }
+
+    auto shutdown = [&]() {
+        {
+            lock_guard<mutex> guard(lock);
+            finished = true;
+        }
+        workReady.notify_all();
+        for (auto& worker : workers) {
+            worker.join();
+        }
+    };
+
+    bool stopped = false;
+    try {
+        struct Frame {
+            Node node;
+            size_t next;
+        };
+        vector<Frame> stack;
+
+        // Waits until a node is listed; returns false if a worker failed or the deadline passed.
+        auto waitListed = [&](const Node& node) {
+            unique_lock<mutex> guard(lock);
+            if (!node->listed && !failure && !interrupted) {
+                awaited = node;
+                workReady.notify_all();
+                auto ready = [&]() { return node->listed || failure || interrupted; };
+                if (options.deadline == chrono::steady_clock::time_point::max()) {
+                    nodeListed.wait(guard, ready);
+                }
+                else if (!nodeListed.wait_until(guard, options.deadline, ready)) {
+                    interrupted = true;
+                }
+                awaited.reset();
+            }
+            return node->listed && !failure;
+        };
+
+        for (auto rootIt = rootNodes.begin(); rootIt != rootNodes.end() && !stopped; ++rootIt) {
+            stack.push_back({ *rootIt, 0 });
+            stopped = !waitListed(*rootIt);
+            while (!stopped && !stack.empty()) {
+                Frame& frame = stack.back();
+                OrderedNode& node = *frame.node;
+                if (frame.next == node.entries.size()) {
+                    {
+                        lock_guard<mutex> guard(lock);
+                        node.children.clear();
+                        release(node);
+                    }
+                    workReady.notify_all();
+                    stack.pop_back();
+                    continue;
+                }
+
+                if (expired()) {
+                    stopped = true;
+                    break;
+                }
+                size_t index = frame.next++;
+                WalkAction action = visitor(node.entries[index], 0);
+                if (action == WalkAction::Stop) {
+                    stopped = true;
+                    break;
+                }
+
+                Node child = node.children[index];
+                if (!child) {
+                    continue;
+                }
+                if (action == WalkAction::SkipSubtree) {
+                    lock_guard<mutex> guard(lock);
+                    cancel(*child);
+                    node.children[index].reset();
+                    continue;
+                }
+                stack.push_back({ child, 0 });
+                stopped = !waitListed(child);
+            }
+            stack.clear();
+        }
+    }
+    catch (...) {
+        shutdown();
+        throw;
+    }
+    shutdown();
+
+    if (failure) {
+        rethrow_exception(failure);
+    }
+    return !stopped;
+}
+
+/**
+ * @brief Computes a value bottom-up over the tree below a root in a parallel post-order walk.
+ * Workers share a stack of directories to list. Listing a directory adds the contributions of
+ * its non-directory entries to its total and schedules its subdirectories; each directory
+ * counts its own listing plus its unfinished children, and the worker that brings that count
+ * to zero finishes the directory and adds its value to the parent, continuing upwards.
+ * @param root Directory to walk.
+ * @param entryValue Callback for non-directory entries.
+ * @param directoryValue Callback for finished directories below the root.
+ * @param total Receives the sum of the contributions of the root's entries.
+ * @return True if the walk completed, false if the deadline passed.
+ */
+bool DirectoryWalker::reduce(const fs::path& root, const EntryValue& entryValue, const DirectoryValue& directoryValue,
+    uint64_t& total) {
+    mutex lock;
+    condition_variable ready;
+    auto rootNode = make_shared<ReduceNode>();
+    rootNode->path = root;
+    vector<shared_ptr<ReduceNode>> pending{ rootNode };
+    size_t active = 0;
+    atomic<bool> stopped{ false };
+    bool interrupted = false;
+    exception_ptr failure;
+    total = 0;
+
+    // Counts down a node and every ancestor it completes, invoking the directory callback.
+    auto finish = [&](shared_ptr<ReduceNode> node, unsigned worker) {
+        while (!stopped && node->pending.fetch_sub(1, memory_order_acq_rel) == 1) {
+            if (!node->parent) {
+                total = node->total.load(memory_order_relaxed);
+                return;
+            }
+            uint64_t value = directoryValue(node->path, node->total.load(memory_order_relaxed),
+                node->complete.load(memory_order_relaxed), worker);
+            node->parent->total.fetch_add(value, memory_order_relaxed);
+            node = node->parent;
+        }
+    };
+
+    auto work = [&](unsigned worker) {
+        while (true) {
+            shared_ptr<ReduceNode> node;
+            {
+                unique_lock<mutex> guard(lock);
+                ready.wait(guard, [&]() { return stopped || !pending.empty() || active == 0; });
+                if (stopped || pending.empty()) {
+                    return;
+                }
+                node = move(pending.back());
+                pending.pop_back();
+                ++active;
+            }
+
+            vector<shared_ptr<ReduceNode>> children;
+            bool stop = false;
+            exception_ptr error;
+            try {
+                error_code ec;
+                fs::directory_iterator it(node->path, ec);
+                if (ec) {
+                    if (ec != errc::permission_denied && ec != errc::no_such_file_or_directory && ec != errc::not_a_directory) {
+                        throw fs::filesystem_error("Cannot open directory", node->path, ec);
+                    }
+                    node->complete = false;
+                }
+                uint64_t sum = 0;
+                uint64_t listed = 0;
+                for (fs::directory_iterator end; it != end; advanceIterator(node->path, it)) {
+                    if (stopped || expired()) {
+                        stop = true;
+                        break;
+                    }
+                    ++listed;
+                    if (fs::is_directory(it->symlink_status(ec))) {
+                        auto child = make_shared<ReduceNode>();
+                        child->path = it->path();
+                        child->parent = node;
+                        children.push_back(move(child));
+                    }
+                    else {
+                        recordHardLink(*it, options.hardLinks);
+                        sum += entryValue(*it, worker);
+                    }
+                }
+                Metrics::getInstance().addEntriesVisited(listed);
+                node->total.fetch_add(sum, memory_order_relaxed);
+                node->pending.fetch_add(children.size(), memory_order_relaxed);
+                if (!stop) {
+                    finish(node, worker);
+                }
+            }
+            catch (...) {
+                error = current_exception();
+            }
+
+            bool wakeAll;
+            {
+                lock_guard<mutex> guard(lock);
+                --active;
+                if (error && !failure) {
+                    failure = error;
+                }
+                if (stop) {
+                    interrupted = true;
+                }
+                if (stop || error) {
+                    stopped = true;
+                }
+                else {
+                    pending.insert(pending.end(), make_move_iterator(children.begin()), make_move_iterator(children.end()));
+                }
+                wakeAll = stopped || (pending.empty() && active == 0);
+            }
+            if (wakeAll || children.size() > 1) {
+                ready.notify_all();
+            }
+            else if (!children.empty()) {
+                ready.notify_one();
+            }
+        }
+    };
+
+    vector<thread> workers;
+    for (unsigned i = 1; i < threadCount(); ++i) {
+        workers.emplace_back(work, i);
+    }
+    work(0);
+    for (auto& worker : workers) {
+        worker.join();
+    }
+
+    if (failure) {
+        rethrow_exception(failure);
+    }
+    return !interrupted;
+}
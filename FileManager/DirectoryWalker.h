@@ -0,0 +1,172 @@
+/**
+ * @file DirectoryWalker.h
+ * @brief Declares the DirectoryWalker class, which traverses directory trees with a pool of worker threads.
+ */
+
+#ifndef DIRECTORY_WALKER_H
+#define DIRECTORY_WALKER_H
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <functional>
+#include <vector>
+
+class FileIdSet;
+class HardLinkIndex;
+
+/**
+ * @brief Tells the walker how to proceed after an entry has been visited.
+ */
+enum class WalkAction {
+    Continue,    ///< Keep walking and descend into the entry if it is a directory.
+    SkipSubtree, ///< Keep walking, but do not descend into this directory.
+    Stop         ///< Abandon the whole walk.
+};
+
+/**
+ * @struct WalkOptions
+ * @brief Tunes how a DirectoryWalker traverses the tree.
+ */
+struct WalkOptions {
+    /**
+     * @brief Number of worker threads; 0 selects the hardware concurrency.
+     */
+    unsigned threads = 0;
+
+    /**
+     * @brief Visit entries in lexicographic tree order instead of discovery order.
+     */
+    bool ordered = true;
+
+    /**
+     * @brief In ordered mode, the maximum number of directories listed ahead of the visitor.
+     */
+    std::size_t reorderWindow = 1024;
+
+    /**
+     * @brief Descend into symbolic links to directories. Every directory is then identified by
+     * device and inode, and one already visited through another path is not entered again,
+     * which breaks cycles and keeps aliased subtrees from being walked twice. Which of two
+     * aliased paths gets walked depends on which worker reaches it first.
+     */
+    bool followSymlinks = false;
+
+    /**
+     * @brief Optional index receiving every regular file with more than one hard link as its
+     * directory is listed, so callers can recognize the paths that share one file. Recording
+     * costs one extra stat per regular file. In ordered mode directories are listed ahead of
+     * the visitor, so files in subtrees the visitor later skips may be recorded as well.
+     */
+    HardLinkIndex* hardLinks = nullptr;
+
+    /**
+     * @brief Point in time at which the walk is abandoned; the default never expires.
+     */
+    std::chrono::steady_clock::time_point deadline = std::chrono::steady_clock::time_point::max();
+};
+
+/**
+ * @class DirectoryWalker
+ * @brief Parallel recursive directory traversal.
+ *
+ * Directories are listed by a pool of worker threads. Symbolic links are reported
+ * but only followed on request, and directories that cannot be read because of missing
+ * permissions or that vanish during the walk are skipped. A walk ends early when the
+ * visitor returns WalkAction::Stop or when the configured deadline passes; directories
+ * still being listed at that point are abandoned.
+ *
+ * In unordered mode the visitor runs concurrently on the workers as entries are
+ * discovered. In ordered mode the workers list directories ahead of the visitor and
+ * sort every listing by name, and the calling thread merges those sorted runs into
+ * lexicographic tree order: each directory's subtree directly follows the directory,
+ * and roots are visited in the order given.
+ */
+class DirectoryWalker {
+public:
+    /**
+     * @brief Callback invoked for every entry below the roots.
+     * The second argument is the index of the worker running the callback, in
+     * [0, threadCount()); in ordered mode it is always 0.
+     */
+    using Visitor = std::function<WalkAction(const std::filesystem::directory_entry& entry, unsigned worker)>;
+
+    /**
+     * @brief Constructs a walker.
+     * @param options Traversal options.
+     */
+    explicit DirectoryWalker(const WalkOptions& options = WalkOptions());
+
+    /**
+     * @brief Returns the number of worker threads a walk uses.
+     * @return Worker thread count.
+     */
+    unsigned threadCount() const;
+
+    /**
+     * @brief Walks the trees below the given roots. The roots themselves are not visited.
+     * @param roots Directories to walk.
+     * @param visitor Callback invoked for every entry.
+     * @return True if the walk completed, false if the visitor stopped it or the deadline passed.
+     * @throws std::filesystem::filesystem_error If a directory cannot be read for a reason
+     * other than missing permissions; exceptions thrown by the visitor are propagated as well.
+     */
+    bool walk(const std::vector<std::filesystem::path>& roots, const Visitor& visitor);
+
+    /**
+     * @brief Callback for reduce returning what a non-directory entry, including a symbolic
+     * link, contributes to the total of its directory.
+     */
+    using EntryValue = std::function<std::uint64_t(const std::filesystem::directory_entry& entry, unsigned worker)>;
+
+    /**
+     * @brief Callback for reduce, invoked once a directory and everything below it have been
+     * processed. It receives the sum of the contributions of the directory's entries and whether
+     * the directory could be listed completely, and returns what the directory contributes to
+     * the total of its parent. It may modify or remove the directory.
+     */
+    using DirectoryValue = std::function<std::uint64_t(const std::filesystem::path& directory, std::uint64_t total,
+        bool complete, unsigned worker)>;
+
+    /**
+     * @brief Computes a value bottom-up over the tree below a root in a parallel post-order walk.
+     * Every directory is finished by whichever worker completes its last pending child, so
+     * values propagate upwards as soon as they are known and no second pass is needed.
+     * Symbolic links are never followed, and the ordering options do not apply; hard links
+     * are recorded if requested.
+     * @param root Directory to walk; directoryValue is not invoked for it.
+     * @param entryValue Callback for non-directory entries.
+     * @param directoryValue Callback for finished directories below the root.
+     * @param total Receives the sum of the contributions of the root's entries.
+     * @return True if the walk completed, false if the deadline passed. Once the walk is
+     * abandoned, directoryValue is not invoked again, so no directory is judged on a partial listing.
+     * @throws std::filesystem::filesystem_error If a directory cannot be read for a reason other
+     * than missing permissions; exceptions thrown by the callbacks are propagated as well.
+     */
+    bool reduce(const std::filesystem::path& root, const EntryValue& entryValue, const DirectoryValue& directoryValue,
+        std::uint64_t& total);
+
+private:
+    /**
+     * @brief Walk implementation for unordered mode.
+     */
+    bool walkUnordered(const std::vector<std::filesystem::path>& roots, const Visitor& visitor, FileIdSet* visited);
+
+    /**
+     * @brief Walk implementation for ordered mode.
+     */
+    bool walkOrdered(const std::vector<std::filesystem::path>& roots, const Visitor& visitor, FileIdSet* visited);
+
+    /**
+     * @brief Checks whether the configured deadline has passed.
+     */
+    bool expired() const;
+
+    /**
+     * @brief Traversal options.
+     */
+    WalkOptions options;
+};
+
+#endif // DIRECTORY_WALKER_H
@@ -0,0 +1,315 @@
+/**
+ * @file EncodingConverter.cpp
+ * @brief Implementation of the Windows-1251 and UTF-8 transcoder and validator.
+ */
+
+#include "EncodingConverter.h"
+#include <array>
+#include <cstring>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define ENCODING_CONVERTER_SSE2
+#include <emmintrin.h>
+#endif
+
+using namespace std;
+
+namespace {
+
+/**
+ * @brief Unicode code points of the Windows-1251 bytes 0x80 to 0xFF.
+ * The unassigned byte 0x98 maps to U+0098 so that every byte survives a round trip.
+ */
+const uint16_t cp1251CodePoints[128] = {
+    0x0402, 0x0403, 0x201A, 0x0453, 0x201E, 0x2026, 0x2020, 0x2021,
+    0x20AC, 0x2030, 0x0409, 0x2039, 0x040A, 0x040C, 0x040B, 0x040F,
+    0x0452, 0x2018, 0x2019, 0x201C, 0x201D, 0x2022, 0x2013, 0x2014,
+    0x0098, 0x2122, 0x0459, 0x203A, 0x045A, 0x045C, 0x045B, 0x045F,
+    0x00A0, 0x040E, 0x045E, 0x0408, 0x00A4, 0x0490, 0x00A6, 0x00A7,
+    0x0401, 0x00A9, 0x0404, 0x00AB, 0x00AC, 0x00AD, 0x00AE, 0x0407,
+    0x00B0, 0x00B1, 0x0406, 0x0456, 0x0491, 0x00B5, 0x00B6, 0x00B7,
+    0x0451, 0x2116, 0x0454, 0x00BB, 0x0458, 0x0405, 0x0455, 0x0457,
+    0x0410, 0x0411, 0x0412, 0x0413, 0x0414, 0x0415, 0x0416, 0x0417,
+    0x0418, 0x0419, 0x041A, 0x041B, 0x041C, 0x041D, 0x041E, 0x041F,
+    0x0420, 0x0421, 0x0422, 0x0423, 0x0424, 0x0425, 0x0426, 0x0427,
+    0x0428, 0x0429, 0x042A, 0x042B, 0x042C, 0x042D, 0x042E, 0x042F,
+    0x0430, 0x0431, 0x0432, 0x0433, 0x0434, 0x0435, 0x0436, 0x0437,
+    0x0438, 0x0439, 0x043A, 0x043B, 0x043C, 0x043D, 0x043E, 0x043F,
+    0x0440, 0x0441, 0x0442, 0x0443, 0x0444, 0x0445, 0x0446, 0x0447,
+    0x0448, 0x0449, 0x044A, 0x044B, 0x044C, 0x044D, 0x044E, 0x044F,
+};
+
+/**
+ * @brief Pre-encoded UTF-8 form of one Windows-1251 byte.
+ */
+struct Utf8Bytes {
+    unsigned char length;
+    char bytes[3];
+};
+
+/**
+ * @brief Returns the UTF-8 encodings of the Windows-1251 bytes 0x80 to 0xFF.
+ * @return Table indexed by byte value minus 0x80.
+ */
+const array<Utf8Bytes, 128>& utf8Table() {
+    static const array<Utf8Bytes, 128> table = []() {
+        array<Utf8Bytes, 128> result{};
+        for (size_t i = 0; i < 128; ++i) {
+            uint32_t codePoint = cp1251CodePoints[i];
+            if (codePoint < 0x800) {
+                result[i].length = 2;
+                result[i].bytes[0] = static_cast<char>(0xC0 | (codePoint >> 6));
+                result[i].bytes[1] = static_cast<char>(0x80 | (codePoint & 0x3F));
+            }
+            else {
+                result[i].length = 3;
+                result[i].bytes[0] = static_cast<char>(0xE0 | (codePoint >> 12));
+                result[i].bytes[1] = static_cast<char>(0x80 | ((codePoint >> 6) & 0x3F));
+                result[i].bytes[2] = static_cast<char>(0x80 | (codePoint & 0x3F));
+            }
+        }
+        return result;
+    }();
+    return table;
+}
+
+/**
+ * @brief Highest code point Windows-1251 can represent, plus one.
+ */
+constexpr size_t reverseTableSize = 0x2123;
+
+/**
+ * @brief Returns the Windows-1251 byte for every code point below reverseTableSize.
+ * @return Table indexed by code point; 0 marks characters Windows-1251 cannot represent.
+ */
+const array<unsigned char, reverseTableSize>& cp1251Table() {
+    static const array<unsigned char, reverseTableSize> table = []() {
+        array<unsigned char, reverseTableSize> result{};
+        for (size_t i = 0; i < 128; ++i) {
+            result[cp1251CodePoints[i]] = static_cast<unsigned char>(0x80 + i);
+        }
+        return result;
+    }();
+    return table;
+}
+
+} // namespace
+
+/**
+ * @brief Returns the length of the leading run of ASCII bytes.
+ * Sixteen bytes are tested per step with SSE2 where available, eight per step otherwise.
+ * @param data Bytes to examine.
+ * @param size Number of bytes.
+ * @return Number of leading bytes below 0x80.
+ */
+size_t EncodingConverter::asciiPrefixLength(const char* data, size_t size) {
+    size_t i = 0;
+#ifdef ENCODING_CONVERTER_SSE2
+    for (; i + 16 <= size; i += 16) {
+        __m128i block = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + i));
+        if (_mm_movemask_epi8(block) != 0) {
+            break;
+        }
+    }
+#endif
+    for (; i + 8 <= size; i += 8) {
+        uint64_t word;
+        memcpy(&word, data + i, sizeof(word));
+        if ((word & 0x8080808080808080ULL) != 0) {
+            break;
+        }
+    }
+    while (i < size && (static_cast<unsigned char>(data[i]) & 0x80) == 0) {
+        ++i;
+    }
+    return i;
+}
+
+/**
+ * @brief Decodes one UTF-8 sequence.
+ * @param data Bytes starting at the sequence.
+ * @param size Number of bytes available.
+ * @param codePoint Receives the decoded code point.
+ * @return Length of the sequence, 0 if it is cut off by the end of the data, or -1 if it is malformed.
+ */
+int EncodingConverter::decodeUtf8(const unsigned char* data, size_t size, uint32_t& codePoint) {
+    unsigned char lead = data[0];
+    int length;
+    if (lead < 0x80) {
+        codePoint = lead;
+        return 1;
+    }
+    if (lead < 0xC2) {
+        return -1;
+    }
+    if (lead < 0xE0) {
+        length = 2;
+        codePoint = lead & 0x1F;
+    }
+    else if (lead < 0xF0) {
+        length = 3;
+        codePoint = lead & 0x0F;
+    }
+    else if (lead < 0xF5) {
+        length = 4;
+        codePoint = lead & 0x07;
+    }
+    else {
+        return -1;
+    }
+
+    for (int i = 1; i < length; ++i) {
+        if (static_cast<size_t>(i) >= size) {
+            return 0;
+        }
+        if ((data[i] & 0xC0) != 0x80) {
+            return -1;
+        }
+        codePoint = (codePoint << 6) | (data[i] & 0x3F);
+    }
+
+    if (length == 3 && (codePoint < 0x800 || (codePoint >= 0xD800 && codePoint <= 0xDFFF))) {
+        return -1;
+    }
+    if (length == 4 && (codePoint < 0x10000 || codePoint > 0x10FFFF)) {
+        return -1;
+    }
+    return length;
+}
+
+/**
+ * @brief Checks whether a complete buffer is well-formed UTF-8.
+ * @param data Bytes to examine.
+ * @param size Number of bytes.
+ * @return True if the buffer is valid UTF-8.
+ */
+bool EncodingConverter::isValidUtf8(const char* data, size_t size) {
+    Utf8Validator validator;
+    validator.feed(data, size);
+    return validator.finish();
+}
+
+/**
+ * @brief Converts Windows-1251 text to UTF-8, copying ASCII runs in bulk.
+ * @param data Windows-1251 bytes.
+ * @param size Number of bytes.
+ * @param output String the UTF-8 text is appended to.
+ */
+void EncodingConverter::cp1251ToUtf8(const char* data, size_t size, string& output) {
+    const auto& table = utf8Table();
+    output.reserve(output.size() + size + size / 2);
+    size_t i = 0;
+    while (i < size) {
+        size_t run = asciiPrefixLength(data + i, size - i);
+        output.append(data + i, run);
+        i += run;
+        while (i < size && (static_cast<unsigned char>(data[i]) & 0x80) != 0) {
+            const Utf8Bytes& encoded = table[static_cast<unsigned char>(data[i]) - 0x80];
+            output.append(encoded.bytes, encoded.length);
+            ++i;
+        }
+    }
+}
+
+/**
+ * @brief Converts UTF-8 text to Windows-1251, copying ASCII runs in bulk.
+ * @param data UTF-8 bytes.
+ * @param size Number of bytes.
+ * @param output String the Windows-1251 text is appended to.
+ * @param consumed Receives the number of input bytes converted.
+ * @return False if the input is malformed or contains a character Windows-1251 cannot represent.
+ */
+bool EncodingConverter::utf8ToCp1251(const char* data, size_t size, string& output, size_t& consumed) {
+    const auto& table = cp1251Table();
+    const auto* bytes = reinterpret_cast<const unsigned char*>(data);
+    output.reserve(output.size() + size);
+    size_t i = 0;
+    while (i < size) {
+        size_t run = asciiPrefixLength(data + i, size - i);
+        output.append(data + i, run);
+        i += run;
+        if (i == size) {
+            break;
+        }
+
+        uint32_t codePoint;
+        int length = decodeUtf8(bytes + i, size - i, codePoint);
+        if (length == 0) {
+            break;
+        }
+        if (length < 0 || codePoint >= reverseTableSize || table[codePoint] == 0) {
+            consumed = i;
+            return false;
+        }
+        output.push_back(static_cast<char>(table[codePoint]));
+        i += static_cast<size_t>(length);
+    }
+    consumed = i;
+    return true;
+}
+
+/**
+ * @brief Validates the next chunk of the stream.
+ * A sequence cut off at the end of a chunk is kept and completed with the next chunk.
+ * @param data Bytes of the chunk.
+ * @param size Number of bytes.
+ */
+void Utf8Validator::feed(const char* data, size_t size) {
+    const auto* bytes = reinterpret_cast<const unsigned char*>(data);
+    size_t i = 0;
+    if (!valid) {
+        return;
+    }
+
+    uint32_t codePoint;
+    while (pendingSize > 0 && i < size) {
+        pending[pendingSize++] = bytes[i++];
+        int length = EncodingConverter::decodeUtf8(pending, pendingSize, codePoint);
+        if (length < 0) {
+            valid = false;
+            return;
+        }
+        if (length > 0) {
+            pendingSize = 0;
+        }
+    }
+
+    while (i < size) {
+        i += EncodingConverter::asciiPrefixLength(data + i, size - i);
+        if (i == size) {
+            break;
+        }
+        nonAscii = true;
+        int length = EncodingConverter::decodeUtf8(bytes + i, size - i, codePoint);
+        if (length < 0) {
+            valid = false;
+            return;
+        }
+        if (length == 0) {
+            pendingSize = size - i;
+            memcpy(pending, bytes + i, pendingSize);
+            return;
+        }
+        i += static_cast<size_t>(length);
+    }
+}
+
+/**
+ * @brief Ends the stream.
+ * @return True if the whole stream was valid UTF-8 and no sequence was left incomplete.
+ */
+bool Utf8Validator::finish() {
+    if (pendingSize > 0) {
+        valid = false;
+        pendingSize = 0;
+    }
+    return valid;
+}
+
+/**
+ * @brief Reports whether any byte seen so far was outside the ASCII range.
+ * @return True if non-ASCII bytes were seen.
+ */
+bool Utf8Validator::hasNonAscii() const {
+    return nonAscii;
+}
@@ -0,0 +1,110 @@
+/**
+ * @file EncodingConverter.h
+ * @brief Declares the EncodingConverter and Utf8Validator classes for Windows-1251 and UTF-8 text.
+ */
+
+#ifndef ENCODING_CONVERTER_H
+#define ENCODING_CONVERTER_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+/**
+ * @brief Direction of an encoding conversion.
+ */
+enum class EncodingDirection {
+    Cp1251ToUtf8, ///< Windows-1251 to UTF-8.
+    Utf8ToCp1251  ///< UTF-8 to Windows-1251.
+};
+
+/**
+ * @class EncodingConverter
+ * @brief Table-driven transcoder between Windows-1251 and UTF-8.
+ *
+ * Runs of ASCII bytes, which are identical in both encodings, are detected
+ * sixteen bytes at a time with SSE2 where available and copied in bulk; only
+ * the remaining bytes go through the lookup tables.
+ */
+class EncodingConverter {
+public:
+    /**
+     * @brief Returns the length of the leading run of ASCII bytes.
+     * @param data Bytes to examine.
+     * @param size Number of bytes.
+     * @return Number of leading bytes below 0x80.
+     */
+    static std::size_t asciiPrefixLength(const char* data, std::size_t size);
+
+    /**
+     * @brief Checks whether a complete buffer is well-formed UTF-8.
+     * Overlong forms, surrogates and code points above U+10FFFF are rejected.
+     * @param data Bytes to examine.
+     * @param size Number of bytes.
+     * @return True if the buffer is valid UTF-8.
+     */
+    static bool isValidUtf8(const char* data, std::size_t size);
+
+    /**
+     * @brief Converts Windows-1251 text to UTF-8.
+     * @param data Windows-1251 bytes.
+     * @param size Number of bytes.
+     * @param output String the UTF-8 text is appended to.
+     */
+    static void cp1251ToUtf8(const char* data, std::size_t size, std::string& output);
+
+    /**
+     * @brief Converts UTF-8 text to Windows-1251.
+     * A sequence cut off at the end of the buffer is not consumed, so a stream can be
+     * converted chunk by chunk by resubmitting the unconsumed tail with the next chunk.
+     * @param data UTF-8 bytes.
+     * @param size Number of bytes.
+     * @param output String the Windows-1251 text is appended to.
+     * @param consumed Receives the number of input bytes converted.
+     * @return False if the input is malformed or contains a character Windows-1251 cannot represent.
+     */
+    static bool utf8ToCp1251(const char* data, std::size_t size, std::string& output, std::size_t& consumed);
+
+    /**
+     * @brief Decodes one UTF-8 sequence.
+     * @param data Bytes starting at the sequence.
+     * @param size Number of bytes available.
+     * @param codePoint Receives the decoded code point.
+     * @return Length of the sequence, 0 if it is cut off by the end of the data, or -1 if it is malformed.
+     */
+    static int decodeUtf8(const unsigned char* data, std::size_t size, std::uint32_t& codePoint);
+};
+
+/**
+ * @class Utf8Validator
+ * @brief Incremental UTF-8 validation of a stream delivered in arbitrary chunks.
+ */
+class Utf8Validator {
+public:
+    /**
+     * @brief Validates the next chunk of the stream.
+     * @param data Bytes of the chunk.
+     * @param size Number of bytes.
+     */
+    void feed(const char* data, std::size_t size);
+
+    /**
+     * @brief Ends the stream.
+     * @return True if the whole stream was valid UTF-8.
+     */
+    bool finish();
+
+    /**
+     * @brief Reports whether any byte seen so far was outside the ASCII range.
+     * @return True if non-ASCII bytes were seen.
+     */
+    bool hasNonAscii() const;
+
+private:
+    bool valid = true;
+    bool nonAscii = false;
+    unsigned char pending[4] = {};
+    std::size_t pendingSize = 0;
+};
+
+#endif // ENCODING_CONVERTER_H
@@ -0,0 +1,248 @@
+/**
+ * @file FileAttributes.cpp
+ * @brief Implementation of permission, ownership and timestamp access with fstatat, fchmodat, fchownat and
+ * utimensat, or their Windows counterparts.
+ */
+
+#include "FileAttributes.h"
+
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <Windows.h>
+#else
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+using namespace std;
+namespace fs = filesystem;
+
+#ifdef _WIN32
+namespace {
+
+/**
+ * @brief Number of 100-nanosecond intervals between 1601-01-01 and 1970-01-01.
+ */
+constexpr int64_t unixEpochInFileTime = 116444736000000000LL;
+
+/**
+ * @brief Converts a Windows file time to nanoseconds since the Unix epoch.
+ */
+int64_t fromFileTime(const FILETIME& time) {
+    int64_t ticks = static_cast<int64_t>((static_cast<uint64_t>(time.dwHighDateTime) << 32) | time.dwLowDateTime);
+    return (ticks - unixEpochInFileTime) * 100;
+}
+
+/**
+ * @brief Converts nanoseconds since the Unix epoch to a Windows file time.
+ */
+FILETIME toFileTime(int64_t nanoseconds) {
+    auto ticks = static_cast<uint64_t>(nanoseconds / 100 + unixEpochInFileTime);
+    FILETIME time;
+    time.dwLowDateTime = static_cast<DWORD>(ticks & 0xFFFFFFFF);
+    time.dwHighDateTime = static_cast<DWORD>(ticks >> 32);
+    return time;
+}
+
+} // namespace
+#else
+namespace {
+
+/**
+ * @brief Converts nanoseconds since the Unix epoch to a timespec, rounding down, so times
+ * before 1970 get a negative tv_sec and a tv_nsec in [0, 1e9) as utimensat requires.
+ */
+timespec toTimespec(int64_t nanoseconds) {
+    int64_t seconds = nanoseconds / 1000000000;
+    int64_t remainder = nanoseconds % 1000000000;
+    if (remainder < 0) {
+        --seconds;
+        remainder += 1000000000;
+    }
+    timespec value;
+    value.tv_sec = static_cast<time_t>(seconds);
+    value.tv_nsec = static_cast<long>(remainder);
+    return value;
+}
+
+} // namespace
+#endif
+
+/**
+ * @brief Reports whether the platform supports changing file ownership.
+ * @return True on POSIX systems.
+ */
+bool ownershipSupported() {
+#ifdef _WIN32
+    return false;
+#else
+    return true;
+#endif
+}
+
+/**
+ * @brief Maps permission bits to the bits the platform can actually store.
+ * On Windows only the read-only attribute exists, controlled by the owner write bit.
+ * @param mode Requested permission bits.
+ * @return The bits readAttributes would report after setMode(mode).
+ */
+uint32_t effectiveMode(uint32_t mode) {
+#ifdef _WIN32
+    return (mode & 0200) ? 0777 : 0555;
+#else
+    return mode & 07777;
+#endif
+}
+
+/**
+ * @brief Reads the attributes of an entry; a symbolic link is examined itself.
+ * @param path Path to the entry.
+ * @param attributes Receives the attributes.
+ * @return False if the entry cannot be examined.
+ */
+bool readAttributes(const fs::path& path, FileAttributes& attributes) {
+#ifdef _WIN32
+    DWORD flags = GetFileAttributesW(path.c_str());
+    if (flags == INVALID_FILE_ATTRIBUTES) {
+        return false;
+    }
+    attributes.isDirectory = (flags & FILE_ATTRIBUTE_DIRECTORY) != 0;
+    attributes.isSymlink = (flags & FILE_ATTRIBUTE_REPARSE_POINT) != 0;
+    attributes.mode = (flags & FILE_ATTRIBUTE_READONLY) ? 0555 : 0777;
+    attributes.owner = -1;
+    attributes.group = -1;
+    return true;
+#else
+    struct stat info;
+    if (fstatat(AT_FDCWD, path.c_str(), &info, AT_SYMLINK_NOFOLLOW) != 0) {
+        return false;
+    }
+    attributes.mode = static_cast<uint32_t>(info.st_mode & 07777);
+    attributes.owner = static_cast<int64_t>(info.st_uid);
+    attributes.group = static_cast<int64_t>(info.st_gid);
+    attributes.isDirectory = S_ISDIR(info.st_mode);
+    attributes.isSymlink = S_ISLNK(info.st_mode);
+    return true;
+#endif
+}
+
+/**
+ * @brief Sets the permission bits of an entry.
+ * @param path Path to the entry; must not be a symbolic link.
+ * @param mode New permission bits.
+ * @return False on failure.
+ */
+bool setMode(const fs::path& path, uint32_t mode) {
+#ifdef _WIN32
+    DWORD flags = GetFileAttributesW(path.c_str());
+    if (flags == INVALID_FILE_ATTRIBUTES) {
+        return false;
+    }
+    DWORD updated = (mode & 0200) ? (flags & ~FILE_ATTRIBUTE_READONLY) : (flags | FILE_ATTRIBUTE_READONLY);
+    return updated == flags || SetFileAttributesW(path.c_str(), updated) != FALSE;
+#else
+    return fchmodat(AT_FDCWD, path.c_str(), static_cast<mode_t>(mode), 0) == 0;
+#endif
+}
+
+/**
+ * @brief Sets the owner and group of an entry; a symbolic link is changed itself.
+ * @param path Path to the entry.
+ * @param owner New user ID, or -1 to keep it.
+ * @param group New group ID, or -1 to keep it.
+ * @return False on failure or where ownership is unsupported.
+ */
+bool setOwner(const fs::path& path, int64_t owner, int64_t group) {
+#ifdef _WIN32
+    (void)path;
+    (void)owner;
+    (void)group;
+    return false;
+#else
+    return fchownat(AT_FDCWD, path.c_str(), static_cast<uid_t>(owner), static_cast<gid_t>(group), AT_SYMLINK_NOFOLLOW) == 0;
+#endif
+}
+
+/**
+ * @brief Reads the access and modification times of an entry; a symbolic link is examined itself.
+ * @param path Path to the entry.
+ * @param times Receives the times.
+ * @return False if the entry cannot be examined.
+ */
+bool readTimes(const fs::path& path, FileTimes& times) {
+#ifdef _WIN32
+    WIN32_FILE_ATTRIBUTE_DATA data;
+    if (!GetFileAttributesExW(path.c_str(), GetFileExInfoStandard, &data)) {
+        return false;
+    }
+    times.access = fromFileTime(data.ftLastAccessTime);
+    times.modification = fromFileTime(data.ftLastWriteTime);
+    return true;
+#else
+    struct stat info;
+    if (fstatat(AT_FDCWD, path.c_str(), &info, AT_SYMLINK_NOFOLLOW) != 0) {
+        return false;
+    }
+    times.access = static_cast<int64_t>(info.st_atim.tv_sec) * 1000000000 + info.st_atim.tv_nsec;
+    times.modification = static_cast<int64_t>(info.st_mtim.tv_sec) * 1000000000 + info.st_mtim.tv_nsec;
+    return true;
+#endif
+}
+
+/**
+ * @brief Sets the access and/or modification time of an entry; a symbolic link is changed itself.
+ * @param path Path to the entry.
+ * @param times New times.
+ * @param setAccess Whether the access time is set.
+ * @param setModification Whether the modification time is set.
+ * @return False on failure.
+ */
+bool setTimes(const fs::path& path, const FileTimes& times, bool setAccess, bool setModification) {
+#ifdef _WIN32
+    HANDLE handle = CreateFileW(path.c_str(), FILE_WRITE_ATTRIBUTES, FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE,
+        nullptr, OPEN_EXISTING, FILE_FLAG_BACKUP_SEMANTICS | FILE_FLAG_OPEN_REPARSE_POINT, nullptr);
+    if (handle == INVALID_HANDLE_VALUE) {
+        return false;
+    }
+    FILETIME access = toFileTime(times.access);
+    FILETIME modification = toFileTime(times.modification);
+    BOOL ok = SetFileTime(handle, nullptr, setAccess ? &access : nullptr, setModification ? &modification : nullptr);
+    CloseHandle(handle);
+    return ok != FALSE;
+#else
+    timespec values[2] = { toTimespec(times.access), toTimespec(times.modification) };
+    if (!setAccess) {
+        values[0].tv_nsec = UTIME_OMIT;
+    }
+    if (!setModification) {
+        values[1].tv_nsec = UTIME_OMIT;
+    }
+    return utimensat(AT_FDCWD, path.c_str(), values, AT_SYMLINK_NOFOLLOW) == 0;
+#endif
+}
+
+/**
+ * @brief Creates an empty regular file that only its owner can read and write.
+ * @param path Path of the new file.
+ * @return False on failure, including when the path already exists.
+ */
+bool createNewFile(const fs::path& path) {
+#ifdef _WIN32
+    HANDLE handle = CreateFileW(path.c_str(), GENERIC_WRITE, 0, nullptr, CREATE_NEW, FILE_ATTRIBUTE_NORMAL, nullptr);
+    if (handle == INVALID_HANDLE_VALUE) {
+        return false;
+    }
+    CloseHandle(handle);
+    return true;
+#else
+    int descriptor = open(path.c_str(), O_WRONLY | O_CREAT | O_EXCL | O_CLOEXEC, 0600);
+    if (descriptor < 0) {
+        return false;
+    }
+    close(descriptor);
+    return true;
+#endif
+}
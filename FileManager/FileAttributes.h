@@ -0,0 +1,102 @@
+/**
+ * @file FileAttributes.h
+ * @brief Declares portable access to permission bits, ownership and timestamps of files, without following symbolic links,
+ * and exclusive creation of files.
+ */
+
+#ifndef FILE_ATTRIBUTES_H
+#define FILE_ATTRIBUTES_H
+
+#include <cstdint>
+#include <filesystem>
+
+/**
+ * @struct FileAttributes
+ * @brief Permission bits, ownership and kind of a directory entry.
+ * On Windows the permission bits are derived from the read-only attribute and no
+ * ownership is reported.
+ */
+struct FileAttributes {
+    std::uint32_t mode = 0;  ///< Permission bits, including setuid, setgid and sticky.
+    std::int64_t owner = -1; ///< User ID, or -1 where unsupported.
+    std::int64_t group = -1; ///< Group ID, or -1 where unsupported.
+    bool isDirectory = false;
+    bool isSymlink = false;
+};
+
+/**
+ * @struct FileTimes
+ * @brief Access and modification times in nanoseconds since the Unix epoch.
+ * Windows stores times in units of 100 nanoseconds.
+ */
+struct FileTimes {
+    std::int64_t access = 0;
+    std::int64_t modification = 0;
+};
+
+/**
+ * @brief Reports whether the platform supports changing file ownership.
+ * @return True on POSIX systems.
+ */
+bool ownershipSupported();
+
+/**
+ * @brief Maps permission bits to the bits the platform can actually store.
+ * @param mode Requested permission bits.
+ * @return The bits readAttributes would report after setMode(mode).
+ */
+std::uint32_t effectiveMode(std::uint32_t mode);
+
+/**
+ * @brief Reads the attributes of an entry; a symbolic link is examined itself.
+ * @param path Path to the entry.
+ * @param attributes Receives the attributes.
+ * @return False if the entry cannot be examined.
+ */
+bool readAttributes(const std::filesystem::path& path, FileAttributes& attributes);
+
+/**
+ * @brief Sets the permission bits of an entry.
+ * On Windows only the owner write bit is honoured, through the read-only attribute.
+ * @param path Path to the entry; must not be a symbolic link.
+ * @param mode New permission bits.
+ * @return False on failure.
+ */
+bool setMode(const std::filesystem::path& path, std::uint32_t mode);
+
+/**
+ * @brief Sets the owner and group of an entry; a symbolic link is changed itself.
+ * @param path Path to the entry.
+ * @param owner New user ID, or -1 to keep it.
+ * @param group New group ID, or -1 to keep it.
+ * @return False on failure or where ownership is unsupported.
+ */
+bool setOwner(const std::filesystem::path& path, std::int64_t owner, std::int64_t group);
+
+/**
+ * @brief Reads the access and modification times of an entry; a symbolic link is examined itself.
+ * @param path Path to the entry.
+ * @param times Receives the times.
+ * @return False if the entry cannot be examined.
+ */
+bool readTimes(const std::filesystem::path& path, FileTimes& times);
+
+/**
+ * @brief Sets the access and/or modification time of an entry; a symbolic link is changed itself.
+ * @param path Path to the entry.
+ * @param times New times.
+ * @param setAccess Whether the access time is set.
+ * @param setModification Whether the modification time is set.
+ * @return False on failure.
+ */
+bool setTimes(const std::filesystem::path& path, const FileTimes& times, bool setAccess, bool setModification);
+
+/**
+ * @brief Creates an empty regular file that only its owner can read and write.
+ * Fails if anything, even a dangling symbolic link, already exists at the path.
+ * @param path Path of the new file.
+ * @return False on failure.
+ */
+bool createNewFile(const std::filesystem::path& path);
+
+#endif // FILE_ATTRIBUTES_H
@@ -0,0 +1,304 @@
+/**
+ * @file FileFollower.cpp
+ * @brief Implementation of tail-and-follow over growing, truncated and rotated files.
+ */
+
+#include "FileFollower.h"
+#include "DirectoryMonitor.h"
+#include "FileId.h"
+#include "TextScanner.h"
+#include <algorithm>
+#include <filesystem>
+#include <iostream>
+#include <memory>
+#include <vector>
+
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <Windows.h>
+#else
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+using namespace std;
+namespace fs = filesystem;
+
+namespace {
+
+/**
+ * @brief Size of the blocks read while scanning backwards and while copying appended data.
+ */
+constexpr size_t blockSize = 1 << 20;
+
+/**
+ * @class ReadHandle
+ * @brief Read-only handle with positional reads that does not block renaming or deleting the file.
+ */
+class ReadHandle {
+public:
+    ReadHandle() = default;
+    ReadHandle(const ReadHandle&) = delete;
+    ReadHandle& operator=(const ReadHandle&) = delete;
+
+    ~ReadHandle() {
+        close();
+    }
+
+    void swap(ReadHandle& other) {
+#ifdef _WIN32
+        std::swap(handle, other.handle);
+#else
+        std::swap(descriptor, other.descriptor);
+#endif
+    }
+
+    bool open(const fs::path& path) {
+        close();
+#ifdef _WIN32
+        HANDLE opened = CreateFileW(path.c_str(), GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE,
+            nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+        if (opened == INVALID_HANDLE_VALUE) {
+            return false;
+        }
+        handle = opened;
+#else
+        descriptor = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+        if (descriptor < 0) {
+            return false;
+        }
+#endif
+        return true;
+    }
+
+    void close() {
+#ifdef _WIN32
+        if (handle != nullptr) {
+            CloseHandle(handle);
+            handle = nullptr;
+        }
+#else
+        if (descriptor >= 0) {
+            ::close(descriptor);
+            descriptor = -1;
+        }
+#endif
+    }
+
+    /**
+     * @brief Reads the current size and identity of the open file.
+     */
+    bool stat(uint64_t& size, FileId& id) const {
+#ifdef _WIN32
+        BY_HANDLE_FILE_INFORMATION info;
+        if (!GetFileInformationByHandle(handle, &info)) {
+            return false;
+        }
+        size = (static_cast<uint64_t>(info.nFileSizeHigh) << 32) | info.nFileSizeLow;
+        id.device = info.dwVolumeSerialNumber;
+        id.inode = (static_cast<uint64_t>(info.nFileIndexHigh) << 32) | info.nFileIndexLow;
+#else
+        struct stat info;
+        if (fstat(descriptor, &info) != 0) {
+            return false;
+        }
+        size = static_cast<uint64_t>(info.st_size);
+        id.device = static_cast<uint64_t>(info.st_dev);
+        id.inode = static_cast<uint64_t>(info.st_ino);
+#endif
+        return true;
+    }
+
+    /**
+     * @brief Reads up to size bytes at an offset.
+     * @return Number of bytes read, 0 at the end of the file, or -1 on error.
+     */
+    long long readAt(uint64_t offset, char* data, size_t size) const {
+#ifdef _WIN32
+        OVERLAPPED position = {};
+        position.Offset = static_cast<DWORD>(offset & 0xFFFFFFFF);
+        position.OffsetHigh = static_cast<DWORD>(offset >> 32);
+        DWORD transferred = 0;
+        if (!ReadFile(handle, data, static_cast<DWORD>(size), &transferred, &position)) {
+            return GetLastError() == ERROR_HANDLE_EOF ? 0 : -1;
+        }
+        return transferred;
+#else
+        return pread(descriptor, data, size, static_cast<off_t>(offset));
+#endif
+    }
+
+private:
+#ifdef _WIN32
+    HANDLE handle = nullptr;
+#else
+    int descriptor = -1;
+#endif
+};
+
+/**
+ * @brief Finds where the last lines of a file begin by scanning backwards block by block.
+ * A final newline ends the last line and does not start another one.
+ * @param file The open file.
+ * @param size Size of the file.
+ * @param lineCount Number of trailing lines wanted.
+ * @param buffer Scratch buffer of blockSize bytes.
+ * @return Offset of the first byte of the trailing lines.
+ */
+uint64_t findTailStart(const ReadHandle& file, uint64_t size, size_t lineCount, vector<char>& buffer) {
+    if (lineCount == 0) {
+        return size;
+    }
+    uint64_t end = size;
+    size_t newlinesWanted = lineCount;
+    bool first = true;
+
+    while (end > 0) {
+        uint64_t start = end > blockSize ? end - blockSize : 0;
+        size_t length = static_cast<size_t>(end - start);
+        long long read = file.readAt(start, buffer.data(), length);
+        if (read != static_cast<long long>(length)) {
+            return start;
+        }
+        if (first) {
+            first = false;
+            if (buffer[length - 1] == '\n') {
+                --length;
+                --end;
+            }
+        }
+
+        size_t newlines = TextScanner::count(buffer.data(), length, '\n');
+        if (newlines < newlinesWanted) {
+            newlinesWanted -= newlines;
+            end = start;
+            continue;
+        }
+        for (size_t i = length; i > 0; --i) {
+            if (buffer[i - 1] == '\n' && --newlinesWanted == 0) {
+                return start + i;
+            }
+        }
+    }
+    return 0;
+}
+
+} // namespace
+
+/**
+ * @brief Constructs a follower.
+ * @param output Receives the initial lines and all appended data.
+ * @param onEvent Optional; receives truncation and rotation notices.
+ */
+FileFollower::FileFollower(Output output, EventHandler onEvent) : output(move(output)), onEvent(move(onEvent)) {}
+
+/**
+ * @brief Writes the last lines of a file, then follows it until the stop condition holds.
+ * @param path Path to the file.
+ * @param lineCount Number of trailing lines to write first.
+ * @param stop Stop condition.
+ * @return Status code: 200 when stopped, 404 if the file does not exist, 400 if it is not
+ * a regular file, 500 if it cannot be read.
+ */
+int FileFollower::follow(const string& path, size_t lineCount, const StopCondition& stop) {
+    try {
+        fs::path target(path);
+        if (!fs::exists(target)) {
+            cerr << "File does not exist: " << path << endl;
+            return 404;
+        }
+        if (!fs::is_regular_file(target)) {
+            cerr << "Not a regular file: " << path << endl;
+            return 400;
+        }
+
+        ReadHandle file;
+        uint64_t size = 0;
+        FileId openedId;
+        if (!file.open(target) || !file.stat(size, openedId)) {
+            cerr << "Failed to open file: " << path << endl;
+            return 500;
+        }
+
+        vector<char> buffer(blockSize);
+        uint64_t position = findTailStart(file, size, lineCount, buffer);
+        fs::path directory = target.has_parent_path() ? target.parent_path() : fs::path(".");
+        string name = target.filename().string();
+        DirectoryMonitor monitor(directory);
+        vector<ChangeEvent> events;
+        bool changed = true;
+
+        while (true) {
+            if (changed || !monitor.isNative()) {
+                FileId currentId;
+                if (!file.stat(size, openedId)) {
+                    cerr << "Failed to read file: " << path << endl;
+                    return 500;
+                }
+                if (size < position) {
+                    position = 0;
+                    if (onEvent) {
+                        onEvent(FollowEvent::Truncated);
+                    }
+                }
+
+                // Copy what was appended up to the size just read; large blocks let this keep up with
+                // fast writers, and the bound keeps a writer that keeps pace from holding the loop here.
+                long long read = 0;
+                while (position < size && (read = file.readAt(position, buffer.data(),
+                    static_cast<size_t>(min<uint64_t>(buffer.size(), size - position)))) > 0) {
+                    output(buffer.data(), static_cast<size_t>(read));
+                    position += static_cast<uint64_t>(read);
+                }
+                if (read < 0) {
+                    cerr << "Failed to read file: " << path << endl;
+                    return 500;
+                }
+
+                // Switch if the path now names another file. Its writer has moved on, so the rest
+                // of the old file is copied first.
+                if (getFileId(target, currentId) && !(currentId == openedId)) {
+                    while ((read = file.readAt(position, buffer.data(), buffer.size())) > 0) {
+                        output(buffer.data(), static_cast<size_t>(read));
+                        position += static_cast<uint64_t>(read);
+                    }
+                    if (read < 0) {
+                        cerr << "Failed to read file: " << path << endl;
+                        return 500;
+                    }
+                    ReadHandle replacement;
+                    if (replacement.open(target)) {
+                        file.swap(replacement);
+                        position = 0;
+                        if (onEvent) {
+                            onEvent(FollowEvent::Rotated);
+                        }
+                        continue;
+                    }
+                }
+            }
+
+            if (stop()) {
+                return 200;
+            }
+            // More may have been appended while copying; go round again instead of waiting.
+            uint64_t latest;
+            FileId latestId;
+            if (file.stat(latest, latestId) && latest > position) {
+                changed = true;
+                continue;
+            }
+            monitor.wait(pollInterval, events);
+            changed = any_of(events.begin(), events.end(), [&name](const ChangeEvent& event) {
+                return event.name == name || event.kind == ChangeKind::Overflow;
+            });
+        }
+    }
+    catch (const exception& e) {
+        cerr << "Error following file: " << e.what() << endl;
+        return 500;
+    }
+}
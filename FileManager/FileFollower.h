@@ -0,0 +1,78 @@
+/**
+ * @file FileFollower.h
+ * @brief Declares the FileFollower class, which prints the end of a file and streams data appended to it.
+ */
+
+#ifndef FILE_FOLLOWER_H
+#define FILE_FOLLOWER_H
+
+#include <chrono>
+#include <cstddef>
+#include <functional>
+#include <string>
+
+/**
+ * @brief Notable changes to a followed file.
+ */
+enum class FollowEvent {
+    Truncated, ///< The file shrank; following restarts from its beginning.
+    Rotated    ///< The path now names a different file; following switches to it.
+};
+
+/**
+ * @class FileFollower
+ * @brief Streams the growth of a file, like tail -F.
+ *
+ * The last lines are located by scanning backwards from the end of the file in chunks,
+ * so only the tail is read. Afterwards the follower sleeps until the containing directory
+ * reports a change to the file, or until the poll interval passes, and then copies
+ * everything appended since in large blocks until it catches up. A file that shrinks is
+ * treated as truncated and read again from the start. When the path starts naming a
+ * different file (another device and inode), the rest of the old file is drained and
+ * following continues with the new file from its beginning.
+ */
+class FileFollower {
+public:
+    /**
+     * @brief Receives file data.
+     */
+    using Output = std::function<void(const char* data, std::size_t size)>;
+
+    /**
+     * @brief Receives truncation and rotation notices.
+     */
+    using EventHandler = std::function<void(FollowEvent event)>;
+
+    /**
+     * @brief Polled regularly; following ends once it returns true.
+     */
+    using StopCondition = std::function<bool()>;
+
+    /**
+     * @brief Longest time between checks of the stop condition and of the file.
+     */
+    static constexpr std::chrono::milliseconds pollInterval{ 200 };
+
+    /**
+     * @brief Constructs a follower.
+     * @param output Receives the initial lines and all appended data.
+     * @param onEvent Optional; receives truncation and rotation notices.
+     */
+    explicit FileFollower(Output output, EventHandler onEvent = nullptr);
+
+    /**
+     * @brief Writes the last lines of a file, then follows it until the stop condition holds.
+     * @param path Path to the file.
+     * @param lineCount Number of trailing lines to write first.
+     * @param stop Stop condition.
+     * @return Status code: 200 when stopped, 404 if the file does not exist, 400 if it is not
+     * a regular file, 500 if it cannot be read.
+     */
+    int follow(const std::string& path, std::size_t lineCount, const StopCondition& stop);
+
+private:
+    Output output;
+    EventHandler onEvent;
+};
+
+#endif // FILE_FOLLOWER_H
@@ -0,0 +1,237 @@
+/**
+ * @file FileId.cpp
+ * @brief Implementation of file identities, the concurrent FileIdSet and the HardLinkIndex.
+ */
+
+#include "FileId.h"
+#include <algorithm>
+#include <thread>
+
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <Windows.h>
+#else
+#include <sys/stat.h>
+#endif
+
+using namespace std;
+namespace fs = filesystem;
+
+namespace {
+
+/**
+ * @brief Mixes the two halves of an identity into a well-distributed 64-bit hash.
+ * @param id The identity to hash.
+ * @return A hash that is never zero.
+ */
+uint64_t mix(const FileId& id) {
+    uint64_t h = id.inode * 0x9E3779B97F4A7C15ULL ^ id.device;
+    h ^= h >> 30;
+    h *= 0xBF58476D1CE4E5B9ULL;
+    h ^= h >> 27;
+    h *= 0x94D049BB133111EBULL;
+    h ^= h >> 31;
+    return h | 1;
+}
+
+} // namespace
+
+/**
+ * @brief Hashes a FileId.
+ * @param id The identity to hash.
+ * @return The hash value.
+ */
+size_t FileIdHash::operator()(const FileId& id) const {
+    return static_cast<size_t>(mix(id));
+}
+
+/**
+ * @brief Reads the identity of a file.
+ * @param path Path to the file.
+ * @param id Receives the identity.
+ * @param linkCount Optional; receives the number of hard links to the file.
+ * @param followLinks Whether a symbolic link is resolved to its target.
+ * @param size Optional; receives the size of the file in bytes.
+ * @return True on success, false if the file cannot be examined.
+ */
+bool getFileId(const fs::path& path, FileId& id, uint64_t* linkCount, bool followLinks, uint64_t* size) {
+#ifdef _WIN32
+    DWORD flags = FILE_FLAG_BACKUP_SEMANTICS;
+    if (!followLinks) {
+        flags |= FILE_FLAG_OPEN_REPARSE_POINT;
+    }
+    HANDLE handle = CreateFileW(path.c_str(), 0, FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE,
+        nullptr, OPEN_EXISTING, flags, nullptr);
+    if (handle == INVALID_HANDLE_VALUE) {
+        return false;
+    }
+    BY_HANDLE_FILE_INFORMATION info;
+    BOOL ok = GetFileInformationByHandle(handle, &info);
+    CloseHandle(handle);
+    if (!ok) {
+        return false;
+    }
+    id.device = info.dwVolumeSerialNumber;
+    id.inode = (static_cast<uint64_t>(info.nFileIndexHigh) << 32) | info.nFileIndexLow;
+    if (linkCount) {
+        *linkCount = info.nNumberOfLinks;
+    }
+    if (size) {
+        *size = (static_cast<uint64_t>(info.nFileSizeHigh) << 32) | info.nFileSizeLow;
+    }
+    return true;
+#else
+    struct stat info;
+    int result = followLinks ? stat(path.c_str(), &info) : lstat(path.c_str(), &info);
+    if (result != 0) {
+        return false;
+    }
+    id.device = static_cast<uint64_t>(info.st_dev);
+    id.inode = static_cast<uint64_t>(info.st_ino);
+    if (linkCount) {
+        *linkCount = static_cast<uint64_t>(info.st_nlink);
+    }
+    if (size) {
+        *size = static_cast<uint64_t>(info.st_size);
+    }
+    return true;
+#endif
+}
+
+/**
+ * @brief Constructs an empty set with lock-free tables sized for the expected number of identities.
+ * @param expectedSize Number of identities the tables are sized for.
+ */
+FileIdSet::FileIdSet(size_t expectedSize) : shards(new Shard[shardCount]) {
+    size_t perShard = expectedSize / shardCount + 1;
+    size_t capacity = 16;
+    while (capacity < perShard * 2) {
+        capacity <<= 1;
+    }
+    for (size_t i = 0; i < shardCount; ++i) {
+        shards[i].slots.reset(new Slot[capacity]);
+        shards[i].mask = capacity - 1;
+        shards[i].limit = capacity / 2;
+    }
+}
+
+/**
+ * @brief Adds an identity to the set.
+ * @param id The identity to add.
+ * @return True if the identity was not in the set before.
+ */
+bool FileIdSet::insert(const FileId& id) {
+    uint64_t hash = mix(id);
+    Shard& shard = shards[hash >> 58];
+
+    if (shard.reserved.fetch_add(1, memory_order_relaxed) < shard.limit) {
+        bool inserted = insertIntoTable(shard, id, hash);
+        shard.published.fetch_add(1, memory_order_release);
+        return inserted;
+    }
+
+    // The table is full: wait until every insert that reserved a table slot is visible,
+    // so the lookup below cannot miss an identity that is about to be added.
+    while (shard.published.load(memory_order_acquire) < shard.limit) {
+        this_thread::yield();
+    }
+    if (tableContains(shard, id, hash)) {
+        return false;
+    }
+    lock_guard<mutex> guard(shard.overflowLock);
+    return shard.overflow.insert(id).second;
+}
+
+/**
+ * @brief Inserts an identity into a shard's table by claiming a free slot with a compare-and-swap.
+ * The shard's load limit guarantees that a free slot exists.
+ * @param shard The shard to insert into.
+ * @param id The identity to insert.
+ * @param hash The identity's hash.
+ * @return True if the identity was inserted, false if it was already present.
+ */
+bool FileIdSet::insertIntoTable(Shard& shard, const FileId& id, uint64_t hash) {
+    for (size_t index = hash & shard.mask;; index = (index + 1) & shard.mask) {
+        Slot& slot = shard.slots[index];
+        uint64_t current = slot.hash.load(memory_order_acquire);
+        if (current == 0) {
+            if (slot.hash.compare_exchange_strong(current, hash, memory_order_acq_rel)) {
+                slot.id = id;
+                slot.ready.store(true, memory_order_release);
+                return true;
+            }
+        }
+        if (current == hash) {
+            while (!slot.ready.load(memory_order_acquire)) {
+                this_thread::yield();
+            }
+            if (slot.id == id) {
+                return false;
+            }
+        }
+    }
+}
+
+/**
+ * @brief Looks an identity up in a shard's table.
+ * @param shard The shard to search.
+ * @param id The identity to look for.
+ * @param hash The identity's hash.
+ * @return True if the table contains the identity.
+ */
+bool FileIdSet::tableContains(const Shard& shard, const FileId& id, uint64_t hash) {
+    for (size_t index = hash & shard.mask;; index = (index + 1) & shard.mask) {
+        const Slot& slot = shard.slots[index];
+        uint64_t current = slot.hash.load(memory_order_acquire);
+        if (current == 0) {
+            return false;
+        }
+        if (current == hash && slot.id == id) {
+            return true;
+        }
+    }
+}
+
+/**
+ * @brief Constructs an empty index.
+ */
+HardLinkIndex::HardLinkIndex() : shards(new Shard[shardCount]) {}
+
+/**
+ * @brief Records a path of a file if the file has more than one hard link.
+ * @param path The path the file was reached through.
+ * @param id The identity of the file.
+ * @param linkCount The number of hard links to the file.
+ * @return True if the path is the first one recorded for the file, or the file has a single link.
+ */
+bool HardLinkIndex::add(const fs::path& path, const FileId& id, uint64_t linkCount) {
+    if (linkCount <= 1) {
+        return true;
+    }
+    Shard& shard = shards[mix(id) >> 58];
+    lock_guard<mutex> guard(shard.lock);
+    auto& paths = shard.paths[id];
+    paths.push_back(path);
+    return paths.size() == 1;
+}
+
+/**
+ * @brief Returns the paths of every file recorded through at least two paths.
+ * @return One group per file, each sorted, ordered by the first path of each group.
+ */
+vector<vector<fs::path>> HardLinkIndex::groups() const {
+    vector<vector<fs::path>> result;
+    for (size_t i = 0; i < shardCount; ++i) {
+        lock_guard<mutex> guard(shards[i].lock);
+        for (const auto& item : shards[i].paths) {
+            if (item.second.size() > 1) {
+                result.push_back(item.second);
+                sort(result.back().begin(), result.back().end());
+            }
+        }
+    }
+    sort(result.begin(), result.end(), [](const auto& a, const auto& b) { return a.front() < b.front(); });
+    return result;
+}
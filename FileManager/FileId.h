@@ -0,0 +1,159 @@
+/**
+ * @file FileId.h
+ * @brief Declares FileId, the device and inode pair identifying a file, FileIdSet, a concurrent set of them,
+ * and HardLinkIndex, which groups the paths of hard-linked files.
+ */
+
+#ifndef FILE_ID_H
+#define FILE_ID_H
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+/**
+ * @struct FileId
+ * @brief Identifies a file independently of the path used to reach it.
+ * On POSIX systems this is the (st_dev, st_ino) pair; on Windows it is the
+ * volume serial number and the file index.
+ */
+struct FileId {
+    std::uint64_t device = 0;
+    std::uint64_t inode = 0;
+
+    bool operator==(const FileId& other) const {
+        return device == other.device && inode == other.inode;
+    }
+};
+
+/**
+ * @brief Hashes a FileId.
+ */
+struct FileIdHash {
+    std::size_t operator()(const FileId& id) const;
+};
+
+/**
+ * @brief Reads the identity of a file.
+ * @param path Path to the file.
+ * @param id Receives the identity.
+ * @param linkCount Optional; receives the number of hard links to the file.
+ * @param followLinks Whether a symbolic link is resolved to its target.
+ * @param size Optional; receives the size of the file in bytes.
+ * @return True on success, false if the file cannot be examined.
+ */
+bool getFileId(const std::filesystem::path& path, FileId& id, std::uint64_t* linkCount = nullptr, bool followLinks = true,
+    std::uint64_t* size = nullptr);
+
+/**
+ * @class FileIdSet
+ * @brief Insert-only set of file identities that many threads can update at once.
+ *
+ * The set is split into shards selected by hash. Each shard is an open-addressing table
+ * whose slots are claimed with a compare-and-swap, so inserts into the table never take
+ * a lock. Once a shard's table reaches its load limit, further inserts into that shard
+ * go to a mutex-protected overflow set, after all pending table inserts have been
+ * published, so an identity is never admitted twice.
+ */
+class FileIdSet {
+public:
+    /**
+     * @brief Constructs an empty set.
+     * @param expectedSize Number of identities the lock-free tables are sized for.
+     */
+    explicit FileIdSet(std::size_t expectedSize = 1 << 14);
+
+    FileIdSet(const FileIdSet&) = delete;
+    FileIdSet& operator=(const FileIdSet&) = delete;
+
+    /**
+     * @brief Adds an identity to the set.
+     * @param id The identity to add.
+     * @return True if the identity was not in the set before.
+     */
+    bool insert(const FileId& id);
+
+private:
+    /**
+     * @brief A table slot; hash is zero while the slot is free.
+     */
+    struct Slot {
+        std::atomic<std::uint64_t> hash{ 0 };
+        std::atomic<bool> ready{ false };
+        FileId id;
+    };
+
+    /**
+     * @brief One shard: a fixed lock-free table plus the overflow used once it is full.
+     */
+    struct Shard {
+        std::unique_ptr<Slot[]> slots;
+        std::size_t mask = 0;
+        std::size_t limit = 0;
+        std::atomic<std::size_t> reserved{ 0 };
+        std::atomic<std::size_t> published{ 0 };
+        std::mutex overflowLock;
+        std::unordered_set<FileId, FileIdHash> overflow;
+    };
+
+    /**
+     * @brief Inserts into a shard's table; returns false if the identity is already present.
+     */
+    static bool insertIntoTable(Shard& shard, const FileId& id, std::uint64_t hash);
+
+    /**
+     * @brief Looks an identity up in a shard's table; all inserts must be published.
+     */
+    static bool tableContains(const Shard& shard, const FileId& id, std::uint64_t hash);
+
+    static constexpr std::size_t shardCount = 64;
+    std::unique_ptr<Shard[]> shards;
+};
+
+/**
+ * @class HardLinkIndex
+ * @brief Groups the paths through which files with several hard links were reached.
+ *
+ * Only files whose link count exceeds one are recorded, so memory grows with the number
+ * of hard-linked paths rather than with the size of the tree. The index is split into
+ * mutex-protected shards selected by hash, so many threads can record paths at once.
+ */
+class HardLinkIndex {
+public:
+    HardLinkIndex();
+
+    HardLinkIndex(const HardLinkIndex&) = delete;
+    HardLinkIndex& operator=(const HardLinkIndex&) = delete;
+
+    /**
+     * @brief Records a path of a file if the file has more than one hard link.
+     * @param path The path the file was reached through.
+     * @param id The identity of the file.
+     * @param linkCount The number of hard links to the file.
+     * @return True if the path is the first one recorded for the file, or the file has a single link.
+     */
+    bool add(const std::filesystem::path& path, const FileId& id, std::uint64_t linkCount);
+
+    /**
+     * @brief Returns the paths of every file recorded through at least two paths.
+     * @return One group per file, each sorted, ordered by the first path of each group.
+     */
+    std::vector<std::vector<std::filesystem::path>> groups() const;
+
+private:
+    struct Shard {
+        mutable std::mutex lock;
+        std::unordered_map<FileId, std::vector<std::filesystem::path>, FileIdHash> paths;
+    };
+
+    static constexpr std::size_t shardCount = 64;
+    std::unique_ptr<Shard[]> shards;
+};
+
+#endif // FILE_ID_H
@@ -4,12 +4,89 @@
  */
 
 #include "FileManagerUI.h"
+#include "FileFollower.h"
+#include "FileViewer.h"
+#include "FolderWatcher.h"
+#include "Journal.h"
+#include "Metrics.h"
+#include "Trash.h"
+#include "TreeMirror.h"
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <ctime>
+#include <filesystem>
 #include <iostream>
+#include <map>
 #include <string>
+#include <sstream>
+#include <system_error>
+#include <thread>
 #include <vector>
 
+#ifdef _WIN32
+#include <conio.h>
+#else
+#include <poll.h>
+#include <unistd.h>
+#endif
+
 using namespace std;
 
+namespace {
+
+/**
+ * @brief Checks without blocking whether the user has pressed Enter, consuming the input if so.
+ * @return True if a line of input was entered.
+ */
+bool enterPressed() {
+#ifdef _WIN32
+    bool pressed = false;
+    while (_kbhit()) {
+        pressed = _getch() == '\r' || pressed;
+    }
+    return pressed;
+#else
+    pollfd request = { STDIN_FILENO, POLLIN, 0 };
+    if (poll(&request, 1, 0) <= 0) {
+        return false;
+    }
+    string ignored;
+    getline(cin, ignored);
+    return true;
+#endif
+}
+
+/**
+ * @brief Moves a path below one root to the same place below another; other text is left unchanged.
+ * @param text A line of recorded input.
+ * @param from The recorded root.
+ * @param to The replay root.
+ * @return True if the text was a path below the recorded root.
+ */
+bool rebase(string& text, const string& from, const string& to) {
+    if (from.empty() || text.compare(0, from.size(), from) != 0) {
+        return false;
+    }
+    if (text.size() > from.size() && text[from.size()] != '/' && text[from.size()] != '\\') {
+        return false;
+    }
+    text = to + text.substr(from.size());
+    return true;
+}
+
+/**
+ * @brief Stream buffer that discards everything written to it.
+ */
+class NullBuffer : public streambuf {
+protected:
+    int_type overflow(int_type character) override {
+        return traits_type::not_eof(character);
+    }
+};
+
+} // namespace
+
 /**
  * @brief Constructor for initializing the FileManagerUI with a BaseFileManager instance.
  * @param manager Reference to the BaseFileManager instance to interact with file system operations.
@@ -33,12 +110,32 @@ void FileManagerUI::start() {
         cout << "6. Rename File/Directory\n";
         cout << "7. Search Files\n";
         cout << "8. Clear Console\n";
-        cout << "9. Exit\n";
+        cout << "9. Count Matching Files\n";
+        cout << "10. Check If Matching File Exists\n";
+        cout << "11. Convert Encoding (Windows-1251/UTF-8)\n";
+        cout << "12. Find and Replace in Files\n";
+        cout << "13. View File\n";
+        cout << "14. Follow File\n";
+        cout << "15. Count Lines, Words and Bytes\n";
+        cout << "16. File Type Breakdown\n";
+        cout << "17. Find Empty Files and Directories\n";
+        cout << "18. Change Permissions and Ownership\n";
+        cout << "19. Set Timestamps\n";
+        cout << "20. Disk Usage\n";
+        cout << "21. Copy File/Directory\n";
+        cout << "22. Build Search Index\n";
+        cout << "23. Watch Folders\n";
+        cout << "24. Mirror Directory\n";
+        cout << "25. Trash\n";
+        cout << "26. Read Journal\n";
+        cout << "27. Export Metrics\n";
+        cout << "28. Profile Operations (" << (Profiler::getInstance().isEnabled() ? "on" : "off") << ")\n";
+        cout << "0. Exit\n";
 
         cout << "\nEnter command: ";
         getline(cin, command);
 
-        if (command == "9") {
+        if (command == "0") {
             char confirm;
             cout << "\nAre you sure you want to exit? (y/n): ";
             cin >> confirm;
@@ -53,8 +150,155 @@ void FileManagerUI::start() {
             }
         }
 
+        if (recorder) {
+            recorder->beginCommand(command);
+        }
         processCommand(command);
+        if (recorder) {
+            recorder->endCommand();
+        }
+    }
+}
+
+/**
+ * @brief Records the commands entered from now on.
+ * @param recorder The opened recorder, or null to stop recording.
+ */
+void FileManagerUI::setRecorder(SessionRecorder* recorder) {
+    this->recorder = recorder;
+}
+
+/**
+ * @brief Returns whether a command that runs until Enter is pressed should stop.
+ * @return True if Enter was pressed or a session is being replayed.
+ */
+bool FileManagerUI::stopRequested() {
+    return replaying || enterPressed();
+}
+
+/**
+ * @brief Runs a recorded session against a directory and prints the latency of every command.
+ * Each command reads its recorded input with paths below the recorded root moved below the
+ * new root, and its output is discarded; errors still go to the error stream. The recorded
+ * working directory is moved below the new root as well, or replaced by the new root if it
+ * was outside the recorded root, so relative paths resolve inside the new root too.
+ * Clearing the console is skipped, and commands that run until Enter is pressed make a
+ * single pass.
+ * @param sessionFile The session file.
+ * @param root The directory that takes the place of the recorded root.
+ * @param paced Whether to start each command at its recorded time.
+ * @return HTTP-like status code:
+ * - 200: Session replayed.
+ * - 400: The session file is damaged or the root is not a directory.
+ * - 404: The session file does not exist.
+ * - 500: The working directory cannot be changed.
+ */
+int FileManagerUI::replay(const string& sessionFile, const string& root, bool paced) {
+    string recordedRoot, recordedDirectory;
+    vector<SessionCommand> commands;
+    int statusCode = readSession(sessionFile, recordedRoot, recordedDirectory, commands);
+    if (statusCode != 200) {
+        return statusCode;
+    }
+
+    error_code ec;
+    if (!filesystem::is_directory(root, ec)) {
+        cerr << "Replay root is not a directory: " << root << endl;
+        return 400;
+    }
+    filesystem::path previousDirectory = filesystem::current_path(ec);
+    string replayRoot = filesystem::absolute(root, ec).lexically_normal().string();
+    if (!rebase(recordedDirectory, recordedRoot, replayRoot)) {
+        recordedDirectory = replayRoot;
+    }
+    if (!ec) {
+        filesystem::current_path(recordedDirectory, ec);
+    }
+    if (ec) {
+        cerr << "Error changing to the replay root: " << ec.message() << endl;
+        return 500;
+    }
+
+    NullBuffer discard;
+    streambuf* input = cin.rdbuf();
+    streambuf* output = cout.rdbuf();
+    vector<int64_t> latencies(commands.size(), -1); // Nanoseconds; -1 for skipped or failed commands.
+    replaying = true;
+    auto started = chrono::steady_clock::now();
+
+    for (size_t i = 0; i < commands.size(); ++i) {
+        const SessionCommand& command = commands[i];
+        if (command.command == "8") {
+            continue;
+        }
+        string text;
+        for (string line : command.input) {
+            rebase(line, recordedRoot, replayRoot);
+            text += line + "\n";
+        }
+        istringstream commandInput(text);
+        if (paced) {
+            this_thread::sleep_until(started + chrono::nanoseconds(command.offset));
+        }
+
+        cin.rdbuf(commandInput.rdbuf());
+        cout.rdbuf(&discard);
+        auto commandStarted = chrono::steady_clock::now();
+        try {
+            processCommand(command.command);
+            latencies[i] = chrono::duration_cast<chrono::nanoseconds>(chrono::steady_clock::now() - commandStarted).count();
+        }
+        catch (const exception& e) {
+            cerr << "Command " << i + 1 << " failed: " << e.what() << endl;
+        }
+        cin.rdbuf(input);
+        cin.clear();
+        cout.rdbuf(output);
+        cout.clear();
+    }
+
+    replaying = false;
+    filesystem::current_path(previousDirectory, ec);
+
+    auto milliseconds = [](int64_t nanoseconds) { return nanoseconds / 1e6; };
+    ostringstream report;
+    report.setf(ios::fixed);
+    report.precision(3);
+    report << "\nReplayed " << commands.size() << " commands from " << sessionFile << " in " << replayRoot << "\n\n";
+    report << "#\tCommand\tRecorded ms\tReplayed ms\n";
+    for (size_t i = 0; i < commands.size(); ++i) {
+        report << i + 1 << "\t" << commands[i].command << "\t" << milliseconds(commands[i].duration) << "\t";
+        if (latencies[i] >= 0) {
+            report << milliseconds(latencies[i]) << "\n";
+        }
+        else {
+            report << (commands[i].command == "8" ? "skipped" : "failed") << "\n";
+        }
+    }
+
+    struct Summary {
+        size_t runs = 0;
+        int64_t recorded = 0;
+        int64_t replayed = 0;
+        int64_t slowest = 0;
+    };
+    map<int, Summary> summaries;
+    for (size_t i = 0; i < commands.size(); ++i) {
+        if (latencies[i] >= 0) {
+            Summary& summary = summaries[stoi(commands[i].command)];
+            ++summary.runs;
+            summary.recorded += commands[i].duration;
+            summary.replayed += latencies[i];
+            summary.slowest = max(summary.slowest, latencies[i]);
+        }
     }
+    report << "\nCommand\tRuns\tRecorded mean ms\tReplayed mean ms\tReplayed max ms\n";
+    for (const auto& [command, summary] : summaries) {
+        report << command << "\t" << summary.runs << "\t" << milliseconds(summary.recorded) / summary.runs << "\t"
+            << milliseconds(summary.replayed) / summary.runs << "\t" << milliseconds(summary.slowest) << "\n";
+    }
+    cout << report.str();
+    return 200;
 }
 
 /**
@@ -88,6 +332,67 @@ void FileManagerUI::processCommand(const string& command) {
         clearConsoleWithConfirmation();
         break;
     case 9:
+        countFiles();
+        break;
+    case 10:
+        fileExists();
+        break;
+    case 11:
+        convertEncoding();
+        break;
+    case 12:
+        replaceInFiles();
+        break;
+    case 13:
+        viewFile();
+        break;
+    case 14:
+        followFile();
+        break;
+    case 15:
+        countText();
+        break;
+    case 16:
+        fileTypeReport();
+        break;
+    case 17:
+        findEmpty();
+        break;
+    case 18:
+        setAttributes();
+        break;
+    case 19:
+        setTimestamps();
+        break;
+    case 20:
+        diskUsage();
+        break;
+    case 21:
+        copyItem();
+        break;
+    case 22:
+        buildSearchIndex();
+        break;
+    case 23:
+        watchFolders();
+        break;
+    case 24:
+        mirrorDirectory();
+        break;
+    case 25:
+        manageTrash();
+        break;
+    case 26:
+        readJournal();
+        break;
+    case 27:
+        exportMetrics();
+        break;
+    case 28:
+        Profiler::getInstance().setEnabled(!Profiler::getInstance().isEnabled());
+        cout << "\nOperation profiling is " << (Profiler::getInstance().isEnabled() ? "on" : "off") << ".\n";
+        break;
+    case 0:
         break; // Exit is handled in `start()`
     default:
         cout << "\nUnknown command. Please try again.\n";
@@ -118,7 +423,11 @@ void FileManagerUI::deleteFile() {
     cin.ignore();
 
     if (confirm == 'y' || confirm == 'Y') {
-        int statusCode = manager.deleteFile(path);
+        cout << "Move it to the trash instead of deleting it permanently? (y/n): ";
+        cin >> confirm;
+        cin.ignore();
+        DeleteMode mode = confirm == 'y' || confirm == 'Y' ? DeleteMode::Trash : DeleteMode::Permanent;
+        int statusCode = manager.deleteFile(path, mode);
         handleStatus(statusCode);
     }
     else {
@@ -150,7 +459,11 @@ void FileManagerUI::deleteDirectory() {
     cin.ignore();
 
     if (confirm == 'y' || confirm == 'Y') {
-        int statusCode = manager.deleteDirectory(path);
+        cout << "Move it to the trash instead of deleting it permanently? (y/n): ";
+        cin >> confirm;
+        cin.ignore();
+        DeleteMode mode = confirm == 'y' || confirm == 'Y' ? DeleteMode::Trash : DeleteMode::Permanent;
+        int statusCode = manager.deleteDirectory(path, mode);
         handleStatus(statusCode);
     }
     else {
@@ -199,23 +512,849 @@ void FileManagerUI::renameItem() {
  * @brief Searches for files matching a pattern in a specified directory and its subdirectories.
  */
 void FileManagerUI::searchFiles() {
-    string path, pattern;
+    string path, pattern, type;
     vector<string> results;
 
-    cout << "\nEnter directory path to search: ";
+    cout << "\nEnter directory path to search (separate several paths with ';'): ";
     getline(cin, path);
     cout << "Enter filename pattern to search for: ";
     getline(cin, pattern);
+    cout << "Enter file type to match, e.g. pdf or zip (leave empty for any): ";
+    getline(cin, type);
+
+    // Keep interactive searches responsive even for a broad pattern over a huge tree.
+    SearchOptions options;
+    options.fileType = type;
+    options.groupHardLinks = true;
+    options.useIndex = true;
+    options.maxResults = 10000;
+    options.maxDuration = chrono::seconds(10);
 
-    int statusCode = manager.searchFiles(path, pattern, results);
+    int statusCode;
+    if (path.find(';') == string::npos) {
+        statusCode = manager.searchFiles(path, pattern, results, options);
+    }
+    else {
+        vector<string> paths;
+        stringstream stream(path);
+        string item;
+        while (getline(stream, item, ';')) {
+            if (!item.empty()) {
+                paths.push_back(item);
+            }
+        }
+        statusCode = manager.searchFiles(paths, pattern, results, options);
+    }
     handleStatus(statusCode);
 
-    if (statusCode == 200) {
+    if (statusCode == 200 || statusCode == 206) {
         cout << "\nSearch Results:\n";
         for (const auto& item : results) {
             cout << "- " + item + "\n";
         }
     }
+    lastSearchResults = move(results);
+}
+
+/**
+ * @brief Counts the files matching a pattern in a specified directory and its subdirectories.
+ */
+void FileManagerUI::countFiles() {
+    string path, pattern;
+    size_t count = 0;
+
+    cout << "\nEnter directory path to search: ";
+    getline(cin, path);
+    cout << "Enter filename pattern to count: ";
+    getline(cin, pattern);
+
+    SearchOptions options;
+    options.useIndex = true;
+    options.maxDuration = chrono::seconds(10);
+
+    int statusCode = manager.countFiles(path, pattern, count, options);
+    handleStatus(statusCode);
+
+    if (statusCode == 200 || statusCode == 206) {
+        cout << "\nMatching files: " << count << "\n";
+    }
+}
+
+/**
+ * @brief Reports whether any file in a specified directory and its subdirectories matches a pattern.
+ */
+void FileManagerUI::fileExists() {
+    string path, pattern;
+    bool found = false;
+
+    cout << "\nEnter directory path to search: ";
+    getline(cin, path);
+    cout << "Enter filename pattern to look for: ";
+    getline(cin, pattern);
+
+    SearchOptions options;
+    options.useIndex = true;
+    options.maxDuration = chrono::seconds(10);
+
+    int statusCode = manager.fileExists(path, pattern, found, options);
+    handleStatus(statusCode);
+
+    if (found) {
+        cout << "\nA matching file exists.\n";
+    }
+}
+
+/**
+ * @brief Converts file names, and optionally file contents, between Windows-1251 and UTF-8.
+ */
+void FileManagerUI::convertEncoding() {
+    string path, direction;
+    EncodingReport report;
+
+    cout << "\nEnter file or directory path: ";
+    getline(cin, path);
+    cout << "Direction (1 - Windows-1251 to UTF-8, 2 - UTF-8 to Windows-1251): ";
+    getline(cin, direction);
+    if (direction != "1" && direction != "2") {
+        cout << "\nUnknown direction. Operation canceled.\n";
+        return;
+    }
+    cout << "Convert file contents as well? (y/n): ";
+    char confirm;
+    cin >> confirm;
+    cin.ignore();
+
+    int statusCode = manager.convertEncoding(path,
+        direction == "1" ? EncodingDirection::Cp1251ToUtf8 : EncodingDirection::Utf8ToCp1251,
+        confirm == 'y' || confirm == 'Y', report);
+    handleStatus(statusCode);
+
+    if (statusCode == 200 || statusCode == 204 || statusCode == 207) {
+        cout << "\nNames converted: " << report.namesConverted << ", skipped: " << report.namesSkipped << "\n";
+        cout << "Contents converted: " << report.contentsConverted << ", skipped: " << report.contentsSkipped << "\n";
+        cout << "Failures: " << report.failures << "\n";
+    }
+}
+
+/**
+ * @brief Replaces a string in the files under a directory after previewing the changes.
+ * A dry run is shown first, and the files are only rewritten after confirmation.
+ */
+void FileManagerUI::replaceInFiles() {
+    string path, pattern, replacement;
+    ReplaceReport preview;
+
+    cout << "\nEnter file or directory path: ";
+    getline(cin, path);
+    cout << "Enter text to find: ";
+    getline(cin, pattern);
+    cout << "Enter replacement text: ";
+    getline(cin, replacement);
+
+    int statusCode = manager.replaceInFiles(path, pattern, replacement, true, preview);
+    handleStatus(statusCode);
+    if (preview.files.empty()) {
+        return;
+    }
+
+    cout << "\nFiles to change:\n";
+    for (const auto& file : preview.files) {
+        cout << "- " << file.path << " (" << file.replacements << " replacements)\n";
+        cout << "  " << file.lineNumber << ": - " << file.lineBefore << "\n";
+        cout << "  " << file.lineNumber << ": + " << file.lineAfter << "\n";
+    }
+    cout << "\nTotal: " << preview.replacements << " replacements in " << preview.filesChanged << " of "
+        << preview.filesScanned << " text files.\n";
+
+    cout << "\nApply these changes? (y/n): ";
+    char confirm;
+    cin >> confirm;
+    cin.ignore();
+
+    if (confirm == 'y' || confirm == 'Y') {
+        ReplaceReport report;
+        statusCode = manager.replaceInFiles(path, pattern, replacement, false, report);
+        handleStatus(statusCode);
+        cout << "\nReplaced " << report.replacements << " occurrences in " << report.filesChanged << " files.\n";
+    }
+    else {
+        cout << "\nOperation canceled.\n";
+    }
+}
+
+/**
+ * @brief Counts the bytes, lines and words of a file, a directory tree or the last search results.
+ */
+void FileManagerUI::countText() {
+    string path;
+    TextCountReport report;
+
+    cout << "\nEnter file or directory path (leave empty to count the last search results): ";
+    getline(cin, path);
+
+    int statusCode;
+    if (path.empty()) {
+        statusCode = manager.countText(lastSearchResults, report);
+    }
+    else {
+        statusCode = manager.countText(path, report);
+    }
+    handleStatus(statusCode);
+
+    if (statusCode == 200 || statusCode == 207) {
+        cout << "\nlines\twords\tbytes\tfile\n";
+        for (const auto& file : report.files) {
+            cout << file.counts.lines << "\t" << file.counts.words << "\t" << file.counts.bytes << "\t" << file.path << "\n";
+        }
+        cout << report.total.lines << "\t" << report.total.words << "\t" << report.total.bytes << "\ttotal ("
+            << report.files.size() << " files)\n";
+    }
+}
+
+/**
+ * @brief Shows how many files of each detected type a directory tree contains.
+ */
+void FileManagerUI::fileTypeReport() {
+    string path;
+    FileTypeReport report;
+
+    cout << "\nEnter file or directory path: ";
+    getline(cin, path);
+
+    int statusCode = manager.fileTypeReport(path, report);
+    handleStatus(statusCode);
+
+    if (statusCode == 200 || statusCode == 207) {
+        cout << "\nfiles\tbytes\ttype\n";
+        for (const auto& type : report.types) {
+            cout << type.files << "\t" << type.bytes << "\t" << type.type << "\n";
+        }
+    }
+}
+
+/**
+ * @brief Lists empty files and directories under a directory and optionally removes the empty directories.
+ */
+void FileManagerUI::findEmpty() {
+    string path;
+    EmptyReport report;
+
+    cout << "\nEnter directory path: ";
+    getline(cin, path);
+    cout << "Remove the empty directories? (y/n): ";
+    char confirm;
+    cin >> confirm;
+    cin.ignore();
+    bool prune = confirm == 'y' || confirm == 'Y';
+
+    int statusCode = manager.findEmpty(path, prune, report);
+    handleStatus(statusCode);
+
+    if (statusCode == 200 || statusCode == 207) {
+        cout << "\nEmpty files:\n";
+        for (const auto& file : report.emptyFiles) {
+            cout << "- " << file << "\n";
+        }
+        cout << (prune ? "\nRemoved directories:\n" : "\nEmpty directories:\n");
+        for (const auto& directory : report.emptyDirectories) {
+            cout << "- " << directory << "\n";
+        }
+    }
+}
+
+/**
+ * @brief Recursively changes permissions and ownership, like chmod -R and chown -R.
+ */
+void FileManagerUI::setAttributes() {
+    string path, fileMode, directoryMode, owner, group;
+    AttributeRules rules;
+    AttributeReport report;
+
+    cout << "\nEnter file or directory path: ";
+    getline(cin, path);
+    cout << "File mode in octal, e.g. 644 (leave empty to keep): ";
+    getline(cin, fileMode);
+    cout << "Directory mode in octal, e.g. 755 (leave empty to keep): ";
+    getline(cin, directoryMode);
+    cout << "Owner user ID (leave empty to keep): ";
+    getline(cin, owner);
+    cout << "Owner group ID (leave empty to keep): ";
+    getline(cin, group);
+
+    try {
+        if (!fileMode.empty()) {
+            rules.fileMode = stoi(fileMode, nullptr, 8);
+        }
+        if (!directoryMode.empty()) {
+            rules.directoryMode = stoi(directoryMode, nullptr, 8);
+        }
+        if (!owner.empty()) {
+            rules.owner = stoll(owner);
+        }
+        if (!group.empty()) {
+            rules.group = stoll(group);
+        }
+    }
+    catch (const exception&) {
+        cout << "\nInvalid number. Operation canceled.\n";
+        return;
+    }
+
+    int statusCode = manager.setAttributes(path, rules, report);
+    handleStatus(statusCode);
+
+    if (statusCode == 200 || statusCode == 204 || statusCode == 207) {
+        cout << "\nChanged: " << report.changed << ", unchanged: " << report.unchanged << ", failures: " << report.failures << "\n";
+    }
+}
+
+/**
+ * @brief Touches, normalizes or copies the timestamps of a file or directory tree.
+ */
+void FileManagerUI::setTimestamps() {
+    string path, operation, value, which;
+    TimestampRequest request;
+    AttributeReport report;
+
+    cout << "\nEnter file or directory path: ";
+    getline(cin, path);
+    cout << "Operation (1 - touch, 2 - normalize to a fixed time, 3 - copy from a reference tree): ";
+    getline(cin, operation);
+    if (operation == "1") {
+        request.operation = TimestampOperation::Touch;
+    }
+    else if (operation == "2") {
+        request.operation = TimestampOperation::Normalize;
+        cout << "Enter the time in seconds since 1970-01-01 UTC: ";
+        getline(cin, value);
+        try {
+            request.time = stoll(value);
+        }
+        catch (const exception&) {
+            cout << "\nInvalid number. Operation canceled.\n";
+            return;
+        }
+    }
+    else if (operation == "3") {
+        request.operation = TimestampOperation::CopyFrom;
+        cout << "Enter the reference path: ";
+        getline(cin, request.reference);
+    }
+    else {
+        cout << "\nUnknown operation. Operation canceled.\n";
+        return;
+    }
+    cout << "Times to change (1 - both, 2 - modification only, 3 - access only): ";
+    getline(cin, which);
+    request.setAccess = which != "2";
+    request.setModification = which != "3";
+
+    int statusCode = manager.setTimestamps(path, request, report);
+    handleStatus(statusCode);
+
+    if (statusCode == 200 || statusCode == 204 || statusCode == 207) {
+        cout << "\nChanged: " << report.changed << ", unchanged: " << report.unchanged << ", failures: " << report.failures << "\n";
+    }
+}
+
+/**
+ * @brief Shows the space taken by a directory tree, counting hard-linked files once.
+ */
+void FileManagerUI::diskUsage() {
+    string path;
+    DiskUsageReport report;
+
+    cout << "\nEnter file or directory path: ";
+    getline(cin, path);
+    cout << "Use the size cache? (y/n): ";
+    char confirm;
+    cin >> confirm;
+    cin.ignore();
+
+    SizeCacheMode mode = confirm == 'y' || confirm == 'Y' ? SizeCacheMode::Validate : SizeCacheMode::Bypass;
+    int statusCode = manager.diskUsage(path, report, mode);
+    handleStatus(statusCode);
+
+    if (statusCode == 200 || statusCode == 207) {
+        cout << "\nTotal: " << report.bytes << " bytes in " << report.files << " files and "
+            << report.directories << " directories\n";
+        if (mode != SizeCacheMode::Bypass) {
+            cout << "Directories read to update the cache: " << report.reread << "\n";
+        }
+        if (report.hardLinks > 0) {
+            cout << "Hard links counted once: " << report.hardLinks << " paths, " << report.linkedBytes << " bytes\n";
+        }
+        const size_t shown = 20;
+        for (size_t i = 0; i < report.subdirectories.size() && i < shown; ++i) {
+            cout << report.subdirectories[i].bytes << "\t" << report.subdirectories[i].path << "\n";
+        }
+        if (report.subdirectories.size() > shown) {
+            cout << "... and " << report.subdirectories.size() - shown << " more directories\n";
+        }
+    }
+}
+
+/**
+ * @brief Copies a file or directory tree, optionally recreating hard links.
+ */
+void FileManagerUI::copyItem() {
+    string source, destination;
+    CopyReport report;
+
+    cout << "\nEnter source path: ";
+    getline(cin, source);
+    cout << "Enter destination path: ";
+    getline(cin, destination);
+    cout << "Preserve hard links? (y/n): ";
+    char confirm;
+    cin >> confirm;
+    cin.ignore();
+
+    int statusCode = manager.copy(source, destination, confirm == 'y' || confirm == 'Y', report);
+    handleStatus(statusCode);
+
+    if (statusCode == 200 || statusCode == 207) {
+        cout << "\nFiles copied: " << report.files << ", hard links: " << report.hardLinks << ", directories: "
+            << report.directories << ", symbolic links: " << report.symlinks << ", failures: " << report.failures << "\n";
+    }
+}
+
+/**
+ * @brief Builds the search index of a directory tree.
+ */
+void FileManagerUI::buildSearchIndex() {
+    string path;
+    SearchIndexReport report;
+
+    cout << "\nEnter directory path to index: ";
+    getline(cin, path);
+
+    int statusCode = manager.buildSearchIndex(path, report);
+    handleStatus(statusCode);
+
+    if (statusCode == 200) {
+        cout << "\nIndexed " << report.directories << " directories, " << report.filters
+            << " with selective filters, " << report.bytes << " bytes\n";
+    }
+}
+
+/**
+ * @brief Watches drop directories and runs an action on every file that arrives until Enter is pressed.
+ */
+void FileManagerUI::watchFolders() {
+    vector<WatchRule> rules;
+    for (;;) {
+        WatchRule rule;
+        string action;
+        cout << "\nEnter directory to watch (empty to start watching): ";
+        getline(cin, rule.directory);
+        if (rule.directory.empty()) {
+            break;
+        }
+        cout << "File name must contain (empty for all files): ";
+        getline(cin, rule.pattern);
+        cout << "Action (move, rename, checksum): ";
+        getline(cin, action);
+        if (action == "move") {
+            rule.action = WatchActionKind::Move;
+            cout << "Destination directory: ";
+        }
+        else if (action == "rename") {
+            rule.action = WatchActionKind::Rename;
+            cout << "New name ({name}, {stem}, {ext}, {time}): ";
+        }
+        else if (action == "checksum") {
+            rule.action = WatchActionKind::Checksum;
+            cout << "Manifest file: ";
+        }
+        else {
+            cout << "\nUnknown action. Rule skipped.\n";
+            continue;
+        }
+        getline(cin, rule.target);
+        rules.push_back(rule);
+    }
+    if (rules.empty()) {
+        cout << "\nNo rules. Operation canceled.\n";
+        return;
+    }
+
+    cout << "\nWatching " << rules.size() << " rules. Press Enter to stop.\n\n";
+    FolderWatcher watcher(rules, WatchOptions(), [](const WatchResult& result) {
+        cout << (result.statusCode == 200 ? "" : "Failed: ") << result.path << " -> " << result.result
+            << " (" << result.latency.count() << " ms)\n";
+    });
+
+    int statusCode = watcher.run([this]() { return stopRequested(); });
+    if (statusCode != 200) {
+        handleStatus(statusCode);
+    }
+}
+
+/**
+ * @brief Keeps a replica of a directory tree up to date until Enter is pressed.
+ */
+void FileManagerUI::mirrorDirectory() {
+    string source, destination, interval;
+    MirrorOptions options;
+
+    cout << "\nEnter source directory: ";
+    getline(cin, source);
+    cout << "Enter replica directory: ";
+    getline(cin, destination);
+    cout << "Minutes between checksum audits (default 60, 0 to disable): ";
+    getline(cin, interval);
+    try {
+        if (!interval.empty()) {
+            options.auditInterval = chrono::minutes(stoul(interval));
+        }
+    }
+    catch (const exception&) {
+        cout << "\nInvalid number. Operation canceled.\n";
+        return;
+    }
+
+    cout << "\nMirroring " << source << " to " << destination << ". Press Enter to stop.\n\n";
+    MirrorReport report;
+    TreeMirror mirror(source, destination, options, [](MirrorChange change, const string& path) {
+        static const char* const names[] = { "copied", "created", "removed", "moved", "repaired" };
+        cout << names[static_cast<int>(change)] << "\t" << path << "\n";
+    });
+
+    int statusCode = mirror.run([this]() { return stopRequested(); }, report);
+    handleStatus(statusCode);
+    if (statusCode == 200 || statusCode == 207) {
+        cout << "\nCopied: " << report.copied << ", created: " << report.created << ", removed: " << report.removed
+            << ", moved: " << report.moved << ", audits: " << report.audits << ", repaired: " << report.repaired
+            << ", failures: " << report.failures << "\n";
+    }
+}
+
+/**
+ * @brief Lists, restores and empties the trash, or changes its capacity.
+ */
+void FileManagerUI::manageTrash() {
+    Trash& trash = Trash::getInstance();
+    string action, value;
+
+    cout << "\nAction (1 - list, 2 - restore, 3 - empty, 4 - set capacity): ";
+    getline(cin, action);
+    if (action == "1") {
+        vector<TrashEntry> entries;
+        int statusCode = trash.list(entries);
+        if (statusCode == 204) {
+            cout << "\nThe trash is empty.\n";
+            return;
+        }
+        cout << "\n";
+        for (const auto& entry : entries) {
+            time_t deletedAt = static_cast<time_t>(entry.deletedAt);
+            char stamp[32] = "";
+            if (const tm* local = localtime(&deletedAt)) {
+                strftime(stamp, sizeof(stamp), "%Y-%m-%d %H:%M:%S", local);
+            }
+            cout << stamp << "\t" << (entry.measured ? to_string(entry.bytes) : string("?")) << "\t"
+                << entry.originalPath << (entry.directory ? "/" : "") << "\n";
+        }
+        cout << "\nCapacity: " << trash.capacity() << " bytes\n";
+    }
+    else if (action == "2") {
+        cout << "Enter the original path: ";
+        getline(cin, value);
+        handleStatus(manager.restoreFromTrash(value));
+    }
+    else if (action == "3") {
+        cout << "Remove everything in the trash permanently? (y/n): ";
+        getline(cin, value);
+        if (value != "y" && value != "Y") {
+            cout << "\nOperation canceled.\n";
+            return;
+        }
+        size_t removed = 0;
+        int statusCode = trash.empty(removed);
+        handleStatus(statusCode);
+        cout << "\nRemoved: " << removed << "\n";
+    }
+    else if (action == "4") {
+        cout << "Current capacity: " << (trash.capacity() >> 20) << " MiB. Enter the new capacity in MiB: ";
+        getline(cin, value);
+        try {
+            handleStatus(trash.setCapacity(static_cast<uint64_t>(stoull(value)) << 20));
+        }
+        catch (const exception&) {
+            cout << "\nInvalid number. Operation canceled.\n";
+        }
+    }
+    else {
+        cout << "\nUnknown action. Operation canceled.\n";
+    }
+}
+
+/**
+ * @brief Prints the journaled operations that match the user's filter.
+ */
+void FileManagerUI::readJournal() {
+    string operations, minutes, failures;
+    JournalFilter filter;
+
+    cout << "\nOperations, separated by spaces (Enter for all; create-file, delete-file, create-directory,\n"
+        << "delete-directory, rename, trash-file, trash-directory, restore, prune-directory): ";
+    getline(cin, operations);
+    istringstream names(operations);
+    for (string name; names >> name;) {
+        bool known = false;
+        for (uint16_t code = 1; code <= static_cast<uint16_t>(JournalOperation::PruneDirectory); ++code) {
+            if (name == journalOperationName(static_cast<JournalOperation>(code))) {
+                filter.operations.push_back(static_cast<JournalOperation>(code));
+                known = true;
+            }
+        }
+        if (!known) {
+            cout << "\nUnknown operation " << name << ". Operation canceled.\n";
+            return;
+        }
+    }
+    cout << "Path substring (Enter for any): ";
+    getline(cin, filter.pathContains);
+    cout << "Only the last N minutes (Enter for all): ";
+    getline(cin, minutes);
+    try {
+        if (!minutes.empty()) {
+            auto since = chrono::system_clock::now() - chrono::minutes(stoul(minutes));
+            filter.since = chrono::duration_cast<chrono::nanoseconds>(since.time_since_epoch()).count();
+        }
+    }
+    catch (const exception&) {
+        cout << "\nInvalid number. Operation canceled.\n";
+        return;
+    }
+    cout << "Only failed operations? (y/n): ";
+    getline(cin, failures);
+    filter.failuresOnly = failures == "y" || failures == "Y";
+
+    vector<JournalRecord> records;
+    int statusCode = Journal::getInstance().read(filter, records);
+    handleStatus(statusCode);
+    cout << "\n";
+    for (const auto& record : records) {
+        time_t seconds = static_cast<time_t>(record.timestamp / 1000000000);
+        char stamp[32] = "";
+        if (const tm* local = localtime(&seconds)) {
+            strftime(stamp, sizeof(stamp), "%Y-%m-%d %H:%M:%S", local);
+        }
+        char fraction[8];
+        snprintf(fraction, sizeof(fraction), ".%03d", static_cast<int>(record.timestamp / 1000000 % 1000));
+        cout << stamp << fraction << "\t" << journalOperationName(record.operation) << "\t" << record.statusCode
+            << "\t" << record.duration / 1000 << " us\t" << record.path;
+        if (!record.target.empty()) {
+            cout << " -> " << record.target;
+        }
+        cout << "\n";
+    }
+}
+
+/**
+ * @brief Starts or stops writing the operation metrics to a Prometheus textfile collector directory.
+ */
+void FileManagerUI::exportMetrics() {
+    string directory, seconds;
+    Metrics& metrics = Metrics::getInstance();
+
+    filesystem::path current = metrics.exportDirectory();
+    if (!current.empty()) {
+        cout << "\nExporting to " << current.string() << "\n";
+    }
+    cout << "\nEnter textfile collector directory (Enter to stop exporting): ";
+    getline(cin, directory);
+    if (directory.empty()) {
+        metrics.stopExport();
+        cout << "\nMetrics export stopped.\n";
+        return;
+    }
+    cout << "Export interval in seconds (Enter for " << Metrics::defaultExportInterval.count() << "): ";
+    getline(cin, seconds);
+
+    chrono::seconds interval = Metrics::defaultExportInterval;
+    try {
+        if (!seconds.empty()) {
+            interval = chrono::seconds(stoul(seconds));
+        }
+    }
+    catch (const exception&) {
+        cout << "\nInvalid number. Operation canceled.\n";
+        return;
+    }
+
+    int statusCode = metrics.startExport(directory, interval);
+    handleStatus(statusCode);
+    if (statusCode == 200) {
+        cout << "Metrics are written to " << (filesystem::path(directory) / Metrics::exportFileName).string() << "\n";
+    }
+}
+
+/**
+ * @brief Pages through a file as text or hex.
+ * Pages are read straight from a memory mapping, so files of any size open immediately.
+ * Line numbers are shown while the position is known by line; after a jump to a byte
+ * offset the page starts at the enclosing line but its number is not computed.
+ */
+void FileManagerUI::viewFile() {
+    const size_t pageLines = 20;
+    const size_t pageRows = 16;
+    string path;
+    FileViewer viewer;
+
+    cout << "\nEnter file path: ";
+    getline(cin, path);
+
+    int statusCode = viewer.open(path);
+    if (statusCode != 200) {
+        handleStatus(statusCode);
+        return;
+    }
+
+    uint64_t offset = 0;
+    uint64_t line = 0;
+    bool lineKnown = true;
+    bool hex = false;
+    uint64_t nextOffset = 0;
+
+    while (true) {
+        vector<string> rows;
+        cout << "\n--- " << path << " (" << viewer.size() << " bytes, offset " << offset << ") ---\n";
+        if (hex) {
+            viewer.hexRows(offset, pageRows, rows);
+            nextOffset = offset + rows.size() * 16;
+            for (const auto& row : rows) {
+                cout << row << "\n";
+            }
+        }
+        else {
+            bool split = false;
+            nextOffset = viewer.readLines(offset, pageLines, rows, &split);
+            for (size_t i = 0; i < rows.size(); ++i) {
+                if (lineKnown) {
+                    cout << line + i + 1 << ": ";
+                }
+                cout << rows[i] << "\n";
+            }
+            if (split && lineKnown) {
+                lineKnown = false;
+                cout << "(long lines were split; line numbers are no longer tracked)\n";
+            }
+        }
+        if (rows.empty()) {
+            cout << "(end of file)\n";
+        }
+
+        cout << "\n[n]ext, [p]revious, [l]ine <number>, [o]ffset <bytes>, [h]ex/text, [q]uit: ";
+        string input;
+        if (!getline(cin, input)) {
+            return;
+        }
+        istringstream parser(input);
+        string action;
+        uint64_t value = 0;
+        parser >> action;
+
+        if (action.empty() || action == "n") {
+            if (nextOffset < viewer.size()) {
+                line += rows.size();
+                lineKnown = lineKnown && !hex;
+                offset = nextOffset;
+            }
+        }
+        else if (action == "p") {
+            if (hex) {
+                offset = offset > pageRows * 16 ? offset - pageRows * 16 : 0;
+                lineKnown = false;
+            }
+            else {
+                offset = viewer.previousLines(offset, pageLines);
+                line = line > pageLines ? line - pageLines : 0;
+                if (offset == 0) {
+                    line = 0;
+                    lineKnown = true;
+                }
+            }
+        }
+        else if (action == "l" && parser >> value && value > 0) {
+            uint64_t target = 0;
+            if (viewer.lineOffset(value - 1, target)) {
+                offset = target;
+                line = value - 1;
+                lineKnown = true;
+                hex = false;
+            }
+            else {
+                cout << "\nThe file has fewer lines.\n";
+            }
+        }
+        else if (action == "o" && parser >> value) {
+            if (value < viewer.size()) {
+                offset = hex ? value - value % 16 : viewer.lineStart(value);
+                lineKnown = offset == 0;
+                line = 0;
+            }
+            else {
+                cout << "\nThe offset is past the end of the file.\n";
+            }
+        }
+        else if (action == "h") {
+            hex = !hex;
+            if (!hex) {
+                offset = viewer.lineStart(offset);
+                lineKnown = lineKnown || offset == 0;
+                if (offset == 0) {
+                    line = 0;
+                }
+            }
+        }
+        else if (action == "q") {
+            return;
+        }
+        else {
+            cout << "\nUnknown viewer command.\n";
+        }
+    }
+}
+
+/**
+ * @brief Prints the last lines of a file and then everything appended to it until Enter is pressed.
+ */
+void FileManagerUI::followFile() {
+    string path, lines;
+
+    cout << "\nEnter file path: ";
+    getline(cin, path);
+    cout << "Number of trailing lines to show (default 10): ";
+    getline(cin, lines);
+
+    size_t lineCount = 10;
+    try {
+        if (!lines.empty()) {
+            lineCount = stoul(lines);
+        }
+    }
+    catch (const exception&) {
+        cout << "\nInvalid number. Operation canceled.\n";
+        return;
+    }
+
+    cout << "\nFollowing " << path << ". Press Enter to stop.\n\n";
+    FileFollower follower(
+        [](const char* data, size_t size) {
+            cout.write(data, static_cast<streamsize>(size));
+            cout.flush();
+        },
+        [](FollowEvent event) {
+            cout << (event == FollowEvent::Truncated ? "\n--- file truncated ---\n" : "\n--- file rotated ---\n");
+        });
+
+    int statusCode = follower.follow(path, lineCount, [this]() { return stopRequested(); });
+    if (statusCode != 200) {
+        handleStatus(statusCode);
+    }
 }
 
 /**
@@ -242,6 +1381,7 @@ void FileManagerUI::clearConsoleWithConfirmation() {
 
 /**
  * @brief Handles and outputs a message corresponding to a file system operation status code.
+ * While profiling is on, the resources used by the operation are printed after the message.
  * @param statusCode Status code returned by a file system operation.
  */
 void FileManagerUI::handleStatus(int statusCode) {
@@ -252,6 +1392,12 @@ void FileManagerUI::handleStatus(int statusCode) {
     case 204:
         cout << "\nNo files found matching the criteria.\n";
         break;
+    case 206:
+        cout << "\nSearch limit reached. Showing partial results.\n";
+        break;
+    case 207:
+        cout << "\nOperation completed, but some items failed. See the errors above.\n";
+        break;
     case 400:
         cout << "\nError: Invalid path or resource already exists.\n";
         break;
@@ -261,8 +1407,49 @@ void FileManagerUI::handleStatus(int statusCode) {
     case 500:
         cout << "\nError: System error occurred. Please check your input or permissions.\n";
         break;
+    case 501:
+        cout << "\nError: This operation is not supported on this platform.\n";
+        break;
     default:
         cout << "\nUnknown status code: " << statusCode << "\n";
         break;
     }
+
+    OperationProfile profile;
+    if (Profiler::getInstance().takeLast(profile)) {
+        printProfile(profile);
+    }
+}
+
+/**
+ * @brief Prints the resources used by an operation.
+ * The share of CPU time in the wall time tells whether the operation was bound by the CPU
+ * or mostly waited; it exceeds 100% when several threads worked in parallel.
+ * @param profile The profile of the operation.
+ */
+void FileManagerUI::printProfile(const OperationProfile& profile) {
+    auto milliseconds = [](int64_t nanoseconds) { return nanoseconds / 1e6; };
+    int64_t cpuTime = profile.userTime + profile.systemTime;
+    ostringstream out;
+    out.setf(ios::fixed);
+    out.precision(3);
+    out << "Wall time: " << milliseconds(profile.wallTime) << " ms, CPU time: " << milliseconds(cpuTime)
+        << " ms (user " << milliseconds(profile.userTime) << " ms, system " << milliseconds(profile.systemTime) << " ms)";
+    if (profile.wallTime > 0) {
+        out.precision(0);
+        out << ", " << 100.0 * cpuTime / profile.wallTime << "% of wall time";
+    }
+    out << "\n";
+#ifndef _WIN32
+    out << "Context switches: " << profile.voluntarySwitches << " voluntary, " << profile.involuntarySwitches
+        << " involuntary\n";
+    out << "Page faults: " << profile.majorFaults << " major, " << profile.minorFaults << " minor\n";
+    out << "Storage: " << profile.blockReads << " blocks read, " << profile.blockWrites << " blocks written\n";
+#else
+    out << "Page faults: " << profile.minorFaults << "\n";
+    out << "I/O operations: " << profile.blockReads << " reads, " << profile.blockWrites << " writes\n";
+#endif
+    out << "Peak memory growth: " << profile.peakResidentGrowth / 1024 << " KiB\n";
+    out << "Allocations: " << profile.allocations << " (" << profile.allocatedBytes << " bytes)\n";
+    cout << out.str();
 }
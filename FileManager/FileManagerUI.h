@@ -7,7 +7,10 @@
 #define FILE_MANAGER_UI_H
 
 #include "BaseFileManager.h"
+#include "Profiler.h"
+#include "Session.h"
 #include <string>
+#include <vector>
 
  /**
   * @class FileManagerUI
@@ -20,12 +23,38 @@ private:
      */
     BaseFileManager& manager;
 
+    /**
+     * @brief Results of the most recent search, for commands that operate on them.
+     */
+    std::vector<std::string> lastSearchResults;
+
+    /**
+     * @brief Recorder of the session, or null if the session is not recorded.
+     */
+    SessionRecorder* recorder = nullptr;
+
+    /**
+     * @brief Whether a recorded session is being replayed; commands that run until Enter is pressed stop at once.
+     */
+    bool replaying = false;
+
+    /**
+     * @brief Returns whether a command that runs until Enter is pressed should stop.
+     */
+    bool stopRequested();
+
     /**
      * @brief Handles status codes and provides user feedback.
      * @param statusCode Status code from file operations.
      */
     void handleStatus(int statusCode);
 
+    /**
+     * @brief Prints the resources used by an operation.
+     * @param profile The profile of the operation.
+     */
+    void printProfile(const OperationProfile& profile);
+
     /**
      * @brief Processes a user command.
      * @param command User command as a string.
@@ -41,6 +70,25 @@ private:
     void renameItem();
     void clearConsoleWithConfirmation();
     void searchFiles();
+    void countFiles();
+    void fileExists();
+    void convertEncoding();
+    void replaceInFiles();
+    void viewFile();
+    void followFile();
+    void countText();
+    void fileTypeReport();
+    void findEmpty();
+    void setAttributes();
+    void setTimestamps();
+    void diskUsage();
+    void copyItem();
+    void buildSearchIndex();
+    void watchFolders();
+    void mirrorDirectory();
+    void manageTrash();
+    void readJournal();
+    void exportMetrics();
 
 public:
     /**
@@ -53,6 +101,22 @@ public:
      * @brief Starts the interactive console UI.
      */
     void start();
+
+    /**
+     * @brief Records the commands entered from now on.
+     * @param recorder The opened recorder, or null to stop recording.
+     */
+    void setRecorder(SessionRecorder* recorder);
+
+    /**
+     * @brief Runs a recorded session against a directory and prints the latency of every command.
+     * @param sessionFile The session file.
+     * @param root The directory that takes the place of the recorded root.
+     * @param paced Whether to start each command at its recorded time instead of as soon as possible.
+     * @return Status code: 200 on success, 404 if the session file does not exist, 400 if it is
+     * not a session file or the root is not a directory, 500 on a system error.
+     */
+    int replay(const std::string& sessionFile, const std::string& root, bool paced);
 };
 
 #endif // FILE_MANAGER_UI_H
\ No newline at end of file
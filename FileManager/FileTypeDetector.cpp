@@ -0,0 +1,286 @@
+/**
+ * @file FileTypeDetector.cpp
+ * @brief Implementation of magic-byte file type detection.
+ */
+
+#include "FileTypeDetector.h"
+#include "ParallelFor.h"
+#include <array>
+#include <cstring>
+
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <Windows.h>
+#else
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+using namespace std;
+namespace fs = filesystem;
+
+namespace {
+
+/**
+ * @brief A magic number: bytes expected at an offset, optionally together with a second
+ * run of bytes at another offset for container formats such as RIFF. Where the second
+ * offset is stored in the file itself, as for the PE header of an executable, secondOffset
+ * is the position of that offset, a little-endian 32-bit value, and secondIndirect is set.
+ */
+struct Signature {
+    const char* type;
+    size_t offset;
+    const char* bytes;
+    size_t length;
+    size_t secondOffset;
+    const char* secondBytes;
+    size_t secondLength;
+    bool secondIndirect;
+};
+
+/**
+ * @brief Known signatures. Where one signature is a prefix of another, the longer one comes first.
+ * Two-letter magic numbers are confirmed by bytes that text never has: BMP's reserved header
+ * words are zero, and an MZ executable is "pe" if its PE header lies within the examined bytes,
+ * otherwise "mz" if the reserved words of its DOS header are zero.
+ */
+const Signature signatures[] = {
+    { "png", 0, "\x89PNG\r\n\x1A\n", 8, 0, nullptr, 0, false },
+    { "jpeg", 0, "\xFF\xD8\xFF", 3, 0, nullptr, 0, false },
+    { "gif", 0, "GIF87a", 6, 0, nullptr, 0, false },
+    { "gif", 0, "GIF89a", 6, 0, nullptr, 0, false },
+    { "bmp", 0, "BM", 2, 6, "\0\0\0\0", 4, false },
+    { "tiff", 0, "II*\0", 4, 0, nullptr, 0, false },
+    { "tiff", 0, "MM\0*", 4, 0, nullptr, 0, false },
+    { "ico", 0, "\0\0\1\0", 4, 0, nullptr, 0, false },
+    { "webp", 0, "RIFF", 4, 8, "WEBP", 4, false },
+    { "wav", 0, "RIFF", 4, 8, "WAVE", 4, false },
+    { "avi", 0, "RIFF", 4, 8, "AVI ", 4, false },
+    { "mp4", 4, "ftyp", 4, 0, nullptr, 0, false },
+    { "mkv", 0, "\x1A\x45\xDF\xA3", 4, 0, nullptr, 0, false },
+    { "mp3", 0, "ID3", 3, 0, nullptr, 0, false },
+    { "flac", 0, "fLaC", 4, 0, nullptr, 0, false },
+    { "ogg", 0, "OggS", 4, 0, nullptr, 0, false },
+    { "pdf", 0, "%PDF-", 5, 0, nullptr, 0, false },
+    { "rtf", 0, "{\\rtf", 5, 0, nullptr, 0, false },
+    { "xml", 0, "<?xml", 5, 0, nullptr, 0, false },
+    { "xml", 0, "\xEF\xBB\xBF<?xml", 8, 0, nullptr, 0, false },
+    { "zip", 0, "PK\3\4", 4, 0, nullptr, 0, false },
+    { "zip", 0, "PK\5\6", 4, 0, nullptr, 0, false },
+    { "gzip", 0, "\x1F\x8B", 2, 0, nullptr, 0, false },
+    { "bzip2", 0, "BZh", 3, 0, nullptr, 0, false },
+    { "xz", 0, "\xFD" "7zXZ\0", 6, 0, nullptr, 0, false },
+    { "7z", 0, "7z\xBC\xAF\x27\x1C", 6, 0, nullptr, 0, false },
+    { "rar", 0, "Rar!\x1A\x07", 6, 0, nullptr, 0, false },
+    { "zstd", 0, "\x28\xB5\x2F\xFD", 4, 0, nullptr, 0, false },
+    { "tar", 257, "ustar", 5, 0, nullptr, 0, false },
+    { "ole", 0, "\xD0\xCF\x11\xE0\xA1\xB1\x1A\xE1", 8, 0, nullptr, 0, false },
+    { "sqlite", 0, "SQLite format 3\0", 16, 0, nullptr, 0, false },
+    { "elf", 0, "\x7F" "ELF", 4, 0, nullptr, 0, false },
+    { "pe", 0, "MZ", 2, 0x3C, "PE\0\0", 4, true },
+    { "mz", 0, "MZ", 2, 0x28, "\0\0\0\0\0\0\0\0\0\0\0\0\0\0\0\0\0\0\0\0", 20, false },
+    { "macho", 0, "\xCF\xFA\xED\xFE", 4, 0, nullptr, 0, false },
+    { "macho", 0, "\xCE\xFA\xED\xFE", 4, 0, nullptr, 0, false },
+    { "java-class", 0, "\xCA\xFE\xBA\xBE", 4, 0, nullptr, 0, false },
+    { "wasm", 0, "\0asm", 4, 0, nullptr, 0, false },
+    { "script", 0, "#!", 2, 0, nullptr, 0, false },
+};
+
+/**
+ * @brief Signatures grouped for lookup: those at offset zero by their first byte, the rest in a list.
+ */
+struct CompiledTable {
+    array<vector<const Signature*>, 256> byFirstByte;
+    vector<const Signature*> elsewhere;
+};
+
+/**
+ * @brief Returns the compiled signature table, building it on first use.
+ * @return The table.
+ */
+const CompiledTable& compiledTable() {
+    static const CompiledTable table = []() {
+        CompiledTable result;
+        for (const auto& signature : signatures) {
+            if (signature.offset == 0) {
+                result.byFirstByte[static_cast<unsigned char>(signature.bytes[0])].push_back(&signature);
+            }
+            else {
+                result.elsewhere.push_back(&signature);
+            }
+        }
+        return result;
+    }();
+    return table;
+}
+
+/**
+ * @brief Control bytes that occur in text: tab, line feed, vertical tab, form feed, carriage return and escape.
+ */
+const bool isTextControl[32] = {
+    false, false, false, false, false, false, false, false, false, true, true, true, true, true, false, false,
+    false, false, false, false, false, false, false, false, false, false, false, true, false, false, false, false,
+};
+
+/**
+ * @brief Checks whether a header carries a signature.
+ * @param signature The signature to test.
+ * @param header Leading bytes of the file.
+ * @param size Number of bytes available.
+ * @return True if every byte of the signature is present.
+ */
+bool matches(const Signature& signature, const char* header, size_t size) {
+    if (signature.offset + signature.length > size || memcmp(header + signature.offset, signature.bytes, signature.length) != 0) {
+        return false;
+    }
+    if (signature.secondBytes == nullptr) {
+        return true;
+    }
+    size_t secondOffset = signature.secondOffset;
+    if (signature.secondIndirect) {
+        if (secondOffset + 4 > size) {
+            return false;
+        }
+        auto bytes = reinterpret_cast<const unsigned char*>(header + secondOffset);
+        secondOffset = static_cast<size_t>(bytes[0]) | static_cast<size_t>(bytes[1]) << 8
+            | static_cast<size_t>(bytes[2]) << 16 | static_cast<size_t>(bytes[3]) << 24;
+    }
+    return secondOffset <= size && signature.secondLength <= size - secondOffset
+        && memcmp(header + secondOffset, signature.secondBytes, signature.secondLength) == 0;
+}
+
+/**
+ * @brief Reads the leading bytes and the size of a file.
+ * @param path Path to the file.
+ * @param header Buffer of FileTypeDetector::headerSize bytes.
+ * @param got Receives the number of bytes read.
+ * @param fileSize Receives the size of the file.
+ * @return False if the file cannot be opened or read.
+ */
+bool readHeader(const fs::path& path, char* header, size_t& got, uint64_t& fileSize) {
+#ifdef _WIN32
+    HANDLE handle = CreateFileW(path.c_str(), GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE,
+        nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+    if (handle == INVALID_HANDLE_VALUE) {
+        return false;
+    }
+    LARGE_INTEGER size;
+    DWORD transferred = 0;
+    bool ok = GetFileSizeEx(handle, &size)
+        && ReadFile(handle, header, static_cast<DWORD>(FileTypeDetector::headerSize), &transferred, nullptr);
+    CloseHandle(handle);
+    got = transferred;
+    fileSize = ok ? static_cast<uint64_t>(size.QuadPart) : 0;
+    return ok;
+#else
+    int descriptor = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (descriptor < 0) {
+        return false;
+    }
+    struct stat info;
+    bool ok = fstat(descriptor, &info) == 0;
+    ssize_t transferred = ok ? read(descriptor, header, FileTypeDetector::headerSize) : -1;
+    close(descriptor);
+    if (transferred < 0) {
+        return false;
+    }
+    got = static_cast<size_t>(transferred);
+    fileSize = static_cast<uint64_t>(info.st_size);
+    return true;
+#endif
+}
+
+} // namespace
+
+/**
+ * @brief Classifies a file header against the compiled signature table.
+ * @param header Leading bytes of the file.
+ * @param size Number of bytes available, at most headerSize are examined.
+ * @return Name of the detected type.
+ */
+const char* FileTypeDetector::detect(const char* header, size_t size) {
+    if (size == 0) {
+        return "empty";
+    }
+    size = min(size, headerSize);
+    const CompiledTable& table = compiledTable();
+    for (const Signature* signature : table.byFirstByte[static_cast<unsigned char>(header[0])]) {
+        if (matches(*signature, header, size)) {
+            return signature->type;
+        }
+    }
+    for (const Signature* signature : table.elsewhere) {
+        if (matches(*signature, header, size)) {
+            return signature->type;
+        }
+    }
+
+    // Text in any ASCII-compatible encoding, UTF-8 or a legacy code page such as
+    // Windows-1251, has no control bytes other than whitespace and escape.
+    for (size_t i = 0; i < size; ++i) {
+        auto byte = static_cast<unsigned char>(header[i]);
+        if (byte < 0x20 && !isTextControl[byte]) {
+            return "binary";
+        }
+    }
+    return "text";
+}
+
+/**
+ * @brief Reads the header of a file and classifies it.
+ * @param path Path to the file.
+ * @param fileSize Optional; receives the size of the file.
+ * @return Name of the detected type, or nullptr if the file cannot be read.
+ */
+const char* FileTypeDetector::detectFile(const fs::path& path, uint64_t* fileSize) {
+    char header[headerSize];
+    size_t got = 0;
+    uint64_t size = 0;
+    if (!readHeader(path, header, got, size)) {
+        return nullptr;
+    }
+    if (fileSize) {
+        *fileSize = size;
+    }
+    return detect(header, got);
+}
+
+/**
+ * @brief Classifies many files, reading their headers in parallel.
+ * Header reads are small and dominated by open latency, so throughput comes from keeping
+ * many opens in flight at once on a pool of threads.
+ * @param files Files to classify.
+ * @param types Receives the type of each file, nullptr where a file cannot be read.
+ * @param sizes Optional; receives the size of each file.
+ * @param threads Number of worker threads; 0 selects the hardware concurrency.
+ */
+void FileTypeDetector::detectFiles(const vector<fs::path>& files, vector<const char*>& types, vector<uint64_t>* sizes,
+    unsigned threads) {
+    types.assign(files.size(), nullptr);
+    if (sizes) {
+        sizes->assign(files.size(), 0);
+    }
+    parallelFor(files.size(), threads, [&](size_t index, unsigned) {
+        types[index] = detectFile(files[index], sizes ? &(*sizes)[index] : nullptr);
+    });
+}
+
+/**
+ * @brief Lists the names of all types the detector can report.
+ * @return Type names in table order without duplicates, followed by "text", "binary" and "empty".
+ */
+vector<const char*> FileTypeDetector::knownTypes() {
+    vector<const char*> names;
+    for (const auto& signature : signatures) {
+        if (names.empty() || strcmp(names.back(), signature.type) != 0) {
+            names.push_back(signature.type);
+        }
+    }
+    names.push_back("text");
+    names.push_back("binary");
+    names.push_back("empty");
+    return names;
+}
@@ -0,0 +1,64 @@
+/**
+ * @file FileTypeDetector.h
+ * @brief Declares the FileTypeDetector class, which identifies file formats from their leading bytes.
+ */
+
+#ifndef FILE_TYPE_DETECTOR_H
+#define FILE_TYPE_DETECTOR_H
+
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <vector>
+
+/**
+ * @class FileTypeDetector
+ * @brief Classifies files by magic bytes rather than by extension.
+ *
+ * Signatures are kept in a static table that is compiled on first use into
+ * per-first-byte candidate lists, so classifying a header compares it against only
+ * the few signatures that can possibly match. Files without a known signature are
+ * reported as "text" if their header has no control bytes other than whitespace and
+ * escape, and as "binary" otherwise; files of size zero are "empty".
+ */
+class FileTypeDetector {
+public:
+    /**
+     * @brief Number of leading bytes read from each file.
+     */
+    static constexpr std::size_t headerSize = 512;
+
+    /**
+     * @brief Classifies a file header.
+     * @param header Leading bytes of the file.
+     * @param size Number of bytes available, at most headerSize are examined.
+     * @return Name of the detected type, such as "png" or "zip".
+     */
+    static const char* detect(const char* header, std::size_t size);
+
+    /**
+     * @brief Reads the header of a file and classifies it.
+     * @param path Path to the file.
+     * @param fileSize Optional; receives the size of the file.
+     * @return Name of the detected type, or nullptr if the file cannot be read.
+     */
+    static const char* detectFile(const std::filesystem::path& path, std::uint64_t* fileSize = nullptr);
+
+    /**
+     * @brief Classifies many files, reading their headers in parallel.
+     * @param files Files to classify.
+     * @param types Receives the type of each file, nullptr where a file cannot be read.
+     * @param sizes Optional; receives the size of each file.
+     * @param threads Number of worker threads; 0 selects the hardware concurrency.
+     */
+    static void detectFiles(const std::vector<std::filesystem::path>& files, std::vector<const char*>& types,
+        std::vector<std::uint64_t>* sizes = nullptr, unsigned threads = 0);
+
+    /**
+     * @brief Lists the names of all types the detector can report.
+     * @return Type names in table order, followed by "text", "binary" and "empty".
+     */
+    static std::vector<const char*> knownTypes();
+};
+
+#endif // FILE_TYPE_DETECTOR_H
@@ -0,0 +1,245 @@
+/**
+ * @file FileViewer.cpp
+ * @brief Implementation of the paged file viewer and its lazily built line index.
+ */
+
+#include "FileViewer.h"
+#include "TextScanner.h"
+#include <algorithm>
+#include <cstring>
+#include <filesystem>
+
+using namespace std;
+namespace fs = filesystem;
+
+namespace {
+
+/**
+ * @brief Number of bytes examined per step while scanning for newlines.
+ */
+constexpr size_t scanBlockSize = 1 << 20;
+
+} // namespace
+
+/**
+ * @brief Opens a file for viewing and resets the line index.
+ * @param path Path to the file.
+ * @return Status code: 200 on success, 404 if the file does not exist, 400 if it is not
+ * a regular file, 500 if it cannot be opened.
+ */
+int FileViewer::open(const string& path) {
+    checkpoints.assign(1, 0);
+    scanOffset = 0;
+    scanLine = 0;
+    file.close();
+
+    error_code error;
+    auto status = fs::status(path, error);
+    if (error || !fs::exists(status)) {
+        return 404;
+    }
+    if (!fs::is_regular_file(status)) {
+        return 400;
+    }
+    return file.open(path) ? 200 : 500;
+}
+
+/**
+ * @brief Returns the size of the open file.
+ * @return File size in bytes.
+ */
+uint64_t FileViewer::size() const {
+    return file.size();
+}
+
+/**
+ * @brief Finds the offset at which a line starts, starting from the nearest index entry.
+ * @param line Zero-based line number.
+ * @param offset Receives the offset of the first byte of the line.
+ * @return False if the file has fewer lines.
+ */
+bool FileViewer::lineOffset(uint64_t line, uint64_t& offset) {
+    size_t entry = static_cast<size_t>(line / lineInterval);
+    extendIndex(entry);
+    if (entry >= checkpoints.size()) {
+        return false;
+    }
+    offset = checkpoints[entry];
+    if (!skipNewlines(offset, line % lineInterval)) {
+        return false;
+    }
+    // A trailing newline ends the last line rather than starting an empty one.
+    return line == 0 || offset < file.size();
+}
+
+/**
+ * @brief Finds the start of the line containing an offset.
+ * @param offset Offset within the file.
+ * @return Offset of the line start.
+ */
+uint64_t FileViewer::lineStart(uint64_t offset) {
+    offset = min(offset, file.size());
+    uint64_t from = offset > maxLineLength ? offset - maxLineLength : 0;
+    size_t available = 0;
+    const char* data = file.map(from, static_cast<size_t>(offset - from), available);
+    if (data == nullptr) {
+        return offset;
+    }
+    for (uint64_t i = offset; i > from; --i) {
+        if (data[i - 1 - from] == '\n') {
+            return i;
+        }
+    }
+    return from;
+}
+
+/**
+ * @brief Moves back a number of lines from a line start.
+ * @param offset Offset of a line start.
+ * @param count Number of lines to move back.
+ * @return Offset of the line start count lines before offset, or 0.
+ */
+uint64_t FileViewer::previousLines(uint64_t offset, size_t count) {
+    for (size_t i = 0; i < count && offset > 0; ++i) {
+        offset = lineStart(offset - 1);
+    }
+    return offset;
+}
+
+/**
+ * @brief Reads lines starting at an offset, without their line terminators.
+ * @param offset Offset of the first line.
+ * @param count Maximum number of lines to read.
+ * @param lines Receives the lines.
+ * @param split Optional; set to true if a line longer than maxLineLength was split.
+ * @return Offset just past the last line read.
+ */
+uint64_t FileViewer::readLines(uint64_t offset, size_t count, vector<string>& lines, bool* split) {
+    lines.clear();
+    while (lines.size() < count && offset < file.size()) {
+        size_t available = 0;
+        const char* data = file.map(offset, maxLineLength + 1, available);
+        if (data == nullptr) {
+            break;
+        }
+        size_t length = min(available, maxLineLength + 1);
+        const char* newline = static_cast<const char*>(memchr(data, '\n', length));
+        size_t lineLength = newline ? static_cast<size_t>(newline - data) : min(length, maxLineLength);
+        if (newline == nullptr && lineLength < file.size() - offset && split) {
+            *split = true;
+        }
+
+        string line(data, lineLength);
+        if (!line.empty() && line.back() == '\r') {
+            line.pop_back();
+        }
+        lines.push_back(move(line));
+        offset += lineLength + (newline ? 1 : 0);
+    }
+    return offset;
+}
+
+/**
+ * @brief Formats bytes as hex dump rows of sixteen bytes with an ASCII column.
+ * @param offset Offset of the first byte.
+ * @param rowCount Maximum number of rows.
+ * @param rows Receives the formatted rows.
+ */
+void FileViewer::hexRows(uint64_t offset, size_t rowCount, vector<string>& rows) {
+    static const char digits[] = "0123456789abcdef";
+    rows.clear();
+    size_t available = 0;
+    const char* data = file.map(offset, rowCount * 16, available);
+    if (data == nullptr) {
+        return;
+    }
+    size_t total = min(available, rowCount * 16);
+
+    for (size_t start = 0; start < total; start += 16) {
+        string row;
+        uint64_t address = offset + start;
+        for (int shift = 44; shift >= 0; shift -= 4) {
+            row.push_back(digits[(address >> shift) & 0xF]);
+        }
+        row += "  ";
+        string text;
+        for (size_t i = start; i < start + 16; ++i) {
+            if (i < total) {
+                auto byte = static_cast<unsigned char>(data[i]);
+                row.push_back(digits[byte >> 4]);
+                row.push_back(digits[byte & 0xF]);
+                text.push_back(byte >= 0x20 && byte < 0x7F ? static_cast<char>(byte) : '.');
+            }
+            else {
+                row += "  ";
+            }
+            row += i - start == 7 ? "  " : " ";
+        }
+        rows.push_back(row + "|" + text + "|");
+    }
+}
+
+/**
+ * @brief Extends the sparse index until it holds the given entry or reaches the end of the file.
+ * Whole blocks whose newline count keeps them short of the next index point are skipped
+ * after a vectorized count; newlines are located one by one only in the block that
+ * completes the line before an index point.
+ * @param entry Index of the wanted entry.
+ */
+void FileViewer::extendIndex(size_t entry) {
+    while (checkpoints.size() <= entry && scanOffset < file.size()) {
+        size_t available = 0;
+        const char* data = file.map(scanOffset, scanBlockSize, available);
+        if (data == nullptr) {
+            return;
+        }
+        size_t length = min(available, scanBlockSize);
+        uint64_t nextLine = checkpoints.size() * lineInterval;
+        size_t newlines = TextScanner::count(data, length, '\n');
+
+        if (scanLine + newlines < nextLine) {
+            scanLine += newlines;
+            scanOffset += length;
+            continue;
+        }
+
+        const char* position = data;
+        const char* end = data + length;
+        while (scanLine < nextLine) {
+            position = static_cast<const char*>(memchr(position, '\n', static_cast<size_t>(end - position))) + 1;
+            ++scanLine;
+        }
+        scanOffset += static_cast<uint64_t>(position - data);
+        checkpoints.push_back(scanOffset);
+    }
+}
+
+/**
+ * @brief Advances past a number of newlines, counting whole blocks where possible.
+ * @param offset Offset to start at; receives the offset after the last newline skipped.
+ * @param count Number of newlines to skip.
+ * @return False if the end of the file comes first.
+ */
+bool FileViewer::skipNewlines(uint64_t& offset, uint64_t count) {
+    while (count > 0) {
+        size_t available = 0;
+        const char* data = file.map(offset, scanBlockSize, available);
+        if (data == nullptr) {
+            return false;
+        }
+        size_t length = min(available, scanBlockSize);
+        size_t newlines = TextScanner::count(data, length, '\n');
+        if (newlines < count) {
+            count -= newlines;
+            offset += length;
+            continue;
+        }
+
+        const char* position = data;
+        for (; count > 0; --count) {
+            position = static_cast<const char*>(memchr(position, '\n', static_cast<size_t>(data + length - position))) + 1;
+        }
+        offset += static_cast<uint64_t>(position - data);
+    }
+    return true;
+}
@@ -0,0 +1,122 @@
+/**
+ * @file FileViewer.h
+ * @brief Declares the FileViewer class, which pages through files of any size by line or byte offset.
+ */
+
+#ifndef FILE_VIEWER_H
+#define FILE_VIEWER_H
+
+#include "MappedFile.h"
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+/**
+ * @class FileViewer
+ * @brief Read-only paged access to a file as text lines or hex rows.
+ *
+ * The file is accessed through a MappedFile window, so memory use does not grow with
+ * the file size. Line numbers are resolved through a sparse index holding the offset
+ * of every lineInterval-th line. The index is built lazily, only as far as the
+ * furthest line requested, by counting newlines a block at a time with
+ * TextScanner::count and locating individual newlines only in the block that
+ * contains an index point.
+ */
+class FileViewer {
+public:
+    /**
+     * @brief Number of lines between two entries of the sparse line index.
+     */
+    static constexpr std::uint64_t lineInterval = 4096;
+
+    /**
+     * @brief Longest run of bytes shown as one line; longer lines are split.
+     */
+    static constexpr std::size_t maxLineLength = 4096;
+
+    /**
+     * @brief Opens a file for viewing.
+     * @param path Path to the file.
+     * @return Status code: 200 on success, 404 if the file does not exist, 400 if it is not
+     * a regular file, 500 if it cannot be opened.
+     */
+    int open(const std::string& path);
+
+    /**
+     * @brief Returns the size of the open file.
+     * @return File size in bytes.
+     */
+    std::uint64_t size() const;
+
+    /**
+     * @brief Finds the offset at which a line starts.
+     * @param line Zero-based line number.
+     * @param offset Receives the offset of the first byte of the line.
+     * @return False if the file has fewer lines.
+     */
+    bool lineOffset(std::uint64_t line, std::uint64_t& offset);
+
+    /**
+     * @brief Finds the start of the line containing an offset.
+     * The search looks back at most maxLineLength bytes.
+     * @param offset Offset within the file.
+     * @return Offset of the line start.
+     */
+    std::uint64_t lineStart(std::uint64_t offset);
+
+    /**
+     * @brief Moves back a number of lines.
+     * @param offset Offset of a line start.
+     * @param count Number of lines to move back.
+     * @return Offset of the line start count lines before offset, or 0.
+     */
+    std::uint64_t previousLines(std::uint64_t offset, std::size_t count);
+
+    /**
+     * @brief Reads lines starting at an offset, without their line terminators.
+     * @param offset Offset of the first line.
+     * @param count Maximum number of lines to read.
+     * @param lines Receives the lines.
+     * @param split Optional; set to true if a line longer than maxLineLength was split.
+     * @return Offset just past the last line read.
+     */
+    std::uint64_t readLines(std::uint64_t offset, std::size_t count, std::vector<std::string>& lines, bool* split = nullptr);
+
+    /**
+     * @brief Formats bytes as hex dump rows of sixteen bytes with an ASCII column.
+     * @param offset Offset of the first byte.
+     * @param rowCount Maximum number of rows.
+     * @param rows Receives the formatted rows.
+     */
+    void hexRows(std::uint64_t offset, std::size_t rowCount, std::vector<std::string>& rows);
+
+private:
+    /**
+     * @brief Extends the sparse index until it holds the given entry or reaches the end of the file.
+     */
+    void extendIndex(std::size_t entry);
+
+    /**
+     * @brief Advances past a number of newlines.
+     * @param offset Offset to start at; receives the offset after the last newline skipped.
+     * @param count Number of newlines to skip.
+     * @return False if the end of the file comes first.
+     */
+    bool skipNewlines(std::uint64_t& offset, std::uint64_t count);
+
+    MappedFile file;
+
+    /**
+     * @brief Offset of line k * lineInterval at position k.
+     */
+    std::vector<std::uint64_t> checkpoints;
+
+    /**
+     * @brief Where the index scan stopped, and the line number at that point.
+     */
+    std::uint64_t scanOffset = 0;
+    std::uint64_t scanLine = 0;
+};
+
+#endif // FILE_VIEWER_H
@@ -0,0 +1,529 @@
+/**
+ * @file FolderWatcher.cpp
+ * @brief Implementation of the debounced watch-folder pipeline.
+ */
+
+#include "FolderWatcher.h"
+#include "BaseFileManager.h"
+#include "DirectoryMonitor.h"
+#include "FileId.h"
+#include "ParallelFor.h"
+#include "Sha256.h"
+#include <algorithm>
+#include <condition_variable>
+#include <ctime>
+#include <deque>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <system_error>
+#include <utility>
+
+using namespace std;
+namespace fs = filesystem;
+
+namespace {
+
+using Clock = chrono::steady_clock;
+
+/**
+ * @brief How long changes to a file produced by an action are ignored, beyond the quiet period.
+ */
+constexpr chrono::milliseconds producedGrace{ 1000 };
+
+/**
+ * @brief A file seen changing that is not yet complete.
+ */
+struct PendingFile {
+    size_t rule = 0;
+    Clock::time_point arrived;    ///< First change seen.
+    Clock::time_point lastChange; ///< Most recent change seen.
+    bool open = false;            ///< Written to since it was last closed.
+};
+
+/**
+ * @brief A complete file waiting for a worker.
+ */
+struct Job {
+    size_t rule;
+    fs::path path;
+    Clock::time_point arrived;
+};
+
+/**
+ * @brief One watched directory and the rules that apply to its files.
+ */
+struct WatchedDirectory {
+    fs::path path;
+    vector<size_t> rules;
+    unique_ptr<DirectoryMonitor> monitor;
+    bool closesReported = false; ///< Whether the monitor reports files closed after writing.
+    map<string, pair<uintmax_t, fs::file_time_type>> snapshot; ///< Sizes and times, when the monitor only sleeps.
+};
+
+/**
+ * @brief State shared by the scheduler, the monitor threads and the workers.
+ */
+struct WatchState {
+    WatchState(const vector<WatchRule>& rules, const WatchOptions& options) : rules(rules), options(options) {}
+
+    const vector<WatchRule>& rules;
+    const WatchOptions& options;
+    mutex lock;
+    condition_variable changed;  ///< Signals the scheduler that a file changed or watching stops.
+    condition_variable jobReady; ///< Signals the workers that a job is queued or watching stops.
+    map<fs::path, PendingFile> pending;
+    deque<Job> jobs;
+    map<fs::path, Clock::time_point> produced; ///< Files written by actions, ignored until the time given.
+    bool stopping = false;
+    mutex destinationLock;  ///< Serializes choosing a free name and renaming into it.
+    mutex manifestLock;     ///< Serializes appending to manifests.
+    mutex resultLock;       ///< Serializes the result handler.
+};
+
+/**
+ * @brief Finds the rule for a file in a watched directory.
+ * @return The index of the first rule whose pattern the name contains, or the number of rules.
+ */
+size_t matchRule(const WatchState& state, const WatchedDirectory& directory, const string& name) {
+    for (size_t rule : directory.rules) {
+        if (name.find(state.rules[rule].pattern) != string::npos) {
+            return rule;
+        }
+    }
+    return state.rules.size();
+}
+
+/**
+ * @brief Records a change to a file in the debounce table. The caller holds the state lock.
+ * @param open Whether the file may still be open for writing.
+ */
+void noteChange(WatchState& state, const WatchedDirectory& directory, const string& name, bool open) {
+    fs::path path = directory.path / name;
+    Clock::time_point now = Clock::now();
+    auto produced = state.produced.find(path);
+    if (produced != state.produced.end() && now < produced->second) {
+        return;
+    }
+    size_t rule = matchRule(state, directory, name);
+    if (rule == state.rules.size()) {
+        return;
+    }
+    auto inserted = state.pending.try_emplace(path);
+    PendingFile& file = inserted.first->second;
+    if (inserted.second) {
+        file.rule = rule;
+        file.arrived = now;
+    }
+    file.lastChange = now;
+    file.open = open && directory.closesReported;
+}
+
+/**
+ * @brief Lists a directory and records every file in it as changed, or in the snapshot only.
+ * The caller holds the state lock.
+ * @param record Whether the files are recorded as changed.
+ */
+void scanDirectory(WatchState& state, WatchedDirectory& directory, bool record) {
+    error_code ec;
+    for (fs::directory_iterator it(directory.path, ec), end; !ec && it != end; it.increment(ec)) {
+        if (!it->is_regular_file(ec)) {
+            continue;
+        }
+        string name = it->path().filename().string();
+        directory.snapshot[name] = { it->file_size(ec), it->last_write_time(ec) };
+        if (record) {
+            noteChange(state, directory, name, false);
+        }
+    }
+}
+
+/**
+ * @brief Compares a directory with its snapshot and records the files that appeared or changed.
+ * Used where the monitor only sleeps. The caller holds the state lock.
+ */
+void pollDirectory(WatchState& state, WatchedDirectory& directory) {
+    auto previous = move(directory.snapshot);
+    directory.snapshot.clear();
+    error_code ec;
+    for (fs::directory_iterator it(directory.path, ec), end; !ec && it != end; it.increment(ec)) {
+        if (!it->is_regular_file(ec)) {
+            continue;
+        }
+        string name = it->path().filename().string();
+        pair<uintmax_t, fs::file_time_type> current{ it->file_size(ec), it->last_write_time(ec) };
+        auto before = previous.find(name);
+        if (before == previous.end() || before->second != current) {
+            noteChange(state, directory, name, false);
+        }
+        directory.snapshot[name] = current;
+    }
+    for (const auto& entry : previous) {
+        if (directory.snapshot.count(entry.first) == 0) {
+            state.pending.erase(directory.path / entry.first);
+        }
+    }
+}
+
+/**
+ * @brief Applies the events reported by a monitor. The caller holds the state lock.
+ */
+void applyEvents(WatchState& state, WatchedDirectory& directory, const vector<ChangeEvent>& events) {
+    for (const auto& event : events) {
+        switch (event.kind) {
+        case ChangeKind::Overflow:
+            scanDirectory(state, directory, true);
+            break;
+        case ChangeKind::Removed:
+            state.pending.erase(directory.path / event.name);
+            break;
+        case ChangeKind::Attributes: {
+            auto file = state.pending.find(directory.path / event.name);
+            if (file != state.pending.end()) {
+                file->second.lastChange = Clock::now();
+            }
+            break;
+        }
+        case ChangeKind::Created: {
+            // Only regular files are acted on, and a new hard link is complete like a file moved in.
+            error_code ec;
+            fs::path path = directory.path / event.name;
+            if (fs::is_regular_file(fs::symlink_status(path, ec))) {
+                noteChange(state, directory, event.name, fs::hard_link_count(path, ec) == 1);
+            }
+            break;
+        }
+        case ChangeKind::Modified:
+            noteChange(state, directory, event.name, true);
+            break;
+        case ChangeKind::Closed:
+        case ChangeKind::MovedIn:
+            noteChange(state, directory, event.name, false);
+            break;
+        }
+    }
+}
+
+/**
+ * @brief Marks a file written by an action, so that the changes it causes are not acted on.
+ */
+void markProduced(WatchState& state, const fs::path& path) {
+    lock_guard<mutex> guard(state.lock);
+    state.produced[path] = Clock::now() + state.options.quietPeriod + producedGrace;
+}
+
+/**
+ * @brief Returns a path that does not exist yet, adding "-1", "-2" and so on before the extension if needed.
+ */
+fs::path freePath(const fs::path& path) {
+    error_code ec;
+    fs::path candidate = path;
+    for (unsigned i = 1; fs::exists(fs::symlink_status(candidate, ec)); ++i) {
+        candidate = path.parent_path() / (path.stem().string() + "-" + to_string(i) + path.extension().string());
+    }
+    return candidate;
+}
+
+/**
+ * @brief Expands the placeholders of a Rename template for a file.
+ */
+string expandTemplate(const string& pattern, const fs::path& file) {
+    time_t now = time(nullptr);
+    tm local{};
+#ifdef _WIN32
+    localtime_s(&local, &now);
+#else
+    localtime_r(&now, &local);
+#endif
+    char stamp[32];
+    strftime(stamp, sizeof(stamp), "%Y%m%d-%H%M%S", &local);
+
+    const pair<string, string> placeholders[] = {
+        { "{name}", file.filename().string() },
+        { "{stem}", file.stem().string() },
+        { "{ext}", file.extension().string() },
+        { "{time}", stamp }
+    };
+    string result;
+    for (size_t i = 0; i < pattern.size();) {
+        bool replaced = false;
+        for (const auto& placeholder : placeholders) {
+            if (pattern.compare(i, placeholder.first.size(), placeholder.first) == 0) {
+                result += placeholder.second;
+                i += placeholder.first.size();
+                replaced = true;
+                break;
+            }
+        }
+        if (!replaced) {
+            result += pattern[i++];
+        }
+    }
+    return result;
+}
+
+/**
+ * @brief Checks whether a file and a directory lie on the same device, so a rename can move the file.
+ */
+bool sameDevice(const fs::path& file, const fs::path& directory) {
+    FileId fileId, directoryId;
+    return getFileId(file, fileId, nullptr, false) && getFileId(directory, directoryId)
+        && fileId.device == directoryId.device;
+}
+
+/**
+ * @brief Runs the action of a rule on a complete file.
+ * @param result Receives the new path or the digest and the status code.
+ * @return False if the file is gone or is not a regular file, so there is nothing to report.
+ */
+bool runAction(WatchState& state, const WatchRule& rule, const fs::path& path, WatchResult& result) {
+    error_code ec;
+    if (!fs::is_regular_file(fs::symlink_status(path, ec))) {
+        return false;
+    }
+    BaseFileManager& manager = BaseFileManager::getInstance();
+
+    switch (rule.action) {
+    case WatchActionKind::Move: {
+        fs::path directory(rule.target);
+        if (sameDevice(path, directory)) {
+            lock_guard<mutex> guard(state.destinationLock);
+            fs::path destination = freePath(directory / path.filename());
+            result.statusCode = manager.rename(path.string(), destination.string());
+            result.result = destination.string();
+        }
+        else {
+            fs::path destination;
+            CopyReport report;
+            {
+                lock_guard<mutex> guard(state.destinationLock);
+                destination = freePath(directory / path.filename());
+                result.statusCode = manager.copy(path.string(), destination.string(), false, report);
+            }
+            if (result.statusCode == 200) {
+                result.statusCode = manager.deleteFile(path.string());
+            }
+            result.result = destination.string();
+        }
+        break;
+    }
+    case WatchActionKind::Rename: {
+        lock_guard<mutex> guard(state.destinationLock);
+        fs::path destination = freePath(path.parent_path() / expandTemplate(rule.target, path));
+        markProduced(state, destination);
+        result.statusCode = manager.rename(path.string(), destination.string());
+        result.result = destination.string();
+        break;
+    }
+    case WatchActionKind::Checksum: {
+        if (!Sha256::hashFile(path, result.result)) {
+            cerr << "Error: Unable to read " << path.string() << endl;
+            result.statusCode = 500;
+            break;
+        }
+        fs::path manifest = fs::absolute(rule.target, ec);
+        lock_guard<mutex> guard(state.manifestLock);
+        markProduced(state, manifest);
+        ofstream output(manifest, ios::app);
+        output << result.result << "  " << path.string() << "\n";
+        if (!output) {
+            cerr << "Error: Unable to write " << manifest.string() << endl;
+            result.statusCode = 500;
+        }
+        break;
+    }
+    }
+    return true;
+}
+
+/**
+ * @brief Watches one directory until watching stops.
+ */
+void monitorDirectory(WatchState& state, WatchedDirectory& directory) {
+    vector<ChangeEvent> events;
+    for (;;) {
+        bool arrived = directory.monitor->wait(FolderWatcher::pollInterval, events);
+        lock_guard<mutex> guard(state.lock);
+        if (state.stopping) {
+            return;
+        }
+        if (arrived) {
+            applyEvents(state, directory, events);
+        }
+        else if (!directory.monitor->isNative()) {
+            pollDirectory(state, directory);
+        }
+        else {
+            continue;
+        }
+        state.changed.notify_one();
+    }
+}
+
+/**
+ * @brief Moves files that have been quiet long enough and are closed, or have been quiet for the
+ * open timeout, to the job queue.
+ * The caller holds the state lock.
+ * @return The time at which the next pending file becomes due, at most one poll interval away.
+ */
+Clock::time_point scheduleDueFiles(WatchState& state) {
+    Clock::time_point now = Clock::now();
+    Clock::time_point wake = now + FolderWatcher::pollInterval;
+    for (auto it = state.pending.begin(); it != state.pending.end();) {
+        const PendingFile& file = it->second;
+        Clock::time_point due = file.lastChange + (file.open ? state.options.openTimeout : state.options.quietPeriod);
+        if (due <= now) {
+            state.jobs.push_back({ file.rule, it->first, file.arrived });
+            it = state.pending.erase(it);
+            continue;
+        }
+        wake = min(wake, due);
+        ++it;
+    }
+    for (auto it = state.produced.begin(); it != state.produced.end();) {
+        it = it->second <= now ? state.produced.erase(it) : next(it);
+    }
+    if (!state.jobs.empty()) {
+        state.jobReady.notify_all();
+    }
+    return wake;
+}
+
+/**
+ * @brief Runs queued jobs until watching stops and the queue is empty.
+ */
+void runJobs(WatchState& state, const FolderWatcher::ResultHandler& onResult) {
+    for (;;) {
+        Job job;
+        {
+            unique_lock<mutex> guard(state.lock);
+            state.jobReady.wait(guard, [&] { return !state.jobs.empty() || state.stopping; });
+            if (state.jobs.empty()) {
+                return;
+            }
+            job = move(state.jobs.front());
+            state.jobs.pop_front();
+        }
+
+        WatchResult result;
+        result.rule = job.rule;
+        result.path = job.path.string();
+        if (!runAction(state, state.rules[job.rule], job.path, result)) {
+            continue;
+        }
+        result.latency = chrono::duration_cast<chrono::milliseconds>(Clock::now() - job.arrived);
+        lock_guard<mutex> guard(state.resultLock);
+        if (onResult) {
+            onResult(result);
+        }
+    }
+}
+
+} // namespace
+
+/**
+ * @brief Constructs a watcher.
+ * @param rules Rules to apply; for a file in a directory, the first rule whose pattern matches is used.
+ * @param options Debouncing and worker options.
+ * @param onResult Receives the outcome of every action.
+ */
+FolderWatcher::FolderWatcher(vector<WatchRule> rules, const WatchOptions& options, ResultHandler onResult)
+    : rules(move(rules)), options(options), onResult(move(onResult)) {
+}
+
+/**
+ * @brief Watches the directories and runs the actions until the stop condition holds.
+ * Every role has a thread of its own for as long as the call runs: one schedules due files,
+ * one per directory waits for events, and the workers run the actions. parallelFor starts one
+ * thread per role, the calling thread being one of them, so no role waits for another to finish.
+ * @param stop Stop condition.
+ * @return HTTP-like status code:
+ * - 200: Stopped.
+ * - 400: There are no rules, or a rule lacks a directory or target, or a Rename target is not a plain name.
+ * - 404: A watched directory or a Move destination does not exist.
+ * - 500: Other errors.
+ */
+int FolderWatcher::run(const StopCondition& stop) {
+    try {
+        if (rules.empty()) {
+            cerr << "Error: No watch rules." << endl;
+            return 400;
+        }
+        map<fs::path, size_t> directoryIndex;
+        vector<WatchedDirectory> directories;
+        for (size_t i = 0; i < rules.size(); ++i) {
+            const WatchRule& rule = rules[i];
+            if (rule.directory.empty() || rule.target.empty()) {
+                cerr << "Error: Watch rule " << i + 1 << " lacks a directory or target." << endl;
+                return 400;
+            }
+            if (rule.action == WatchActionKind::Rename && fs::path(rule.target).has_parent_path()) {
+                cerr << "Error: Rename target must be a file name." << endl;
+                return 400;
+            }
+            if (!fs::is_directory(rule.directory)
+                || (rule.action == WatchActionKind::Move && !fs::is_directory(rule.target))) {
+                cerr << "Error: Directory does not exist." << endl;
+                return 404;
+            }
+            fs::path directory = fs::canonical(rule.directory);
+            auto inserted = directoryIndex.emplace(directory, directories.size());
+            if (inserted.second) {
+                directories.emplace_back();
+                directories.back().path = directory;
+            }
+            directories[inserted.first->second].rules.push_back(i);
+        }
+
+        WatchState state(rules, options);
+        for (auto& directory : directories) {
+            directory.monitor = make_unique<DirectoryMonitor>(directory.path);
+#ifdef __linux__
+            directory.closesReported = directory.monitor->isNative();
+#endif
+            scanDirectory(state, directory, options.processExisting);
+        }
+
+        unsigned workers = parallelWorkerCount(options.workers);
+        size_t roles = 1 + directories.size() + workers;
+        auto stopAll = [&] {
+            lock_guard<mutex> guard(state.lock);
+            state.stopping = true;
+            state.jobReady.notify_all();
+            state.changed.notify_all();
+        };
+        // As many threads as roles: each thread takes one role and keeps it until stopping.
+        parallelFor(roles, static_cast<unsigned>(roles), [&](size_t role, unsigned) {
+            try {
+                if (role == 0) {
+                    while (!stop()) {
+                        unique_lock<mutex> guard(state.lock);
+                        if (state.stopping) {
+                            return;
+                        }
+                        state.changed.wait_until(guard, scheduleDueFiles(state));
+                    }
+                    stopAll();
+                }
+                else if (role <= directories.size()) {
+                    monitorDirectory(state, directories[role - 1]);
+                }
+                else {
+                    runJobs(state, onResult);
+                }
+            }
+            catch (...) {
+                stopAll();
+                throw;
+            }
+        });
+        return 200;
+    }
+    catch (const exception& e) {
+        cerr << "Error watching directories: " << e.what() << endl;
+        return 500;
+    }
+}
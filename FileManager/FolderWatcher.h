@@ -0,0 +1,147 @@
+/**
+ * @file FolderWatcher.h
+ * @brief Declares the FolderWatcher class, which runs configured actions on files arriving in watched directories.
+ */
+
+#ifndef FOLDER_WATCHER_H
+#define FOLDER_WATCHER_H
+
+#include <chrono>
+#include <cstddef>
+#include <functional>
+#include <string>
+#include <vector>
+
+/**
+ * @brief Action run on a file that has arrived in a watched directory.
+ */
+enum class WatchActionKind {
+    Move,    ///< Move the file into the target directory.
+    Rename,  ///< Rename the file within its directory using the target as a name template.
+    Checksum ///< Append the file's SHA-256 digest and path to the target manifest file.
+};
+
+/**
+ * @struct WatchRule
+ * @brief Connects a watched directory and a file name pattern to an action.
+ */
+struct WatchRule {
+    /**
+     * @brief Directory whose files are watched; subdirectories are not.
+     */
+    std::string directory;
+
+    /**
+     * @brief Substring the file name must contain; empty matches every file.
+     */
+    std::string pattern;
+
+    WatchActionKind action = WatchActionKind::Move;
+
+    /**
+     * @brief For Move, the destination directory. For Rename, the new name, in which {name},
+     * {stem}, {ext} and {time} are replaced by the old name, its stem, its extension including
+     * the dot, and the local time as YYYYMMDD-HHMMSS. For Checksum, the manifest file.
+     */
+    std::string target;
+};
+
+/**
+ * @struct WatchOptions
+ * @brief Tunes how a FolderWatcher decides that a file is complete and runs the actions.
+ */
+struct WatchOptions {
+    /**
+     * @brief Time without further changes after which a closed file is taken to be complete.
+     */
+    std::chrono::milliseconds quietPeriod{ 250 };
+
+    /**
+     * @brief Time without further changes after which a file whose close was never reported is
+     * taken to be complete anyway, so a writer that never reports one does not hold it back forever.
+     */
+    std::chrono::milliseconds openTimeout{ 300000 };
+
+    /**
+     * @brief Number of worker threads running actions; 0 selects the hardware concurrency.
+     */
+    unsigned workers = 0;
+
+    /**
+     * @brief Also run the actions on matching files already present when watching starts.
+     */
+    bool processExisting = true;
+};
+
+/**
+ * @struct WatchResult
+ * @brief Outcome of one action.
+ */
+struct WatchResult {
+    std::size_t rule = 0;    ///< Index of the rule that matched the file.
+    std::string path;        ///< The file the action was run on.
+    std::string result;      ///< The new path for Move and Rename, the hexadecimal digest for Checksum.
+    int statusCode = 200;    ///< Status code of the action.
+    std::chrono::milliseconds latency{ 0 }; ///< Time from the first change seen for the file until the action finished.
+};
+
+/**
+ * @class FolderWatcher
+ * @brief Event-driven replacement for polling drop directories.
+ *
+ * Every watched directory has a thread blocked on a DirectoryMonitor, so an idle watcher
+ * costs a few wakeups per second to check the stop condition. Events are collected per file
+ * in a debounce table. A file is handed to the worker pool once it has been quiet for the
+ * quiet period and is no longer open for writing: a file created or modified in place must
+ * have been closed (inotify's close-after-write), while a file renamed or hard-linked into
+ * the directory is complete on arrival. A file whose close never arrives counts as closed
+ * once it has been quiet for the open timeout. Directories and symbolic links are ignored.
+ * Where the operating system does not report closes, the quiet period alone decides; where
+ * it reports no changes at all, the directories are listed every poll
+ * interval and files whose size or modification time changed are treated as modified.
+ *
+ * Actions go through BaseFileManager, so the size cache and other bookkeeping stay current.
+ * Files produced by a Rename or by writing a manifest inside a watched directory are not
+ * acted on again.
+ */
+class FolderWatcher {
+public:
+    /**
+     * @brief Receives the outcome of every action; calls are serialized.
+     */
+    using ResultHandler = std::function<void(const WatchResult& result)>;
+
+    /**
+     * @brief Polled regularly; watching ends once it returns true.
+     */
+    using StopCondition = std::function<bool()>;
+
+    /**
+     * @brief Longest time between checks of the stop condition.
+     */
+    static constexpr std::chrono::milliseconds pollInterval{ 200 };
+
+    /**
+     * @brief Constructs a watcher.
+     * @param rules Rules to apply; for a file in a directory, the first rule whose pattern matches is used.
+     * @param options Debouncing and worker options.
+     * @param onResult Receives the outcome of every action.
+     */
+    FolderWatcher(std::vector<WatchRule> rules, const WatchOptions& options, ResultHandler onResult);
+
+    /**
+     * @brief Watches the directories and runs the actions until the stop condition holds.
+     * Actions already handed to the workers are finished before returning.
+     * @param stop Stop condition.
+     * @return Status code: 200 when stopped, 400 if there are no rules or a rule is incomplete,
+     * 404 if a watched directory or a Move destination does not exist, 500 on other errors.
+     */
+    int run(const StopCondition& stop);
+
+private:
+    std::vector<WatchRule> rules;
+    WatchOptions options;
+    ResultHandler onResult;
+};
+
+#endif // FOLDER_WATCHER_H
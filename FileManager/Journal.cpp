@@ -0,0 +1,652 @@
+/**
+ * @file Journal.cpp
+ * @brief Implementation of the binary operation journal.
+ */
+
+#include "Journal.h"
+#include "CacheLocation.h"
+#include "MappedFile.h"
+#include "Metrics.h"
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <functional>
+#include <system_error>
+
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <Windows.h>
+#else
+#include <fcntl.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+using namespace std;
+namespace fs = filesystem;
+
+namespace {
+
+/**
+ * @brief Identifies a segment file and its format version; followed by zeros up to headerSize.
+ */
+const char segmentMagic[8] = { 'F', 'M', 'J', 'R', 'N', 'L', '1', '\0' };
+
+/**
+ * @brief Bytes at the start of a segment before the first record.
+ */
+constexpr size_t headerSize = 64;
+
+/**
+ * @brief Offset in the header of the uint64 number of bytes used, stored when the writer closes
+ * the segment; zero while it is being written or after a crash.
+ */
+constexpr size_t usedOffset = 8;
+
+/**
+ * @brief Size of the fixed part of a record:
+ * uint32 size, uint16 operation, int16 status, int64 timestamp, int64 duration,
+ * uint32 thread, uint16 path length, uint16 target length.
+ */
+constexpr size_t recordHeaderSize = 32;
+
+/**
+ * @brief Longest path stored; longer paths are truncated.
+ */
+constexpr size_t maxPathLength = 0xFFFF;
+
+const char* const operationNames[] = {
+    "unknown", "create-file", "delete-file", "create-directory", "delete-directory", "rename",
+    "trash-file", "trash-directory", "restore", "prune-directory"
+};
+
+/**
+ * @brief Returns the file name of a segment.
+ */
+string segmentName(uint64_t number) {
+    char name[32];
+    snprintf(name, sizeof(name), "%010llu.journal", static_cast<unsigned long long>(number));
+    return name;
+}
+
+/**
+ * @brief Lists the numbers of the segments in a directory, in ascending order.
+ */
+vector<uint64_t> segmentNumbers(const fs::path& directory) {
+    vector<uint64_t> numbers;
+    error_code ec;
+    for (fs::directory_iterator it(directory, ec), end; !ec && it != end; it.increment(ec)) {
+        string stem = it->path().stem().string();
+        if (it->path().extension() == ".journal" && !stem.empty()
+            && all_of(stem.begin(), stem.end(), [](char c) { return c >= '0' && c <= '9'; })) {
+            numbers.push_back(stoull(stem));
+        }
+    }
+    sort(numbers.begin(), numbers.end());
+    return numbers;
+}
+
+/**
+ * @brief Deletes a segment file unless another writer holds it.
+ * @param path The segment file.
+ */
+void deleteSegment(const fs::path& path) {
+#ifdef _WIN32
+    // Fails while a writer has the file open, since writers do not share delete access.
+    error_code ec;
+    fs::remove(path, ec);
+#else
+    int descriptor = open(path.c_str(), O_RDWR);
+    if (descriptor < 0) {
+        return;
+    }
+    if (flock(descriptor, LOCK_EX | LOCK_NB) == 0) {
+        unlink(path.c_str());
+    }
+    close(descriptor);
+#endif
+}
+
+/**
+ * @brief Returns the bytes a segment holds, as stored in its header when its writer closed it.
+ * @param path The segment file.
+ * @return The stored size, or segmentSize if the segment is being written, was left by a crash or cannot be read.
+ */
+uint64_t storedSegmentSize(const fs::path& path) {
+    ifstream input(path, ios::binary);
+    char header[usedOffset + sizeof(uint64_t)];
+    uint64_t used = 0;
+    if (input.read(header, sizeof(header)) && memcmp(header, segmentMagic, sizeof(segmentMagic)) == 0) {
+        memcpy(&used, header + usedOffset, sizeof(used));
+    }
+    return used != 0 ? used : Journal::segmentSize;
+}
+
+/**
+ * @brief Zeroes a segment from an offset to its end, writing only to pages that hold data,
+ * so the unused part of a sparse segment is not allocated.
+ * @param data The segment.
+ * @param offset First byte to clear.
+ */
+void clearTail(char* data, size_t offset) {
+    constexpr size_t blockSize = 4096;
+    while (offset < Journal::segmentSize) {
+        size_t blockEnd = min(Journal::segmentSize, (offset / blockSize + 1) * blockSize);
+        if (any_of(data + offset, data + blockEnd, [](char c) { return c != 0; })) {
+            memset(data + offset, 0, blockEnd - offset);
+        }
+        offset = blockEnd;
+    }
+}
+
+/**
+ * @brief Returns the offset just past the last complete record of a segment.
+ * @param data The segment contents, from the start of the first record.
+ * @param size Number of bytes available.
+ */
+size_t recordsEnd(const char* data, size_t size) {
+    size_t offset = 0;
+    while (offset + recordHeaderSize <= size) {
+        uint32_t length;
+        memcpy(&length, data + offset, sizeof(length));
+        if (length < recordHeaderSize || length % 8 != 0 || length > size - offset) {
+            break;
+        }
+        offset += length;
+    }
+    return offset;
+}
+
+/**
+ * @brief Returns the size of a record with the given path lengths, padded to eight bytes.
+ */
+size_t recordSize(size_t pathLength, size_t targetLength) {
+    return (recordHeaderSize + pathLength + targetLength + 7) & ~size_t(7);
+}
+
+/**
+ * @brief Encodes a record; the destination must hold recordSize bytes.
+ */
+void encodeRecord(char* destination, JournalOperation operation, const string& path, const string& target, int statusCode,
+    int64_t timestamp, int64_t duration, uint32_t thread) {
+    uint16_t pathLength = static_cast<uint16_t>(min(path.size(), maxPathLength));
+    uint16_t targetLength = static_cast<uint16_t>(min(target.size(), maxPathLength));
+    uint32_t size = static_cast<uint32_t>(recordSize(pathLength, targetLength));
+    uint16_t code = static_cast<uint16_t>(operation);
+    int16_t status = static_cast<int16_t>(statusCode);
+    memcpy(destination, &size, 4);
+    memcpy(destination + 4, &code, 2);
+    memcpy(destination + 6, &status, 2);
+    memcpy(destination + 8, &timestamp, 8);
+    memcpy(destination + 16, &duration, 8);
+    memcpy(destination + 24, &thread, 4);
+    memcpy(destination + 28, &pathLength, 2);
+    memcpy(destination + 30, &targetLength, 2);
+    memcpy(destination + recordHeaderSize, path.data(), pathLength);
+    memcpy(destination + recordHeaderSize + pathLength, target.data(), targetLength);
+    memset(destination + recordHeaderSize + pathLength + targetLength, 0,
+        size - recordHeaderSize - pathLength - targetLength);
+}
+
+/**
+ * @brief Decodes a record whose length has been checked.
+ */
+JournalRecord decodeRecord(const char* source) {
+    JournalRecord record;
+    uint16_t code, pathLength, targetLength;
+    int16_t status;
+    memcpy(&code, source + 4, 2);
+    memcpy(&status, source + 6, 2);
+    memcpy(&record.timestamp, source + 8, 8);
+    memcpy(&record.duration, source + 16, 8);
+    memcpy(&record.thread, source + 24, 4);
+    memcpy(&pathLength, source + 28, 2);
+    memcpy(&targetLength, source + 30, 2);
+    record.operation = static_cast<JournalOperation>(code);
+    record.statusCode = status;
+    record.path.assign(source + recordHeaderSize, pathLength);
+    record.target.assign(source + recordHeaderSize + pathLength, targetLength);
+    return record;
+}
+
+/**
+ * @brief Returns the metrics operation counting a journaled operation.
+ */
+MetricOperation metricOperation(JournalOperation operation) {
+    switch (operation) {
+    case JournalOperation::CreateFile: return MetricOperation::CreateFile;
+    case JournalOperation::DeleteFile: return MetricOperation::DeleteFile;
+    case JournalOperation::CreateDirectory: return MetricOperation::CreateDirectory;
+    case JournalOperation::DeleteDirectory: return MetricOperation::DeleteDirectory;
+    case JournalOperation::Rename: return MetricOperation::Rename;
+    case JournalOperation::TrashFile: return MetricOperation::TrashFile;
+    case JournalOperation::TrashDirectory: return MetricOperation::TrashDirectory;
+    case JournalOperation::Restore: return MetricOperation::Restore;
+    case JournalOperation::PruneDirectory: return MetricOperation::PruneDirectory;
+    }
+    return MetricOperation::Rename;
+}
+
+/**
+ * @brief Returns a 32-bit hash of the calling thread's identifier.
+ */
+uint32_t currentThreadHash() {
+    size_t hash = std::hash<thread::id>()(this_thread::get_id());
+    return static_cast<uint32_t>(hash ^ (static_cast<uint64_t>(hash) >> 32));
+}
+
+} // namespace
+
+/**
+ * @brief Returns the name of an operation.
+ * @param operation The operation.
+ * @return The name, or "unknown".
+ */
+const char* journalOperationName(JournalOperation operation) {
+    size_t index = static_cast<size_t>(operation);
+    return index < sizeof(operationNames) / sizeof(operationNames[0]) ? operationNames[index] : operationNames[0];
+}
+
+/**
+ * @brief Stores the bytes used in the header of a segment that was written, unmaps the segment and releases the file.
+ */
+Journal::Segment::~Segment() {
+    if (data != nullptr) {
+        if (used != 0) {
+            uint64_t size = used;
+            memcpy(data + usedOffset, &size, sizeof(size));
+        }
+#ifdef _WIN32
+        UnmapViewOfFile(data);
+#else
+        munmap(data, segmentSize);
+#endif
+    }
+#ifdef _WIN32
+    if (fileHandle != nullptr) {
+        CloseHandle(fileHandle);
+    }
+#else
+    if (descriptor >= 0) {
+        close(descriptor);
+    }
+#endif
+}
+
+/**
+ * @brief Opens a segment file for writing, locks it against other writers and maps it, extending it
+ * to full size if needed. On Windows the file is opened without write or delete sharing, which
+ * keeps other processes from writing or deleting it; elsewhere an exclusive flock does the same
+ * for other writers and for deleteSegment.
+ * @param path The segment file.
+ * @param create Whether the file is created; it must not exist yet. Otherwise it must exist.
+ * @return False if the file cannot be opened or mapped, or another process holds it.
+ */
+bool Journal::Segment::open(const fs::path& path, bool create) {
+#ifdef _WIN32
+    HANDLE file = CreateFileW(path.c_str(), GENERIC_READ | GENERIC_WRITE, FILE_SHARE_READ, nullptr,
+        create ? CREATE_NEW : OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+    if (file == INVALID_HANDLE_VALUE) {
+        return false;
+    }
+    HANDLE mapping = CreateFileMappingW(file, nullptr, PAGE_READWRITE, 0, static_cast<DWORD>(segmentSize), nullptr);
+    void* view = mapping != nullptr ? MapViewOfFile(mapping, FILE_MAP_WRITE, 0, 0, segmentSize) : nullptr;
+    if (mapping != nullptr) {
+        CloseHandle(mapping);
+    }
+    if (view == nullptr) {
+        CloseHandle(file);
+        return false;
+    }
+    fileHandle = file;
+    data = static_cast<char*>(view);
+    return true;
+#else
+    int descriptor = ::open(path.c_str(), O_RDWR | (create ? O_CREAT | O_EXCL : 0), 0600);
+    if (descriptor < 0) {
+        return false;
+    }
+    struct stat info;
+    if (flock(descriptor, LOCK_EX | LOCK_NB) != 0 || fstat(descriptor, &info) != 0
+        || (info.st_size < static_cast<off_t>(segmentSize) && ftruncate(descriptor, segmentSize) != 0)) {
+        close(descriptor);
+        return false;
+    }
+    void* view = mmap(nullptr, segmentSize, PROT_READ | PROT_WRITE, MAP_SHARED, descriptor, 0);
+    if (view == MAP_FAILED) {
+        close(descriptor);
+        return false;
+    }
+    this->descriptor = descriptor;
+    data = static_cast<char*>(view);
+    return true;
+#endif
+}
+
+/**
+ * @brief Retrieves the journal.
+ * @return Reference to the Journal instance.
+ */
+Journal& Journal::getInstance() {
+    static Journal instance;
+    return instance;
+}
+
+/**
+ * @brief Starts the background thread. Segments are opened when the first records are copied.
+ */
+Journal::Journal() : directory(cacheDirectory() / "journal") {
+    flusher = thread(&Journal::flushPeriodically, this);
+}
+
+/**
+ * @brief Stops the background thread and copies the remaining records.
+ */
+Journal::~Journal() {
+    {
+        lock_guard<mutex> guard(wakeLock);
+        stopping = true;
+    }
+    wake.notify_all();
+    flusher.join();
+    flush();
+}
+
+/**
+ * @brief Adds a record to the calling thread's buffer, copying the buffer into the journal first if it is full.
+ * @param operation The operation.
+ * @param path The entry operated on.
+ * @param target The new path for renames and restores.
+ * @param statusCode Status code of the operation.
+ * @param timestamp Start of the operation in nanoseconds since the Unix epoch.
+ * @param duration Duration of the operation in nanoseconds.
+ */
+void Journal::append(JournalOperation operation, const string& path, const string& target, int statusCode,
+    int64_t timestamp, int64_t duration) {
+    if (!enabled.load(memory_order_relaxed)) {
+        return;
+    }
+    thread_local shared_ptr<ThreadBuffer> buffer = registerBuffer();
+    thread_local uint32_t thread = currentThreadHash();
+    size_t size = recordSize(min(path.size(), maxPathLength), min(target.size(), maxPathLength));
+
+    lock_guard<mutex> guard(buffer->lock);
+    if (buffer->used + size > buffer->data.size()) {
+        writeChunk(buffer->data.data(), buffer->used);
+        buffer->used = 0;
+        if (size > buffer->data.size()) {
+            vector<char> record(size);
+            encodeRecord(record.data(), operation, path, target, statusCode, timestamp, duration, thread);
+            writeChunk(record.data(), size);
+            return;
+        }
+    }
+    encodeRecord(buffer->data.data() + buffer->used, operation, path, target, statusCode, timestamp, duration, thread);
+    buffer->used += size;
+}
+
+/**
+ * @brief Copies the records in all thread buffers into the journal and forgets the buffers of
+ * threads that have exited.
+ */
+void Journal::flush() {
+    vector<shared_ptr<ThreadBuffer>> snapshot;
+    {
+        lock_guard<mutex> guard(buffersLock);
+        snapshot = buffers;
+    }
+    for (const auto& buffer : snapshot) {
+        lock_guard<mutex> guard(buffer->lock);
+        if (buffer->used > 0) {
+            writeChunk(buffer->data.data(), buffer->used);
+            buffer->used = 0;
+        }
+    }
+    snapshot.clear();
+
+    lock_guard<mutex> guard(buffersLock);
+    buffers.erase(remove_if(buffers.begin(), buffers.end(), [](const shared_ptr<ThreadBuffer>& buffer) {
+        return buffer.use_count() == 1 && buffer->used == 0;
+    }), buffers.end());
+}
+
+/**
+ * @brief Decodes the records of all segments, ordered by start time.
+ * @param filter Selects the records.
+ * @param records Receives the matching records.
+ * @return HTTP-like status code:
+ * - 200: Success.
+ * - 204: No record matches.
+ */
+int Journal::read(const JournalFilter& filter, vector<JournalRecord>& records) {
+    flush();
+    size_t found = 0;
+    for (uint64_t number : segmentNumbers(directory)) {
+        MappedFile file;
+        size_t available = 0;
+        const char* data = file.open((directory / segmentName(number)).string()) ? file.map(0, segmentSize, available) : nullptr;
+        if (data == nullptr || available < headerSize || memcmp(data, segmentMagic, sizeof(segmentMagic)) != 0) {
+            continue;
+        }
+        const char* first = data + headerSize;
+        size_t end = recordsEnd(first, available - headerSize);
+        for (size_t offset = 0; offset < end;) {
+            uint32_t length;
+            memcpy(&length, first + offset, sizeof(length));
+            JournalRecord record = decodeRecord(first + offset);
+            offset += length;
+            if (record.timestamp < filter.since || (filter.failuresOnly && record.statusCode == 200)) {
+                continue;
+            }
+            if (!filter.operations.empty()
+                && find(filter.operations.begin(), filter.operations.end(), record.operation) == filter.operations.end()) {
+                continue;
+            }
+            if (!filter.pathContains.empty() && record.path.find(filter.pathContains) == string::npos
+                && record.target.find(filter.pathContains) == string::npos) {
+                continue;
+            }
+            records.push_back(move(record));
+            ++found;
+        }
+    }
+    // Processes writing at the same time fill different segments, so segment order is only roughly time order.
+    stable_sort(records.end() - found, records.end(), [](const JournalRecord& a, const JournalRecord& b) {
+        return a.timestamp < b.timestamp;
+    });
+    return found > 0 ? 200 : 204;
+}
+
+/**
+ * @brief Turns journaling on or off.
+ */
+void Journal::setEnabled(bool enable) {
+    enabled = enable;
+}
+
+/**
+ * @brief Returns whether journaling is on.
+ */
+bool Journal::isEnabled() const {
+    return enabled;
+}
+
+/**
+ * @brief Creates and registers a buffer for the calling thread. The journal keeps a reference,
+ * so records buffered by a thread that exits are still copied by the next flush.
+ * @return The buffer.
+ */
+shared_ptr<Journal::ThreadBuffer> Journal::registerBuffer() {
+    auto buffer = make_shared<ThreadBuffer>();
+    buffer->data.resize(bufferSize);
+    lock_guard<mutex> guard(buffersLock);
+    buffers.push_back(buffer);
+    return buffer;
+}
+
+/**
+ * @brief Copies encoded records into the current segment. Space is reserved under the lock and
+ * filled outside it. The first length field is stored last, so readers see either all of the
+ * records or none of them. Records are dropped if no segment can be opened.
+ * @param data The encoded records.
+ * @param size Number of bytes; at most segmentSize - headerSize.
+ */
+void Journal::writeChunk(const char* data, size_t size) {
+    if (size == 0) {
+        return;
+    }
+    shared_ptr<Segment> segment;
+    size_t offset = 0;
+    {
+        lock_guard<mutex> guard(segmentLock);
+        if (!opened) {
+            opened = true;
+            reopenLast();
+        }
+        if (!current || current->used + size > segmentSize) {
+            rotate();
+            if (!current) {
+                return;
+            }
+        }
+        segment = current;
+        offset = segment->used;
+        segment->used += size;
+    }
+
+    char* destination = segment->data + offset;
+    memcpy(destination + sizeof(uint32_t), data + sizeof(uint32_t), size - sizeof(uint32_t));
+    atomic_thread_fence(memory_order_release);
+    memcpy(destination, data, sizeof(uint32_t));
+}
+
+/**
+ * @brief Continues the newest segment after its last complete record, unless another process is
+ * writing it. A crash may have left a torn copy behind that record, so a segment that was not
+ * closed cleanly has the rest of it cleared first.
+ */
+void Journal::reopenLast() {
+    vector<uint64_t> numbers = segmentNumbers(directory);
+    if (numbers.empty()) {
+        return;
+    }
+    auto last = make_shared<Segment>();
+    last->number = numbers.back();
+    if (!last->open(directory / segmentName(last->number), false)
+        || memcmp(last->data, segmentMagic, sizeof(segmentMagic)) != 0) {
+        return;
+    }
+    uint64_t stored;
+    memcpy(&stored, last->data + usedOffset, sizeof(stored));
+    last->used = headerSize + recordsEnd(last->data + headerSize, segmentSize - headerSize);
+    if (stored != last->used) {
+        clearTail(last->data, last->used);
+    }
+    stored = 0;
+    memcpy(last->data + usedOffset, &stored, sizeof(stored));
+    current = last;
+}
+
+/**
+ * @brief Creates and maps the segment after the newest one and deletes old segments.
+ * Writers still copying into the previous segment keep it mapped until they finish.
+ */
+void Journal::rotate() {
+    error_code ec;
+    fs::create_directories(directory, ec);
+    vector<uint64_t> numbers = segmentNumbers(directory);
+    uint64_t number = max(current ? current->number : 0, numbers.empty() ? 0 : numbers.back());
+
+    // Creation is exclusive, so a number another process took at the same moment is skipped.
+    auto next = make_shared<Segment>();
+    for (int attempt = 0; attempt < 16 && next->data == nullptr; ++attempt) {
+        next->number = ++number;
+        next->open(directory / segmentName(number), true);
+    }
+    if (next->data == nullptr) {
+        current.reset();
+        return;
+    }
+    memcpy(next->data, segmentMagic, sizeof(segmentMagic));
+    next->used = headerSize;
+    current = next;
+    removeOldSegments();
+}
+
+/**
+ * @brief Deletes the segments beyond the newest retainedBytes of records. Segments that another
+ * process still writes are kept until a later rotation.
+ */
+void Journal::removeOldSegments() {
+    vector<uint64_t> numbers = segmentNumbers(directory);
+    uint64_t total = 0;
+    for (auto number = numbers.rbegin(); number != numbers.rend(); ++number) {
+        fs::path path = directory / segmentName(*number);
+        total += *number == current->number ? current->used : storedSegmentSize(path);
+        if (total > retainedBytes && *number != current->number) {
+            deleteSegment(path);
+        }
+    }
+}
+
+/**
+ * @brief Copies the thread buffers every flush interval until the journal is destroyed.
+ */
+void Journal::flushPeriodically() {
+    unique_lock<mutex> guard(wakeLock);
+    while (!wake.wait_for(guard, flushInterval, [this] { return stopping; })) {
+        guard.unlock();
+        flush();
+        guard.lock();
+    }
+}
+
+/**
+ * @brief Starts timing an operation.
+ * @param operation The operation.
+ * @param path The entry operated on.
+ */
+JournalScope::JournalScope(JournalOperation operation, const string& path)
+    : operation(operation), path(path), target(nullptr), started(chrono::system_clock::now()),
+    startedSteady(chrono::steady_clock::now()) {
+}
+
+/**
+ * @brief Starts timing an operation with a target path.
+ * @param operation The operation.
+ * @param path The entry operated on.
+ * @param target The new path.
+ */
+JournalScope::JournalScope(JournalOperation operation, const string& path, const string& target)
+    : operation(operation), path(path), target(&target), started(chrono::system_clock::now()),
+    startedSteady(chrono::steady_clock::now()) {
+}
+
+/**
+ * @brief Journals the operation with status 500 if no status was reported.
+ */
+JournalScope::~JournalScope() {
+    if (!recorded) {
+        done(500);
+    }
+}
+
+/**
+ * @brief Journals the operation with its status and counts it in the metrics.
+ * @param statusCode Status code of the operation.
+ * @return The status code.
+ */
+int JournalScope::done(int statusCode) {
+    recorded = true;
+    static const string none;
+    auto duration = chrono::duration_cast<chrono::nanoseconds>(chrono::steady_clock::now() - startedSteady);
+    Journal::getInstance().append(operation, path, target ? *target : none, statusCode,
+        chrono::duration_cast<chrono::nanoseconds>(started.time_since_epoch()).count(), duration.count());
+    Metrics::getInstance().recordOperation(metricOperation(operation), statusCode, duration);
+    return statusCode;
+}
@@ -0,0 +1,287 @@
+/**
+ * @file Journal.h
+ * @brief Declares the Journal class, an append-only binary log of the changes made through BaseFileManager,
+ * and JournalScope, which times one operation and records it.
+ */
+
+#ifndef JOURNAL_H
+#define JOURNAL_H
+
+#include "Profiler.h"
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+/**
+ * @brief Kind of journaled operation. The values are stored in the journal and must not change.
+ */
+enum class JournalOperation : std::uint16_t {
+    CreateFile = 1,
+    DeleteFile = 2,
+    CreateDirectory = 3,
+    DeleteDirectory = 4,
+    Rename = 5,
+    TrashFile = 6,      ///< A file was moved to the trash.
+    TrashDirectory = 7, ///< A directory was moved to the trash.
+    Restore = 8,        ///< An entry was moved back from the trash.
+    PruneDirectory = 9  ///< An empty directory was removed by findEmpty.
+};
+
+/**
+ * @brief Returns the name of an operation as shown and accepted by the reader, such as "delete-file".
+ * @param operation The operation.
+ * @return The name, or "unknown".
+ */
+const char* journalOperationName(JournalOperation operation);
+
+/**
+ * @struct JournalRecord
+ * @brief One decoded journal record.
+ */
+struct JournalRecord {
+    JournalOperation operation = JournalOperation::CreateFile;
+    int statusCode = 0;
+    std::int64_t timestamp = 0; ///< Start of the operation in nanoseconds since the Unix epoch.
+    std::int64_t duration = 0;  ///< Duration of the operation in nanoseconds.
+    std::uint32_t thread = 0;   ///< Hash of the thread that ran the operation.
+    std::string path;           ///< The entry operated on.
+    std::string target;         ///< The new path for renames, the absolute path restored to for restores; empty otherwise.
+};
+
+/**
+ * @struct JournalFilter
+ * @brief Selects the records returned by Journal::read.
+ */
+struct JournalFilter {
+    std::vector<JournalOperation> operations; ///< Operations to include; empty includes all.
+    std::string pathContains;                 ///< Substring of the path or the target; empty matches all.
+    std::int64_t since = 0;                   ///< Earliest start time in nanoseconds since the Unix epoch.
+    bool failuresOnly = false;                ///< Whether only records with a status other than 200 are included.
+};
+
+/**
+ * @class Journal
+ * @brief Audit trail of the changes made through BaseFileManager.
+ *
+ * Records have a fixed 32-byte header holding the operation, status, start time, duration
+ * and thread, followed by the paths and padded to eight bytes. Each thread encodes records
+ * into its own buffer, so journaling an operation costs a few stores and an uncontended lock.
+ * Full buffers are copied into the current segment, a file of segmentSize bytes mapped into
+ * memory, with one reservation per buffer. The length of a buffer's first record is written
+ * last, so a reader stops before a buffer that was only partly copied. A background thread
+ * copies all buffers every flush interval, and once a segment is full the next one is started
+ * and the oldest ones beyond retainedBytes of records are deleted.
+ *
+ * Segments live in the journal directory below the cache directory. Each writing process holds
+ * the segment it writes exclusively, so several processes can journal at once: a new process
+ * continues the newest segment after its last complete record, clearing whatever a crash left
+ * behind it, unless another process is writing that segment, in which case it starts a new one.
+ * A segment that another process holds is never deleted.
+ */
+class Journal {
+public:
+    /**
+     * @brief Size of a segment file.
+     */
+    static constexpr std::size_t segmentSize = 16 << 20;
+
+    /**
+     * @brief Bytes of records kept across all segments; older segments are deleted.
+     */
+    static constexpr std::uint64_t retainedBytes = 256 << 20;
+
+    /**
+     * @brief Size of each thread's buffer.
+     */
+    static constexpr std::size_t bufferSize = 64 << 10;
+
+    /**
+     * @brief Longest time records stay in a thread buffer.
+     */
+    static constexpr std::chrono::milliseconds flushInterval{ 1000 };
+
+    /**
+     * @brief Retrieves the journal, starting its background thread on first use.
+     * @return Reference to the Journal instance.
+     */
+    static Journal& getInstance();
+
+    Journal(const Journal&) = delete;
+    Journal& operator=(const Journal&) = delete;
+
+    /**
+     * @brief Adds a record to the calling thread's buffer.
+     * @param operation The operation.
+     * @param path The entry operated on.
+     * @param target The new path for renames and restores.
+     * @param statusCode Status code of the operation.
+     * @param timestamp Start of the operation in nanoseconds since the Unix epoch.
+     * @param duration Duration of the operation in nanoseconds.
+     */
+    void append(JournalOperation operation, const std::string& path, const std::string& target, int statusCode,
+        std::int64_t timestamp, std::int64_t duration);
+
+    /**
+     * @brief Copies the records in all thread buffers into the journal.
+     */
+    void flush();
+
+    /**
+     * @brief Decodes the records of all segments, ordered by start time.
+     * @param filter Selects the records.
+     * @param records Receives the matching records.
+     * @return Status code: 200 on success, 204 if no record matches.
+     */
+    int read(const JournalFilter& filter, std::vector<JournalRecord>& records);
+
+    /**
+     * @brief Turns journaling on or off; it is on by default.
+     */
+    void setEnabled(bool enabled);
+
+    /**
+     * @brief Returns whether journaling is on.
+     */
+    bool isEnabled() const;
+
+private:
+    /**
+     * @brief A writable mapping of one segment file.
+     */
+    struct Segment {
+        std::uint64_t number = 0;
+        char* data = nullptr;
+        std::size_t used = 0; ///< Bytes reserved, guarded by segmentLock.
+#ifdef _WIN32
+        void* fileHandle = nullptr;
+#else
+        int descriptor = -1;
+#endif
+
+        Segment() = default;
+        ~Segment();
+
+        Segment(const Segment&) = delete;
+        Segment& operator=(const Segment&) = delete;
+
+        /**
+         * @brief Opens, locks and maps a segment file.
+         * @param path The segment file.
+         * @param create Whether the file is created; it must not exist yet.
+         * @return False if the file cannot be opened or mapped, or another process writes it.
+         */
+        bool open(const std::filesystem::path& path, bool create);
+    };
+
+    /**
+     * @brief Records encoded by one thread and not yet copied into a segment.
+     */
+    struct ThreadBuffer {
+        std::mutex lock;
+        std::vector<char> data;
+        std::size_t used = 0;
+    };
+
+    Journal();
+    ~Journal();
+
+    /**
+     * @brief Creates and registers a buffer for the calling thread.
+     */
+    std::shared_ptr<ThreadBuffer> registerBuffer();
+
+    /**
+     * @brief Copies encoded records into the current segment, starting a new one if they do not fit.
+     */
+    void writeChunk(const char* data, std::size_t size);
+
+    /**
+     * @brief Continues the newest segment unless another process writes it; segmentLock must be held.
+     */
+    void reopenLast();
+
+    /**
+     * @brief Maps the segment to write next and deletes old ones; segmentLock must be held.
+     */
+    void rotate();
+
+    /**
+     * @brief Deletes the segments beyond retainedBytes; segmentLock must be held.
+     */
+    void removeOldSegments();
+
+    /**
+     * @brief Body of the background thread.
+     */
+    void flushPeriodically();
+
+    std::filesystem::path directory;
+    std::atomic<bool> enabled{ true };
+
+    std::mutex segmentLock;
+    std::shared_ptr<Segment> current;
+    bool opened = false;
+
+    std::mutex buffersLock;
+    std::vector<std::shared_ptr<ThreadBuffer>> buffers;
+
+    std::mutex wakeLock;
+    std::condition_variable wake;
+    bool stopping = false;
+    std::thread flusher;
+};
+
+/**
+ * @class JournalScope
+ * @brief Times one operation and journals it when the operation reports its status.
+ * The operation is counted in the Metrics as well. If the scope ends without a status, for
+ * example because an exception escaped, the operation is journaled with status 500.
+ */
+class JournalScope {
+public:
+    /**
+     * @brief Starts timing an operation. The path is referenced, not copied, and must outlive the scope.
+     * @param operation The operation.
+     * @param path The entry operated on.
+     */
+    JournalScope(JournalOperation operation, const std::string& path);
+
+    /**
+     * @brief Starts timing an operation with a target path; both paths must outlive the scope.
+     * @param operation The operation.
+     * @param path The entry operated on.
+     * @param target The new path for renames and restores.
+     */
+    JournalScope(JournalOperation operation, const std::string& path, const std::string& target);
+
+    ~JournalScope();
+
+    JournalScope(const JournalScope&) = delete;
+    JournalScope& operator=(const JournalScope&) = delete;
+
+    /**
+     * @brief Journals the operation with its status.
+     * @param statusCode Status code of the operation.
+     * @return The status code, so that it can be returned directly.
+     */
+    int done(int statusCode);
+
+private:
+    ProfileScope profile; ///< First, so that it covers the whole operation.
+    JournalOperation operation;
+    const std::string& path;
+    const std::string* target;
+    std::chrono::system_clock::time_point started;
+    std::chrono::steady_clock::time_point startedSteady;
+    bool recorded = false;
+};
+
+#endif // JOURNAL_H
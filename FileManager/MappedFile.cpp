@@ -0,0 +1,192 @@
+/**
+ * @file MappedFile.cpp
+ * @brief Implementation of the sliding-window read-only file mapping.
+ */
+
+#include "MappedFile.h"
+#include <algorithm>
+#include <filesystem>
+
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <Windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+using namespace std;
+
+namespace {
+
+/**
+ * @brief Returns the alignment required for mapping offsets.
+ * @return The allocation granularity on Windows, the page size elsewhere.
+ */
+uint64_t mappingGranularity() {
+#ifdef _WIN32
+    SYSTEM_INFO info;
+    GetSystemInfo(&info);
+    return info.dwAllocationGranularity;
+#else
+    return static_cast<uint64_t>(sysconf(_SC_PAGESIZE));
+#endif
+}
+
+} // namespace
+
+/**
+ * @brief Destructor; unmaps the window and closes the file.
+ */
+MappedFile::~MappedFile() {
+    close();
+}
+
+/**
+ * @brief Opens a file for mapping, closing any file opened before.
+ * @param path Path to the file.
+ * @return True on success.
+ */
+bool MappedFile::open(const string& path) {
+    close();
+#ifdef _WIN32
+    HANDLE handle = CreateFileW(filesystem::path(path).c_str(), GENERIC_READ,
+        FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+    if (handle == INVALID_HANDLE_VALUE) {
+        return false;
+    }
+    LARGE_INTEGER length;
+    if (!GetFileSizeEx(handle, &length)) {
+        CloseHandle(handle);
+        return false;
+    }
+    fileHandle = handle;
+    fileSize = static_cast<uint64_t>(length.QuadPart);
+    if (fileSize > 0) {
+        mappingHandle = CreateFileMappingW(handle, nullptr, PAGE_READONLY, 0, 0, nullptr);
+        if (mappingHandle == nullptr) {
+            close();
+            return false;
+        }
+    }
+    return true;
+#else
+    descriptor = ::open(path.c_str(), O_RDONLY);
+    if (descriptor < 0) {
+        return false;
+    }
+    struct stat info;
+    if (fstat(descriptor, &info) != 0 || !S_ISREG(info.st_mode)) {
+        close();
+        return false;
+    }
+    fileSize = static_cast<uint64_t>(info.st_size);
+    return true;
+#endif
+}
+
+/**
+ * @brief Unmaps the window and closes the file.
+ */
+void MappedFile::close() {
+    unmapWindow();
+#ifdef _WIN32
+    if (mappingHandle != nullptr) {
+        CloseHandle(mappingHandle);
+        mappingHandle = nullptr;
+    }
+    if (fileHandle != nullptr) {
+        CloseHandle(fileHandle);
+        fileHandle = nullptr;
+    }
+#else
+    if (descriptor >= 0) {
+        ::close(descriptor);
+        descriptor = -1;
+    }
+#endif
+    fileSize = 0;
+}
+
+/**
+ * @brief Returns the size of the open file as of the last call to open or map.
+ * @return File size in bytes.
+ */
+uint64_t MappedFile::size() const {
+    return fileSize;
+}
+
+/**
+ * @brief Makes a range of the file accessible, remapping the window if the range lies outside it.
+ * The file size is read again first. Pages past the end of a file that was truncated while mapped
+ * raise SIGBUS when touched, so a window reaching beyond the new end is dropped and mapped again.
+ * Windows refuses to truncate a file with a mapped view, so the size read by open is kept there.
+ * @param offset Offset of the first byte.
+ * @param length Number of bytes wanted.
+ * @param available Receives the number of bytes accessible at the returned pointer.
+ * @return Pointer to the byte at offset, or nullptr if offset is past the end or mapping fails.
+ */
+const char* MappedFile::map(uint64_t offset, size_t length, size_t& available) {
+    available = 0;
+#ifndef _WIN32
+    struct stat info;
+    if (fstat(descriptor, &info) != 0) {
+        return nullptr;
+    }
+    fileSize = static_cast<uint64_t>(info.st_size);
+    if (window != nullptr && windowOffset + windowLength > fileSize) {
+        unmapWindow();
+    }
+#endif
+    if (offset >= fileSize) {
+        return nullptr;
+    }
+    length = static_cast<size_t>(min<uint64_t>(length, fileSize - offset));
+
+    if (window == nullptr || offset < windowOffset || offset + length > windowOffset + windowLength) {
+        unmapWindow();
+        uint64_t granularity = mappingGranularity();
+        uint64_t start = offset - offset % granularity;
+        uint64_t wanted = max<uint64_t>(defaultWindowSize, offset - start + length);
+        size_t mappedLength = static_cast<size_t>(min<uint64_t>(wanted, fileSize - start));
+#ifdef _WIN32
+        void* view = MapViewOfFile(mappingHandle, FILE_MAP_READ, static_cast<DWORD>(start >> 32),
+            static_cast<DWORD>(start & 0xFFFFFFFF), mappedLength);
+        if (view == nullptr) {
+            return nullptr;
+        }
+#else
+        void* view = mmap(nullptr, mappedLength, PROT_READ, MAP_PRIVATE, descriptor, static_cast<off_t>(start));
+        if (view == MAP_FAILED) {
+            return nullptr;
+        }
+#endif
+        window = static_cast<const char*>(view);
+        windowOffset = start;
+        windowLength = mappedLength;
+    }
+
+    available = static_cast<size_t>(windowOffset + windowLength - offset);
+    return window + (offset - windowOffset);
+}
+
+/**
+ * @brief Unmaps the current window.
+ */
+void MappedFile::unmapWindow() {
+    if (window == nullptr) {
+        return;
+    }
+#ifdef _WIN32
+    UnmapViewOfFile(window);
+#else
+    munmap(const_cast<char*>(window), windowLength);
+#endif
+    window = nullptr;
+    windowOffset = 0;
+    windowLength = 0;
+}
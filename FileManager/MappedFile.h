@@ -0,0 +1,83 @@
+/**
+ * @file MappedFile.h
+ * @brief Declares the MappedFile class, which maps a window of a read-only file into memory.
+ */
+
+#ifndef MAPPED_FILE_H
+#define MAPPED_FILE_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+/**
+ * @class MappedFile
+ * @brief Read-only memory mapping of a file through a sliding window.
+ *
+ * Only one window of the file is mapped at a time, so address space and memory use
+ * stay bounded no matter how large the file is. The pages of the window are loaded
+ * on demand by the operating system. The file may change size while it is open; each
+ * call to map sees the current size.
+ */
+class MappedFile {
+public:
+    /**
+     * @brief Default size of the mapped window.
+     */
+    static constexpr std::size_t defaultWindowSize = 64 << 20;
+
+    MappedFile() = default;
+    ~MappedFile();
+
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    /**
+     * @brief Opens a file for mapping, closing any file opened before.
+     * @param path Path to the file.
+     * @return True on success.
+     */
+    bool open(const std::string& path);
+
+    /**
+     * @brief Unmaps the window and closes the file.
+     */
+    void close();
+
+    /**
+     * @brief Returns the size of the open file as of the last call to open or map.
+     * @return File size in bytes.
+     */
+    std::uint64_t size() const;
+
+    /**
+     * @brief Makes a range of the file accessible.
+     * The range is clipped to the current end of the file. The returned pointer stays valid until
+     * the next call to map or close, as long as the file is not truncated in the meantime.
+     * @param offset Offset of the first byte.
+     * @param length Number of bytes wanted.
+     * @param available Receives the number of bytes accessible at the returned pointer, at least
+     * min(length, size() - offset) and possibly more.
+     * @return Pointer to the byte at offset, or nullptr if offset is past the end or mapping fails.
+     */
+    const char* map(std::uint64_t offset, std::size_t length, std::size_t& available);
+
+private:
+    /**
+     * @brief Unmaps the current window.
+     */
+    void unmapWindow();
+
+#ifdef _WIN32
+    void* fileHandle = nullptr;
+    void* mappingHandle = nullptr;
+#else
+    int descriptor = -1;
+#endif
+    std::uint64_t fileSize = 0;
+    const char* window = nullptr;
+    std::uint64_t windowOffset = 0;
+    std::size_t windowLength = 0;
+};
+
+#endif // MAPPED_FILE_H
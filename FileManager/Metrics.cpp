@@ -0,0 +1,367 @@
+/**
+ * @file Metrics.cpp
+ * @brief Implementation of the operation metrics and their Prometheus textfile export.
+ */
+
+#include "Metrics.h"
+#include "CacheLocation.h"
+#include <algorithm>
+#include <cstdio>
+#include <iostream>
+#include <system_error>
+
+using namespace std;
+namespace fs = filesystem;
+
+namespace {
+
+const char* const operationNames[] = {
+    "list_directory", "create_file", "delete_file", "create_directory", "delete_directory", "rename",
+    "trash_file", "trash_directory", "restore", "prune_directory", "search", "count_files", "file_exists",
+    "build_search_index", "convert_encoding", "replace_in_files", "count_text", "file_type_report",
+    "find_empty", "set_attributes", "set_timestamps", "disk_usage", "copy"
+};
+
+static_assert(sizeof(operationNames) / sizeof(operationNames[0]) == static_cast<size_t>(MetricOperation::Count),
+    "Every operation needs a name");
+
+/**
+ * @brief Adds to a counter that only the calling thread writes.
+ * A relaxed load and store suffice, and unlike an atomic increment they need no locked instruction.
+ */
+void bump(atomic<uint64_t>& counter, uint64_t amount = 1) {
+    counter.store(counter.load(memory_order_relaxed) + amount, memory_order_relaxed);
+}
+
+/**
+ * @brief Formats a count of nanoseconds as seconds.
+ */
+string seconds(uint64_t nanoseconds) {
+    char text[32];
+    snprintf(text, sizeof(text), "%.9g", static_cast<double>(nanoseconds) / 1e9);
+    return text;
+}
+
+/**
+ * @brief Appends the HELP and TYPE lines of a metric.
+ */
+void describe(string& out, const char* name, const char* type, const char* help) {
+    out += string("# HELP ") + name + " " + help + "\n# TYPE " + name + " " + type + "\n";
+}
+
+} // namespace
+
+/**
+ * @brief Retrieves the metrics.
+ * @return Reference to the Metrics instance.
+ */
+Metrics& Metrics::getInstance() {
+    static Metrics instance;
+    return instance;
+}
+
+/**
+ * @brief Stops exporting, writing the final counts.
+ */
+Metrics::~Metrics() {
+    stopExport();
+}
+
+/**
+ * @brief Creates a shard and registers it for rendering.
+ * @param metrics The metrics the shard belongs to.
+ */
+Metrics::ShardOwner::ShardOwner(Metrics& metrics) : metrics(metrics), shard(make_unique<Shard>()) {
+    lock_guard<mutex> guard(metrics.shardsLock);
+    metrics.shards.push_back(shard.get());
+}
+
+/**
+ * @brief Adds the shard to the retired counts and unregisters it.
+ */
+Metrics::ShardOwner::~ShardOwner() {
+    lock_guard<mutex> guard(metrics.shardsLock);
+    accumulate(metrics.retired, *shard);
+    metrics.shards.erase(find(metrics.shards.begin(), metrics.shards.end(), shard.get()));
+}
+
+/**
+ * @brief Returns the calling thread's shard, registering it on first use.
+ * @return The shard.
+ */
+Metrics::Shard& Metrics::localShard() {
+    thread_local ShardOwner owner(*this);
+    return *owner.shard;
+}
+
+/**
+ * @brief Adds the counts of a shard to a total.
+ * @param total The total; it must not be written concurrently.
+ * @param shard The shard added.
+ */
+void Metrics::accumulate(Shard& total, const Shard& shard) {
+    for (size_t i = 0; i < operationCount; ++i) {
+        for (size_t j = 0; j < statusCount; ++j) {
+            bump(total.operations[i][j], shard.operations[i][j].load(memory_order_relaxed));
+        }
+        for (size_t j = 0; j < bucketCount; ++j) {
+            bump(total.latency[i][j], shard.latency[i][j].load(memory_order_relaxed));
+        }
+        bump(total.latencySum[i], shard.latencySum[i].load(memory_order_relaxed));
+    }
+    bump(total.entriesVisited, shard.entriesVisited.load(memory_order_relaxed));
+    bump(total.bytesCopied, shard.bytesCopied.load(memory_order_relaxed));
+    bump(total.bytesDeleted, shard.bytesDeleted.load(memory_order_relaxed));
+    bump(total.sizeCacheHits, shard.sizeCacheHits.load(memory_order_relaxed));
+    bump(total.sizeCacheMisses, shard.sizeCacheMisses.load(memory_order_relaxed));
+    bump(total.sizeCacheReread, shard.sizeCacheReread.load(memory_order_relaxed));
+    bump(total.indexPruned, shard.indexPruned.load(memory_order_relaxed));
+    bump(total.indexDescended, shard.indexDescended.load(memory_order_relaxed));
+}
+
+/**
+ * @brief Counts a finished operation and adds its duration to the latency histogram.
+ * @param operation The operation.
+ * @param statusCode Its status code.
+ * @param duration Its duration.
+ */
+void Metrics::recordOperation(MetricOperation operation, int statusCode, chrono::nanoseconds duration) {
+    Shard& shard = localShard();
+    size_t index = static_cast<size_t>(operation);
+    size_t status = 0;
+    while (status < statusCount - 1 && statusCodes[status] != statusCode) {
+        ++status;
+    }
+    size_t bucket = 0;
+    while (bucket < bucketCount - 1 && duration.count() > bucketBounds[bucket]) {
+        ++bucket;
+    }
+    bump(shard.operations[index][status]);
+    bump(shard.latency[index][bucket]);
+    bump(shard.latencySum[index], static_cast<uint64_t>(duration.count()));
+}
+
+/**
+ * @brief Counts directory entries listed during traversals.
+ */
+void Metrics::addEntriesVisited(uint64_t count) {
+    bump(localShard().entriesVisited, count);
+}
+
+/**
+ * @brief Counts bytes of file data copied.
+ */
+void Metrics::addBytesCopied(uint64_t bytes) {
+    bump(localShard().bytesCopied, bytes);
+}
+
+/**
+ * @brief Counts bytes of files removed.
+ */
+void Metrics::addBytesDeleted(uint64_t bytes) {
+    bump(localShard().bytesDeleted, bytes);
+}
+
+/**
+ * @brief Counts a disk usage query answered from the size cache.
+ * @param reread Number of directories listed to bring the cache up to date.
+ */
+void Metrics::recordSizeCacheQuery(uint64_t reread) {
+    Shard& shard = localShard();
+    bump(reread == 0 ? shard.sizeCacheHits : shard.sizeCacheMisses);
+    bump(shard.sizeCacheReread, reread);
+}
+
+/**
+ * @brief Counts a search index lookup for a subtree.
+ * @param pruned Whether the subtree was skipped.
+ */
+void Metrics::recordIndexLookup(bool pruned) {
+    Shard& shard = localShard();
+    bump(pruned ? shard.indexPruned : shard.indexDescended);
+}
+
+/**
+ * @brief Adds up all shards and renders them in the Prometheus text exposition format.
+ * Operations that never ran and status codes that never occurred are left out.
+ * @return The rendered metrics.
+ */
+string Metrics::render() {
+    Shard total;
+    {
+        lock_guard<mutex> guard(shardsLock);
+        accumulate(total, retired);
+        for (const Shard* shard : shards) {
+            accumulate(total, *shard);
+        }
+    }
+    auto value = [](const atomic<uint64_t>& counter) { return counter.load(memory_order_relaxed); };
+
+    string out;
+    describe(out, "filemanager_operations_total", "counter", "Operations run, by operation and status code.");
+    for (size_t i = 0; i < operationCount; ++i) {
+        for (size_t j = 0; j < statusCount; ++j) {
+            if (value(total.operations[i][j]) > 0) {
+                out += string("filemanager_operations_total{operation=\"") + operationNames[i] + "\",status=\""
+                    + (j < statusCount - 1 ? to_string(statusCodes[j]) : string("other")) + "\"} "
+                    + to_string(value(total.operations[i][j])) + "\n";
+            }
+        }
+    }
+
+    describe(out, "filemanager_operation_duration_seconds", "histogram", "Duration of operations.");
+    for (size_t i = 0; i < operationCount; ++i) {
+        uint64_t cumulative = 0;
+        for (size_t j = 0; j < bucketCount; ++j) {
+            cumulative += value(total.latency[i][j]);
+        }
+        if (cumulative == 0) {
+            continue;
+        }
+        string label = string("operation=\"") + operationNames[i] + "\"";
+        cumulative = 0;
+        for (size_t j = 0; j < bucketCount; ++j) {
+            cumulative += value(total.latency[i][j]);
+            string bound = j < bucketCount - 1 ? seconds(static_cast<uint64_t>(bucketBounds[j])) : string("+Inf");
+            out += "filemanager_operation_duration_seconds_bucket{" + label + ",le=\"" + bound + "\"} "
+                + to_string(cumulative) + "\n";
+        }
+        out += "filemanager_operation_duration_seconds_sum{" + label + "} " + seconds(value(total.latencySum[i])) + "\n";
+        out += "filemanager_operation_duration_seconds_count{" + label + "} " + to_string(cumulative) + "\n";
+    }
+
+    describe(out, "filemanager_entries_visited_total", "counter", "Directory entries listed by traversals.");
+    out += "filemanager_entries_visited_total " + to_string(value(total.entriesVisited)) + "\n";
+    describe(out, "filemanager_copied_bytes_total", "counter", "Bytes of file data copied.");
+    out += "filemanager_copied_bytes_total " + to_string(value(total.bytesCopied)) + "\n";
+    describe(out, "filemanager_deleted_bytes_total", "counter", "Bytes of files deleted one by one.");
+    out += "filemanager_deleted_bytes_total " + to_string(value(total.bytesDeleted)) + "\n";
+    describe(out, "filemanager_size_cache_queries_total", "counter",
+        "Disk usage queries answered from the size cache; a hit needed no directory to be listed.");
+    out += "filemanager_size_cache_queries_total{result=\"hit\"} " + to_string(value(total.sizeCacheHits)) + "\n";
+    out += "filemanager_size_cache_queries_total{result=\"miss\"} " + to_string(value(total.sizeCacheMisses)) + "\n";
+    describe(out, "filemanager_size_cache_reread_directories_total", "counter",
+        "Directories listed to bring the size cache up to date.");
+    out += "filemanager_size_cache_reread_directories_total " + to_string(value(total.sizeCacheReread)) + "\n";
+    describe(out, "filemanager_search_index_lookups_total", "counter",
+        "Subtrees looked up in search indexes; pruned ones were skipped.");
+    out += "filemanager_search_index_lookups_total{result=\"pruned\"} " + to_string(value(total.indexPruned)) + "\n";
+    out += "filemanager_search_index_lookups_total{result=\"descended\"} " + to_string(value(total.indexDescended)) + "\n";
+    return out;
+}
+
+/**
+ * @brief Writes the rendered metrics to the export directory through a temporary file, whose
+ * name does not end in .prom, so the collector ignores it.
+ * @param directory The export directory.
+ * @return True on success.
+ */
+bool Metrics::writeExport(const fs::path& directory) {
+    return writeCacheFile(directory / exportFileName, render());
+}
+
+/**
+ * @brief Starts writing the metrics to a directory periodically, replacing any earlier export.
+ * @param directory The textfile collector directory.
+ * @param interval Time between writes.
+ * @return HTTP-like status code:
+ * - 200: Success.
+ * - 404: Directory does not exist.
+ * - 400: Path is not a directory, or the interval is zero.
+ * - 500: The metrics file cannot be written.
+ */
+int Metrics::startExport(const string& directory, chrono::seconds interval) {
+    try {
+        if (!fs::exists(directory)) {
+            cerr << "Error: Directory does not exist." << endl;
+            return 404;
+        }
+        if (!fs::is_directory(directory) || interval.count() <= 0) {
+            cerr << "Error: Path is not a directory or the interval is not positive." << endl;
+            return 400;
+        }
+        stopExport();
+        if (!writeExport(directory)) {
+            cerr << "Error: Unable to write " << (fs::path(directory) / exportFileName).string() << endl;
+            return 500;
+        }
+        lock_guard<mutex> guard(exportLock);
+        exporting = directory;
+        stopping = false;
+        exporter = thread(&Metrics::exportPeriodically, this, fs::path(directory), interval);
+        return 200;
+    }
+    catch (const exception& e) {
+        cerr << "Error starting the metrics export: " << e.what() << endl;
+        return 500;
+    }
+}
+
+/**
+ * @brief Writes the metrics a final time and stops exporting.
+ */
+void Metrics::stopExport() {
+    {
+        lock_guard<mutex> guard(exportLock);
+        stopping = true;
+    }
+    wake.notify_all();
+    if (exporter.joinable()) {
+        exporter.join();
+    }
+    lock_guard<mutex> guard(exportLock);
+    exporting.clear();
+}
+
+/**
+ * @brief Returns the directory being exported to, or an empty path if not exporting.
+ */
+fs::path Metrics::exportDirectory() {
+    lock_guard<mutex> guard(exportLock);
+    return exporting;
+}
+
+/**
+ * @brief Writes the metrics every interval until stopped, and once more when stopping.
+ * @param directory The export directory.
+ * @param interval Time between writes.
+ */
+void Metrics::exportPeriodically(fs::path directory, chrono::seconds interval) {
+    unique_lock<mutex> guard(exportLock);
+    while (!wake.wait_for(guard, interval, [this] { return stopping; })) {
+        guard.unlock();
+        if (!writeExport(directory)) {
+            cerr << "Error: Unable to write " << (directory / exportFileName).string() << endl;
+        }
+        guard.lock();
+    }
+    guard.unlock();
+    writeExport(directory);
+}
+
+/**
+ * @brief Starts timing an operation.
+ * @param operation The operation.
+ */
+MetricsScope::MetricsScope(MetricOperation operation) : operation(operation), started(chrono::steady_clock::now()) {
+}
+
+/**
+ * @brief Counts the operation with status 500 if no status was reported.
+ */
+MetricsScope::~MetricsScope() {
+    if (!recorded) {
+        done(500);
+    }
+}
+
+/**
+ * @brief Counts the operation with its status.
+ * @param statusCode Status code of the operation.
+ * @return The status code.
+ */
+int MetricsScope::done(int statusCode) {
+    recorded = true;
+    Metrics::getInstance().recordOperation(operation, statusCode, chrono::steady_clock::now() - started);
+    return statusCode;
+}
@@ -0,0 +1,256 @@
+/**
+ * @file Metrics.h
+ * @brief Declares the Metrics class, which counts the work done through BaseFileManager and exports
+ * the counters as a Prometheus textfile, and MetricsScope, which times one operation.
+ */
+
+#ifndef METRICS_H
+#define METRICS_H
+
+#include "Profiler.h"
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+/**
+ * @brief Operation counted by the metrics; the label value is its name in snake case.
+ */
+enum class MetricOperation {
+    ListDirectory,
+    CreateFile,
+    DeleteFile,
+    CreateDirectory,
+    DeleteDirectory,
+    Rename,
+    TrashFile,
+    TrashDirectory,
+    Restore,
+    PruneDirectory,
+    Search,
+    CountFiles,
+    FileExists,
+    BuildSearchIndex,
+    ConvertEncoding,
+    ReplaceInFiles,
+    CountText,
+    FileTypeReport,
+    FindEmpty,
+    SetAttributes,
+    SetTimestamps,
+    DiskUsage,
+    Copy,
+    Count ///< Number of operations; not an operation.
+};
+
+/**
+ * @class Metrics
+ * @brief Counters of operations, latencies, entries visited, bytes moved and cache effectiveness.
+ *
+ * Every thread updates its own shard of counters with relaxed loads and stores, so counting
+ * costs no more than an ordinary increment and never contends with other threads. Shards are
+ * only added up when the metrics are rendered; when a thread exits, its shard is added to the
+ * retired counts and dropped, so threads started for each walk do not accumulate. Exporting writes the rendered text every export
+ * interval to a file in the node_exporter textfile collector directory, replacing the file with
+ * a rename so the collector never reads a partial file.
+ */
+class Metrics {
+public:
+    /**
+     * @brief Name of the exported file.
+     */
+    static constexpr const char* exportFileName = "filemanager.prom";
+
+    /**
+     * @brief Time between exports unless another interval is given.
+     */
+    static constexpr std::chrono::seconds defaultExportInterval{ 15 };
+
+    /**
+     * @brief Retrieves the metrics.
+     * @return Reference to the Metrics instance.
+     */
+    static Metrics& getInstance();
+
+    Metrics(const Metrics&) = delete;
+    Metrics& operator=(const Metrics&) = delete;
+
+    /**
+     * @brief Counts a finished operation and adds its duration to the latency histogram.
+     * @param operation The operation.
+     * @param statusCode Its status code.
+     * @param duration Its duration.
+     */
+    void recordOperation(MetricOperation operation, int statusCode, std::chrono::nanoseconds duration);
+
+    /**
+     * @brief Counts directory entries listed during traversals.
+     */
+    void addEntriesVisited(std::uint64_t count);
+
+    /**
+     * @brief Counts bytes of file data copied.
+     */
+    void addBytesCopied(std::uint64_t bytes);
+
+    /**
+     * @brief Counts bytes of files removed.
+     */
+    void addBytesDeleted(std::uint64_t bytes);
+
+    /**
+     * @brief Counts a disk usage query answered from the size cache.
+     * @param reread Number of directories listed to bring the cache up to date; a query with none is a hit.
+     */
+    void recordSizeCacheQuery(std::uint64_t reread);
+
+    /**
+     * @brief Counts a search index lookup for a subtree.
+     * @param pruned Whether the index allowed the subtree to be skipped.
+     */
+    void recordIndexLookup(bool pruned);
+
+    /**
+     * @brief Adds up all shards and renders them in the Prometheus text exposition format.
+     * @return The rendered metrics.
+     */
+    std::string render();
+
+    /**
+     * @brief Starts writing the metrics to a directory periodically, replacing any earlier export.
+     * @param directory The textfile collector directory.
+     * @param interval Time between writes.
+     * @return Status code: 200 on success, 404 if the directory does not exist, 400 if it is not
+     * a directory or the interval is zero, 500 if the file cannot be written.
+     */
+    int startExport(const std::string& directory, std::chrono::seconds interval = defaultExportInterval);
+
+    /**
+     * @brief Writes the metrics a final time and stops exporting.
+     */
+    void stopExport();
+
+    /**
+     * @brief Returns the directory being exported to, or an empty path if not exporting.
+     */
+    std::filesystem::path exportDirectory();
+
+private:
+    /**
+     * @brief Status codes counted separately; others are counted as "other".
+     */
+    static constexpr int statusCodes[] = { 200, 204, 206, 207, 400, 404, 500, 501 };
+    static constexpr std::size_t statusCount = sizeof(statusCodes) / sizeof(statusCodes[0]) + 1;
+
+    /**
+     * @brief Upper bounds of the latency histogram buckets, in nanoseconds; +Inf is implied.
+     */
+    static constexpr std::int64_t bucketBounds[] = { 100000, 1000000, 10000000, 100000000, 1000000000, 10000000000 };
+    static constexpr std::size_t bucketCount = sizeof(bucketBounds) / sizeof(bucketBounds[0]) + 1;
+
+    static constexpr std::size_t operationCount = static_cast<std::size_t>(MetricOperation::Count);
+
+    /**
+     * @brief Counters written by a single thread and read when rendering.
+     */
+    struct Shard {
+        std::atomic<std::uint64_t> operations[operationCount][statusCount] = {};
+        std::atomic<std::uint64_t> latency[operationCount][bucketCount] = {}; ///< Non-cumulative bucket counts.
+        std::atomic<std::uint64_t> latencySum[operationCount] = {};           ///< Nanoseconds.
+        std::atomic<std::uint64_t> entriesVisited{ 0 };
+        std::atomic<std::uint64_t> bytesCopied{ 0 };
+        std::atomic<std::uint64_t> bytesDeleted{ 0 };
+        std::atomic<std::uint64_t> sizeCacheHits{ 0 };
+        std::atomic<std::uint64_t> sizeCacheMisses{ 0 };
+        std::atomic<std::uint64_t> sizeCacheReread{ 0 };
+        std::atomic<std::uint64_t> indexPruned{ 0 };
+        std::atomic<std::uint64_t> indexDescended{ 0 };
+    };
+
+    /**
+     * @brief Owns a thread's shard, registered while the thread runs and retired when it exits.
+     */
+    struct ShardOwner {
+        explicit ShardOwner(Metrics& metrics);
+        ~ShardOwner();
+
+        ShardOwner(const ShardOwner&) = delete;
+        ShardOwner& operator=(const ShardOwner&) = delete;
+
+        Metrics& metrics;
+        std::unique_ptr<Shard> shard;
+    };
+
+    Metrics() = default;
+    ~Metrics();
+
+    /**
+     * @brief Returns the calling thread's shard, creating it on first use.
+     */
+    Shard& localShard();
+
+    /**
+     * @brief Adds the counts of a shard to a total; the total must not be written concurrently.
+     */
+    static void accumulate(Shard& total, const Shard& shard);
+
+    /**
+     * @brief Writes the rendered metrics to the export directory.
+     */
+    bool writeExport(const std::filesystem::path& directory);
+
+    /**
+     * @brief Body of the export thread.
+     */
+    void exportPeriodically(std::filesystem::path directory, std::chrono::seconds interval);
+
+    std::mutex shardsLock;
+    std::vector<Shard*> shards; ///< Shards of running threads.
+    Shard retired;              ///< Counts of threads that have exited, guarded by shardsLock.
+
+    std::mutex exportLock;
+    std::condition_variable wake;
+    std::filesystem::path exporting;
+    bool stopping = false;
+    std::thread exporter;
+};
+
+/**
+ * @class MetricsScope
+ * @brief Times one operation and counts it when the operation reports its status.
+ * If the scope ends without a status, the operation is counted with status 500.
+ */
+class MetricsScope {
+public:
+    /**
+     * @brief Starts timing an operation.
+     * @param operation The operation.
+     */
+    explicit MetricsScope(MetricOperation operation);
+    ~MetricsScope();
+
+    MetricsScope(const MetricsScope&) = delete;
+    MetricsScope& operator=(const MetricsScope&) = delete;
+
+    /**
+     * @brief Counts the operation with its status.
+     * @param statusCode Status code of the operation.
+     * @return The status code, so that it can be returned directly.
+     */
+    int done(int statusCode);
+
+private:
+    ProfileScope profile; ///< First, so that it covers the whole operation.
+    MetricOperation operation;
+    std::chrono::steady_clock::time_point started;
+    bool recorded = false;
+};
+
+#endif // METRICS_H
@@ -0,0 +1,73 @@
+/**
+ * @file ParallelFor.cpp
+ * @brief Implementation of parallelFor.
+ */
+
+#include "ParallelFor.h"
+#include <algorithm>
+#include <atomic>
+#include <exception>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+using namespace std;
+
+/**
+ * @brief Returns the number of workers parallelFor uses for a thread setting.
+ * @param threads Requested number of threads; 0 selects the hardware concurrency.
+ * @return The effective number of workers.
+ */
+unsigned parallelWorkerCount(unsigned threads) {
+    if (threads != 0) {
+        return threads;
+    }
+    return max(1u, thread::hardware_concurrency());
+}
+
+/**
+ * @brief Runs a function for every index in [0, count) on a pool of worker threads.
+ * The calling thread takes part as worker 0.
+ * @param count Number of work items.
+ * @param threads Number of worker threads; 0 selects the hardware concurrency.
+ * @param body Function called with the item index and the index of the worker running it.
+ */
+void parallelFor(size_t count, unsigned threads, const function<void(size_t index, unsigned worker)>& body) {
+    atomic<size_t> next{ 0 };
+    atomic<bool> failed{ false };
+    mutex failureLock;
+    exception_ptr failure;
+
+    auto work = [&](unsigned worker) {
+        while (!failed) {
+            size_t index = next.fetch_add(1, memory_order_relaxed);
+            if (index >= count) {
+                return;
+            }
+            try {
+                body(index, worker);
+            }
+            catch (...) {
+                lock_guard<mutex> guard(failureLock);
+                if (!failure) {
+                    failure = current_exception();
+                }
+                failed = true;
+            }
+        }
+    };
+
+    unsigned workerCount = static_cast<unsigned>(min<size_t>(parallelWorkerCount(threads), max<size_t>(count, 1)));
+    vector<thread> workers;
+    for (unsigned i = 1; i < workerCount; ++i) {
+        workers.emplace_back(work, i);
+    }
+    work(0);
+    for (auto& worker : workers) {
+        worker.join();
+    }
+
+    if (failure) {
+        rethrow_exception(failure);
+    }
+}
@@ -0,0 +1,30 @@
+/**
+ * @file ParallelFor.h
+ * @brief Declares parallelFor, which spreads independent work items over a pool of threads.
+ */
+
+#ifndef PARALLEL_FOR_H
+#define PARALLEL_FOR_H
+
+#include <cstddef>
+#include <functional>
+
+/**
+ * @brief Runs a function for every index in [0, count) on a pool of worker threads.
+ * Workers take indices from a shared counter, so uneven items balance out. The first
+ * exception thrown by the function stops the remaining work and is rethrown once all
+ * workers have finished.
+ * @param count Number of work items.
+ * @param threads Number of worker threads; 0 selects the hardware concurrency.
+ * @param body Function called with the item index and the index of the worker running it.
+ */
+void parallelFor(std::size_t count, unsigned threads, const std::function<void(std::size_t index, unsigned worker)>& body);
+
+/**
+ * @brief Returns the number of workers parallelFor uses for a thread setting.
+ * @param threads Requested number of threads; 0 selects the hardware concurrency.
+ * @return The effective number of workers.
+ */
+unsigned parallelWorkerCount(unsigned threads);
+
+#endif // PARALLEL_FOR_H
@@ -0,0 +1,226 @@
+/**
+ * @file Profiler.cpp
+ * @brief Implementation of the operation profiler and the counting allocator.
+ */
+
+#include "Profiler.h"
+#include <chrono>
+#include <cstddef>
+#include <cstdlib>
+#include <new>
+
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <Windows.h>
+#include <Psapi.h>
+#else
+#include <sys/resource.h>
+#endif
+
+using namespace std;
+
+namespace {
+
+/**
+ * @brief Number of allocation counters; threads beyond this share them.
+ */
+const size_t allocationShardCount = 64;
+
+/**
+ * @brief Allocation counters of a group of threads, on a cache line of their own.
+ */
+struct alignas(64) AllocationShard {
+    atomic<uint64_t> count{ 0 };
+    atomic<uint64_t> bytes{ 0 };
+};
+
+atomic<bool> countingAllocations{ false };
+AllocationShard allocationShards[allocationShardCount];
+atomic<unsigned> nextAllocationShard{ 0 };
+
+thread_local int profileDepth = 0;
+thread_local OperationProfile lastProfile;
+thread_local bool hasLastProfile = false;
+
+/**
+ * @brief Counts an allocation in the calling thread's counters if profiling is on.
+ */
+void countAllocation(size_t size) {
+    if (!countingAllocations.load(memory_order_relaxed)) {
+        return;
+    }
+    thread_local unsigned shard = nextAllocationShard.fetch_add(1, memory_order_relaxed) % allocationShardCount;
+    allocationShards[shard].count.fetch_add(1, memory_order_relaxed);
+    allocationShards[shard].bytes.fetch_add(size, memory_order_relaxed);
+}
+
+#ifdef _WIN32
+/**
+ * @brief Converts a FILETIME duration in 100-nanosecond ticks to nanoseconds.
+ */
+int64_t nanoseconds(const FILETIME& time) {
+    return static_cast<int64_t>((static_cast<uint64_t>(time.dwHighDateTime) << 32) | time.dwLowDateTime) * 100;
+}
+#else
+/**
+ * @brief Converts a timeval to nanoseconds.
+ */
+int64_t nanoseconds(const timeval& time) {
+    return static_cast<int64_t>(time.tv_sec) * 1000000000 + static_cast<int64_t>(time.tv_usec) * 1000;
+}
+#endif
+
+} // namespace
+
+/**
+ * @brief Allocates memory and counts the allocation while profiling.
+ */
+void* operator new(size_t size) {
+    countAllocation(size);
+    if (size == 0) {
+        size = 1;
+    }
+    while (true) {
+        if (void* memory = malloc(size)) {
+            return memory;
+        }
+        new_handler handler = get_new_handler();
+        if (!handler) {
+            throw bad_alloc();
+        }
+        handler();
+    }
+}
+
+/**
+ * @brief Frees memory allocated by operator new.
+ */
+void operator delete(void* memory) noexcept {
+    free(memory);
+}
+
+/**
+ * @brief Frees memory allocated by operator new.
+ */
+void operator delete(void* memory, size_t) noexcept {
+    free(memory);
+}
+
+/**
+ * @brief Retrieves the profiler.
+ * @return Reference to the Profiler instance.
+ */
+Profiler& Profiler::getInstance() {
+    static Profiler instance;
+    return instance;
+}
+
+/**
+ * @brief Turns profiling on or off.
+ */
+void Profiler::setEnabled(bool enabled) {
+    this->enabled.store(enabled, memory_order_relaxed);
+    countingAllocations.store(enabled, memory_order_relaxed);
+}
+
+/**
+ * @brief Returns whether profiling is on.
+ */
+bool Profiler::isEnabled() const {
+    return enabled.load(memory_order_relaxed);
+}
+
+/**
+ * @brief Takes the profile of the last operation finished on the calling thread.
+ * @param profile Receives the profile.
+ * @return Whether an operation was profiled since the last call.
+ */
+bool Profiler::takeLast(OperationProfile& profile) {
+    if (!hasLastProfile) {
+        return false;
+    }
+    profile = lastProfile;
+    hasLastProfile = false;
+    return true;
+}
+
+/**
+ * @brief Reads the counters of the process.
+ * @return The counters, with a steady clock reading as the wall time.
+ */
+OperationProfile Profiler::sample() {
+    OperationProfile profile;
+    profile.wallTime = chrono::duration_cast<chrono::nanoseconds>(chrono::steady_clock::now().time_since_epoch()).count();
+    for (const auto& shard : allocationShards) {
+        profile.allocations += shard.count.load(memory_order_relaxed);
+        profile.allocatedBytes += shard.bytes.load(memory_order_relaxed);
+    }
+#ifdef _WIN32
+    HANDLE process = GetCurrentProcess();
+    FILETIME creation, exit, kernel, user;
+    if (GetProcessTimes(process, &creation, &exit, &kernel, &user)) {
+        profile.userTime = nanoseconds(user);
+        profile.systemTime = nanoseconds(kernel);
+    }
+    IO_COUNTERS io;
+    if (GetProcessIoCounters(process, &io)) {
+        profile.blockReads = static_cast<int64_t>(io.ReadOperationCount);
+        profile.blockWrites = static_cast<int64_t>(io.WriteOperationCount);
+    }
+    PROCESS_MEMORY_COUNTERS memory;
+    if (GetProcessMemoryInfo(process, &memory, sizeof(memory))) {
+        profile.minorFaults = memory.PageFaultCount;
+        profile.peakResidentGrowth = static_cast<int64_t>(memory.PeakWorkingSetSize);
+    }
+#else
+    rusage usage{};
+    if (getrusage(RUSAGE_SELF, &usage) == 0) {
+        profile.userTime = nanoseconds(usage.ru_utime);
+        profile.systemTime = nanoseconds(usage.ru_stime);
+        profile.voluntarySwitches = usage.ru_nvcsw;
+        profile.involuntarySwitches = usage.ru_nivcsw;
+        profile.majorFaults = usage.ru_majflt;
+        profile.minorFaults = usage.ru_minflt;
+        profile.blockReads = usage.ru_inblock;
+        profile.blockWrites = usage.ru_oublock;
+        profile.peakResidentGrowth = static_cast<int64_t>(usage.ru_maxrss) * 1024; // Kilobytes on Linux.
+    }
+#endif
+    return profile;
+}
+
+/**
+ * @brief Starts profiling unless profiling is off or an outer operation is being profiled.
+ */
+ProfileScope::ProfileScope() {
+    if (profileDepth++ == 0 && Profiler::getInstance().isEnabled()) {
+        active = true;
+        start = Profiler::sample();
+    }
+}
+
+/**
+ * @brief Stores the resources used since the scope started as the thread's last profile.
+ */
+ProfileScope::~ProfileScope() {
+    --profileDepth;
+    if (!active) {
+        return;
+    }
+    OperationProfile end = Profiler::sample();
+    lastProfile.wallTime = end.wallTime - start.wallTime;
+    lastProfile.userTime = end.userTime - start.userTime;
+    lastProfile.systemTime = end.systemTime - start.systemTime;
+    lastProfile.voluntarySwitches = end.voluntarySwitches - start.voluntarySwitches;
+    lastProfile.involuntarySwitches = end.involuntarySwitches - start.involuntarySwitches;
+    lastProfile.majorFaults = end.majorFaults - start.majorFaults;
+    lastProfile.minorFaults = end.minorFaults - start.minorFaults;
+    lastProfile.blockReads = end.blockReads - start.blockReads;
+    lastProfile.blockWrites = end.blockWrites - start.blockWrites;
+    lastProfile.peakResidentGrowth = end.peakResidentGrowth - start.peakResidentGrowth;
+    lastProfile.allocations = end.allocations - start.allocations;
+    lastProfile.allocatedBytes = end.allocatedBytes - start.allocatedBytes;
+    hasLastProfile = true;
+}
@@ -0,0 +1,105 @@
+/**
+ * @file Profiler.h
+ * @brief Declares the Profiler class, which measures the CPU time, context switches, page faults,
+ * storage I/O, peak memory and allocations of BaseFileManager operations, and ProfileScope,
+ * which measures one operation.
+ */
+
+#ifndef PROFILER_H
+#define PROFILER_H
+
+#include <atomic>
+#include <cstdint>
+
+/**
+ * @struct OperationProfile
+ * @brief Resources used by one operation, measured for the whole process.
+ *
+ * Operations that walk directories in parallel use several threads, so the CPU time can exceed
+ * the wall time. Background threads such as the journal flusher are counted as well.
+ */
+struct OperationProfile {
+    std::int64_t wallTime = 0;            ///< Nanoseconds.
+    std::int64_t userTime = 0;            ///< Nanoseconds of CPU time in user mode.
+    std::int64_t systemTime = 0;          ///< Nanoseconds of CPU time in the kernel.
+    std::int64_t voluntarySwitches = 0;   ///< Context switches while waiting for I/O or locks; 0 on Windows.
+    std::int64_t involuntarySwitches = 0; ///< Context switches by preemption; 0 on Windows.
+    std::int64_t majorFaults = 0;         ///< Page faults that read from storage; 0 on Windows.
+    std::int64_t minorFaults = 0;         ///< Other page faults; all page faults on Windows.
+    std::int64_t blockReads = 0;          ///< 512-byte blocks read from storage, or read operations on Windows.
+    std::int64_t blockWrites = 0;         ///< 512-byte blocks written to storage, or write operations on Windows.
+    std::int64_t peakResidentGrowth = 0;  ///< Bytes by which the peak resident set size grew.
+    std::int64_t allocations = 0;         ///< Calls to operator new.
+    std::int64_t allocatedBytes = 0;      ///< Bytes requested from operator new.
+};
+
+/**
+ * @class Profiler
+ * @brief Profiles BaseFileManager operations while enabled.
+ *
+ * JournalScope and MetricsScope each hold a ProfileScope, so every operation is profiled
+ * without further changes to BaseFileManager. Only the outermost operation on a thread is
+ * measured; the profile of the last one is kept for that thread until it is taken.
+ *
+ * Allocations are counted by replacing the global operator new and operator delete. While
+ * profiling is disabled this costs one relaxed load per allocation.
+ */
+class Profiler {
+public:
+    /**
+     * @brief Retrieves the profiler.
+     * @return Reference to the Profiler instance.
+     */
+    static Profiler& getInstance();
+
+    Profiler(const Profiler&) = delete;
+    Profiler& operator=(const Profiler&) = delete;
+
+    /**
+     * @brief Turns profiling on or off; it is off by default.
+     */
+    void setEnabled(bool enabled);
+
+    /**
+     * @brief Returns whether profiling is on.
+     */
+    bool isEnabled() const;
+
+    /**
+     * @brief Takes the profile of the last operation finished on the calling thread.
+     * @param profile Receives the profile.
+     * @return Whether an operation was profiled since the last call.
+     */
+    bool takeLast(OperationProfile& profile);
+
+private:
+    friend class ProfileScope;
+
+    Profiler() = default;
+
+    /**
+     * @brief Reads the counters of the process; wallTime is a steady clock reading.
+     */
+    static OperationProfile sample();
+
+    std::atomic<bool> enabled{ false };
+};
+
+/**
+ * @class ProfileScope
+ * @brief Profiles the enclosing operation if profiling is on and no outer operation is being profiled.
+ */
+class ProfileScope {
+public:
+    ProfileScope();
+    ~ProfileScope();
+
+    ProfileScope(const ProfileScope&) = delete;
+    ProfileScope& operator=(const ProfileScope&) = delete;
+
+private:
+    bool active = false;
+    OperationProfile start;
+};
+
+#endif // PROFILER_H
@@ -0,0 +1,540 @@
+/**
+ * @file SearchIndex.cpp
+ * @brief Implementation of the per-subtree trigram Bloom filter index and the SubtreePruner.
+ */
+
+#include "SearchIndex.h"
+#include "CacheLocation.h"
+#include "DirectoryWalker.h"
+#include "Metrics.h"
+#include <algorithm>
+#include <bitset>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+#include <mutex>
+#include <system_error>
+#include <type_traits>
+#include <unordered_map>
+
+using namespace std;
+namespace fs = filesystem;
+
+namespace {
+
+/**
+ * @brief Identifies an index file and its format version.
+ */
+const char indexMagic[8] = { 'F', 'M', 'S', 'I', 'D', 'X', '1', '\0' };
+
+/**
+ * @brief Extension of the index files in the cache directory.
+ */
+const char* const indexExtension = ".sidx";
+
+/**
+ * @brief Hashes the trigram starting at a position of a name.
+ * @param name Bytes of the name.
+ * @return A well-mixed 64-bit hash.
+ */
+uint64_t trigramHash(const unsigned char* name) {
+    uint64_t h = name[0] | (static_cast<uint64_t>(name[1]) << 8) | (static_cast<uint64_t>(name[2]) << 16);
+    h *= 0x9E3779B97F4A7C15ULL;
+    h ^= h >> 29;
+    h *= 0xBF58476D1CE4E5B9ULL;
+    h ^= h >> 32;
+    return h;
+}
+
+/**
+ * @brief Returns the bit a hash selects for one of the filter's hash functions.
+ * Positions are taken modulo a power of two, so a filter folded to half its size
+ * selects the same bits modulo the smaller size.
+ * @param hash The trigram hash.
+ * @param i Index of the hash function, below SearchIndex::hashCount.
+ * @param bits Filter size in bits, a power of two.
+ * @return The bit position.
+ */
+size_t bitPosition(uint64_t hash, unsigned i, size_t bits) {
+    uint64_t step = (hash >> 32) | 1;
+    return static_cast<size_t>((hash + i * step) & (bits - 1));
+}
+
+/**
+ * @brief Returns the filename of a path as the search compares it against patterns.
+ * @param path The path.
+ * @return The filename bytes.
+ */
+string nameOf(const fs::path& path) {
+    if constexpr (is_same_v<fs::path::value_type, char>) {
+        return path.filename().native();
+    }
+    else {
+        return path.filename().string();
+    }
+}
+
+/**
+ * @brief Checks whether a path character separates directories.
+ * @param c The character.
+ * @return True for the preferred separator and for '/'.
+ */
+bool isSeparator(fs::path::value_type c) {
+    return c == fs::path::preferred_separator || c == '/';
+}
+
+/**
+ * @brief Counts the bits set in a filter.
+ * @param words The filter.
+ * @param count Number of words.
+ * @return The number of set bits.
+ */
+size_t countBits(const uint64_t* words, size_t count) {
+    size_t total = 0;
+    for (size_t i = 0; i < count; ++i) {
+        total += bitset<64>(words[i]).count();
+    }
+    return total;
+}
+
+/**
+ * @brief Folds a filter to the smallest power-of-two size at most half full.
+ * The number of distinct trigrams is estimated from the fill of the full-size filter,
+ * the filter is folded once to the size that estimate calls for, and then doubled back
+ * while it is still more than half full.
+ * @param filter The full-size filter.
+ * @param folded Receives the folded filter; left empty if even the full size is more than half full.
+ */
+void foldFilter(const vector<uint64_t>& filter, vector<uint64_t>& folded) {
+    folded.clear();
+    size_t fullWords = filter.size();
+    size_t fullBits = fullWords * 64;
+    size_t setBits = countBits(filter.data(), fullWords);
+    if (setBits * 2 > fullBits) {
+        return;
+    }
+    double distinct = -static_cast<double>(fullBits) / SearchIndex::hashCount * log1p(-static_cast<double>(setBits) / fullBits);
+    size_t wordCount = 1;
+    while (wordCount < fullWords && wordCount * 64 < distinct * SearchIndex::hashCount * 1.45) {
+        wordCount <<= 1;
+    }
+    for (;; wordCount <<= 1) {
+        folded.assign(filter.begin(), filter.begin() + wordCount);
+        for (size_t offset = wordCount; offset < fullWords; offset += wordCount) {
+            for (size_t i = 0; i < wordCount; ++i) {
+                folded[i] |= filter[offset + i];
+            }
+        }
+        if (wordCount == fullWords || countBits(folded.data(), wordCount) * 2 <= wordCount * 64) {
+            return;
+        }
+    }
+}
+
+/**
+ * @brief Appends the bytes of a value to a buffer.
+ */
+template <typename T>
+void appendValue(string& buffer, const T& value) {
+    buffer.append(reinterpret_cast<const char*>(&value), sizeof(value));
+}
+
+/**
+ * @brief Reads a value from a buffer, advancing the position.
+ * @return False if the buffer ends first.
+ */
+template <typename T>
+bool readValue(const string& buffer, size_t& position, T& value) {
+    if (buffer.size() - position < sizeof(value)) {
+        return false;
+    }
+    memcpy(&value, buffer.data() + position, sizeof(value));
+    position += sizeof(value);
+    return true;
+}
+
+} // namespace
+
+/**
+ * @brief Builds the index of a tree and stores it in the cache directory.
+ * The tree is walked in tree order, so every directory's subtree is complete once the walk
+ * leaves it. Open directories form a stack of full-size filters: each name is added to the
+ * filter of its directory, and a finished directory's filter is folded and stored, then
+ * merged into its parent's. Directories modified shortly before or during the walk, and
+ * directories that cannot be read, are stored without a usable modification time, so they
+ * are never skipped.
+ * @param root Canonical path of the directory to index.
+ * @param directories Receives the number of directories indexed, including the root.
+ * @param filters Receives the number of directories stored with a usable filter.
+ * @param bytes Receives the size of the stored index.
+ * @return True if the index was stored.
+ */
+bool SearchIndex::build(const fs::path& root, size_t& directories, size_t& filters, uint64_t& bytes) {
+    struct OpenDirectory {
+        fs::path path;
+        vector<uint64_t> filter;
+    };
+    struct Finished {
+        string key;
+        vector<uint64_t> filter;
+        int64_t modified;
+    };
+
+    const size_t filterWords = maxFilterBits / 64;
+    auto trusted = fs::file_time_type::clock::now() - chrono::seconds(2);
+    vector<OpenDirectory> open;
+    vector<Finished> finished;
+    open.push_back({ root, vector<uint64_t>(filterWords, 0) });
+
+    auto close = [&]() {
+        OpenDirectory& top = open.back();
+        Finished result;
+        result.key = top.path == root ? string() : top.path.lexically_relative(root).generic_u8string();
+        error_code ec;
+        fs::file_time_type modified = fs::last_write_time(top.path, ec);
+        result.modified = ec || modified >= trusted ? unknownTime : static_cast<int64_t>(modified.time_since_epoch().count());
+        if (none_of(top.filter.begin(), top.filter.end(), [](uint64_t word) { return word != 0; })) {
+            // An unreadable directory looks empty; it must not be skipped once it becomes readable.
+            fs::directory_iterator probe(top.path, ec);
+            if (ec) {
+                result.modified = unknownTime;
+            }
+        }
+        foldFilter(top.filter, result.filter);
+        if (open.size() > 1) {
+            vector<uint64_t>& parent = open[open.size() - 2].filter;
+            for (size_t i = 0; i < filterWords; ++i) {
+                parent[i] |= top.filter[i];
+            }
+        }
+        finished.push_back(move(result));
+        open.pop_back();
+    };
+
+    WalkOptions walkOptions;
+    walkOptions.ordered = true;
+    DirectoryWalker walker(walkOptions);
+    walker.walk({ root }, [&](const fs::directory_entry& entry, unsigned) {
+        const fs::path& path = entry.path();
+        fs::path parent = path.parent_path();
+        while (open.back().path != parent) {
+            close();
+        }
+        string name = nameOf(path);
+        const auto* bytes = reinterpret_cast<const unsigned char*>(name.data());
+        vector<uint64_t>& filter = open.back().filter;
+        for (size_t i = 0; i + 3 <= name.size(); ++i) {
+            uint64_t hash = trigramHash(bytes + i);
+            for (unsigned j = 0; j < hashCount; ++j) {
+                size_t bit = bitPosition(hash, j, maxFilterBits);
+                filter[bit / 64] |= uint64_t(1) << (bit % 64);
+            }
+        }
+        error_code ec;
+        if (fs::is_directory(entry.symlink_status(ec))) {
+            open.push_back({ path, vector<uint64_t>(filterWords, 0) });
+        }
+        return WalkAction::Continue;
+    });
+    while (!open.empty()) {
+        close();
+    }
+
+    sort(finished.begin(), finished.end(), [](const Finished& a, const Finished& b) { return a.key < b.key; });
+    string rootString = root.generic_u8string();
+    string keyBlob;
+    string filterBlob;
+    string recordBlob;
+    filters = 0;
+    for (const auto& item : finished) {
+        Record record;
+        record.keyOffset = keyBlob.size();
+        record.keyLength = static_cast<uint32_t>(item.key.size());
+        record.filterWords = static_cast<uint32_t>(item.filter.size());
+        record.filterOffset = filterBlob.size() / sizeof(uint64_t);
+        record.modified = item.modified;
+        keyBlob += item.key;
+        filterBlob.append(reinterpret_cast<const char*>(item.filter.data()), item.filter.size() * sizeof(uint64_t));
+        appendValue(recordBlob, record);
+        if (!item.filter.empty()) {
+            ++filters;
+        }
+    }
+
+    string contents(indexMagic, sizeof(indexMagic));
+    appendValue(contents, static_cast<uint64_t>(rootString.size()));
+    appendValue(contents, static_cast<uint64_t>(finished.size()));
+    appendValue(contents, static_cast<uint64_t>(keyBlob.size()));
+    appendValue(contents, static_cast<uint64_t>(filterBlob.size() / sizeof(uint64_t)));
+    contents += rootString;
+    contents += recordBlob;
+    contents += keyBlob;
+    contents += filterBlob;
+
+    directories = finished.size();
+    bytes = contents.size();
+    return writeCacheFile(cacheFilePath(root, indexExtension), contents);
+}
+
+/**
+ * @brief Loads an index file.
+ * @param file Path of the index file.
+ * @return The index, or null if the file is missing or malformed.
+ */
+shared_ptr<const SearchIndex> SearchIndex::load(const fs::path& file) {
+    ifstream input(file, ios::binary);
+    if (!input) {
+        return nullptr;
+    }
+    string contents((istreambuf_iterator<char>(input)), istreambuf_iterator<char>());
+    if (contents.size() < sizeof(indexMagic) || memcmp(contents.data(), indexMagic, sizeof(indexMagic)) != 0) {
+        return nullptr;
+    }
+
+    size_t position = sizeof(indexMagic);
+    uint64_t rootLength, recordCount, keyLength, wordCount;
+    if (!readValue(contents, position, rootLength) || !readValue(contents, position, recordCount)
+        || !readValue(contents, position, keyLength) || !readValue(contents, position, wordCount)) {
+        return nullptr;
+    }
+    uint64_t expected = rootLength + recordCount * sizeof(Record) + keyLength + wordCount * sizeof(uint64_t);
+    if (contents.size() - position != expected) {
+        return nullptr;
+    }
+
+    auto index = make_shared<SearchIndex>();
+    index->rootPath = fs::u8path(contents.substr(position, rootLength));
+    position += rootLength;
+    index->records.resize(recordCount);
+    memcpy(index->records.data(), contents.data() + position, recordCount * sizeof(Record));
+    position += recordCount * sizeof(Record);
+    index->keys = contents.substr(position, keyLength);
+    position += keyLength;
+    index->words.resize(wordCount);
+    memcpy(index->words.data(), contents.data() + position, wordCount * sizeof(uint64_t));
+
+    for (const auto& record : index->records) {
+        if (record.keyOffset + record.keyLength > keyLength || record.filterOffset + record.filterWords > wordCount) {
+            return nullptr;
+        }
+    }
+    return index;
+}
+
+/**
+ * @brief Finds the index covering a directory, walking up from the directory to the filesystem root.
+ * Loaded indexes are cached by file and reloaded when the file's size or modification time changes.
+ * @param directory Canonical path of the directory.
+ * @return The index, or null if none covers the directory.
+ */
+shared_ptr<const SearchIndex> SearchIndex::find(const fs::path& directory) {
+    struct CachedIndex {
+        fs::file_time_type modified;
+        uintmax_t size;
+        shared_ptr<const SearchIndex> index;
+    };
+    static mutex cacheLock;
+    static unordered_map<string, CachedIndex> cache;
+
+    for (fs::path current = directory;; current = current.parent_path()) {
+        fs::path file = cacheFilePath(current, indexExtension);
+        error_code ec;
+        uintmax_t size = fs::file_size(file, ec);
+        if (!ec) {
+            fs::file_time_type modified = fs::last_write_time(file, ec);
+            shared_ptr<const SearchIndex> index;
+            {
+                lock_guard<mutex> guard(cacheLock);
+                auto it = cache.find(file.string());
+                if (it != cache.end() && it->second.modified == modified && it->second.size == size) {
+                    index = it->second.index;
+                }
+            }
+            if (!index) {
+                index = load(file);
+                lock_guard<mutex> guard(cacheLock);
+                cache[file.string()] = { modified, size, index };
+            }
+            if (index && index->rootPath == current) {
+                return index;
+            }
+        }
+        if (current == current.parent_path()) {
+            return nullptr;
+        }
+    }
+}
+
+/**
+ * @brief Hashes the trigrams of a search pattern.
+ * @param pattern The substring pattern.
+ * @return One hash per trigram; empty if the pattern is shorter than three bytes.
+ */
+vector<uint64_t> SearchIndex::patternHashes(const string& pattern) {
+    vector<uint64_t> hashes;
+    const auto* bytes = reinterpret_cast<const unsigned char*>(pattern.data());
+    for (size_t i = 0; i + 3 <= pattern.size(); ++i) {
+        hashes.push_back(trigramHash(bytes + i));
+    }
+    return hashes;
+}
+
+/**
+ * @brief Returns the canonical path of the indexed directory.
+ * @return The root of the index.
+ */
+const fs::path& SearchIndex::root() const {
+    return rootPath;
+}
+
+/**
+ * @brief Returns the key of a record.
+ * @param record The record.
+ * @return The directory's path relative to the root.
+ */
+string_view SearchIndex::keyOf(const Record& record) const {
+    return string_view(keys).substr(static_cast<size_t>(record.keyOffset), record.keyLength);
+}
+
+/**
+ * @brief Checks whether a directory still has the modification time stored in its record.
+ * @param record The record of the directory.
+ * @param directory Path through which the directory is reached.
+ * @return True if the times match.
+ */
+bool SearchIndex::unchanged(const Record& record, const fs::path& directory) {
+    if (record.modified == unknownTime) {
+        return false;
+    }
+    error_code ec;
+    fs::file_time_type modified = fs::last_write_time(directory, ec);
+    return !ec && static_cast<int64_t>(modified.time_since_epoch().count()) == record.modified;
+}
+
+/**
+ * @brief Checks whether the subtree below a directory may contain a name with all the given trigrams.
+ * The filter is consulted first; modification times are only read for subtrees it rules out.
+ * With verification, the records below the directory are found as the contiguous range of
+ * keys starting with the directory's key and a slash.
+ * @param key Path of the directory relative to the root in UTF-8, with '/' separators; empty for the root.
+ * @param directory Path through which the directory is reached, used to check modification times.
+ * @param hashes Trigram hashes from patternHashes.
+ * @param verify Whether every indexed directory below is checked for changes, not only the directory itself.
+ * @return False only if the filter rules the trigrams out and the checked directories are unchanged.
+ */
+bool SearchIndex::mayContain(const string& key, const fs::path& directory, const vector<uint64_t>& hashes,
+    bool verify) const {
+    auto less = [this](const Record& record, const string& value) { return keyOf(record) < value; };
+    auto it = lower_bound(records.begin(), records.end(), key, less);
+    if (it == records.end() || keyOf(*it) != key || it->filterWords == 0) {
+        return true;
+    }
+
+    const uint64_t* filter = words.data() + it->filterOffset;
+    size_t bits = static_cast<size_t>(it->filterWords) * 64;
+    bool excluded = false;
+    for (size_t i = 0; i < hashes.size() && !excluded; ++i) {
+        for (unsigned j = 0; j < hashCount; ++j) {
+            size_t bit = bitPosition(hashes[i], j, bits);
+            if ((filter[bit / 64] & (uint64_t(1) << (bit % 64))) == 0) {
+                excluded = true;
+                break;
+            }
+        }
+    }
+    if (!excluded || !unchanged(*it, directory)) {
+        return true;
+    }
+
+    if (verify) {
+        string prefix = key.empty() ? string() : key + "/";
+        for (auto below = it + 1; below != records.end(); ++below) {
+            string_view belowKey = keyOf(*below);
+            if (belowKey.compare(0, prefix.size(), prefix) != 0) {
+                break;
+            }
+            if (!unchanged(*below, directory / fs::u8path(belowKey.substr(prefix.size())))) {
+                return true;
+            }
+        }
+    }
+    return false;
+}
+
+/**
+ * @brief Prepares pruning for a search by finding the index covering each root.
+ * @param roots The directories being searched, as passed to the walker.
+ * @param pattern The substring pattern.
+ * @param verify Whether every indexed directory in a subtree is checked for changes before it is skipped.
+ */
+SubtreePruner::SubtreePruner(const vector<fs::path>& roots, const string& pattern, bool verify)
+    : hashes(SearchIndex::patternHashes(pattern)), verify(verify) {
+    if (hashes.empty()) {
+        return;
+    }
+    for (const auto& root : roots) {
+        error_code ec;
+        fs::path canonical = fs::canonical(root, ec);
+        if (ec) {
+            continue;
+        }
+        shared_ptr<const SearchIndex> index = SearchIndex::find(canonical);
+        if (!index) {
+            continue;
+        }
+        string prefix = canonical == index->root() ? string() : canonical.lexically_relative(index->root()).generic_u8string();
+        this->roots.push_back({ root.native(), move(index), move(prefix) });
+    }
+}
+
+/**
+ * @brief Reports whether any subtree can be skipped at all.
+ * @return False if no root is indexed or the pattern is shorter than three bytes.
+ */
+bool SubtreePruner::active() const {
+    return !roots.empty();
+}
+
+/**
+ * @brief Checks whether nothing below a directory can match the pattern.
+ * The directory is matched against the roots by path prefix, and its key in the
+ * index is the covering root's key followed by the rest of the path.
+ * @param directory A root or a directory below one, as produced by the walker.
+ * @return True if the subtree can be skipped.
+ */
+bool SubtreePruner::prunes(const fs::path& directory) const {
+    const auto& path = directory.native();
+    for (const auto& root : roots) {
+        if (path.size() < root.path.size() || path.compare(0, root.path.size(), root.path) != 0) {
+            continue;
+        }
+        string key = root.prefix;
+        if (path.size() > root.path.size()) {
+            size_t start = root.path.size();
+            if (root.path.empty() || !isSeparator(root.path.back())) {
+                if (!isSeparator(path[start])) {
+                    continue;
+                }
+                ++start;
+            }
+            string rest = fs::path(path.substr(start)).generic_u8string();
+            key = key.empty() ? rest : key + "/" + rest;
+        }
+        bool pruned = !root.index->mayContain(key, directory, hashes, verify);
+        Metrics::getInstance().recordIndexLookup(pruned);
+        return pruned;
+    }
+    return false;
+}
+
+/**
+ * @brief Checks whether an entry is a directory below which nothing can match the pattern.
+ * @param entry An entry produced by the walker.
+ * @return True if the entry is a directory whose subtree can be skipped.
+ */
+bool SubtreePruner::prunes(const fs::directory_entry& entry) const {
+    error_code ec;
+    return fs::is_directory(entry.symlink_status(ec)) && prunes(entry.path());
+}
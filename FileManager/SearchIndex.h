@@ -0,0 +1,172 @@
+/**
+ * @file SearchIndex.h
+ * @brief Declares the SearchIndex class, a persistent index of per-subtree Bloom filters over
+ * filename trigrams, and the SubtreePruner, which uses it to skip subtrees during searches.
+ */
+
+#ifndef SEARCH_INDEX_H
+#define SEARCH_INDEX_H
+
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <vector>
+
+/**
+ * @class SearchIndex
+ * @brief Bloom filters over the filename trigrams below every directory of a tree.
+ *
+ * The filter of a directory covers the names of all entries below it, so a substring search
+ * can skip the whole subtree when one of the pattern's trigrams is missing from the filter.
+ * Filters are built bottom-up at a fixed size and then folded to the smallest power of two
+ * that keeps them at most half full; filters of subtrees with too many distinct trigrams are
+ * dropped, and such subtrees are never skipped. Every directory's modification time is stored
+ * with its filter, so changes made since the index was built are detected.
+ *
+ * The index is stored in the user's cache directory and serves searches of its root and of
+ * any directory below it.
+ */
+class SearchIndex {
+public:
+    /**
+     * @brief Number of bit positions set per trigram.
+     */
+    static constexpr unsigned hashCount = 4;
+
+    /**
+     * @brief Size in bits of the filters while they are being built, before folding.
+     */
+    static constexpr std::size_t maxFilterBits = 1 << 17;
+
+    /**
+     * @brief Builds the index of a tree and stores it in the cache directory, replacing any older one.
+     * @param root Canonical path of the directory to index.
+     * @param directories Receives the number of directories indexed, including the root.
+     * @param filters Receives the number of directories stored with a usable filter.
+     * @param bytes Receives the size of the stored index.
+     * @return True if the index was stored.
+     * @throws std::filesystem::filesystem_error If the tree cannot be walked.
+     */
+    static bool build(const std::filesystem::path& root, std::size_t& directories, std::size_t& filters,
+        std::uint64_t& bytes);
+
+    /**
+     * @brief Finds the index covering a directory: the one built for it or for its nearest indexed ancestor.
+     * Loaded indexes stay in memory until their file changes.
+     * @param directory Canonical path of the directory.
+     * @return The index, or null if none covers the directory.
+     */
+    static std::shared_ptr<const SearchIndex> find(const std::filesystem::path& directory);
+
+    /**
+     * @brief Hashes the trigrams of a search pattern.
+     * @param pattern The substring pattern.
+     * @return One hash per trigram; empty if the pattern is shorter than three bytes.
+     */
+    static std::vector<std::uint64_t> patternHashes(const std::string& pattern);
+
+    /**
+     * @brief Returns the canonical path of the indexed directory.
+     * @return The root of the index.
+     */
+    const std::filesystem::path& root() const;
+
+    /**
+     * @brief Checks whether the subtree below a directory may contain a name with all the given trigrams.
+     * @param key Path of the directory relative to the root in UTF-8, with '/' separators; empty for the root.
+     * @param directory Path through which the directory is reached, used to check modification times.
+     * @param hashes Trigram hashes from patternHashes.
+     * @param verify Whether every indexed directory below is checked for changes, not only the directory itself.
+     * @return False only if the filter rules the trigrams out and the checked directories are unchanged.
+     */
+    bool mayContain(const std::string& key, const std::filesystem::path& directory,
+        const std::vector<std::uint64_t>& hashes, bool verify) const;
+
+private:
+    /**
+     * @brief One indexed directory; offsets point into keys and words.
+     */
+    struct Record {
+        std::uint64_t keyOffset;
+        std::uint32_t keyLength;
+        std::uint32_t filterWords; ///< Filter size in 64-bit words; 0 if the filter was dropped.
+        std::uint64_t filterOffset;
+        std::int64_t modified;     ///< Modification time when indexed, or unknownTime.
+    };
+
+    /**
+     * @brief Modification time stored for directories changed while the index was built.
+     */
+    static constexpr std::int64_t unknownTime = INT64_MIN;
+
+    /**
+     * @brief Loads an index file.
+     */
+    static std::shared_ptr<const SearchIndex> load(const std::filesystem::path& file);
+
+    /**
+     * @brief Returns the key of a record.
+     */
+    std::string_view keyOf(const Record& record) const;
+
+    /**
+     * @brief Checks whether a directory still has the modification time stored in its record.
+     */
+    static bool unchanged(const Record& record, const std::filesystem::path& directory);
+
+    std::filesystem::path rootPath;
+    std::string keys;
+    std::vector<Record> records; ///< Sorted by key.
+    std::vector<std::uint64_t> words;
+};
+
+/**
+ * @class SubtreePruner
+ * @brief Decides which directories a substring search can skip, using the indexes covering its roots.
+ */
+class SubtreePruner {
+public:
+    /**
+     * @brief Prepares pruning for a search.
+     * @param roots The directories being searched, as passed to the walker.
+     * @param pattern The substring pattern.
+     * @param verify Whether every indexed directory in a subtree is checked for changes before it is skipped.
+     */
+    SubtreePruner(const std::vector<std::filesystem::path>& roots, const std::string& pattern, bool verify);
+
+    /**
+     * @brief Reports whether any subtree can be skipped at all.
+     * @return False if no root is indexed or the pattern is shorter than three bytes.
+     */
+    bool active() const;
+
+    /**
+     * @brief Checks whether nothing below a directory can match the pattern.
+     * @param directory A root or a directory below one, as produced by the walker.
+     * @return True if the subtree can be skipped.
+     */
+    bool prunes(const std::filesystem::path& directory) const;
+
+    /**
+     * @brief Checks whether an entry is a directory below which nothing can match the pattern.
+     * @param entry An entry produced by the walker.
+     * @return True if the entry is a directory whose subtree can be skipped.
+     */
+    bool prunes(const std::filesystem::directory_entry& entry) const;
+
+private:
+    struct IndexedRoot {
+        std::filesystem::path::string_type path; ///< The root as passed to the walker.
+        std::shared_ptr<const SearchIndex> index;
+        std::string prefix;                       ///< Key of the root within the index.
+    };
+
+    std::vector<IndexedRoot> roots;
+    std::vector<std::uint64_t> hashes;
+    bool verify;
+};
+
+#endif // SEARCH_INDEX_H
@@ -0,0 +1,220 @@
+/**
+ * @file Session.cpp
+ * @brief Implementation of session recording and loading.
+ */
+
+#include "Session.h"
+#include <algorithm>
+#include <filesystem>
+#include <iostream>
+#include <sstream>
+#include <system_error>
+
+using namespace std;
+namespace fs = filesystem;
+
+namespace {
+
+/**
+ * @brief First line of a session file; the number is the format version.
+ */
+const char sessionHeader[] = "FileManager session 1";
+
+} // namespace
+
+/**
+ * @brief Creates a stream buffer that reads from another one.
+ * @param source The stream buffer read from.
+ * @param recorder The recorder that receives the characters.
+ */
+SessionRecorder::InputTee::InputTee(streambuf* source, SessionRecorder& recorder) : source(source), recorder(recorder) {}
+
+/**
+ * @brief Returns the next character without consuming it, counting the wait as input time.
+ */
+SessionRecorder::InputTee::int_type SessionRecorder::InputTee::underflow() {
+    auto waitStarted = chrono::steady_clock::now();
+    int_type character = source->sgetc();
+    recorder.inputWait += chrono::steady_clock::now() - waitStarted;
+    return character;
+}
+
+/**
+ * @brief Consumes the next character and records it, counting the wait as input time.
+ */
+SessionRecorder::InputTee::int_type SessionRecorder::InputTee::uflow() {
+    auto waitStarted = chrono::steady_clock::now();
+    int_type character = source->sbumpc();
+    recorder.inputWait += chrono::steady_clock::now() - waitStarted;
+    if (!traits_type::eq_int_type(character, traits_type::eof())) {
+        recorder.capture(traits_type::to_char_type(character));
+    }
+    return character;
+}
+
+/**
+ * @brief Finishes a command left open and gives std::cin its stream buffer back.
+ */
+SessionRecorder::~SessionRecorder() {
+    if (recording) {
+        endCommand();
+    }
+    if (originalInput) {
+        cin.rdbuf(originalInput);
+    }
+}
+
+/**
+ * @brief Creates the session file and starts capturing std::cin.
+ * @param file The session file.
+ * @param root The directory the session works in.
+ * @return HTTP-like status code:
+ * - 200: Recording started.
+ * - 400: The root is not a directory.
+ * - 500: The file cannot be written.
+ */
+int SessionRecorder::open(const string& file, const string& root) {
+    error_code ec;
+    if (!fs::is_directory(root, ec)) {
+        cerr << "Session root is not a directory: " << root << endl;
+        return 400;
+    }
+    fs::path absoluteRoot = fs::absolute(root, ec);
+    fs::path directory = ec ? fs::path() : fs::current_path(ec);
+    if (ec) {
+        cerr << "Error resolving session root: " << ec.message() << endl;
+        return 500;
+    }
+
+    output.open(file, ios::binary | ios::trunc);
+    if (!output) {
+        cerr << "Cannot create session file: " << file << endl;
+        return 500;
+    }
+    output << sessionHeader << "\n" << "root " << absoluteRoot.lexically_normal().string() << "\n"
+        << "directory " << directory.string() << "\n";
+    output.flush();
+
+    started = chrono::steady_clock::now();
+    originalInput = cin.rdbuf();
+    tee = make_unique<InputTee>(originalInput, *this);
+    cin.rdbuf(tee.get());
+    return 200;
+}
+
+/**
+ * @brief Starts recording a command.
+ * @param command The menu command as entered.
+ */
+void SessionRecorder::beginCommand(const string& command) {
+    current = SessionCommand();
+    current.command = command;
+    line.clear();
+    recording = true;
+    commandStarted = chrono::steady_clock::now();
+    inputWait = chrono::steady_clock::duration::zero();
+    current.offset = chrono::duration_cast<chrono::nanoseconds>(commandStarted - started).count();
+}
+
+/**
+ * @brief Finishes the current command and writes it to the file.
+ */
+void SessionRecorder::endCommand() {
+    if (!recording) {
+        return;
+    }
+    recording = false;
+    auto elapsed = chrono::steady_clock::now() - commandStarted - inputWait;
+    current.duration = max<int64_t>(chrono::duration_cast<chrono::nanoseconds>(elapsed).count(), 0);
+    if (!line.empty()) {
+        current.input.push_back(line);
+        line.clear();
+    }
+
+    output << "command " << current.offset << " " << current.duration << " " << current.input.size() << "\n"
+        << current.command << "\n";
+    for (const auto& inputLine : current.input) {
+        output << inputLine << "\n";
+    }
+    output.flush();
+    if (!output) {
+        cerr << "Error writing the session file." << endl;
+    }
+}
+
+/**
+ * @brief Adds a character read by the UI to the current line; lines read between commands are dropped.
+ * @param character The character.
+ */
+void SessionRecorder::capture(char character) {
+    if (character == '\n') {
+        if (recording) {
+            current.input.push_back(line);
+        }
+        line.clear();
+    }
+    else if (character != '\r') {
+        line += character;
+    }
+}
+
+/**
+ * @brief Loads a recorded session.
+ * @param file The session file.
+ * @param root Receives the directory the session was recorded in.
+ * @param directory Receives the working directory of the recording.
+ * @param commands Receives the commands.
+ * @return HTTP-like status code:
+ * - 200: Session loaded.
+ * - 400: The file is not a session file or is damaged.
+ * - 404: The file does not exist.
+ */
+int readSession(const string& file, string& root, string& directory, vector<SessionCommand>& commands) {
+    ifstream input(file, ios::binary);
+    if (!input) {
+        cerr << "Session file not found: " << file << endl;
+        return 404;
+    }
+
+    auto readLine = [&input](string& text) {
+        if (!getline(input, text)) {
+            return false;
+        }
+        if (!text.empty() && text.back() == '\r') {
+            text.pop_back();
+        }
+        return true;
+    };
+
+    string text;
+    if (!readLine(text) || text != sessionHeader || !readLine(root) || root.compare(0, 5, "root ") != 0
+        || !readLine(directory) || directory.compare(0, 10, "directory ") != 0) {
+        cerr << "Not a session file: " << file << endl;
+        return 400;
+    }
+    root.erase(0, 5);
+    directory.erase(0, 10);
+
+    commands.clear();
+    while (readLine(text)) {
+        istringstream fields(text);
+        string keyword;
+        SessionCommand command;
+        size_t lineCount = 0;
+        if (!(fields >> keyword >> command.offset >> command.duration >> lineCount) || keyword != "command"
+            || !readLine(command.command)) {
+            cerr << "Damaged session file: " << file << endl;
+            return 400;
+        }
+        for (size_t i = 0; i < lineCount; ++i) {
+            string inputLine;
+            if (!readLine(inputLine)) {
+                cerr << "Damaged session file: " << file << endl;
+                return 400;
+            }
+            command.input.push_back(move(inputLine));
+        }
+        commands.push_back(move(command));
+    }
+    return 200;
+}
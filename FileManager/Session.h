@@ -0,0 +1,114 @@
+/**
+ * @file Session.h
+ * @brief Declares SessionRecorder, which records the commands entered in FileManagerUI with their
+ * input and timing, and readSession, which loads a recorded session for replay.
+ */
+
+#ifndef SESSION_H
+#define SESSION_H
+
+#include <chrono>
+#include <cstdint>
+#include <fstream>
+#include <memory>
+#include <streambuf>
+#include <string>
+#include <vector>
+
+/**
+ * @struct SessionCommand
+ * @brief One recorded menu command.
+ */
+struct SessionCommand {
+    std::string command;            ///< The menu command as entered.
+    std::vector<std::string> input; ///< Lines read while the command ran, such as paths and answers.
+    std::int64_t offset = 0;        ///< Start in nanoseconds since the session started.
+    std::int64_t duration = 0;      ///< Nanoseconds the command ran, not counting the wait for input.
+};
+
+/**
+ * @class SessionRecorder
+ * @brief Records a FileManagerUI session to a text file.
+ *
+ * While open, the recorder sits between std::cin and its stream buffer, so every line the
+ * UI reads is captured without changes to the command handlers. The time spent waiting for
+ * input is subtracted from each command's duration. Each command is written and flushed as
+ * soon as it finishes, so a session that ends abruptly keeps the commands before it.
+ *
+ * The file starts with a format line, the session root and the working directory; paths
+ * below the root, including the working directory, are moved to the replay root when the
+ * session is replayed. Each command follows as a line
+ * "command <offset> <duration> <input lines>", the command itself and its input lines.
+ */
+class SessionRecorder {
+public:
+    SessionRecorder() = default;
+    ~SessionRecorder();
+
+    SessionRecorder(const SessionRecorder&) = delete;
+    SessionRecorder& operator=(const SessionRecorder&) = delete;
+
+    /**
+     * @brief Creates the session file and starts capturing std::cin.
+     * @param file The session file; an existing file is replaced.
+     * @param root The directory the session works in.
+     * @return Status code: 200 on success, 400 if the root is not a directory, 500 if the file cannot be written.
+     */
+    int open(const std::string& file, const std::string& root);
+
+    /**
+     * @brief Starts recording a command; the input read until endCommand belongs to it.
+     * @param command The menu command as entered.
+     */
+    void beginCommand(const std::string& command);
+
+    /**
+     * @brief Finishes the current command and writes it to the file.
+     */
+    void endCommand();
+
+private:
+    /**
+     * @brief Stream buffer that passes the characters of another one through and records them.
+     */
+    class InputTee : public std::streambuf {
+    public:
+        InputTee(std::streambuf* source, SessionRecorder& recorder);
+
+    protected:
+        int_type underflow() override;
+        int_type uflow() override;
+
+    private:
+        std::streambuf* source;
+        SessionRecorder& recorder;
+    };
+
+    /**
+     * @brief Adds a character read by the UI to the current line.
+     */
+    void capture(char character);
+
+    std::ofstream output;
+    std::unique_ptr<InputTee> tee;
+    std::streambuf* originalInput = nullptr;
+    std::chrono::steady_clock::time_point started;
+    std::chrono::steady_clock::time_point commandStarted;
+    std::chrono::steady_clock::duration inputWait{ 0 };
+    bool recording = false;
+    SessionCommand current;
+    std::string line;
+};
+
+/**
+ * @brief Loads a recorded session.
+ * @param file The session file.
+ * @param root Receives the directory the session was recorded in.
+ * @param directory Receives the working directory of the recording.
+ * @param commands Receives the commands in the order they were entered.
+ * @return Status code: 200 on success, 404 if the file does not exist, 400 if it is not a session file.
+ */
+int readSession(const std::string& file, std::string& root, std::string& directory,
+    std::vector<SessionCommand>& commands);
+
+#endif // SESSION_H
@@ -0,0 +1,56 @@
+/**
+ * @file Sha256.h
+ * @brief Declares the Sha256 class, an incremental SHA-256 hash.
+ */
+
+#ifndef SHA256_H
+#define SHA256_H
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <string>
+
+/**
+ * @class Sha256
+ * @brief Computes the SHA-256 digest of data supplied in pieces.
+ */
+class Sha256 {
+public:
+    Sha256();
+
+    /**
+     * @brief Adds data to the hash.
+     * @param data The data.
+     * @param size Number of bytes.
+     */
+    void update(const void* data, std::size_t size);
+
+    /**
+     * @brief Finishes the hash; no more data may be added afterwards.
+     * @return The digest as 64 lowercase hexadecimal digits.
+     */
+    std::string hexDigest();
+
+    /**
+     * @brief Hashes the contents of a file.
+     * @param path The file.
+     * @param digest Receives the digest as hexadecimal digits.
+     * @return False if the file cannot be read.
+     */
+    static bool hashFile(const std::filesystem::path& path, std::string& digest);
+
+private:
+    /**
+     * @brief Processes one 64-byte block.
+     */
+    void transform(const unsigned char* block);
+
+    std::array<std::uint32_t, 8> state;
+    std::array<unsigned char, 64> buffer;
+    std::size_t buffered = 0;
+    std::uint64_t length = 0; ///< Bytes added so far.
+};
+
+#endif // SHA256_H
@@ -0,0 +1,802 @@
+/**
+ * @file SizeCache.cpp
+ * @brief Implementation of the persistent, incrementally updated directory size cache.
+ */
+
+#include "SizeCache.h"
+#include "CacheLocation.h"
+#include "FileId.h"
+#include "MappedFile.h"
+#include "ParallelFor.h"
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+#include <map>
+#include <mutex>
+#include <set>
+#include <string_view>
+#include <system_error>
+#include <utility>
+
+using namespace std;
+namespace fs = filesystem;
+
+namespace {
+
+/**
+ * @brief Identifies a cache file and its format version.
+ */
+const char cacheMagic[8] = { 'F', 'M', 'D', 'S', 'Z', '1', '\0', '\0' };
+
+/**
+ * @brief Extension of the cache files.
+ */
+const char* const cacheExtension = ".dsize";
+
+/**
+ * @brief Extension of the files listing the changes recorded by invalidate.
+ */
+const char* const changesExtension = ".dsize.changes";
+
+/**
+ * @brief Extension a changes file is renamed to while a query applies it.
+ */
+const char* const applyingExtension = ".dsize.applying";
+
+/**
+ * @brief Size beyond which a changes file is replaced by a single rescan of the whole tree.
+ */
+constexpr streamoff changesLimit = 256 << 10;
+
+/**
+ * @brief Modification time stored for directories changed while they were listed.
+ */
+constexpr int64_t unknownTime = INT64_MIN;
+
+/**
+ * @brief Fixed-size header at the start of a cache file. It is followed by the records,
+ * the key bytes they point into, and the root path.
+ */
+struct Header {
+    char magic[8];
+    uint64_t recordCount;
+    uint64_t keyBytes;
+    uint64_t rootLength;
+};
+
+/**
+ * @brief One directory as stored in a cache file.
+ */
+struct Record {
+    uint64_t keyOffset;
+    uint32_t keyLength;
+    uint32_t reserved;
+    int64_t modified;    ///< Modification time when listed, or unknownTime.
+    DirectorySize own;   ///< Entries directly in the directory.
+    DirectorySize total; ///< Everything below the directory.
+};
+
+/**
+ * @brief One directory while a cache is being updated.
+ */
+struct Entry {
+    string key;          ///< Path relative to the cache root in UTF-8 with '/' separators; empty for the root.
+    int64_t modified = unknownTime;
+    DirectorySize own;
+    DirectorySize total;
+    bool removed = false;
+};
+
+/**
+ * @brief Adds sizes; the counts wrap, so adding a difference computed by subtract is exact.
+ */
+void add(DirectorySize& target, const DirectorySize& value) {
+    target.bytes += value.bytes;
+    target.files += value.files;
+    target.directories += value.directories;
+    target.linkedSize += value.linkedSize;
+    target.linkedShares += value.linkedShares;
+    target.linkedRepeats += value.linkedRepeats;
+}
+
+/**
+ * @brief Subtracts sizes, wrapping like add.
+ */
+void subtract(DirectorySize& target, const DirectorySize& value) {
+    target.bytes -= value.bytes;
+    target.files -= value.files;
+    target.directories -= value.directories;
+    target.linkedSize -= value.linkedSize;
+    target.linkedShares -= value.linkedShares;
+    target.linkedRepeats -= value.linkedRepeats;
+}
+
+/**
+ * @brief Returns the key of the parent of a directory.
+ * @param key Key of a directory other than the root.
+ * @return The parent's key.
+ */
+string_view parentKey(string_view key) {
+    size_t slash = key.rfind('/');
+    return slash == string_view::npos ? string_view() : key.substr(0, slash);
+}
+
+/**
+ * @brief Returns the key of a subdirectory.
+ */
+string childKey(const string& key, const string& name) {
+    return key.empty() ? name : key + "/" + name;
+}
+
+/**
+ * @brief Finds the first key not less than a key in a sorted table.
+ * @param count Number of keys.
+ * @param keyAt Function returning the key at an index.
+ * @param key The key to look for.
+ * @return The index of the first key not less than key.
+ */
+template <typename KeyAt>
+size_t lowerBound(size_t count, const KeyAt& keyAt, string_view key) {
+    size_t low = 0;
+    size_t high = count;
+    while (low < high) {
+        size_t middle = low + (high - low) / 2;
+        if (keyAt(middle) < key) {
+            low = middle + 1;
+        }
+        else {
+            high = middle;
+        }
+    }
+    return low;
+}
+
+/**
+ * @brief Finds a key in a sorted table.
+ * @return The index of the key, or count if it is missing.
+ */
+template <typename KeyAt>
+size_t findKey(size_t count, const KeyAt& keyAt, string_view key) {
+    size_t index = lowerBound(count, keyAt, key);
+    return index < count && keyAt(index) == key ? index : count;
+}
+
+/**
+ * @brief Returns the range of keys below a directory.
+ * Keys below k all start with k + '/', and '0' follows '/', so they lie between
+ * k + '/' and k + '0'; other keys with prefix k, such as k + '.', fall outside.
+ * @return The half-open index range of the descendants.
+ */
+template <typename KeyAt>
+pair<size_t, size_t> subtreeRange(size_t count, const KeyAt& keyAt, string_view key) {
+    if (key.empty()) {
+        size_t start = lowerBound(count, keyAt, key);
+        if (start < count && keyAt(start).empty()) {
+            ++start;
+        }
+        return { start, count };
+    }
+    string low(key);
+    low += '/';
+    string high(key);
+    high += '0';
+    return { lowerBound(count, keyAt, low), lowerBound(count, keyAt, high) };
+}
+
+/**
+ * @brief Returns the indices of the immediate subdirectories of a directory.
+ * The subtree of every child is skipped with one search, so the cost grows with the
+ * number of children rather than the size of the subtree.
+ */
+template <typename KeyAt>
+vector<size_t> childIndices(size_t count, const KeyAt& keyAt, string_view key) {
+    vector<size_t> children;
+    auto range = subtreeRange(count, keyAt, key);
+    size_t prefixLength = key.empty() ? 0 : key.size() + 1;
+    for (size_t i = range.first; i < range.second;) {
+        string_view rest = keyAt(i).substr(prefixLength);
+        size_t slash = rest.find('/');
+        if (slash == string_view::npos) {
+            children.push_back(i);
+            ++i;
+        }
+        else {
+            string next(keyAt(i).substr(0, prefixLength + slash));
+            next += '0';
+            i = lowerBound(count, keyAt, next);
+        }
+    }
+    return children;
+}
+
+/**
+ * @brief Converts a directory's modification time for storage.
+ * @param modified The modification time.
+ * @param trusted Times at or after this may still change within the same tick and are not stored.
+ * @return The stored time, or unknownTime.
+ */
+int64_t storedTime(fs::file_time_type modified, fs::file_time_type trusted) {
+    return modified >= trusted ? unknownTime : static_cast<int64_t>(modified.time_since_epoch().count());
+}
+
+/**
+ * @brief Lists the entries directly in a directory.
+ * The modification time is read before the listing, so a change during the listing
+ * makes the stored time stale rather than hiding the change.
+ * @param path The directory.
+ * @param trusted Modification times at or after this are stored as unknown.
+ * @param entry Receives the modification time and the sizes of the directory's own entries.
+ * @param subdirectories Receives the names of the subdirectories in UTF-8.
+ * @return False if the directory no longer exists.
+ */
+bool readDirectory(const fs::path& path, fs::file_time_type trusted, Entry& entry, vector<string>& subdirectories) {
+    error_code ec;
+    fs::file_time_type modified = fs::last_write_time(path, ec);
+    if (ec) {
+        return ec != errc::no_such_file_or_directory && ec != errc::not_a_directory;
+    }
+    entry.modified = storedTime(modified, trusted);
+    entry.own = DirectorySize();
+
+    fs::directory_iterator it(path, ec);
+    if (ec) {
+        entry.modified = unknownTime;
+        return true;
+    }
+    for (fs::directory_iterator end; it != end; it.increment(ec)) {
+        fs::file_status status = it->symlink_status(ec);
+        if (fs::is_directory(status)) {
+            ++entry.own.directories;
+            subdirectories.push_back(it->path().filename().u8string());
+        }
+        else if (fs::is_regular_file(status)) {
+            FileId id;
+            uint64_t linkCount = 1;
+            uint64_t size = 0;
+            if (!getFileId(it->path(), id, &linkCount, false, &size)) {
+                entry.modified = unknownTime;
+                continue;
+            }
+            ++entry.own.files;
+            if (linkCount > 1) {
+                const uint64_t unit = DirectorySizeCache::shareUnit;
+                entry.own.linkedSize += size;
+                entry.own.linkedShares += size / linkCount * unit + size % linkCount * unit / linkCount;
+                entry.own.linkedRepeats += (linkCount - 1) * unit / linkCount;
+            }
+            else {
+                entry.own.bytes += size;
+            }
+        }
+    }
+    if (ec) {
+        entry.modified = unknownTime;
+    }
+    return true;
+}
+
+/**
+ * @brief Lists a whole subtree and computes the totals of every directory in it.
+ * Directories are listed level by level, each level in parallel. The totals are then
+ * summed bottom-up by visiting the sorted keys in reverse, which reaches every
+ * directory after all of its descendants.
+ * @param root Root of the cache.
+ * @param key Key of the directory to scan.
+ * @param trusted Modification times at or after this are stored as unknown.
+ * @param entries Receives the directories, sorted by key, the scanned directory first; empty if it does not exist.
+ * @param reread Incremented by the number of directories listed.
+ */
+void scanTree(const fs::path& root, const string& key, fs::file_time_type trusted, vector<Entry>& entries, size_t& reread) {
+    entries.clear();
+    vector<string> level{ key };
+    while (!level.empty()) {
+        vector<Entry> listed(level.size());
+        vector<vector<string>> subdirectories(level.size());
+        vector<char> exists(level.size(), 0);
+        parallelFor(level.size(), 0, [&](size_t i, unsigned) {
+            listed[i].key = level[i];
+            exists[i] = readDirectory(root / fs::u8path(level[i]), trusted, listed[i], subdirectories[i]);
+        });
+        reread += level.size();
+
+        vector<string> next;
+        for (size_t i = 0; i < level.size(); ++i) {
+            if (!exists[i]) {
+                continue;
+            }
+            for (const auto& name : subdirectories[i]) {
+                next.push_back(childKey(level[i], name));
+            }
+            entries.push_back(move(listed[i]));
+        }
+        level = move(next);
+    }
+
+    sort(entries.begin(), entries.end(), [](const Entry& a, const Entry& b) { return a.key < b.key; });
+    auto keyAt = [&](size_t i) { return string_view(entries[i].key); };
+    for (size_t i = entries.size(); i-- > 0;) {
+        add(entries[i].total, entries[i].own);
+        if (entries[i].key != key) {
+            size_t parent = findKey(entries.size(), keyAt, parentKey(entries[i].key));
+            add(entries[parent].total, entries[i].total);
+        }
+    }
+}
+
+/**
+ * @brief A cache file mapped into memory.
+ */
+class MappedCache {
+public:
+    /**
+     * @brief Maps a cache file and checks that it belongs to a root.
+     * @return False if the file is missing, malformed, or belongs to another root.
+     */
+    bool open(const fs::path& file, const fs::path& root) {
+        if (!mapping.open(file.string())) {
+            return false;
+        }
+        size_t available = 0;
+        const char* base = mapping.map(0, static_cast<size_t>(mapping.size()), available);
+        if (base == nullptr || available < sizeof(Header) || available != mapping.size()) {
+            return false;
+        }
+        Header header;
+        memcpy(&header, base, sizeof(header));
+        if (memcmp(header.magic, cacheMagic, sizeof(cacheMagic)) != 0
+            || sizeof(Header) + header.recordCount * sizeof(Record) + header.keyBytes + header.rootLength != available) {
+            return false;
+        }
+        records = reinterpret_cast<const Record*>(base + sizeof(Header));
+        count = static_cast<size_t>(header.recordCount);
+        keys = base + sizeof(Header) + count * sizeof(Record);
+        string storedRoot(keys + header.keyBytes, static_cast<size_t>(header.rootLength));
+        return storedRoot == root.generic_u8string();
+    }
+
+    /**
+     * @brief Unmaps the file, so that it can be replaced.
+     */
+    void close() {
+        mapping.close();
+        records = nullptr;
+        count = 0;
+    }
+
+    string_view key(size_t i) const {
+        return string_view(keys + records[i].keyOffset, records[i].keyLength);
+    }
+
+    MappedFile mapping;
+    const Record* records = nullptr;
+    size_t count = 0;
+    const char* keys = nullptr;
+};
+
+/**
+ * @brief Guards cacheRoots.
+ */
+mutex rootsLock;
+
+/**
+ * @brief Generic paths of the roots of all caches, loaded from the cache directory on first use.
+ */
+set<string> cacheRoots;
+bool cacheRootsLoaded = false;
+
+/**
+ * @brief Reads the root paths stored at the end of the cache files; rootsLock must be held.
+ */
+void loadCacheRoots() {
+    cacheRootsLoaded = true;
+    error_code ec;
+    for (fs::directory_iterator it(cacheDirectory(), ec), end; !ec && it != end; it.increment(ec)) {
+        if (it->path().extension() != cacheExtension) {
+            continue;
+        }
+        ifstream input(it->path(), ios::binary);
+        Header header;
+        if (!input.read(reinterpret_cast<char*>(&header), sizeof(header))
+            || memcmp(header.magic, cacheMagic, sizeof(cacheMagic)) != 0 || header.rootLength > (1 << 16)) {
+            continue;
+        }
+        string root(static_cast<size_t>(header.rootLength), '\0');
+        input.seekg(-static_cast<streamoff>(header.rootLength), ios::end);
+        if (input.read(&root[0], static_cast<streamsize>(root.size()))) {
+            cacheRoots.insert(root);
+        }
+    }
+}
+
+/**
+ * @brief Serializes and stores a cache, and registers its root for invalidate.
+ * @return True on success.
+ */
+bool saveCache(const fs::path& root, const vector<Entry>& entries) {
+    string keys;
+    string records;
+    for (const auto& entry : entries) {
+        Record record{};
+        record.keyOffset = keys.size();
+        record.keyLength = static_cast<uint32_t>(entry.key.size());
+        record.modified = entry.modified;
+        record.own = entry.own;
+        record.total = entry.total;
+        records.append(reinterpret_cast<const char*>(&record), sizeof(record));
+        keys += entry.key;
+    }
+    string rootString = root.generic_u8string();
+
+    Header header;
+    memcpy(header.magic, cacheMagic, sizeof(cacheMagic));
+    header.recordCount = entries.size();
+    header.keyBytes = keys.size();
+    header.rootLength = rootString.size();
+    string contents(reinterpret_cast<const char*>(&header), sizeof(header));
+    contents += records;
+    contents += keys;
+    contents += rootString;
+    if (!writeCacheFile(cacheFilePath(root, cacheExtension), contents)) {
+        return false;
+    }
+    lock_guard<mutex> guard(rootsLock);
+    if (!cacheRootsLoaded) {
+        loadCacheRoots();
+    }
+    cacheRoots.insert(rootString);
+    return true;
+}
+
+/**
+ * @brief Serializes appending changes and taking them over within this process.
+ */
+mutex changesLock;
+
+/**
+ * @brief Takes over the changes recorded for a cache.
+ * The changes file is renamed before it is read, so changes recorded while the query runs
+ * go to a fresh file and are kept for the next query. If a query was interrupted before it
+ * stored the cache, its file is still there; new changes are appended to it and it is read again.
+ * @param root Root of the cache.
+ * @param changes Receives the recorded keys, mapped to whether their whole subtree changed.
+ * @return The file to remove once the cache has been stored, or an empty path if there were no changes.
+ */
+fs::path takeChanges(const fs::path& root, map<string, bool>& changes) {
+    fs::path pending = cacheFilePath(root, changesExtension);
+    fs::path applying = cacheFilePath(root, applyingExtension);
+    {
+        lock_guard<mutex> guard(changesLock);
+        error_code ec;
+        if (fs::exists(applying, ec)) {
+            if (fs::exists(pending, ec)) {
+                ifstream input(pending, ios::binary);
+                ofstream output(applying, ios::binary | ios::app);
+                output << input.rdbuf();
+                input.close();
+                fs::remove(pending, ec);
+            }
+        }
+        else {
+            fs::rename(pending, applying, ec);
+            if (ec) {
+                return fs::path();
+            }
+        }
+    }
+
+    ifstream input(applying, ios::binary);
+    char kind;
+    uint32_t length;
+    while (input.get(kind) && input.read(reinterpret_cast<char*>(&length), sizeof(length))) {
+        string key(length, '\0');
+        if (length > 0 && !input.read(&key[0], length)) {
+            break;
+        }
+        changes[key] = changes[key] || kind == 'S';
+    }
+    return applying;
+}
+
+/**
+ * @brief Applies changed directories to a cache.
+ * Changed directories are handled in key order, parents before children. A directory is
+ * listed again; subdirectories that appeared are scanned, those that vanished are removed
+ * with their subtrees, and the difference between the new and the stored totals is added
+ * to the directory and to each of its ancestors. A subtree change scans the subtree again
+ * instead. Added directories are collected separately and merged in at the end, so the
+ * indices into the table stay valid throughout.
+ * @param root Root of the cache.
+ * @param entries The cached directories in key order; updated in place.
+ * @param changes Keys of changed directories, mapped to whether their whole subtree changed.
+ * @param trusted Modification times at or after this are stored as unknown.
+ * @param reread Incremented by the number of directories listed.
+ */
+void applyChanges(const fs::path& root, vector<Entry>& entries, const map<string, bool>& changes,
+    fs::file_time_type trusted, size_t& reread) {
+    auto keyAt = [&](size_t i) { return string_view(entries[i].key); };
+    size_t count = entries.size();
+
+    // A change below a directory the cache does not know yet is found by listing its nearest known ancestor.
+    map<string, bool> known;
+    for (const auto& change : changes) {
+        string_view key = change.first;
+        bool subtree = change.second;
+        while (!key.empty() && findKey(count, keyAt, key) == count) {
+            key = parentKey(key);
+            subtree = false;
+        }
+        bool& flag = known[string(key)];
+        flag = flag || subtree;
+    }
+
+    vector<Entry> added;
+    auto propagate = [&](string_view key, const DirectorySize& delta, const DirectorySize& removedDelta) {
+        while (!key.empty()) {
+            key = parentKey(key);
+            size_t ancestor = findKey(count, keyAt, key);
+            add(entries[ancestor].total, delta);
+            subtract(entries[ancestor].total, removedDelta);
+        }
+    };
+    auto removeSubtree = [&](size_t index) {
+        entries[index].removed = true;
+        auto range = subtreeRange(count, keyAt, entries[index].key);
+        for (size_t i = range.first; i < range.second; ++i) {
+            entries[i].removed = true;
+        }
+    };
+
+    // A directory that vanished takes its subtree and itself out of every ancestor's total.
+    auto removeVanished = [&](size_t index) {
+        removeSubtree(index);
+        DirectorySize lost = entries[index].total;
+        ++lost.directories;
+        propagate(entries[index].key, DirectorySize(), lost);
+        if (!entries[index].key.empty()) {
+            --entries[findKey(count, keyAt, parentKey(entries[index].key))].own.directories;
+        }
+    };
+
+    for (const auto& change : known) {
+        size_t index = findKey(count, keyAt, change.first);
+        if (entries[index].removed) {
+            continue;
+        }
+        Entry& entry = entries[index];
+        DirectorySize oldTotal = entry.total;
+
+        if (change.second) {
+            vector<Entry> fresh;
+            scanTree(root, entry.key, trusted, fresh, reread);
+            removeSubtree(index);
+            if (fresh.empty()) {
+                removeVanished(index);
+                continue;
+            }
+            propagate(entry.key, fresh.front().total, oldTotal);
+            move(fresh.begin(), fresh.end(), back_inserter(added));
+            continue;
+        }
+
+        Entry listed;
+        vector<string> subdirectories;
+        ++reread;
+        if (!readDirectory(root / fs::u8path(entry.key), trusted, listed, subdirectories)) {
+            removeVanished(index);
+            continue;
+        }
+
+        DirectorySize delta = listed.own;
+        subtract(delta, entry.own);
+        sort(subdirectories.begin(), subdirectories.end());
+        for (size_t child : childIndices(count, keyAt, entry.key)) {
+            string_view name = keyAt(child).substr(entry.key.empty() ? 0 : entry.key.size() + 1);
+            if (!binary_search(subdirectories.begin(), subdirectories.end(), name)) {
+                subtract(delta, entries[child].total);
+                removeSubtree(child);
+            }
+        }
+        for (const auto& name : subdirectories) {
+            string key = childKey(entry.key, name);
+            if (findKey(count, keyAt, key) != count) {
+                continue;
+            }
+            vector<Entry> fresh;
+            scanTree(root, key, trusted, fresh, reread);
+            if (!fresh.empty()) {
+                add(delta, fresh.front().total);
+                move(fresh.begin(), fresh.end(), back_inserter(added));
+            }
+        }
+
+        entry.own = listed.own;
+        entry.modified = listed.modified;
+        add(entry.total, delta);
+        propagate(entry.key, delta, DirectorySize());
+    }
+
+    entries.erase(remove_if(entries.begin(), entries.end(), [](const Entry& entry) { return entry.removed; }), entries.end());
+    move(added.begin(), added.end(), back_inserter(entries));
+    sort(entries.begin(), entries.end(), [](const Entry& a, const Entry& b) { return a.key < b.key; });
+}
+
+} // namespace
+
+/**
+ * @brief Returns the total size, each file counted once when all its links are included.
+ * @return Size in bytes, rounded to the nearest byte.
+ */
+uint64_t DirectorySize::totalBytes() const {
+    return bytes + (linkedShares + DirectorySizeCache::shareUnit / 2) / DirectorySizeCache::shareUnit;
+}
+
+/**
+ * @brief Returns the size of a directory tree, bringing the cache up to date first.
+ * Without recorded changes, and with every directory unchanged when validating, the answer
+ * comes straight from the mapped cache file: one binary search for the directory and one per
+ * subdirectory. Otherwise the cache is loaded, updated with applyChanges and stored again.
+ * @param directory Canonical path of the directory.
+ * @param validate Whether every cached directory below is checked for changes by modification time.
+ * @param total Receives the totals below the directory.
+ * @param children Receives the totals below each immediate subdirectory.
+ * @param reread Receives the number of directories listed to bring the cache up to date.
+ * @return True if the cache was current or could be updated, false if it could not be stored.
+ */
+bool DirectorySizeCache::measure(const fs::path& directory, bool validate, DirectorySize& total,
+    vector<ChildSize>& children, size_t& reread) {
+    fs::file_time_type trusted = fs::file_time_type::clock::now() - chrono::seconds(2);
+    reread = 0;
+    children.clear();
+
+    fs::path root;
+    MappedCache cache;
+    for (fs::path current = directory;; current = current.parent_path()) {
+        error_code ec;
+        if (fs::exists(cacheFilePath(current, cacheExtension), ec) && cache.open(cacheFilePath(current, cacheExtension), current)) {
+            root = current;
+            break;
+        }
+        if (current == current.parent_path()) {
+            break;
+        }
+    }
+
+    vector<Entry> entries;
+    string key;
+    bool stored = true;
+    if (root.empty()) {
+        root = directory;
+        scanTree(root, key, trusted, entries, reread);
+        stored = saveCache(root, entries);
+    }
+    else {
+        key = directory == root ? string() : directory.lexically_relative(root).generic_u8string();
+        auto mappedKey = [&](size_t i) { return cache.key(i); };
+        map<string, bool> changes;
+        fs::path applying = takeChanges(root, changes);
+
+        size_t index = findKey(cache.count, mappedKey, key);
+        if (index == cache.count) {
+            changes[key];
+        }
+        else if (validate) {
+            auto range = subtreeRange(cache.count, mappedKey, key);
+            vector<size_t> checked{ index };
+            for (size_t i = range.first; i < range.second; ++i) {
+                checked.push_back(i);
+            }
+            vector<char> changed(checked.size(), 0);
+            parallelFor(checked.size(), 0, [&](size_t i, unsigned) {
+                const Record& record = cache.records[checked[i]];
+                error_code ec;
+                fs::file_time_type modified = fs::last_write_time(root / fs::u8path(cache.key(checked[i])), ec);
+                changed[i] = record.modified == unknownTime || ec || storedTime(modified, trusted) != record.modified;
+            });
+            for (size_t i = 0; i < checked.size(); ++i) {
+                if (changed[i]) {
+                    changes[string(cache.key(checked[i]))];
+                }
+            }
+        }
+
+        if (changes.empty()) {
+            total = cache.records[index].total;
+            for (size_t child : childIndices(cache.count, mappedKey, key)) {
+                string_view childPath = cache.key(child);
+                children.push_back({ string(childPath.substr(childPath.rfind('/') + 1)), cache.records[child].total });
+            }
+            return true;
+        }
+
+        entries.resize(cache.count);
+        for (size_t i = 0; i < cache.count; ++i) {
+            entries[i].key = string(cache.key(i));
+            entries[i].modified = cache.records[i].modified;
+            entries[i].own = cache.records[i].own;
+            entries[i].total = cache.records[i].total;
+        }
+        cache.close();
+        applyChanges(root, entries, changes, trusted, reread);
+        stored = saveCache(root, entries);
+        if (stored && !applying.empty()) {
+            error_code ec;
+            fs::remove(applying, ec);
+        }
+    }
+
+    auto keyAt = [&](size_t i) { return string_view(entries[i].key); };
+    size_t index = findKey(entries.size(), keyAt, key);
+    if (index == entries.size()) {
+        throw fs::filesystem_error("Cannot read directory", directory, make_error_code(errc::no_such_file_or_directory));
+    }
+    total = entries[index].total;
+    for (size_t child : childIndices(entries.size(), keyAt, key)) {
+        children.push_back({ entries[child].key.substr(entries[child].key.rfind('/') + 1), entries[child].total });
+    }
+    return stored;
+}
+
+/**
+ * @brief Records a change in the changes file of every cache covering it.
+ * The caches are found among the roots known to this process, so a change outside every
+ * cached tree costs a lexical comparison per root and no file system access. Paths that
+ * reach a cached tree through a symbolic link, and caches created by another process after
+ * the roots were loaded, are not matched; a validating query still finds those changes by
+ * modification time. Each change is appended as a kind byte, 'D' for a directory to list
+ * again or 'S' for a subtree to scan again, followed by the length and the bytes of the key.
+ * A changes file that grows beyond changesLimit, because its cache is not queried, is
+ * replaced by a single record to scan the whole tree again.
+ * @param path The entry that changed, or a directory whose whole subtree may have changed.
+ * @param subtree Whether everything below path may have changed.
+ */
+void DirectorySizeCache::invalidate(const fs::path& path, bool subtree) {
+    vector<string> roots;
+    {
+        lock_guard<mutex> guard(rootsLock);
+        if (!cacheRootsLoaded) {
+            loadCacheRoots();
+        }
+        if (cacheRoots.empty()) {
+            return;
+        }
+        roots.assign(cacheRoots.begin(), cacheRoots.end());
+    }
+
+    error_code ec;
+    fs::path directory = fs::absolute(path, ec).lexically_normal();
+    if (ec) {
+        return;
+    }
+    if (!directory.has_filename()) {
+        directory = directory.parent_path();
+    }
+    if (!subtree) {
+        directory = directory.parent_path();
+    }
+    string changed = directory.generic_u8string();
+
+    for (const auto& root : roots) {
+        if (changed.compare(0, root.size(), root) != 0
+            || (changed.size() > root.size() && changed[root.size()] != '/' && root.back() != '/')) {
+            continue;
+        }
+        string key = changed.size() == root.size() ? string() : changed.substr(root.size() + (root.back() == '/' ? 0 : 1));
+        uint32_t length = static_cast<uint32_t>(key.size());
+        fs::path changes = cacheFilePath(fs::u8path(root), changesExtension);
+
+        lock_guard<mutex> guard(changesLock);
+        ofstream output(changes, ios::binary | ios::app);
+        output.put(subtree ? 'S' : 'D');
+        output.write(reinterpret_cast<const char*>(&length), sizeof(length));
+        output.write(key.data(), static_cast<streamsize>(key.size()));
+        if (output.tellp() > changesLimit) {
+            output.close();
+            output.open(changes, ios::binary | ios::trunc);
+            length = 0;
+            output.put('S');
+            output.write(reinterpret_cast<const char*>(&length), sizeof(length));
+        }
+    }
+}
@@ -0,0 +1,94 @@
+/**
+ * @file SizeCache.h
+ * @brief Declares the DirectorySizeCache class, a persistent cache of directory subtree sizes
+ * that is brought up to date incrementally.
+ */
+
+#ifndef SIZE_CACHE_H
+#define SIZE_CACHE_H
+
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <string>
+#include <vector>
+
+/**
+ * @struct DirectorySize
+ * @brief Sizes and counts of the entries in a directory or below it.
+ * A file with n hard links contributes 1/n of its size through each of its paths, so a
+ * file whose links all lie within the measured tree is counted exactly once. Such shares
+ * are kept in fixed point, in units of DirectorySizeCache::shareUnit.
+ */
+struct DirectorySize {
+    std::uint64_t bytes = 0;         ///< Size of the regular files with a single link.
+    std::uint64_t files = 0;         ///< Regular file paths.
+    std::uint64_t directories = 0;   ///< Directories.
+    std::uint64_t linkedSize = 0;    ///< Full size of every path to a file with several links.
+    std::uint64_t linkedShares = 0;  ///< Sum of the shares of those paths; each of n paths adds size / n.
+    std::uint64_t linkedRepeats = 0; ///< Repeated links; each of n paths adds (n - 1) / n.
+
+    /**
+     * @brief Returns the total size, each file counted once when all its links are included.
+     * @return Size in bytes, rounded to the nearest byte.
+     */
+    std::uint64_t totalBytes() const;
+};
+
+/**
+ * @struct ChildSize
+ * @brief Total size below one immediate subdirectory.
+ */
+struct ChildSize {
+    std::string name; ///< Name of the subdirectory.
+    DirectorySize size;
+};
+
+/**
+ * @class DirectorySizeCache
+ * @brief Per-directory sizes of a tree, stored in the user's cache directory.
+ *
+ * Every directory is stored with its modification time, the sizes of its own entries and
+ * the totals of its subtree, sorted by path so that a subtree is one contiguous range. A
+ * query maps the cache file and answers from the stored totals. Directories that changed
+ * are listed again, and the difference to their stored sizes is added to every ancestor,
+ * so a change deep in the tree costs one listing and a few updates instead of a full walk.
+ *
+ * Changes are found in two ways. Operations of this program record the directories they
+ * modify with invalidate, and a validating query also compares the modification time of
+ * every cached directory below the one asked about. Modification times only reveal added,
+ * removed and renamed entries, so files rewritten in place by other programs are noticed
+ * once their directory changes for another reason.
+ */
+class DirectorySizeCache {
+public:
+    /**
+     * @brief Fixed-point unit of DirectorySize::linkedShares and DirectorySize::linkedRepeats.
+     */
+    static constexpr std::uint64_t shareUnit = 1 << 16;
+
+    /**
+     * @brief Returns the size of a directory tree, bringing the cache up to date first.
+     * The cache of the directory or of its nearest cached ancestor is used. If there is none,
+     * the tree is scanned and a cache is created for the directory.
+     * @param directory Canonical path of the directory.
+     * @param validate Whether every cached directory below is checked for changes by modification time.
+     * @param total Receives the totals below the directory.
+     * @param children Receives the totals below each immediate subdirectory.
+     * @param reread Receives the number of directories listed to bring the cache up to date.
+     * @return True if the cache was current or could be updated, false if it could not be stored.
+     * @throws std::filesystem::filesystem_error If a directory cannot be examined.
+     */
+    static bool measure(const std::filesystem::path& directory, bool validate, DirectorySize& total,
+        std::vector<ChildSize>& children, std::size_t& reread);
+
+    /**
+     * @brief Records a change so that every cache covering it is updated by the next query.
+     * @param path An entry that was created, removed, renamed or rewritten; its directory is listed
+     * again. For a subtree change, a directory whose whole subtree is scanned again.
+     * @param subtree Whether everything below path may have changed.
+     */
+    static void invalidate(const std::filesystem::path& path, bool subtree = false);
+};
+
+#endif // SIZE_CACHE_H
@@ -0,0 +1,197 @@
+/**
+ * @file TextScanner.cpp
+ * @brief Implementation of the vectorized buffer scanning kernels.
+ */
+
+#include "TextScanner.h"
+#include <cstdint>
+#include <cstring>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define TEXT_SCANNER_SSE2
+#include <emmintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+#endif
+
+using namespace std;
+
+namespace {
+
+#ifdef TEXT_SCANNER_SSE2
+/**
+ * @brief Returns the index of the lowest set bit of a non-zero mask.
+ * @param mask The mask to examine.
+ * @return Index of the lowest set bit.
+ */
+inline unsigned lowestBit(unsigned mask) {
+#ifdef _MSC_VER
+    unsigned long index;
+    _BitScanForward(&index, mask);
+    return static_cast<unsigned>(index);
+#else
+    return static_cast<unsigned>(__builtin_ctz(mask));
+#endif
+}
+#endif
+
+/**
+ * @brief Counts the set bits of a 64-bit mask.
+ * @param mask The mask to examine.
+ * @return Number of set bits.
+ */
+inline size_t bitCount(uint64_t mask) {
+    mask = mask - ((mask >> 1) & 0x5555555555555555ULL);
+    mask = (mask & 0x3333333333333333ULL) + ((mask >> 2) & 0x3333333333333333ULL);
+    mask = (mask + (mask >> 4)) & 0x0F0F0F0F0F0F0F0FULL;
+    return static_cast<size_t>((mask * 0x0101010101010101ULL) >> 56);
+}
+
+/**
+ * @brief Checks whether a byte separates words.
+ * @param byte The byte to test.
+ * @return True for space and '\t' through '\r'.
+ */
+inline bool isSeparator(unsigned char byte) {
+    return byte == ' ' || static_cast<unsigned char>(byte - '\t') <= '\r' - '\t';
+}
+
+} // namespace
+
+/**
+ * @brief Finds the first occurrence of a substring.
+ * @param data Buffer to search.
+ * @param size Size of the buffer.
+ * @param needle Substring to look for.
+ * @param needleSize Size of the substring; must not be zero.
+ * @return Pointer to the first occurrence, or nullptr if there is none.
+ */
+const char* TextScanner::find(const char* data, size_t size, const char* needle, size_t needleSize) {
+    if (needleSize == 0 || needleSize > size) {
+        return nullptr;
+    }
+    if (needleSize == 1) {
+        return static_cast<const char*>(memchr(data, needle[0], size));
+    }
+
+    size_t i = 0;
+    size_t last = size - needleSize;
+#ifdef TEXT_SCANNER_SSE2
+    const __m128i first = _mm_set1_epi8(needle[0]);
+    const __m128i final = _mm_set1_epi8(needle[needleSize - 1]);
+    for (; i + 16 <= last + 1; i += 16) {
+        __m128i head = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + i));
+        __m128i tail = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + i + needleSize - 1));
+        unsigned mask = static_cast<unsigned>(_mm_movemask_epi8(
+            _mm_and_si128(_mm_cmpeq_epi8(head, first), _mm_cmpeq_epi8(tail, final))));
+        while (mask != 0) {
+            unsigned bit = lowestBit(mask);
+            if (memcmp(data + i + bit + 1, needle + 1, needleSize - 2) == 0) {
+                return data + i + bit;
+            }
+            mask &= mask - 1;
+        }
+    }
+#endif
+    while (i <= last) {
+        const char* candidate = static_cast<const char*>(memchr(data + i, needle[0], last - i + 1));
+        if (candidate == nullptr) {
+            return nullptr;
+        }
+        if (memcmp(candidate + 1, needle + 1, needleSize - 1) == 0) {
+            return candidate;
+        }
+        i = static_cast<size_t>(candidate - data) + 1;
+    }
+    return nullptr;
+}
+
+/**
+ * @brief Counts the occurrences of a byte.
+ * With SSE2, matches are accumulated in sixteen byte-wide counters that are folded
+ * into the total before any of them can overflow.
+ * @param data Buffer to scan.
+ * @param size Size of the buffer.
+ * @param byte Byte to count.
+ * @return Number of occurrences.
+ */
+size_t TextScanner::count(const char* data, size_t size, char byte) {
+    size_t total = 0;
+    size_t i = 0;
+#ifdef TEXT_SCANNER_SSE2
+    const __m128i target = _mm_set1_epi8(byte);
+    const __m128i zero = _mm_setzero_si128();
+    while (i + 16 <= size) {
+        __m128i counters = zero;
+        size_t blockEnd = i + 255 * 16;
+        if (blockEnd > size) {
+            blockEnd = size;
+        }
+        for (; i + 16 <= blockEnd; i += 16) {
+            __m128i chunk = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + i));
+            counters = _mm_sub_epi8(counters, _mm_cmpeq_epi8(chunk, target));
+        }
+        __m128i sums = _mm_sad_epu8(counters, zero);
+        total += static_cast<size_t>(_mm_cvtsi128_si32(sums)) + static_cast<size_t>(_mm_cvtsi128_si32(_mm_srli_si128(sums, 8)));
+    }
+#endif
+    for (; i < size; ++i) {
+        if (data[i] == byte) {
+            ++total;
+        }
+    }
+    return total;
+}
+
+/**
+ * @brief Counts newlines and word starts in one pass.
+ * With SSE2, 64 bytes are classified per step into a newline mask and a separator mask.
+ * A word starts wherever a non-separator follows a separator, so the word starts of a
+ * block are the non-separator bits whose predecessor bit, carried across blocks, is a
+ * separator; both masks are then counted with a population count.
+ * @param data Buffer to scan.
+ * @param size Size of the buffer.
+ * @param lines Incremented by the number of newlines.
+ * @param words Incremented by the number of words starting in the buffer.
+ * @param inWord Whether the byte before the buffer belongs to a word; updated for the next buffer.
+ */
+void TextScanner::countLinesAndWords(const char* data, size_t size, size_t& lines, size_t& words, bool& inWord) {
+    size_t i = 0;
+#ifdef TEXT_SCANNER_SSE2
+    const __m128i newline = _mm_set1_epi8('\n');
+    const __m128i space = _mm_set1_epi8(' ');
+    const __m128i controlBase = _mm_set1_epi8('\t');
+    const __m128i controlRange = _mm_set1_epi8('\r' - '\t');
+    uint64_t previousSeparator = inWord ? 0 : 1;
+    for (; i + 64 <= size; i += 64) {
+        uint64_t newlineMask = 0;
+        uint64_t separatorMask = 0;
+        for (int part = 0; part < 4; ++part) {
+            __m128i chunk = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + i + part * 16));
+            __m128i offset = _mm_sub_epi8(chunk, controlBase);
+            __m128i control = _mm_cmpeq_epi8(_mm_min_epu8(offset, controlRange), offset);
+            __m128i separator = _mm_or_si128(control, _mm_cmpeq_epi8(chunk, space));
+            newlineMask |= static_cast<uint64_t>(static_cast<unsigned>(_mm_movemask_epi8(_mm_cmpeq_epi8(chunk, newline)))) << (part * 16);
+            separatorMask |= static_cast<uint64_t>(static_cast<unsigned>(_mm_movemask_epi8(separator))) << (part * 16);
+        }
+        lines += bitCount(newlineMask);
+        words += bitCount(~separatorMask & ((separatorMask << 1) | previousSeparator));
+        previousSeparator = separatorMask >> 63;
+    }
+    inWord = previousSeparator == 0;
+#endif
+    for (; i < size; ++i) {
+        auto byte = static_cast<unsigned char>(data[i]);
+        if (byte == '\n') {
+            ++lines;
+        }
+        if (isSeparator(byte)) {
+            inWord = false;
+        }
+        else if (!inWord) {
+            ++words;
+            inWord = true;
+        }
+    }
+}
@@ -0,0 +1,51 @@
+/**
+ * @file TextScanner.h
+ * @brief Declares the TextScanner class, which provides vectorized byte and substring scans over buffers.
+ */
+
+#ifndef TEXT_SCANNER_H
+#define TEXT_SCANNER_H
+
+#include <cstddef>
+
+/**
+ * @class TextScanner
+ * @brief Buffer scanning kernels that examine sixteen bytes per step with SSE2 where available.
+ */
+class TextScanner {
+public:
+    /**
+     * @brief Finds the first occurrence of a substring.
+     * Candidate positions are found by comparing the first and last byte of the needle
+     * against sixteen positions at once; only candidates are compared in full.
+     * @param data Buffer to search.
+     * @param size Size of the buffer.
+     * @param needle Substring to look for.
+     * @param needleSize Size of the substring; must not be zero.
+     * @return Pointer to the first occurrence, or nullptr if there is none.
+     */
+    static const char* find(const char* data, std::size_t size, const char* needle, std::size_t needleSize);
+
+    /**
+     * @brief Counts the occurrences of a byte.
+     * @param data Buffer to scan.
+     * @param size Size of the buffer.
+     * @param byte Byte to count.
+     * @return Number of occurrences.
+     */
+    static std::size_t count(const char* data, std::size_t size, char byte);
+
+    /**
+     * @brief Counts newlines and word starts in one pass, like wc.
+     * A word is a run of bytes other than space and '\t' through '\r'. Buffers of one stream
+     * can be processed in turn by passing the same inWord flag to each call.
+     * @param data Buffer to scan.
+     * @param size Size of the buffer.
+     * @param lines Incremented by the number of newlines.
+     * @param words Incremented by the number of words starting in the buffer.
+     * @param inWord Whether the byte before the buffer belongs to a word; updated for the next buffer.
+     */
+    static void countLinesAndWords(const char* data, std::size_t size, std::size_t& lines, std::size_t& words, bool& inWord);
+};
+
+#endif // TEXT_SCANNER_H
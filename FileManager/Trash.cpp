@@ -0,0 +1,679 @@
+/**
+ * @file Trash.cpp
+ * @brief Implementation of the size-capped trash.
+ */
+
+#include "Trash.h"
+#include "CacheLocation.h"
+#include "FileId.h"
+#include "SizeCache.h"
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+#include <set>
+#include <sstream>
+#include <system_error>
+
+#ifndef _WIN32
+#include <unistd.h>
+#endif
+
+using namespace std;
+namespace fs = filesystem;
+
+namespace {
+
+/**
+ * @brief Name of the directory within a bin that holds the entries.
+ */
+const char* const filesName = "files";
+
+/**
+ * @brief Name of the index file within a bin.
+ */
+const char* const indexName = "index";
+
+/**
+ * @brief Returns the file listing the directory of every bin created.
+ */
+fs::path registryPath() {
+    return cacheDirectory() / "trash.bins";
+}
+
+/**
+ * @brief Returns the file holding the capacity.
+ */
+fs::path capacityPath() {
+    return cacheDirectory() / "trash.capacity";
+}
+
+/**
+ * @brief Returns the name of the bin directory at the root of a volume.
+ */
+string volumeBinName() {
+#ifdef _WIN32
+    return ".FileManagerTrash";
+#else
+    return ".filemanager-trash-" + to_string(getuid());
+#endif
+}
+
+/**
+ * @brief Escapes backslashes and line breaks so that a path fits on one index line.
+ */
+string escapePath(const string& path) {
+    string escaped;
+    for (char c : path) {
+        if (c == '\\') {
+            escaped += "\\\\";
+        }
+        else if (c == '\n') {
+            escaped += "\\n";
+        }
+        else {
+            escaped += c;
+        }
+    }
+    return escaped;
+}
+
+/**
+ * @brief Reverses escapePath.
+ */
+string unescapePath(const string& escaped) {
+    string path;
+    for (size_t i = 0; i < escaped.size(); ++i) {
+        if (escaped[i] == '\\' && i + 1 < escaped.size()) {
+            path += escaped[++i] == 'n' ? '\n' : escaped[i];
+        }
+        else {
+            path += escaped[i];
+        }
+    }
+    return path;
+}
+
+/**
+ * @brief Finds the device holding a path, or the nearest existing ancestor if the path is missing.
+ * @return False if no ancestor can be examined.
+ */
+bool deviceOf(const fs::path& path, uint64_t& device) {
+    FileId id;
+    for (fs::path current = path;; current = current.parent_path()) {
+        if (getFileId(current, id)) {
+            device = id.device;
+            return true;
+        }
+        if (current == current.parent_path()) {
+            return false;
+        }
+    }
+}
+
+/**
+ * @brief Returns the topmost ancestor of a directory that is still on the given device.
+ */
+fs::path volumeRoot(const fs::path& directory, uint64_t device) {
+    fs::path root = directory;
+    FileId id;
+    while (root != root.parent_path() && getFileId(root.parent_path(), id) && id.device == device) {
+        root = root.parent_path();
+    }
+    return root;
+}
+
+/**
+ * @brief Checks whether a path equals a directory or lies below it; both must be normalized.
+ */
+bool isWithin(const fs::path& path, const fs::path& directory) {
+    fs::path relative = path.lexically_relative(directory);
+    return !relative.empty() && *relative.begin() != "..";
+}
+
+/**
+ * @brief Returns an absolute path with its parent resolved, leaving the final entry itself alone.
+ */
+fs::path resolveEntry(const string& path) {
+    fs::path absolute = fs::absolute(path).lexically_normal();
+    if (absolute.filename().empty()) {
+        absolute = absolute.parent_path();
+    }
+    return fs::weakly_canonical(absolute.parent_path()) / absolute.filename();
+}
+
+/**
+ * @brief Adds up the sizes of the files in an entry without following symbolic links.
+ * @param path The entry.
+ * @param stopping Checked between directory entries; measuring ends early once set.
+ * @param exists Receives false if the entry is gone.
+ * @return Total size in bytes.
+ */
+uint64_t measureEntry(const fs::path& path, const atomic<bool>& stopping, bool& exists) {
+    error_code ec;
+    fs::file_status status = fs::symlink_status(path, ec);
+    exists = fs::exists(status);
+    if (!exists) {
+        return 0;
+    }
+    if (!fs::is_directory(status)) {
+        uintmax_t size = fs::is_regular_file(status) ? fs::file_size(path, ec) : 0;
+        return ec ? 0 : static_cast<uint64_t>(size);
+    }
+    uint64_t bytes = 0;
+    fs::recursive_directory_iterator it(path, fs::directory_options::skip_permission_denied, ec);
+    for (fs::recursive_directory_iterator end; !ec && it != end && !stopping; it.increment(ec)) {
+        error_code entryError;
+        if (it->is_regular_file(entryError) && !it->is_symlink(entryError)) {
+            uintmax_t size = it->file_size(entryError);
+            if (!entryError) {
+                bytes += static_cast<uint64_t>(size);
+            }
+        }
+    }
+    return bytes;
+}
+
+/**
+ * @brief Removes an entry bottom-up so that removal of a large tree can be interrupted.
+ * @param path The entry.
+ * @param stopping Checked between directory entries; whatever is left stays in place once set.
+ * @return True if the entry is gone.
+ */
+bool removeEntry(const fs::path& path, const atomic<bool>& stopping) {
+    error_code ec;
+    if (fs::is_directory(fs::symlink_status(path, ec))) {
+        for (fs::directory_iterator it(path, ec), end; !ec && it != end && !stopping; it.increment(ec)) {
+            removeEntry(it->path(), stopping);
+        }
+    }
+    if (stopping) {
+        return false;
+    }
+    fs::remove(path, ec);
+    return !ec;
+}
+
+} // namespace
+
+/**
+ * @brief Retrieves the trash.
+ * @return Reference to the Trash instance.
+ */
+Trash& Trash::getInstance() {
+    static Trash instance;
+    return instance;
+}
+
+/**
+ * @brief Reads the stored capacity and starts the background thread.
+ */
+Trash::Trash() {
+    ifstream input(capacityPath());
+    uint64_t stored = 0;
+    if (input >> stored) {
+        limit = stored;
+    }
+    worker = thread(&Trash::maintain, this);
+}
+
+/**
+ * @brief Stops the background thread. Entries being removed at that moment are finished on a later run.
+ */
+Trash::~Trash() {
+    stopping = true;
+    {
+        lock_guard<mutex> guard(lock);
+    }
+    wake.notify_all();
+    worker.join();
+}
+
+/**
+ * @brief Returns the bin for entries of a directory, creating and registering it if needed.
+ * @param parent Directory holding the entry.
+ * @param error Receives the reason if no bin can be used.
+ * @return The bin, or nullptr.
+ */
+Trash::Bin* Trash::binFor(const fs::path& parent, string& error) {
+    uint64_t device = 0;
+    if (!deviceOf(parent, device)) {
+        error = "Unable to examine " + parent.string();
+        return nullptr;
+    }
+    auto found = bins.find(device);
+    if (found != bins.end()) {
+        return found->second.get();
+    }
+
+    uint64_t homeDevice = 0;
+    fs::path home = cacheDirectory();
+    fs::path directory = deviceOf(home, homeDevice) && homeDevice == device
+        ? home / "trash" : volumeRoot(parent, device) / volumeBinName();
+    error_code ec;
+    fs::create_directories(directory / filesName, ec);
+    FileId id;
+    if (ec || !getFileId(directory / filesName, id)) {
+        error = "Unable to create the trash directory " + directory.string();
+        return nullptr;
+    }
+    if (id.device != device) {
+        error = "The trash directory " + directory.string() + " is on another filesystem";
+        return nullptr;
+    }
+#ifndef _WIN32
+    fs::permissions(directory, fs::perms::owner_all, ec);
+#endif
+    directory = fs::canonical(directory, ec);
+
+    set<string> registered;
+    ifstream registry(registryPath());
+    for (string line; getline(registry, line);) {
+        registered.insert(line);
+    }
+    registry.close();
+    if (!registered.count(directory.u8string())) {
+        fs::create_directories(registryPath().parent_path(), ec);
+        ofstream output(registryPath(), ios::app);
+        output << directory.u8string() << '\n';
+    }
+    return loadBin(directory, device);
+}
+
+/**
+ * @brief Loads a bin from its index. Entries of the bin that the index does not know are left
+ * from evictions that were interrupted, and are removed in the background.
+ * @param directory The bin directory.
+ * @param device Device of the bin.
+ * @return The bin.
+ */
+Trash::Bin* Trash::loadBin(const fs::path& directory, uint64_t device) {
+    auto bin = make_unique<Bin>();
+    bin->directory = directory;
+
+    ifstream input(directory / indexName, ios::binary);
+    for (string line; getline(input, line); ++bin->records) {
+        istringstream record(line);
+        string kind, name;
+        record >> kind >> name;
+        if (kind == "+") {
+            TrashEntry entry;
+            string type, path;
+            record >> entry.deletedAt >> type;
+            record.get();
+            getline(record, path);
+            entry.directory = type == "d";
+            entry.originalPath = fs::u8path(unescapePath(path)).string();
+            bin->items[name] = entry;
+        }
+        else if (kind == "=") {
+            auto item = bin->items.find(name);
+            if (item != bin->items.end() && record >> item->second.bytes) {
+                item->second.measured = true;
+            }
+        }
+        else if (kind == "-") {
+            bin->items.erase(name);
+        }
+    }
+
+    for (const auto& item : bin->items) {
+        if (item.second.measured) {
+            used += item.second.bytes;
+        }
+    }
+    error_code ec;
+    for (fs::directory_iterator it(directory / filesName, ec), end; !ec && it != end; it.increment(ec)) {
+        string name = it->path().filename().u8string();
+        if (!bin->items.count(name)) {
+            bin->orphans.push_back(name);
+        }
+    }
+
+    Bin* loaded = bin.get();
+    bins[device] = move(bin);
+    wake.notify_one();
+    return loaded;
+}
+
+/**
+ * @brief Loads every registered bin that still exists.
+ */
+void Trash::loadAllBins() {
+    if (allLoaded) {
+        return;
+    }
+    ifstream registry(registryPath());
+    for (string line; getline(registry, line);) {
+        fs::path directory = fs::u8path(line);
+        FileId id;
+        if (getFileId(directory / filesName, id) && !bins.count(id.device)) {
+            loadBin(directory, id.device);
+        }
+    }
+    allLoaded = true;
+}
+
+/**
+ * @brief Appends one record to a bin's index.
+ * @param bin The bin.
+ * @param record The record, without the line break.
+ * @return True if the record was written.
+ */
+bool Trash::appendRecord(Bin& bin, const string& record) {
+    ofstream output(bin.directory / indexName, ios::binary | ios::app);
+    output << record << '\n';
+    output.close();
+    if (!output) {
+        return false;
+    }
+    ++bin.records;
+    return true;
+}
+
+/**
+ * @brief Rewrites a bin's index with one addition record and, if measured, one size record per entry.
+ * @param bin The bin.
+ */
+void Trash::compact(Bin& bin) {
+    string contents;
+    size_t records = 0;
+    for (const auto& [name, entry] : bin.items) {
+        contents += "+ " + name + " " + to_string(entry.deletedAt) + (entry.directory ? " d " : " f ")
+            + escapePath(fs::path(entry.originalPath).u8string()) + "\n";
+        ++records;
+        if (entry.measured) {
+            contents += "= " + name + " " + to_string(entry.bytes) + "\n";
+            ++records;
+        }
+    }
+    if (writeCacheFile(bin.directory / indexName, contents)) {
+        bin.records = records;
+    }
+}
+
+/**
+ * @brief Background loop: removes leftovers of interrupted evictions, measures new entries, evicts the
+ * entries deleted longest ago while the capacity is exceeded, and compacts indexes. Removing and
+ * measuring happen without holding the lock, so deletions and restores never wait for them.
+ */
+void Trash::maintain() {
+    unique_lock<mutex> guard(lock);
+    while (!stopping) {
+        Bin* target = nullptr;
+        string name;
+        for (auto& loaded : bins) {
+            if (!loaded.second->orphans.empty()) {
+                target = loaded.second.get();
+                name = target->orphans.back();
+                target->orphans.pop_back();
+                break;
+            }
+        }
+        if (target) {
+            fs::path path = target->directory / filesName / fs::u8path(name);
+            guard.unlock();
+            removeEntry(path, stopping);
+            guard.lock();
+            continue;
+        }
+
+        for (auto& loaded : bins) {
+            auto item = find_if(loaded.second->items.begin(), loaded.second->items.end(),
+                [](const auto& candidate) { return !candidate.second.measured; });
+            if (item != loaded.second->items.end()) {
+                target = loaded.second.get();
+                name = item->first;
+                break;
+            }
+        }
+        if (target) {
+            fs::path path = target->directory / filesName / fs::u8path(name);
+            guard.unlock();
+            bool exists = false;
+            uint64_t bytes = measureEntry(path, stopping, exists);
+            guard.lock();
+            auto item = target->items.find(name);
+            if (stopping || item == target->items.end() || item->second.measured) {
+                continue;
+            }
+            if (!exists) {
+                target->items.erase(item);
+                appendRecord(*target, "- " + name);
+                continue;
+            }
+            item->second.bytes = bytes;
+            item->second.measured = true;
+            used += bytes;
+            appendRecord(*target, "= " + name + " " + to_string(bytes));
+            continue;
+        }
+
+        if (used > limit) {
+            for (auto& loaded : bins) {
+                auto& items = loaded.second->items;
+                if (!items.empty() && (!target || items.begin()->first < name)) {
+                    target = loaded.second.get();
+                    name = items.begin()->first;
+                }
+            }
+            if (target) {
+                used -= target->items.begin()->second.bytes;
+                target->items.erase(target->items.begin());
+                appendRecord(*target, "- " + name);
+                fs::path path = target->directory / filesName / fs::u8path(name);
+                guard.unlock();
+                removeEntry(path, stopping);
+                DirectorySizeCache::invalidate(path);
+                guard.lock();
+                continue;
+            }
+        }
+
+        for (auto& loaded : bins) {
+            if (loaded.second->records > 2 * loaded.second->items.size() + 64) {
+                compact(*loaded.second);
+            }
+        }
+        wake.wait(guard);
+    }
+}
+
+/**
+ * @brief Moves an entry into the bin of its filesystem. The addition is recorded in the index before
+ * the rename, so an interruption can only leave a record whose entry is missing, which is dropped later.
+ * @param path The entry to move.
+ * @return HTTP-like status code:
+ * - 200: Success.
+ * - 400: The entry is a bin, lies inside one, or contains one.
+ * - 500: The entry could not be moved.
+ */
+int Trash::moveToTrash(const fs::path& path) {
+    try {
+        fs::path original = resolveEntry(path.string());
+        lock_guard<mutex> guard(lock);
+        string error;
+        Bin* bin = binFor(original.parent_path(), error);
+        if (!bin) {
+            cerr << "Error: " << error << "." << endl;
+            return 500;
+        }
+        if (isWithin(original, bin->directory) || isWithin(bin->directory, original)) {
+            cerr << "Error: Path is part of the trash." << endl;
+            return 400;
+        }
+
+        auto now = chrono::system_clock::now();
+        char name[32];
+        snprintf(name, sizeof(name), "%016llx-%08x",
+            static_cast<unsigned long long>(chrono::duration_cast<chrono::nanoseconds>(now.time_since_epoch()).count()),
+            static_cast<unsigned>(sequence++));
+        TrashEntry entry;
+        entry.originalPath = original.string();
+        entry.deletedAt = chrono::duration_cast<chrono::seconds>(now.time_since_epoch()).count();
+        entry.directory = fs::is_directory(fs::symlink_status(original));
+
+        if (!appendRecord(*bin, string("+ ") + name + " " + to_string(entry.deletedAt) + (entry.directory ? " d " : " f ")
+            + escapePath(original.u8string()))) {
+            cerr << "Error: Unable to update the trash index." << endl;
+            return 500;
+        }
+        fs::path stored = bin->directory / filesName / name;
+        error_code ec;
+        fs::rename(original, stored, ec);
+        if (ec) {
+            appendRecord(*bin, string("- ") + name);
+            cerr << "Error moving to the trash: " << ec.message() << endl;
+            return 500;
+        }
+        bin->items.emplace(name, entry);
+        DirectorySizeCache::invalidate(stored);
+        wake.notify_one();
+        return 200;
+    }
+    catch (const exception& e) {
+        cerr << "Error moving to the trash: " << e.what() << endl;
+        return 500;
+    }
+}
+
+/**
+ * @brief Moves the most recently deleted entry with the given original path back to it.
+ * @param originalPath Path the entry was deleted from.
+ * @param restoredTo Receives the absolute path the entry is moved back to.
+ * @return HTTP-like status code:
+ * - 200: Success.
+ * - 404: The trash holds no entry deleted from this path.
+ * - 400: The path exists again.
+ * - 500: Other errors.
+ */
+int Trash::restore(const string& originalPath, string& restoredTo) {
+    try {
+        fs::path target = resolveEntry(originalPath);
+        restoredTo = target.string();
+        lock_guard<mutex> guard(lock);
+        loadAllBins();
+
+        Bin* bin = nullptr;
+        string name;
+        for (auto& loaded : bins) {
+            for (const auto& item : loaded.second->items) {
+                if (fs::path(item.second.originalPath) == target && (!bin || item.first > name)) {
+                    bin = loaded.second.get();
+                    name = item.first;
+                }
+            }
+        }
+        if (!bin) {
+            cerr << "Error: The trash holds nothing deleted from this path." << endl;
+            return 404;
+        }
+        if (fs::exists(fs::symlink_status(target))) {
+            cerr << "Error: Path already exists." << endl;
+            return 400;
+        }
+
+        fs::path stored = bin->directory / filesName / name;
+        fs::create_directories(target.parent_path());
+        fs::rename(stored, target);
+        auto item = bin->items.find(name);
+        if (item->second.measured) {
+            used -= item->second.bytes;
+        }
+        bin->items.erase(item);
+        appendRecord(*bin, "- " + name);
+        DirectorySizeCache::invalidate(stored);
+        return 200;
+    }
+    catch (const exception& e) {
+        cerr << "Error restoring from the trash: " << e.what() << endl;
+        return 500;
+    }
+}
+
+/**
+ * @brief Lists the entries of every known bin.
+ * @param entries Receives the entries, most recently deleted first.
+ * @return HTTP-like status code:
+ * - 200: Success.
+ * - 204: The trash is empty.
+ */
+int Trash::list(vector<TrashEntry>& entries) {
+    lock_guard<mutex> guard(lock);
+    loadAllBins();
+    vector<pair<string, TrashEntry>> named;
+    for (const auto& loaded : bins) {
+        named.insert(named.end(), loaded.second->items.begin(), loaded.second->items.end());
+    }
+    sort(named.begin(), named.end(), [](const auto& a, const auto& b) { return a.first > b.first; });
+    for (auto& item : named) {
+        entries.push_back(move(item.second));
+    }
+    return named.empty() ? 204 : 200;
+}
+
+/**
+ * @brief Removes every entry for good. The indexes are emptied first, then the entries are removed.
+ * @param removed Receives the number of entries removed.
+ * @return HTTP-like status code:
+ * - 200: Success.
+ * - 207: Some entries could not be removed completely.
+ */
+int Trash::empty(size_t& removed) {
+    vector<fs::path> paths;
+    {
+        lock_guard<mutex> guard(lock);
+        loadAllBins();
+        for (auto& loaded : bins) {
+            for (const auto& item : loaded.second->items) {
+                paths.push_back(loaded.second->directory / filesName / fs::u8path(item.first));
+            }
+            loaded.second->items.clear();
+            compact(*loaded.second);
+        }
+        used = 0;
+    }
+
+    atomic<bool> never{ false };
+    size_t failures = 0;
+    for (const auto& path : paths) {
+        if (removeEntry(path, never)) {
+            ++removed;
+        }
+        else {
+            cerr << "Error: Unable to remove " << path.string() << endl;
+            ++failures;
+        }
+        DirectorySizeCache::invalidate(path);
+    }
+    return failures > 0 ? 207 : 200;
+}
+
+/**
+ * @brief Returns the capacity in bytes.
+ */
+uint64_t Trash::capacity() {
+    lock_guard<mutex> guard(lock);
+    return limit;
+}
+
+/**
+ * @brief Sets and stores the capacity; the background thread evicts entries above it.
+ * @param bytes New capacity in bytes.
+ * @return HTTP-like status code:
+ * - 200: Success.
+ * - 207: The capacity applies, but could not be stored.
+ */
+int Trash::setCapacity(uint64_t bytes) {
+    {
+        lock_guard<mutex> guard(lock);
+        limit = bytes;
+    }
+    wake.notify_one();
+    if (!writeCacheFile(capacityPath(), to_string(bytes) + "\n")) {
+        cerr << "Error: Unable to store the trash capacity." << endl;
+        return 207;
+    }
+    return 200;
+}
@@ -0,0 +1,165 @@
+/**
+ * @file Trash.h
+ * @brief Declares the Trash class, a size-capped store of deleted files and directories that can be restored.
+ */
+
+#ifndef TRASH_H
+#define TRASH_H
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+/**
+ * @struct TrashEntry
+ * @brief An entry held in the trash.
+ */
+struct TrashEntry {
+    std::string originalPath;    ///< Absolute path the entry was deleted from.
+    std::int64_t deletedAt = 0;  ///< Time of deletion in seconds since the Unix epoch.
+    std::uint64_t bytes = 0;     ///< Total size of the files in the entry; valid once measured.
+    bool measured = false;       ///< Whether the size has been determined yet.
+    bool directory = false;      ///< Whether the entry is a directory.
+};
+
+/**
+ * @class Trash
+ * @brief Holds deleted entries until they are restored or evicted to stay within a byte capacity.
+ *
+ * Every filesystem has its own bin, so moving an entry to the trash is a rename and costs the
+ * same however large the entry is. The bin of the filesystem holding the cache directory lives
+ * in that directory; on other filesystems it is a hidden directory at the root of the volume.
+ * A bin holds the entries under generated names and an append-only index recording for each
+ * one its original path, the time of deletion and, once known, its size.
+ *
+ * Measuring entries and evicting them is left to a background thread. It adds up the sizes of
+ * new entries and, while the entries of all bins together exceed the capacity, removes the one
+ * deleted longest ago, so the trash keeps the most recent deletions. Indexes are compacted once
+ * most of their records describe entries that are gone. A bin is meant to be managed by one
+ * process at a time.
+ */
+class Trash {
+public:
+    /**
+     * @brief Capacity used until another one is set.
+     */
+    static constexpr std::uint64_t defaultCapacity = 10ULL << 30;
+
+    /**
+     * @brief Retrieves the trash, starting its background thread on first use.
+     * @return Reference to the Trash instance.
+     */
+    static Trash& getInstance();
+
+    Trash(const Trash&) = delete;
+    Trash& operator=(const Trash&) = delete;
+
+    /**
+     * @brief Moves a file, directory or symbolic link into the bin of its filesystem.
+     * @param path The entry to move; it must exist.
+     * @return Status code: 200 on success, 400 if the entry is a bin or lies inside one, 500 if it
+     * cannot be moved, for example because no bin can be created on its filesystem.
+     */
+    int moveToTrash(const std::filesystem::path& path);
+
+    /**
+     * @brief Moves the most recently deleted entry with the given original path back to it.
+     * Missing parent directories are created.
+     * @param originalPath Path the entry was deleted from.
+     * @param restoredTo Receives the absolute path the entry is moved back to.
+     * @return Status code: 200 on success, 404 if the trash holds no such entry, 400 if the
+     * path exists again, 500 on other errors.
+     */
+    int restore(const std::string& originalPath, std::string& restoredTo);
+
+    /**
+     * @brief Lists the entries of every known bin.
+     * @param entries Receives the entries, most recently deleted first.
+     * @return Status code: 200 on success, 204 if the trash is empty.
+     */
+    int list(std::vector<TrashEntry>& entries);
+
+    /**
+     * @brief Removes every entry for good.
+     * @param removed Receives the number of entries removed.
+     * @return Status code: 200 on success, 207 if some entries could not be removed completely.
+     */
+    int empty(std::size_t& removed);
+
+    /**
+     * @brief Returns the capacity in bytes.
+     */
+    std::uint64_t capacity();
+
+    /**
+     * @brief Sets and stores the capacity; entries above it are evicted in the background.
+     * @param bytes New capacity in bytes.
+     * @return Status code: 200 on success, 207 if it applies only until the program exits.
+     */
+    int setCapacity(std::uint64_t bytes);
+
+private:
+    /**
+     * @brief The bin of one filesystem.
+     */
+    struct Bin {
+        std::filesystem::path directory;
+        std::map<std::string, TrashEntry> items; ///< Entries by generated name, which sorts by time of deletion.
+        std::vector<std::string> orphans;        ///< Stored entries the index does not know, left to be removed.
+        std::size_t records = 0;                 ///< Records in the index file.
+    };
+
+    Trash();
+    ~Trash();
+
+    /**
+     * @brief Returns the bin for entries of a directory, creating it if needed; the lock must be held.
+     */
+    Bin* binFor(const std::filesystem::path& parent, std::string& error);
+
+    /**
+     * @brief Reads a bin's index; the lock must be held.
+     */
+    Bin* loadBin(const std::filesystem::path& directory, std::uint64_t device);
+
+    /**
+     * @brief Loads every bin listed in the registry; the lock must be held.
+     */
+    void loadAllBins();
+
+    /**
+     * @brief Appends one record to a bin's index.
+     */
+    bool appendRecord(Bin& bin, const std::string& record);
+
+    /**
+     * @brief Rewrites a bin's index with the records of the remaining entries only.
+     */
+    void compact(Bin& bin);
+
+    /**
+     * @brief Body of the background thread.
+     */
+    void maintain();
+
+    std::mutex lock;
+    std::condition_variable wake;
+    std::unordered_map<std::uint64_t, std::unique_ptr<Bin>> bins; ///< Loaded bins by device.
+    std::uint64_t limit = defaultCapacity;
+    std::uint64_t used = 0;          ///< Size of the measured entries of all loaded bins.
+    std::uint32_t sequence = 0;      ///< Distinguishes entries deleted within the same clock tick.
+    bool allLoaded = false;
+    std::atomic<bool> stopping{ false };
+    std::thread worker;
+};
+
+#endif // TRASH_H
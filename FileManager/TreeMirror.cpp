@@ -0,0 +1,522 @@
+/**
+ * @file TreeMirror.cpp
+ * @brief Implementation of the event-driven one-way mirror.
+ */
+
+#include "TreeMirror.h"
+#include "DirectoryMonitor.h"
+#include "DirectoryWalker.h"
+#include "ParallelFor.h"
+#include "Sha256.h"
+#include <algorithm>
+#include <iostream>
+#include <map>
+#include <system_error>
+#include <utility>
+#include <vector>
+
+using namespace std;
+namespace fs = filesystem;
+
+namespace {
+
+using Clock = chrono::steady_clock;
+
+/**
+ * @brief What reconciliation compares for one entry.
+ */
+struct EntryInfo {
+    fs::file_type type = fs::file_type::none;
+    uintmax_t size = 0;
+    fs::file_time_type modified;
+};
+
+/**
+ * @brief A path named by events, waiting to be applied.
+ */
+struct DirtyPath {
+    Clock::time_point lastChange;
+    bool changed = false; ///< Written, or for a directory created or moved in.
+};
+
+/**
+ * @brief Joins a base directory and a relative path that may be empty.
+ */
+fs::path under(const fs::path& base, const fs::path& relative) {
+    return relative.empty() ? base : base / relative;
+}
+
+/**
+ * @brief Checks whether a path equals or lies inside another path, comparing elements.
+ */
+bool isWithin(const fs::path& path, const fs::path& ancestor) {
+    auto mismatch = std::mismatch(ancestor.begin(), ancestor.end(), path.begin(), path.end());
+    return mismatch.first == ancestor.end();
+}
+
+/**
+ * @brief Lists every entry below a directory with a parallel walk.
+ * @return The entries keyed by their path relative to root, parents before children.
+ */
+map<fs::path, EntryInfo> listTree(const fs::path& root, unsigned threads) {
+    WalkOptions walkOptions;
+    walkOptions.ordered = false;
+    walkOptions.threads = threads;
+    DirectoryWalker walker(walkOptions);
+    vector<vector<pair<fs::path, EntryInfo>>> entriesPerWorker(walker.threadCount());
+    walker.walk({ root }, [&](const fs::directory_entry& entry, unsigned worker) {
+        error_code ec;
+        EntryInfo info;
+        info.type = entry.symlink_status(ec).type();
+        if (info.type == fs::file_type::regular) {
+            info.size = entry.file_size(ec);
+        }
+        if (info.type != fs::file_type::symlink) {
+            info.modified = entry.last_write_time(ec);
+        }
+        entriesPerWorker[worker].push_back({ entry.path().lexically_relative(root), info });
+        return WalkAction::Continue;
+    });
+
+    map<fs::path, EntryInfo> entries;
+    for (auto& worker : entriesPerWorker) {
+        for (auto& entry : worker) {
+            entries.insert(move(entry));
+        }
+    }
+    return entries;
+}
+
+} // namespace
+
+/**
+ * @brief Constructs a mirror.
+ * @param source Directory to mirror.
+ * @param destination Replica directory; created if missing.
+ * @param options Coalescing and audit options.
+ * @param onChange Optional; receives every change made to the replica.
+ */
+TreeMirror::TreeMirror(const string& source, const string& destination, const MirrorOptions& options,
+    ChangeHandler onChange)
+    : source(source), destination(destination), options(options), onChange(move(onChange)) {
+}
+
+/**
+ * @brief Counts a change and passes it to the handler.
+ * @param change Kind of change.
+ * @param relative Path of the changed entry relative to the replica.
+ */
+void TreeMirror::record(MirrorChange change, const fs::path& relative) {
+    lock_guard<mutex> guard(reportLock);
+    switch (change) {
+    case MirrorChange::Copied:
+        ++report->copied;
+        break;
+    case MirrorChange::Created:
+        ++report->created;
+        break;
+    case MirrorChange::Removed:
+        ++report->removed;
+        break;
+    case MirrorChange::Moved:
+        ++report->moved;
+        break;
+    case MirrorChange::Repaired:
+        ++report->repaired;
+        break;
+    }
+    if (onChange) {
+        onChange(change, relative.string());
+    }
+}
+
+/**
+ * @brief Counts and reports an entry that could not be mirrored.
+ * @param relative Path of the entry relative to the source.
+ * @param message Description of the error.
+ */
+void TreeMirror::fail(const fs::path& relative, const string& message) {
+    lock_guard<mutex> guard(reportLock);
+    ++report->failures;
+    cerr << "Error mirroring " << relative.string() << ": " << message << endl;
+}
+
+/**
+ * @brief Removes a replica entry and everything below it.
+ * @param relative Path of the entry relative to the replica.
+ */
+void TreeMirror::remove(const fs::path& relative) {
+    error_code ec;
+    if (fs::remove_all(under(destination, relative), ec) > 0) {
+        record(MirrorChange::Removed, relative);
+    }
+    else if (ec) {
+        fail(relative, ec.message());
+    }
+}
+
+/**
+ * @brief Copies a file over its replica through a temporary file next to it, then gives the
+ * replica the source's modification time as read before copying. A source written during
+ * the copy thus keeps a newer time, and the next reconciliation copies it again.
+ * @param relative Path of the file relative to the source.
+ * @param change Reported as Copied for ordinary updates and as Repaired by audits.
+ */
+void TreeMirror::copyFile(const fs::path& relative, MirrorChange change) {
+    fs::path from = under(source, relative);
+    fs::path to = under(destination, relative);
+    fs::path temporary = to.parent_path() / ("." + to.filename().string() + ".mirror");
+    error_code ec;
+    fs::file_time_type modified = fs::last_write_time(from, ec);
+    if (!ec) {
+        fs::copy_file(from, temporary, fs::copy_options::overwrite_existing, ec);
+    }
+    if (!ec) {
+        fs::last_write_time(temporary, modified, ec);
+    }
+    error_code missing;
+    if (!ec && fs::is_directory(fs::symlink_status(to, missing))) {
+        fs::remove_all(to, ec);
+    }
+    if (!ec) {
+        fs::rename(temporary, to, ec);
+    }
+    if (ec) {
+        error_code ignored;
+        fs::remove(temporary, ignored);
+        if (fs::exists(fs::symlink_status(from, ignored))) {
+            fail(relative, ec.message());
+        }
+        return;
+    }
+    record(change, relative);
+}
+
+/**
+ * @brief Recreates a symbolic link in the replica with the same target.
+ * @param relative Path of the link relative to the source.
+ */
+void TreeMirror::copySymlink(const fs::path& relative) {
+    error_code ec;
+    fs::remove_all(under(destination, relative), ec);
+    if (!ec) {
+        fs::copy_symlink(under(source, relative), under(destination, relative), ec);
+    }
+    if (ec) {
+        fail(relative, ec.message());
+        return;
+    }
+    record(MirrorChange::Created, relative);
+}
+
+/**
+ * @brief Makes the replica of a directory match the source.
+ * Both trees are listed with parallel walks. Entries missing from the replica or differing in
+ * type are created; files differing in size or modification time are copied in parallel;
+ * replica entries missing from the source are removed. An audit also compares the SHA-256
+ * digests of files whose metadata match.
+ * @param relative Path of the directory relative to the source; empty for the root.
+ * @param audit Whether files with matching metadata are also compared by checksum.
+ */
+void TreeMirror::reconcile(const fs::path& relative, bool audit) {
+    error_code ec;
+    fs::path sourceRoot = under(source, relative);
+    fs::path replicaRoot = under(destination, relative);
+    if (!fs::is_directory(fs::symlink_status(sourceRoot, ec))) {
+        sync(relative, false);
+        return;
+    }
+    fs::file_status replicaStatus = fs::symlink_status(replicaRoot, ec);
+    if (fs::exists(replicaStatus) && !fs::is_directory(replicaStatus)) {
+        remove(relative);
+    }
+    if (!fs::is_directory(fs::symlink_status(replicaRoot, ec))) {
+        fs::create_directory(replicaRoot, sourceRoot, ec);
+        if (ec) {
+            fail(relative, ec.message());
+            return;
+        }
+        record(MirrorChange::Created, relative);
+    }
+
+    map<fs::path, EntryInfo> sourceEntries = listTree(sourceRoot, options.threads);
+    map<fs::path, EntryInfo> replicaEntries = listTree(replicaRoot, options.threads);
+    vector<fs::path> copies;
+    vector<fs::path> audited;
+    for (const auto& entry : sourceEntries) {
+        fs::path path = under(relative, entry.first);
+        const EntryInfo& info = entry.second;
+        auto replica = replicaEntries.find(entry.first);
+        bool present = replica != replicaEntries.end();
+        if (present && replica->second.type != info.type) {
+            remove(path);
+            present = false;
+        }
+
+        switch (info.type) {
+        case fs::file_type::directory:
+            if (!present) {
+                fs::create_directory(under(destination, path), under(source, path), ec);
+                if (ec) {
+                    fail(path, ec.message());
+                }
+                else {
+                    record(MirrorChange::Created, path);
+                }
+            }
+            break;
+        case fs::file_type::regular:
+            if (!present || replica->second.size != info.size || replica->second.modified != info.modified) {
+                copies.push_back(path);
+            }
+            else if (audit) {
+                audited.push_back(path);
+            }
+            break;
+        case fs::file_type::symlink:
+            if (!present || fs::read_symlink(under(source, path), ec) != fs::read_symlink(under(destination, path), ec)) {
+                copySymlink(path);
+            }
+            break;
+        default:
+            break;
+        }
+        if (replica != replicaEntries.end()) {
+            replicaEntries.erase(replica);
+        }
+    }
+
+    // Whatever is left exists only in the replica; descendants follow their directory and go with it.
+    fs::path removedDirectory;
+    for (const auto& entry : replicaEntries) {
+        if (!removedDirectory.empty() && isWithin(entry.first, removedDirectory)) {
+            continue;
+        }
+        remove(under(relative, entry.first));
+        removedDirectory = entry.first;
+    }
+
+    parallelFor(copies.size(), options.threads, [&](size_t index, unsigned) {
+        copyFile(copies[index], MirrorChange::Copied);
+    });
+    parallelFor(audited.size(), options.threads, [&](size_t index, unsigned) {
+        string sourceDigest, replicaDigest;
+        if (!Sha256::hashFile(under(source, audited[index]), sourceDigest)) {
+            return;
+        }
+        if (!Sha256::hashFile(under(destination, audited[index]), replicaDigest) || sourceDigest != replicaDigest) {
+            copyFile(audited[index], MirrorChange::Repaired);
+        }
+    });
+}
+
+/**
+ * @brief Makes one replica entry match the source as it is now.
+ * Missing sources are removed from the replica, files are copied when written or when their
+ * metadata differ, and directories that were created or moved in are reconciled as a whole.
+ * The permissions of files and directories are copied when only they changed.
+ * @param relative Path of the entry relative to the source.
+ * @param contentsChanged Whether the file was written, or the directory created or moved in.
+ */
+void TreeMirror::sync(const fs::path& relative, bool contentsChanged) {
+    error_code ec;
+    fs::path from = under(source, relative);
+    fs::path to = under(destination, relative);
+    fs::file_status status = fs::symlink_status(from, ec);
+    if (!fs::exists(status)) {
+        remove(relative);
+        return;
+    }
+    fs::file_status replica = fs::symlink_status(to, ec);
+    if (fs::exists(replica) && replica.type() != status.type()) {
+        remove(relative);
+        replica = fs::file_status(fs::file_type::not_found);
+    }
+    if (!fs::is_directory(to.parent_path(), ec)) {
+        reconcile(relative.parent_path(), false);
+        return;
+    }
+
+    if (fs::is_directory(status)) {
+        if (contentsChanged || !fs::exists(replica)) {
+            reconcile(relative, false);
+        }
+        if (fs::exists(replica) && status.permissions() != replica.permissions()) {
+            fs::permissions(to, status.permissions(), ec);
+        }
+    }
+    else if (fs::is_regular_file(status)) {
+        if (contentsChanged || !fs::exists(replica) || fs::file_size(from, ec) != fs::file_size(to, ec)
+            || fs::last_write_time(from, ec) != fs::last_write_time(to, ec)) {
+            copyFile(relative, MirrorChange::Copied);
+        }
+        else if (status.permissions() != replica.permissions()) {
+            fs::permissions(to, status.permissions(), ec);
+        }
+    }
+    else if (fs::is_symlink(status)) {
+        if (!fs::exists(replica) || fs::read_symlink(from, ec) != fs::read_symlink(to, ec)) {
+            copySymlink(relative);
+        }
+    }
+}
+
+/**
+ * @brief Repeats a rename within the source in the replica, so the data is not copied again.
+ * @param from Old path relative to the source.
+ * @param to New path relative to the source.
+ * @return False if the old path still exists in the source or is missing from the replica.
+ */
+bool TreeMirror::moveReplica(const fs::path& from, const fs::path& to) {
+    error_code ec;
+    fs::path oldReplica = under(destination, from);
+    fs::path newReplica = under(destination, to);
+    if (fs::exists(fs::symlink_status(under(source, from), ec)) || !fs::exists(fs::symlink_status(oldReplica, ec))
+        || !fs::is_directory(newReplica.parent_path(), ec)) {
+        return false;
+    }
+    if (fs::exists(fs::symlink_status(newReplica, ec))) {
+        fs::remove_all(newReplica, ec);
+    }
+    fs::rename(oldReplica, newReplica, ec);
+    if (ec) {
+        return false;
+    }
+    record(MirrorChange::Moved, to);
+    return true;
+}
+
+/**
+ * @brief Reconciles the replica, then keeps it current until the stop condition holds.
+ * The source is monitored before the initial reconciliation, so changes made meanwhile are
+ * not lost. Each event marks its path dirty; renames are repeated at once, and dirty paths
+ * are applied in path order, parents first, once quiet. Paths below a directory that was just
+ * reconciled are dropped, since the reconciliation already covered them.
+ * @param stop Stop condition.
+ * @param report Receives the counts of changes made.
+ * @return HTTP-like status code:
+ * - 200: Stopped.
+ * - 207: Some entries could not be mirrored.
+ * - 400: The source is not a directory, or one tree lies inside the other.
+ * - 404: The source does not exist.
+ * - 500: Other errors.
+ */
+int TreeMirror::run(const StopCondition& stop, MirrorReport& report) {
+    try {
+        this->report = &report;
+        if (!fs::exists(source)) {
+            cerr << "Error: Source does not exist." << endl;
+            return 404;
+        }
+        if (!fs::is_directory(source)) {
+            cerr << "Error: Source is not a directory." << endl;
+            return 400;
+        }
+        source = fs::canonical(source);
+        fs::path replica = fs::weakly_canonical(destination);
+        if (isWithin(replica, source) || isWithin(source, replica)) {
+            cerr << "Error: Source and destination overlap." << endl;
+            return 400;
+        }
+        fs::create_directories(replica);
+        destination = fs::canonical(replica);
+
+        DirectoryMonitor monitor(source, true);
+        reconcile(fs::path(), false);
+
+        map<fs::path, DirtyPath> dirty;
+        vector<ChangeEvent> events;
+        Clock::time_point lastAudit = Clock::now();
+        Clock::time_point lastRescan = lastAudit;
+        for (;;) {
+            bool stopping = stop();
+            bool overflow = false;
+            if (!stopping && monitor.wait(pollInterval, events)) {
+                Clock::time_point now = Clock::now();
+                auto mark = [&](const fs::path& path, bool changed) {
+                    DirtyPath& entry = dirty[path];
+                    entry.lastChange = now;
+                    entry.changed = entry.changed || changed;
+                };
+                for (const auto& event : events) {
+                    fs::path path(event.name);
+                    switch (event.kind) {
+                    case ChangeKind::Overflow:
+                        overflow = true;
+                        break;
+                    case ChangeKind::MovedIn:
+                        if (!event.from.empty() && moveReplica(event.from, path)) {
+                            // Changes still pending below the old path now apply below the new one.
+                            fs::path from(event.from);
+                            vector<pair<fs::path, DirtyPath>> moved;
+                            for (auto it = dirty.begin(); it != dirty.end();) {
+                                if (isWithin(it->first, from)) {
+                                    moved.push_back({ path / it->first.lexically_relative(from), it->second });
+                                    it = dirty.erase(it);
+                                }
+                                else {
+                                    ++it;
+                                }
+                            }
+                            for (auto& entry : moved) {
+                                dirty[entry.first] = entry.second;
+                            }
+                            mark(path, false);
+                        }
+                        else {
+                            if (!event.from.empty()) {
+                                mark(fs::path(event.from), false);
+                            }
+                            mark(path, true);
+                        }
+                        break;
+                    case ChangeKind::Created:
+                    case ChangeKind::Modified:
+                    case ChangeKind::Closed:
+                        mark(path, true);
+                        break;
+                    case ChangeKind::Removed:
+                    case ChangeKind::Attributes:
+                        mark(path, false);
+                        break;
+                    }
+                }
+            }
+
+            Clock::time_point now = Clock::now();
+            if (overflow || (!monitor.isNative() && now - lastRescan >= rescanInterval)) {
+                reconcile(fs::path(), false);
+                dirty.clear();
+                lastRescan = now;
+            }
+            fs::path reconciled;
+            for (auto it = dirty.begin(); it != dirty.end();) {
+                if (!stopping && now - it->second.lastChange < options.quietPeriod) {
+                    ++it;
+                    continue;
+                }
+                if (reconciled.empty() || !isWithin(it->first, reconciled)) {
+                    sync(it->first, it->second.changed);
+                    error_code ec;
+                    if (it->second.changed && fs::is_directory(fs::symlink_status(under(source, it->first), ec))) {
+                        reconciled = it->first;
+                    }
+                }
+                it = dirty.erase(it);
+            }
+            if (options.auditInterval.count() > 0 && now - lastAudit >= options.auditInterval) {
+                reconcile(fs::path(), true);
+                ++report.audits;
+                lastAudit = Clock::now();
+            }
+            if (stopping) {
+                break;
+            }
+        }
+        return report.failures > 0 ? 207 : 200;
+    }
+    catch (const exception& e) {
+        cerr << "Error mirroring: " << e.what() << endl;
+        return 500;
+    }
+}
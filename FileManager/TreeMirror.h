@@ -0,0 +1,178 @@
+/**
+ * @file TreeMirror.h
+ * @brief Declares the TreeMirror class, which keeps a replica of a directory tree up to date from change events.
+ */
+
+#ifndef TREE_MIRROR_H
+#define TREE_MIRROR_H
+
+#include <chrono>
+#include <cstddef>
+#include <filesystem>
+#include <functional>
+#include <mutex>
+#include <string>
+
+/**
+ * @brief Kind of change made to the replica.
+ */
+enum class MirrorChange {
+    Copied,   ///< A file was copied or updated.
+    Created,  ///< A directory or symbolic link was created.
+    Removed,  ///< An entry was removed because it is gone from the source.
+    Moved,    ///< An entry was renamed to follow a rename in the source.
+    Repaired  ///< An audit found a file with different contents and copied it again.
+};
+
+/**
+ * @struct MirrorOptions
+ * @brief Tunes how a TreeMirror coalesces changes and audits the replica.
+ */
+struct MirrorOptions {
+    /**
+     * @brief Time a changed path must stay quiet before it is applied, so bursts of writes are copied once.
+     */
+    std::chrono::milliseconds quietPeriod{ 200 };
+
+    /**
+     * @brief Time between checksum audits of the whole replica; zero disables them.
+     */
+    std::chrono::seconds auditInterval{ 3600 };
+
+    /**
+     * @brief Number of threads for walking and copying; 0 selects the hardware concurrency.
+     */
+    unsigned threads = 0;
+};
+
+/**
+ * @struct MirrorReport
+ * @brief Changes made to the replica while mirroring.
+ */
+struct MirrorReport {
+    std::size_t copied = 0;      ///< Files copied or updated.
+    std::size_t created = 0;     ///< Directories and symbolic links created.
+    std::size_t removed = 0;     ///< Entries removed.
+    std::size_t moved = 0;       ///< Entries renamed.
+    std::size_t audits = 0;      ///< Checksum audits completed.
+    std::size_t repaired = 0;    ///< Files the audits found different.
+    std::size_t failures = 0;    ///< Entries that could not be mirrored.
+};
+
+/**
+ * @class TreeMirror
+ * @brief One-way mirror of a directory tree, kept current from filesystem events.
+ *
+ * Mirroring starts with one reconciliation that walks both trees and copies, creates and
+ * removes whatever differs by type, size or modification time. From then on the source
+ * tree is monitored, and only the paths named by events are examined: each changed path
+ * waits until it has been quiet for the quiet period and is then made to match the source
+ * as it is at that moment, so any burst of changes to a path costs one copy and the order
+ * in which events arrive does not matter. A rename within the source is repeated in the
+ * replica instead of copying the data again. New directories are reconciled as a whole,
+ * since files can land in them before their watch exists, and an event queue overflow
+ * triggers a full reconciliation.
+ *
+ * Steady-state cost therefore follows the rate of change. Periodic audits compare the
+ * SHA-256 digests of all files to catch anything the events missed. Files are replaced
+ * through a temporary file and a rename, so readers of the replica never see partial files.
+ * Where the platform delivers no events, the trees are reconciled every rescan interval.
+ */
+class TreeMirror {
+public:
+    /**
+     * @brief Receives every change made to the replica; calls are serialized.
+     */
+    using ChangeHandler = std::function<void(MirrorChange change, const std::string& path)>;
+
+    /**
+     * @brief Polled regularly; mirroring ends once it returns true.
+     */
+    using StopCondition = std::function<bool()>;
+
+    /**
+     * @brief Longest time between checks of the stop condition.
+     */
+    static constexpr std::chrono::milliseconds pollInterval{ 200 };
+
+    /**
+     * @brief Time between reconciliations where the platform delivers no events.
+     */
+    static constexpr std::chrono::seconds rescanInterval{ 10 };
+
+    /**
+     * @brief Constructs a mirror.
+     * @param source Directory to mirror.
+     * @param destination Replica directory; created if missing.
+     * @param options Coalescing and audit options.
+     * @param onChange Optional; receives every change made to the replica.
+     */
+    TreeMirror(const std::string& source, const std::string& destination, const MirrorOptions& options,
+        ChangeHandler onChange = nullptr);
+
+    /**
+     * @brief Reconciles the replica, then keeps it current until the stop condition holds.
+     * Changes still waiting for their quiet period are applied before returning.
+     * @param stop Stop condition.
+     * @param report Receives the counts of changes made.
+     * @return Status code: 200 when stopped, 207 if some entries could not be mirrored, 404 if
+     * the source does not exist, 400 if it is not a directory or the trees overlap, 500 on other errors.
+     */
+    int run(const StopCondition& stop, MirrorReport& report);
+
+private:
+    /**
+     * @brief Makes the replica of a directory match the source by type, size and modification time.
+     * @param relative Path of the directory relative to the source; empty for the root.
+     * @param audit Whether files with matching metadata are also compared by checksum.
+     */
+    void reconcile(const std::filesystem::path& relative, bool audit);
+
+    /**
+     * @brief Makes one replica entry match the source as it is now.
+     * @param relative Path of the entry relative to the source.
+     * @param contentsChanged Whether the file was written, or the directory created or moved in, so it is
+     * copied or reconciled even if it looks current.
+     */
+    void sync(const std::filesystem::path& relative, bool contentsChanged);
+
+    /**
+     * @brief Repeats a rename within the source in the replica.
+     * @return False if the replica entry cannot simply be renamed and must be copied instead.
+     */
+    bool moveReplica(const std::filesystem::path& from, const std::filesystem::path& to);
+
+    /**
+     * @brief Copies a file over its replica through a temporary file.
+     */
+    void copyFile(const std::filesystem::path& relative, MirrorChange change);
+
+    /**
+     * @brief Recreates a symbolic link in the replica.
+     */
+    void copySymlink(const std::filesystem::path& relative);
+
+    /**
+     * @brief Removes a replica entry and everything below it.
+     */
+    void remove(const std::filesystem::path& relative);
+
+    /**
+     * @brief Counts a change and passes it to the handler.
+     */
+    void record(MirrorChange change, const std::filesystem::path& relative);
+
+    /**
+     * @brief Counts and reports an entry that could not be mirrored.
+     */
+    void fail(const std::filesystem::path& relative, const std::string& message);
+
+    std::filesystem::path source;
+    std::filesystem::path destination;
+    MirrorOptions options;
+    ChangeHandler onChange;
+    MirrorReport* report = nullptr;
+    std::mutex reportLock;
+};
+
+#endif // TREE_MIRROR_H
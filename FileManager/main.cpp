@@ -5,25 +5,87 @@
 
 #include "FileManagerUI.h"
 #include "BaseFileManager.h"
+#include "Metrics.h"
+#include "Session.h"
+#include <cstdlib>
+#include <filesystem>
+#include <iostream>
+#include <string>
 #include <Windows.h>
 
  /**
   * @brief Main function to start the File Manager application.
   * Sets up the console encoding to support specific character sets
-  * and initializes the file manager and user interface.
+  * and initializes the file manager and user interface. If FILEMANAGER_METRICS_DIR is set,
+  * the operation metrics are exported to that directory from the start.
+  *
+  * Usage: FileManager [--record <session file> [--root <directory>]]
+  *        FileManager --replay <session file> --root <directory> [--paced]
+  * Recording saves every command with its input and timing; the root, the working
+  * directory by default, is the part of the paths that a replay moves to its own root.
+  * @param argc Number of command-line arguments.
+  * @param argv Command-line arguments.
   * @return int Exit status of the program.
   */
-int main() {
+int main(int argc, char* argv[]) {
     // Set console input and output encoding to Windows-1251 for proper character display.
     SetConsoleCP(1251);
     SetConsoleOutputCP(1251);
 
+    std::string recordFile, replayFile, root;
+    bool paced = false;
+    for (int i = 1; i < argc; ++i) {
+        std::string argument = argv[i];
+        if (argument == "--record" && i + 1 < argc) {
+            recordFile = argv[++i];
+        }
+        else if (argument == "--replay" && i + 1 < argc) {
+            replayFile = argv[++i];
+        }
+        else if (argument == "--root" && i + 1 < argc) {
+            root = argv[++i];
+        }
+        else if (argument == "--paced") {
+            paced = true;
+        }
+        else {
+            std::cerr << "Usage: FileManager [--record <session file> [--root <directory>]]\n"
+                << "       FileManager --replay <session file> --root <directory> [--paced]" << std::endl;
+            return 1;
+        }
+    }
+    if (!replayFile.empty() && (root.empty() || !recordFile.empty())) {
+        std::cerr << "A replay needs --root and cannot be recorded." << std::endl;
+        return 1;
+    }
+
     // Obtain the singleton instance of the file manager.
     BaseFileManager& manager = BaseFileManager::getInstance();
 
+    // Export metrics to a textfile collector directory if one is configured.
+    if (const char* metricsDirectory = std::getenv("FILEMANAGER_METRICS_DIR")) {
+        if (*metricsDirectory && Metrics::getInstance().startExport(metricsDirectory) != 200) {
+            std::cerr << "Cannot export metrics to " << metricsDirectory << std::endl;
+        }
+    }
+
     // Initialize the user interface with the file manager instance.
     FileManagerUI ui(manager);
 
+    // Replay a recorded session instead of starting the user interface if asked to.
+    if (!replayFile.empty()) {
+        return ui.replay(replayFile, root, paced) == 200 ? 0 : 1;
+    }
+
+    // Record the session if asked to.
+    SessionRecorder recorder;
+    if (!recordFile.empty()) {
+        if (recorder.open(recordFile, root.empty() ? std::filesystem::current_path().string() : root) != 200) {
+            return 1;
+        }
+        ui.setRecorder(&recorder);
+    }
+
     // Start the user interface.
     ui.start();
 
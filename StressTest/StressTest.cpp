@@ -0,0 +1,518 @@
+/**
+ * @file StressTest.cpp
+ * @brief Concurrency stress harness for BaseFileManager.
+ *
+ * For each thread count, the harness builds a fresh tree below the given root and lets the
+ * threads run randomized create, delete, rename, list and search operations on it for a fixed
+ * time. Operations on the same name are serialized by striped locks, so a shadow model of the
+ * tree knows the status every operation must return and the exact tree expected at the end;
+ * operations on different names, and all listings and searches, run concurrently. Throughput
+ * and latency percentiles are reported per operation and per thread count.
+ *
+ * Usage: StressTest <root> [--threads 1,2,4,8] [--seconds 3] [--seed 1]
+ */
+
+#include "BaseFileManager.h"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <filesystem>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <map>
+#include <mutex>
+#include <random>
+#include <sstream>
+#include <string>
+#include <system_error>
+#include <thread>
+#include <vector>
+
+using namespace std;
+namespace fs = filesystem;
+
+namespace {
+
+/**
+ * @brief Operations issued by the worker threads.
+ */
+enum class Operation { CreateFile, DeleteFile, Rename, CreateDirectory, DeleteDirectory, List, Search, Count };
+
+const char* const operationNames[] = { "create-file", "delete-file", "rename", "create-directory", "delete-directory",
+    "list", "search" };
+
+/**
+ * @brief Relative frequency of each operation; searches walk the whole tree and are rarer.
+ */
+const unsigned operationWeights[] = { 25, 20, 15, 6, 6, 24, 4 };
+
+const size_t operationCount = static_cast<size_t>(Operation::Count);
+
+/**
+ * @brief Shape of the tree and length of each round.
+ */
+struct Settings {
+    fs::path root;
+    vector<unsigned> threadCounts;
+    chrono::seconds duration{ 3 };
+    uint32_t seed = 1;
+    size_t directories = 8;     ///< Top-level directories d0, d1, ...; they are never removed.
+    size_t fileSlots = 64;      ///< Names f0, f1, ... in each directory that may hold a file.
+    size_t directorySlots = 8;  ///< Names s0, s1, ... in each directory that may hold an empty directory.
+};
+
+/**
+ * @brief Kind of entry the model expects at a name.
+ */
+enum class EntryType { File, Directory };
+
+/**
+ * @class ShadowTree
+ * @brief The entries that must exist in the tree, and the locks that serialize operations per name.
+ */
+class ShadowTree {
+public:
+    static const size_t stripeCount = 256;
+
+    /**
+     * @brief Returns the lock guarding a name.
+     */
+    mutex& stripe(const string& name) {
+        return stripes[hash<string>()(name) % stripeCount];
+    }
+
+    bool contains(const string& name) {
+        lock_guard<mutex> guard(lock);
+        return entries.count(name) != 0;
+    }
+
+    void insert(const string& name, EntryType type) {
+        lock_guard<mutex> guard(lock);
+        entries[name] = type;
+    }
+
+    void erase(const string& name) {
+        lock_guard<mutex> guard(lock);
+        entries.erase(name);
+    }
+
+    map<string, EntryType> snapshot() {
+        lock_guard<mutex> guard(lock);
+        return entries;
+    }
+
+private:
+    mutex stripes[stripeCount];
+    mutex lock;
+    map<string, EntryType> entries; ///< Keyed by path relative to the round directory, with '/' separators.
+};
+
+/**
+ * @brief Latencies and violations collected by one worker thread.
+ */
+struct WorkerResult {
+    vector<int64_t> latencies[operationCount]; ///< Nanoseconds.
+    vector<string> violations;
+    size_t violationCount = 0;
+};
+
+/**
+ * @brief Stream buffer that discards everything written to it.
+ */
+class NullBuffer : public streambuf {
+protected:
+    int_type overflow(int_type character) override {
+        return traits_type::not_eof(character);
+    }
+};
+
+/**
+ * @brief Returns whether a file name is one of the slot names the harness creates.
+ */
+bool isSlotName(const string& name) {
+    return name.size() > 1 && (name[0] == 'f' || name[0] == 's')
+        && all_of(name.begin() + 1, name.end(), [](char c) { return c >= '0' && c <= '9'; });
+}
+
+/**
+ * @brief Runs randomized operations until stopped.
+ */
+void runWorker(const Settings& settings, const fs::path& tree, ShadowTree& model, atomic<bool>& stop, uint32_t seed,
+    WorkerResult& result) {
+    BaseFileManager& manager = BaseFileManager::getInstance();
+    mt19937 random(seed);
+    discrete_distribution<size_t> pickOperation(begin(operationWeights), end(operationWeights));
+    uniform_int_distribution<size_t> pickDirectory(0, settings.directories - 1);
+    uniform_int_distribution<size_t> pickFile(0, settings.fileSlots - 1);
+    uniform_int_distribution<size_t> pickSubdirectory(0, settings.directorySlots - 1);
+
+    auto fileName = [&]() {
+        return "d" + to_string(pickDirectory(random)) + "/f" + to_string(pickFile(random));
+    };
+    auto fullPath = [&](const string& name) {
+        return (tree / fs::path(name)).string();
+    };
+    auto violation = [&](Operation operation, const string& name, const string& problem) {
+        if (++result.violationCount <= 10) {
+            result.violations.push_back(string(operationNames[static_cast<size_t>(operation)]) + " " + name + ": " + problem);
+        }
+    };
+    auto unexpectedStatus = [&](Operation operation, const string& name, int statusCode, int expected) {
+        violation(operation, name, "returned " + to_string(statusCode) + ", expected " + to_string(expected));
+    };
+
+    while (!stop.load(memory_order_relaxed)) {
+        Operation operation = static_cast<Operation>(pickOperation(random));
+        auto started = chrono::steady_clock::now();
+
+        switch (operation) {
+        case Operation::CreateFile: {
+            string name = fileName();
+            lock_guard<mutex> guard(model.stripe(name));
+            int statusCode = manager.createFile(fullPath(name));
+            if (statusCode == 200) {
+                model.insert(name, EntryType::File);
+            }
+            else {
+                unexpectedStatus(operation, name, statusCode, 200);
+            }
+            break;
+        }
+        case Operation::DeleteFile: {
+            string name = fileName();
+            lock_guard<mutex> guard(model.stripe(name));
+            int expected = model.contains(name) ? 200 : 404;
+            int statusCode = manager.deleteFile(fullPath(name));
+            if (statusCode == 200) {
+                model.erase(name);
+            }
+            if (statusCode != expected) {
+                unexpectedStatus(operation, name, statusCode, expected);
+            }
+            break;
+        }
+        case Operation::Rename: {
+            string source = fileName();
+            string target = fileName();
+            if (source == target) {
+                continue;
+            }
+            mutex* first = &model.stripe(source);
+            mutex* second = &model.stripe(target);
+            if (first > second) {
+                swap(first, second);
+            }
+            unique_lock<mutex> firstGuard(*first);
+            unique_lock<mutex> secondGuard;
+            if (second != first) {
+                secondGuard = unique_lock<mutex>(*second);
+            }
+            int expected = model.contains(source) ? 200 : 404;
+            int statusCode = manager.rename(fullPath(source), fullPath(target));
+            if (statusCode == 200) {
+                model.erase(source);
+                model.insert(target, EntryType::File);
+            }
+            if (statusCode != expected) {
+                unexpectedStatus(operation, source + " -> " + target, statusCode, expected);
+            }
+            break;
+        }
+        case Operation::CreateDirectory:
+        case Operation::DeleteDirectory: {
+            string name = "d" + to_string(pickDirectory(random)) + "/s" + to_string(pickSubdirectory(random));
+            lock_guard<mutex> guard(model.stripe(name));
+            bool exists = model.contains(name);
+            int expected, statusCode;
+            if (operation == Operation::CreateDirectory) {
+                expected = exists ? 400 : 200;
+                statusCode = manager.createDirectory(fullPath(name));
+                if (statusCode == 200) {
+                    model.insert(name, EntryType::Directory);
+                }
+            }
+            else {
+                expected = exists ? 200 : 404;
+                statusCode = manager.deleteDirectory(fullPath(name));
+                if (statusCode == 200) {
+                    model.erase(name);
+                }
+            }
+            if (statusCode != expected) {
+                unexpectedStatus(operation, name, statusCode, expected);
+            }
+            break;
+        }
+        case Operation::List: {
+            string name = "d" + to_string(pickDirectory(random));
+            vector<string> contents;
+            int statusCode = manager.listDirectoryContents(fullPath(name), contents);
+            if (statusCode != 200) {
+                unexpectedStatus(operation, name, statusCode, 200);
+            }
+            for (const auto& entry : contents) {
+                if (!isSlotName(fs::path(entry).filename().string())) {
+                    violation(operation, name, "unexpected entry " + entry);
+                }
+            }
+            break;
+        }
+        case Operation::Search: {
+            vector<string> results;
+            SearchOptions options;
+            options.threads = 2;
+            int statusCode = manager.searchFiles(tree.string(), "f", results, options);
+            if (statusCode != 200 && statusCode != 204) {
+                unexpectedStatus(operation, tree.string(), statusCode, 200);
+            }
+            for (const auto& file : results) {
+                if (fs::path(file).filename().string()[0] != 'f') {
+                    violation(operation, tree.string(), "unexpected result " + file);
+                }
+            }
+            break;
+        }
+        default:
+            break;
+        }
+
+        result.latencies[static_cast<size_t>(operation)].push_back(
+            chrono::duration_cast<chrono::nanoseconds>(chrono::steady_clock::now() - started).count());
+    }
+}
+
+/**
+ * @brief Compares the tree on disk with the model.
+ * @return Descriptions of the differences.
+ */
+vector<string> compareTree(const fs::path& tree, ShadowTree& model) {
+    vector<string> differences;
+    map<string, EntryType> expected = model.snapshot();
+    map<string, EntryType> actual;
+    error_code ec;
+    for (fs::recursive_directory_iterator it(tree, ec), end; !ec && it != end; it.increment(ec)) {
+        string name = it->path().lexically_relative(tree).generic_string();
+        actual[name] = it->is_directory() ? EntryType::Directory : EntryType::File;
+    }
+    if (ec) {
+        differences.push_back("Cannot walk the tree: " + ec.message());
+    }
+    for (const auto& [name, type] : expected) {
+        auto found = actual.find(name);
+        if (found == actual.end()) {
+            differences.push_back("missing " + name);
+        }
+        else if (found->second != type) {
+            differences.push_back("wrong type " + name);
+        }
+    }
+    for (const auto& [name, type] : actual) {
+        if (!expected.count(name)) {
+            differences.push_back("unexpected " + name);
+        }
+    }
+    return differences;
+}
+
+/**
+ * @brief Returns a percentile of sorted latencies in microseconds.
+ */
+double percentile(const vector<int64_t>& sorted, double fraction) {
+    if (sorted.empty()) {
+        return 0;
+    }
+    size_t index = min(sorted.size() - 1, static_cast<size_t>(fraction * sorted.size()));
+    return sorted[index] / 1000.0;
+}
+
+/**
+ * @brief Summary of one round, for the final table.
+ */
+struct RoundSummary {
+    unsigned threads = 0;
+    double throughput = 0;
+    double p50 = 0, p99 = 0, p999 = 0, max = 0;
+    size_t violations = 0;
+};
+
+/**
+ * @brief Prints a latency row.
+ */
+void printRow(const string& label, vector<int64_t>& latencies) {
+    sort(latencies.begin(), latencies.end());
+    cout << left << setw(18) << label << right << setw(10) << latencies.size() << setw(12) << percentile(latencies, 0.5)
+        << setw(12) << percentile(latencies, 0.99) << setw(12) << percentile(latencies, 0.999) << setw(12)
+        << (latencies.empty() ? 0 : latencies.back() / 1000.0) << "\n";
+}
+
+/**
+ * @brief Builds a tree, stresses it with a number of threads and checks it.
+ * @return The summary of the round.
+ */
+RoundSummary runRound(const Settings& settings, unsigned threads) {
+    RoundSummary summary;
+    summary.threads = threads;
+    fs::path tree = settings.root / ("stress-" + to_string(threads));
+    error_code ec;
+    fs::remove_all(tree, ec);
+    ShadowTree model;
+    for (size_t d = 0; d < settings.directories; ++d) {
+        fs::create_directories(tree / ("d" + to_string(d)), ec);
+        model.insert("d" + to_string(d), EntryType::Directory);
+    }
+    if (ec) {
+        cerr << "Cannot create the tree " << tree.string() << ": " << ec.message() << endl;
+        summary.violations = 1;
+        return summary;
+    }
+
+    // Expected failures print error messages; keep them out of the report.
+    NullBuffer discard;
+    streambuf* errors = cerr.rdbuf(&discard);
+
+    atomic<bool> stop{ false };
+    vector<WorkerResult> results(threads);
+    vector<thread> workers;
+    auto started = chrono::steady_clock::now();
+    for (unsigned i = 0; i < threads; ++i) {
+        workers.emplace_back(runWorker, cref(settings), cref(tree), ref(model), ref(stop), settings.seed * 7919 + i,
+            ref(results[i]));
+    }
+    this_thread::sleep_for(settings.duration);
+    stop = true;
+    for (auto& worker : workers) {
+        worker.join();
+    }
+    double seconds = chrono::duration<double>(chrono::steady_clock::now() - started).count();
+    cerr.rdbuf(errors);
+
+    vector<string> differences = compareTree(tree, model);
+
+    vector<int64_t> all;
+    vector<int64_t> byOperation[operationCount];
+    vector<string> violations;
+    for (auto& result : results) {
+        for (size_t op = 0; op < operationCount; ++op) {
+            byOperation[op].insert(byOperation[op].end(), result.latencies[op].begin(), result.latencies[op].end());
+        }
+        summary.violations += result.violationCount;
+        violations.insert(violations.end(), result.violations.begin(), result.violations.end());
+    }
+    summary.violations += differences.size();
+    for (const auto& latencies : byOperation) {
+        all.insert(all.end(), latencies.begin(), latencies.end());
+    }
+
+    cout << fixed << setprecision(1);
+    cout << "\n" << threads << " thread(s): " << all.size() << " operations in " << seconds << " s, "
+        << all.size() / seconds << " ops/s, " << summary.violations << " violation(s)\n";
+    cout << left << setw(18) << "Operation" << right << setw(10) << "Count" << setw(12) << "p50 us" << setw(12)
+        << "p99 us" << setw(12) << "p99.9 us" << setw(12) << "Max us" << "\n";
+    for (size_t op = 0; op < operationCount; ++op) {
+        printRow(operationNames[op], byOperation[op]);
+    }
+    printRow("all", all);
+    for (const auto& message : violations) {
+        cout << "  operation: " << message << "\n";
+    }
+    for (size_t i = 0; i < differences.size() && i < 10; ++i) {
+        cout << "  tree: " << differences[i] << "\n";
+    }
+
+    summary.throughput = all.size() / seconds;
+    summary.p50 = percentile(all, 0.5);
+    summary.p99 = percentile(all, 0.99);
+    summary.p999 = percentile(all, 0.999);
+    summary.max = all.empty() ? 0 : all.back() / 1000.0;
+
+    // Keep a damaged tree for inspection.
+    if (summary.violations == 0) {
+        fs::remove_all(tree, ec);
+    }
+    return summary;
+}
+
+/**
+ * @brief Parses a comma-separated list of thread counts.
+ */
+bool parseThreadCounts(const string& text, vector<unsigned>& counts) {
+    counts.clear();
+    istringstream input(text);
+    for (string item; getline(input, item, ',');) {
+        try {
+            unsigned long count = stoul(item);
+            if (count == 0 || count > 1024) {
+                return false;
+            }
+            counts.push_back(static_cast<unsigned>(count));
+        }
+        catch (const exception&) {
+            return false;
+        }
+    }
+    return !counts.empty();
+}
+
+} // namespace
+
+/**
+ * @brief Runs the stress rounds and prints the report.
+ * @return 0 if no round found a violation, 1 if one did, 2 on invalid arguments.
+ */
+int main(int argc, char* argv[]) {
+    Settings settings;
+    bool valid = argc >= 2;
+    if (valid) {
+        settings.root = argv[1];
+    }
+    for (int i = 2; valid && i < argc; ++i) {
+        string argument = argv[i];
+        try {
+            if (argument == "--threads" && i + 1 < argc) {
+                valid = parseThreadCounts(argv[++i], settings.threadCounts);
+            }
+            else if (argument == "--seconds" && i + 1 < argc) {
+                settings.duration = chrono::seconds(stoul(argv[++i]));
+                valid = settings.duration.count() > 0;
+            }
+            else if (argument == "--seed" && i + 1 < argc) {
+                settings.seed = static_cast<uint32_t>(stoul(argv[++i]));
+            }
+            else {
+                valid = false;
+            }
+        }
+        catch (const exception&) {
+            valid = false;
+        }
+    }
+    error_code ec;
+    if (!valid || !fs::is_directory(settings.root, ec)) {
+        cerr << "Usage: StressTest <existing root directory> [--threads 1,2,4,8] [--seconds 3] [--seed 1]" << endl;
+        return 2;
+    }
+    if (settings.threadCounts.empty()) {
+        unsigned limit = max(2u, thread::hardware_concurrency() * 2);
+        for (unsigned count = 1; count <= limit; count *= 2) {
+            settings.threadCounts.push_back(count);
+        }
+    }
+
+    vector<RoundSummary> summaries;
+    for (unsigned threads : settings.threadCounts) {
+        summaries.push_back(runRound(settings, threads));
+    }
+
+    cout << "\n" << left << setw(10) << "Threads" << right << setw(12) << "Ops/s" << setw(12) << "p50 us" << setw(12)
+        << "p99 us" << setw(12) << "p99.9 us" << setw(12) << "Max us" << setw(12) << "Violations" << "\n";
+    bool failed = false;
+    for (const auto& summary : summaries) {
+        cout << left << setw(10) << summary.threads << right << setw(12) << summary.throughput << setw(12) << summary.p50
+            << setw(12) << summary.p99 << setw(12) << summary.p999 << setw(12) << summary.max << setw(12)
+            << summary.violations << "\n";
+        failed = failed || summary.violations != 0;
+    }
+    return failed ? 1 : 0;
+}